@@ -1,4 +1,5 @@
-#include "simplefs.h"
+#define _GNU_SOURCE
+#include "simplefs_internal.h"
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -9,6 +10,14 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <stdint.h>
+#include <sched.h>
 
 /*
  * ---------------------------------------------------------------------------------------------------------------------
@@ -16,6 +25,116 @@
  */
 file * open_files = NULL;
 pthread_mutex_t open_files_write_mutex = PTHREAD_MUTEX_INITIALIZER;
+mounted_fs * mounted_filesystems = NULL;
+pthread_mutex_t mounted_filesystems_write_mutex = PTHREAD_MUTEX_INITIALIZER;
+__thread io_plug * current_io_plug = NULL;
+async_pool async_operations = { .workers = NULL, .running_fds = NULL, .number_of_workers = 0, .stopping = FALSE,
+                                .submitted_head = NULL, .submitted_tail = NULL, .completed_head = NULL,
+                                .completed_tail = NULL, .requests = NULL, .next_request = 0, .event_fd = -1,
+                                .mutex = PTHREAD_MUTEX_INITIALIZER, .submitted = PTHREAD_COND_INITIALIZER,
+                                .completed = PTHREAD_COND_INITIALIZER };
+parallel_pool parallel_operations = { .threads = NULL, .number_of_threads = DEFAULT_PARALLEL_THREADS,
+                                      .min_blocks = PARALLEL_IO_MIN_BLOCKS, .owner = 0, .ranges = NULL,
+                                      .job_number = 0, .active = 0, .stopping = FALSE,
+                                      .mutex = PTHREAD_MUTEX_INITIALIZER, .job_mutex = PTHREAD_MUTEX_INITIALIZER,
+                                      .job_started = PTHREAD_COND_INITIALIZER, .job_finished = PTHREAD_COND_INITIALIZER };
+__thread buffer_pool * thread_buffer_pool = NULL;
+pthread_key_t buffer_pool_key;
+pthread_once_t buffer_pool_key_once = PTHREAD_ONCE_INIT;
+
+/*
+ * ---------------------------------------------------------------------------------------------------------------------
+ * Pula buforów.
+ * Każdy wątek przechowuje wolne bufory w klasach rozmiarów będących potęgami dwójki - bufor oddany przez _pool_free
+ * wraca z najbliższym _pool_alloc tej samej klasy w tym wątku, bez blokad i bez wywołań malloc/free. Bufory klas
+ * od 512 bajtów są wyrównane do swojego rozmiaru. Wszystkie bufory pochodzą z posix_memalign, więc wolno je też
+ * zwolnić zwykłym free().
+ */
+
+/**
+ * Destruktor klucza wątku - zwalnia bufory puli kończącego się wątku.
+ */
+void _pool_destroy(void * pool_pointer) {
+    buffer_pool * pool = (buffer_pool *) pool_pointer;
+    unsigned i, j;
+    for (i = 0; i <= BUFFER_POOL_MAX_SHIFT - BUFFER_POOL_MIN_SHIFT; i++) {
+        for (j = 0; j < pool->magazines[i].count; j++) {
+            free(pool->magazines[i].buffers[j]);
+        }
+    }
+    free(pool);
+    thread_buffer_pool = NULL;
+}
+
+void _pool_create_key() {
+    pthread_key_create(&buffer_pool_key, _pool_destroy);
+}
+
+/**
+ * @return pula buforów wątku (tworzona przy pierwszym użyciu), NULL gdy brakuje pamięci
+ */
+buffer_pool * _pool_get() {
+    if (thread_buffer_pool == NULL) {
+        pthread_once(&buffer_pool_key_once, _pool_create_key);
+        thread_buffer_pool = (buffer_pool *) calloc(1, sizeof(buffer_pool));
+        if (thread_buffer_pool != NULL) {
+            pthread_setspecific(buffer_pool_key, thread_buffer_pool);
+        }
+    }
+    return thread_buffer_pool;
+}
+
+/**
+ * @return indeks klasy bufora o danym rozmiarze, -1 gdy rozmiar przekracza największą klasę
+ */
+int _pool_class(unsigned long size) {
+    unsigned shift = BUFFER_POOL_MIN_SHIFT;
+    while ((1UL << shift) < size) {
+        if (++shift > BUFFER_POOL_MAX_SHIFT) {
+            return -1;
+        }
+    }
+    return shift - BUFFER_POOL_MIN_SHIFT;
+}
+
+/**
+ * Funkcja przydzielająca bufor co najmniej size bajtów - w pierwszej kolejności z puli wątku.
+ * @return bufor, NULL gdy brakuje pamięci
+ */
+void * _pool_alloc(unsigned long size) {
+    int class = _pool_class(size);
+    if (class < 0) {
+        return malloc(size);
+    }
+    buffer_pool * pool = _pool_get();
+    if (pool != NULL && pool->magazines[class].count > 0) {
+        return pool->magazines[class].buffers[--pool->magazines[class].count];
+    }
+    unsigned long class_size = 1UL << (class + BUFFER_POOL_MIN_SHIFT);
+    void * buffer = NULL;
+    if (posix_memalign(&buffer, class_size >= 512 ? class_size : sizeof(void *), class_size) != 0) {
+        return NULL;
+    }
+    return buffer;
+}
+
+/**
+ * Funkcja zwracająca bufor przydzielony przez _pool_alloc do puli wątku (lub do free(), gdy pula klasy jest pełna).
+ * @param size - rozmiar podany przy przydziale
+ */
+void _pool_free(void * buffer, unsigned long size) {
+    if (buffer == NULL) {
+        return;
+    }
+    int class = _pool_class(size);
+    buffer_pool * pool = class < 0 ? NULL : _pool_get();
+    if (pool == NULL || pool->magazines[class].count == BUFFER_POOL_MAGAZINE) {
+        free(buffer);
+        return;
+    }
+    pool->magazines[class].buffers[pool->magazines[class].count++] = buffer;
+}
+
 /*
  * ---------------------------------------------------------------------------------------------------------------------
  * ---------------------------------------------------------------------------------------------------------------------
@@ -51,7 +170,7 @@ int munmap_enhanced(void *addr, size_t length, unsigned delta) {
  * Funkcja zwracająca docelowy rozmiar systemu plików na podstawie rozmiaru bloku i pożądanej liczby bloków danych
  * @return przygotowany master_block, gotowy do umieszczenia go na dysku
  */
-master_block get_initial_master_block(unsigned block_size, unsigned number_of_blocks) {
+master_block get_initial_master_block(unsigned block_size, unsigned number_of_blocks, int flags) {
     master_block masterblock;
     memset(&masterblock, 0, sizeof(master_block));
     DEBUG("Setting block size to %d\n", block_size);
@@ -63,8 +182,26 @@ master_block get_initial_master_block(unsigned block_size, unsigned number_of_bl
     masterblock.number_of_inode_table_blocks = ceil((double) number_of_blocks / floor((double) block_size / sizeof(inode)));
     masterblock.data_start_block = 1 + masterblock.number_of_bitmap_blocks + masterblock.number_of_inode_table_blocks;
     masterblock.first_inode_table_block = 1 + masterblock.number_of_bitmap_blocks;
+    if (flags & INIT_LINK_TABLE) {
+        // tablica wskaźników leży między tablicą inode'ów a blokami danych
+        masterblock.first_link_table_block = masterblock.data_start_block;
+        masterblock.number_of_link_table_blocks = ((unsigned long) number_of_blocks * sizeof(unsigned long) + block_size - 1)
+                                                  / block_size;
+        masterblock.data_start_block += masterblock.number_of_link_table_blocks;
+    }
+    if (flags & INIT_FRAGMENTS) {
+        masterblock.fragment_size = block_size / FRAGMENTS_PER_BLOCK;
+    }
     masterblock.first_free_inode = 2; // 0 - root inode, 1 - .lock
+    if (flags & INIT_JOURNAL) {
+        // nagłówek i miejsce na dwie największe transakcje (deskryptor i obrazy bloków)
+        masterblock.journal_start_block = masterblock.data_start_block + masterblock.number_of_blocks;
+        masterblock.number_of_journal_blocks = (sizeof(journal_header) + block_size - 1) / block_size;
+    }
     masterblock.magic_number = SIMPLEFS_MAGIC_NUMBER;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    masterblock.image_id = ((unsigned long) now.tv_sec << 30) ^ (unsigned long) now.tv_nsec ^ ((unsigned long) getpid() << 44);
     return masterblock;
 }
 
@@ -95,8 +232,62 @@ int check_magic_number(master_block * mb) {
  * Funkcja zwracająca offset bloku danych o zadanym numerze w całym systemie plików
  * @return policzony offset
  */
-unsigned long _get_block_offset(master_block * master_block_pointer, unsigned long block_number) {
-    return master_block_pointer->block_size * (block_number + master_block_pointer->data_start_block);
+static inline unsigned long _get_block_offset(master_block * master_block_pointer, unsigned long block_number) {
+    return (unsigned long) master_block_pointer->block_size * (block_number + master_block_pointer->data_start_block);
+}
+
+/**
+ * Rozmiar danych w bloku - bez wskaźnika następnego bloku, chyba że wskaźniki leżą w osobnej tablicy.
+ */
+static inline unsigned int _block_payload(master_block * master_block_pointer) {
+    return master_block_pointer->number_of_link_table_blocks > 0 ? master_block_pointer->block_size
+                                                                  : master_block_pointer->block_size - sizeof(long);
+}
+
+/**
+ * Wylicza stałe arytmetyki pozycji dla rozmiaru bloku i formatu systemu plików.
+ */
+void _block_geometry_init(block_geometry * geometry, master_block * master_block_pointer) {
+    unsigned int real_block_size = _block_payload(master_block_pointer);
+    geometry->block_size = master_block_pointer->block_size;
+    geometry->real_block_size = real_block_size;
+    geometry->shift = 0;
+    geometry->reciprocal = 0;
+    if ((real_block_size & (real_block_size - 1)) == 0) {
+        while ((1U << geometry->shift) < real_block_size) {
+            geometry->shift++;
+        }
+    } else {
+        geometry->reciprocal = UINT64_MAX / real_block_size;
+    }
+}
+
+/**
+ * Indeks bloku pliku z pozycją {position}, w {offset} zapisywana jest pozycja w tym bloku.
+ */
+static inline unsigned long _block_split(const block_geometry * geometry, unsigned long position,
+                                         unsigned long * offset) {
+    if (geometry->reciprocal == 0) {
+        *offset = position & (geometry->real_block_size - 1);
+        return position >> geometry->shift;
+    }
+    // iloraz z odwrotności jest zaniżony co najwyżej o 1
+    unsigned long index = (unsigned long) (((unsigned __int128) position * geometry->reciprocal) >> 64);
+    *offset = position - index * geometry->real_block_size;
+    if (*offset >= geometry->real_block_size) {
+        *offset -= geometry->real_block_size;
+        index++;
+    }
+    return index;
+}
+
+/**
+ * Liczba bloków zajmowanych przez pierwsze {length} bajtów pliku.
+ */
+static inline unsigned long _block_count(const block_geometry * geometry, unsigned long length) {
+    unsigned long offset;
+    unsigned long blocks = _block_split(geometry, length, &offset);
+    return offset != 0 ? blocks + 1 : blocks;
 }
 
 /**
@@ -109,7 +300,7 @@ unsigned long _get_block_offset(master_block * master_block_pointer, unsigned lo
  * @return initialized_structures* wskaźnik na zainicjalizowane strutkury systemu pliku, w przypadku błędu - NULL
  */
 initialized_structures * _initialize_structures(int fd, int init_bitmaps) {
-    initialized_structures * initialized_structures_pointer = malloc(sizeof(initialized_structures));
+    initialized_structures * initialized_structures_pointer = _pool_alloc(sizeof(initialized_structures));
     // zamapowanie master blocka
     master_block * master_block_pointer
             = (master_block *) mmap(NULL, sizeof(master_block), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
@@ -158,6 +349,7 @@ initialized_structures * _initialize_structures(int fd, int init_bitmaps) {
     initialized_structures_pointer->inode_table = inodes_table;
     initialized_structures_pointer->bitmap_delta = bitmap_delta;
     initialized_structures_pointer->inode_delta = inode_delta;
+    initialized_structures_pointer->fsfd = fd;
     DEBUG("Initalized structures!\n");
     return initialized_structures_pointer;
 }
@@ -177,600 +369,3500 @@ void _uninitilize_structures(initialized_structures * initialized_structures_poi
     DEBUG("Munmap result: %d", result);
     result = munmap(initialized_structures_pointer->master_block_pointer, sizeof(master_block));
     DEBUG("Munmap result: %d", result);
-    free(initialized_structures_pointer);
+    _pool_free(initialized_structures_pointer, sizeof(initialized_structures));
 }
 
+/*
+ * ---------------------------------------------------------------------------------------------------------------------
+ * Backend wejścia-wyjścia bloków danych.
+ * Domyślnie bloki czytane i zapisywane są przez pread/pwrite. Backend io_uring wysyła operacje przez pierścień
+ * z zarejestrowanym deskryptorem obrazu; operacje nie dłuższe niż blok przechodzą przez wolne sloty zarejestrowanego
+ * bufora pośredniego. Wywołujący zawsze czeka na zakończenie swoich operacji, ale mutex backendu chroni tylko kolejki
+ * pierścienia - operacje wielu wątków są w pierścieniu naraz, a zapisy gromadzone między _io_plug i _io_unplug trafiają
+ * do niego razem. Readahead nie czeka wcale.
+ */
+
 /**
- * Funkcja czytająca z dysku blok określony numerem bloku z offsetem (również podanym jako ilość bloków)
- * @return odczytany blok
+ * Zwalnia pierścienie io_uring i wraca do backendu synchronicznego.
  */
-void* _read_block(int fsfd, long block_no, long block_offset, long block_size) {
-    char* block_data = malloc(block_size-sizeof(unsigned long));
-    block* block_read = malloc(sizeof(block));
-    lseek(fsfd, (block_no + block_offset) * block_size, SEEK_SET);
-    //read data
-    read(fsfd, block_data, block_size - sizeof(unsigned long));
-    //read next data block
-    read(fsfd, &(block_read->next_data_block), sizeof(unsigned long));
-    block_read->data = block_data;
-    return block_read;
+void _io_uring_wait(io_backend * backend);
+
+void _io_uring_teardown(io_backend * backend) {
+    if (backend->type != IO_BACKEND_IO_URING) {
+        return;
+    }
+    // pierścień można zamknąć dopiero po zakończeniu readahead
+    pthread_mutex_lock(&backend->mutex);
+    while (backend->in_flight > 0) {
+        _io_uring_wait(backend);
+    }
+    pthread_mutex_unlock(&backend->mutex);
+    close(backend->ring_fd);
+    munmap(backend->sqes, backend->sqes_size);
+    if (backend->cq_ring != backend->sq_ring) {
+        munmap(backend->cq_ring, backend->cq_ring_size);
+    }
+    munmap(backend->sq_ring, backend->sq_ring_size);
+    free(backend->staging);
+    free(backend->free_slots);
+    pthread_mutex_destroy(&backend->mutex);
+    pthread_cond_destroy(&backend->completed);
+    backend->type = IO_BACKEND_SYNC;
 }
 
 /**
- * Funkcja czytająca z dysku dla danego bloku tylko jego następnik
- * @return numer następnego bloku
+ * Tworzy pierścień io_uring dla obrazu i rejestruje w nim deskryptor obrazu oraz bufor pośredni.
+ * @return {0} sukces, {IO_BACKEND_NOT_AVAILABLE} jądro nie udostępnia io_uring (backend pozostaje synchroniczny)
  */
-unsigned long _find_next_block(int fd, long block_no, long block_offset, long block_size) {
-    unsigned long next_block = 0;
-    lseek(fd, (block_no + block_offset) * block_size + block_size - sizeof(unsigned long), SEEK_SET);
-    //read data
-    read(fd, &next_block, sizeof(unsigned long));
-    return next_block;
-}
+int _io_uring_setup(io_backend * backend, int fsfd, unsigned queue_depth, unsigned int block_size) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring_fd = syscall(__NR_io_uring_setup, queue_depth, &params);
+    if (ring_fd < 0) {
+        return IO_BACKEND_NOT_AVAILABLE;
+    }
+    backend->ring_fd = ring_fd;
+    backend->queue_depth = params.sq_entries;
+    backend->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    backend->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (backend->cq_ring_size > backend->sq_ring_size) {
+            backend->sq_ring_size = backend->cq_ring_size;
+        }
+        backend->cq_ring_size = backend->sq_ring_size;
+    }
+    backend->sq_ring = mmap(NULL, backend->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                            IORING_OFF_SQ_RING);
+    if (backend->sq_ring == MAP_FAILED) {
+        close(ring_fd);
+        return IO_BACKEND_NOT_AVAILABLE;
+    }
+    backend->cq_ring = backend->sq_ring;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        backend->cq_ring = mmap(NULL, backend->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                                IORING_OFF_CQ_RING);
+    }
+    backend->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    backend->sqes = mmap(NULL, backend->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                         IORING_OFF_SQES);
+    if (backend->cq_ring == MAP_FAILED || backend->sqes == MAP_FAILED
+        || syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_FILES, &fsfd, 1) < 0) {
+        if (backend->sqes != MAP_FAILED) {
+            munmap(backend->sqes, backend->sqes_size);
+        }
+        if (backend->cq_ring != MAP_FAILED && backend->cq_ring != backend->sq_ring) {
+            munmap(backend->cq_ring, backend->cq_ring_size);
+        }
+        munmap(backend->sq_ring, backend->sq_ring_size);
+        close(ring_fd);
+        return IO_BACKEND_NOT_AVAILABLE;
+    }
+    char * sq = (char *) backend->sq_ring;
+    char * cq = (char *) backend->cq_ring;
+    backend->sq_head = (unsigned *) (sq + params.sq_off.head);
+    backend->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    backend->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    backend->sq_array = (unsigned *) (sq + params.sq_off.array);
+    backend->cq_head = (unsigned *) (cq + params.cq_off.head);
+    backend->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    backend->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    backend->cqes = cq + params.cq_off.cqes;
 
-void free_block_struct(block* bl) {
-    free(bl->data);
-    free(bl);
+    // bufor pośredni jest opcjonalny - rejestracja może przekroczyć limit pamięci zablokowanej procesu
+    backend->staging_slot_size = block_size;
+    struct iovec staging_vector;
+    staging_vector.iov_len = (unsigned long) block_size * backend->queue_depth;
+    if (posix_memalign((void **) &backend->staging, sysconf(_SC_PAGE_SIZE), staging_vector.iov_len) != 0) {
+        backend->staging = NULL;
+    } else {
+        staging_vector.iov_base = backend->staging;
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, &staging_vector, 1) < 0) {
+            free(backend->staging);
+            backend->staging = NULL;
+        }
+    }
+    unsigned long slot_words = (backend->queue_depth + 63) / 64;
+    backend->free_slots = (unsigned long *) malloc(sizeof(unsigned long) * slot_words);
+    unsigned long word;
+    for (word = 0; word < slot_words; word++) {
+        unsigned slots_in_word = backend->queue_depth - word * 64 < 64 ? backend->queue_depth - word * 64 : 64;
+        backend->free_slots[word] = slots_in_word == 64 ? ~0UL : (1UL << slots_in_word) - 1;
+    }
+    backend->in_flight = 0;
+    backend->submitted = 0;
+    backend->reaping = FALSE;
+    pthread_mutex_init(&backend->mutex, NULL);
+    pthread_cond_init(&backend->completed, NULL);
+    backend->type = IO_BACKEND_IO_URING;
+    return OK;
 }
 
 /**
- * Funkcja czytająca inode katalogu głównego /
- * @return odczytany inode
+ * Zdejmuje z pierścienia zakończone operacje i zapisuje ich wyniki (user_data = adres io_completion, 0 = readahead,
+ * na który nikt nie czeka). Wywoływana z zablokowanym mutexem backendu.
  */
-inode* _get_root_inode(int fd, master_block* masterblock) {
-    DEBUG("Seeking to %lu\n", masterblock->first_inode_table_block * masterblock->block_size);
-    DEBUG("first inode table block is %d and block size is %d\n", masterblock->first_inode_table_block, masterblock->block_size);
-    lseek(fd, masterblock->first_inode_table_block * masterblock->block_size, SEEK_SET);
-    inode* root_inode = malloc(sizeof(inode));
-    read(fd, root_inode, sizeof(inode));
-    DEBUG("Read root inode. Name is %s. Type is %c and first data block is %lu\n", root_inode->filename, root_inode->type, root_inode->first_data_block);
-    return root_inode;
+void _io_uring_reap(io_backend * backend) {
+    unsigned head = *backend->cq_head;
+    int reaped = FALSE;
+    while (head != __atomic_load_n(backend->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe * cqe = (struct io_uring_cqe *) backend->cqes + (head & *backend->cq_mask);
+        if (cqe->user_data != 0) {
+            io_completion * completion = (io_completion *) cqe->user_data;
+            completion->result = cqe->res;
+            completion->done = TRUE;
+        }
+        backend->in_flight--;
+        reaped = TRUE;
+        head++;
+    }
+    __atomic_store_n(backend->cq_head, head, __ATOMIC_RELEASE);
+    if (reaped) {
+        pthread_cond_broadcast(&backend->completed);
+    }
 }
 
 /**
- * Funkcja znajdująca inode pliku znajdującego się w katalogu reprezentowanym przez dany inode
- * @return znaleziony inode
+ * Czeka na zakończenie którejkolwiek operacji w pierścieniu i zdejmuje zakończenia. W jądrze czeka naraz jeden wątek,
+ * już bez mutexu (inne wątki mogą w tym czasie wysyłać operacje), pozostałe czekają na zmiennej warunkowej.
+ * Wywoływana z zablokowanym mutexem backendu, gdy w pierścieniu są operacje (in_flight > 0).
  */
-inode* _get_inode_in_dir(int fd, inode* parent_inode, char* name, master_block* masterblock, unsigned long* inode_no) {
-    DEBUG("_get_inode_in_dir %c\n", parent_inode->type);
-
-    if(parent_inode->type != INODE_DIR) {
-        return NULL;
+void _io_uring_wait(io_backend * backend) {
+    if (backend->reaping) {
+        pthread_cond_wait(&backend->completed, &backend->mutex);
+        return;
     }
-    block* dir_block = _read_block(fd, parent_inode->first_data_block, masterblock->data_start_block, masterblock->block_size);
-    DEBUG("Next data block: %d\n", dir_block->next_data_block);
-    long i;
-    while(1) {
-        DEBUG("finding dir: next data block: %d\n", dir_block->next_data_block);
-        for(i = 0; i <= masterblock->block_size - sizeof(file_signature) - sizeof(long); i += sizeof(file_signature)) {
-            DEBUG("indeks %d\n", i);
-            file_signature* signature = (file_signature*) (dir_block->data + i * sizeof(char));
-            if(strcmp(name, signature->name) == 0 && signature->inode_no != 0) {
-                //calculate number of inode table block, where we'll find the right node
-                long block_to_read = signature->inode_no * sizeof(inode) / masterblock->block_size;
-                //zapameitujemy numer inode w tablicy inodow
-                *inode_no = signature->inode_no;
-                DEBUG("Zapamiętanie w tablicy inodów: %lu\n", signature->inode_no);
-                char* inode_block = malloc(masterblock->block_size); // = (char*) _read_block(fd, block_to_read, masterblock->first_inode_table_block, masterblock->block_size);
-                lseek(fd, (masterblock->first_inode_table_block + block_to_read) * masterblock->block_size, SEEK_SET);
-                read(fd, inode_block, masterblock->block_size);
-                inode* result_inode = malloc(sizeof(inode));
-                memcpy(result_inode, inode_block + ((signature->inode_no * sizeof(inode)) % masterblock->block_size), sizeof(inode));
-                free(dir_block->data);
-                free(dir_block);
-                free(inode_block);
-                return result_inode;
+    backend->reaping = TRUE;
+    pthread_mutex_unlock(&backend->mutex);
+    if (syscall(__NR_io_uring_enter, backend->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0
+        && errno != EINTR) {
+        // zakończenia pojawiają się w pierścieniu także bez io_uring_enter
+        sched_yield();
+    }
+    pthread_mutex_lock(&backend->mutex);
+    backend->reaping = FALSE;
+    _io_uring_reap(backend);
+    // czekanie w jądrze może przejąć inny wątek
+    pthread_cond_broadcast(&backend->completed);
+}
+
+/**
+ * Przekazuje jądru zgłoszenia dodane na koniec kolejki. EINTR, EAGAIN i EBUSY (brak zasobów jądra, pełna kolejka
+ * zakończeń) są ponawiane - przy dwóch ostatnich po zdjęciu zakończeń. Przy innym błędzie zgłoszenia nieprzyjęte przez
+ * jądro są wycofywane z kolejki. Wywoływana z zablokowanym mutexem backendu (nikt inny nie dodaje zgłoszeń).
+ * @return liczba zgłoszeń przyjętych przez jądro (zawsze pierwsze z dodanych)
+ */
+unsigned _io_uring_enter_submit(io_backend * backend, unsigned count) {
+    unsigned submitted = 0;
+    while (submitted < count) {
+        int result = syscall(__NR_io_uring_enter, backend->ring_fd, count - submitted, 0, 0, NULL, 0);
+        if (result > 0) {
+            submitted += result;
+            backend->in_flight += result;
+            backend->submitted += result;
+        } else if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result < 0 && (errno == EAGAIN || errno == EBUSY)) {
+            if (backend->in_flight > 0) {
+                syscall(__NR_io_uring_enter, backend->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+                _io_uring_reap(backend);
+            } else {
+                sched_yield();
             }
+        } else {
+            break;
         }
-        if(dir_block->next_data_block == 0) {
-            DEBUG("Nie znaleziony inode!\n");
-            free(dir_block->data);
-            free(dir_block);
-            return NULL;
-        }
-        unsigned long next_data_block = dir_block->next_data_block;
-        free(dir_block->data);
-        free(dir_block);
-        dir_block = _read_block(fd, next_data_block, masterblock->data_start_block, masterblock->block_size);
     }
-    free(dir_block->data);
-    free(dir_block);
-    DEBUG("wyjscie z get inode in dir\n");
-    return NULL;
+    if (submitted < count) {
+        __atomic_store_n(backend->sq_tail, __atomic_load_n(backend->sq_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    }
+    return submitted;
 }
 
 /**
- * Funkcja znajdująca inode pliku reprezentowanego przez pełną ścieżkę (np. /dir/file)
- * @param inode_no, parametr wyjsciowy, do zwrocenie polozenia inoda w tablicy inodow
- * @return znelziony inode
+ * Pobiera wolny slot bufora pośredniego. Wywoływana z zablokowanym mutexem backendu.
+ * @return numer slotu, -1 = brak wolnych slotów
  */
-inode* _get_inode_by_path(char* path, master_block* masterblock, int fd, unsigned long* inode_no) {
-    if(path[0] != '/') {
-        return NULL;
+int _io_uring_slot_get(io_backend * backend) {
+    if (backend->staging == NULL) {
+        return -1;
     }
-    if(strlen(path) == 1) {
-        //root inode
-        *inode_no = 0;
-        DEBUG("In _get_inode_by_path - get root inode. Block size is %d\n", masterblock->block_size);
-        return _get_root_inode(fd, masterblock);
+    unsigned long word;
+    for (word = 0; word * 64 < backend->queue_depth; word++) {
+        if (backend->free_slots[word] != 0) {
+            int bit = __builtin_ctzl(backend->free_slots[word]);
+            backend->free_slots[word] &= ~(1UL << bit);
+            return (int) (word * 64 + bit);
+        }
     }
-    unsigned path_index = 1;
-    char* path_part = malloc(strlen(path) * sizeof(char));
-    DEBUG("Path_part %c\n", path_part);
-    inode* current_inode = _get_root_inode(fd, masterblock);
-    while(1) {
-        unsigned i = 0;
-        while(path[path_index] != '/' && path[path_index] != '\0') {
-            path_part[i++] = path[path_index++];
+    return -1;
+}
+
+/**
+ * Wysyła operacje przez pierścień i czeka na ich zakończenie. Operacje, których jądro nie przyjęło, oraz zakończone
+ * błędem lub nieprzenoszące wszystkich danych są powtarzane przez pread/pwrite - dopiero gdy żadna operacja partii nie
+ * jest już w toku, więc późny zapis z pierścienia nie nadpisze danych zapisanych w ten sposób.
+ */
+void _io_uring_submit(io_backend * backend, int fsfd, io_request * requests, unsigned count) {
+    io_completion completions[IO_PLUG_REQUESTS];
+    int slots[IO_PLUG_REQUESTS];
+    pthread_mutex_lock(&backend->mutex);
+    unsigned first;
+    unsigned batch;
+    for (first = 0; first < count; first += batch) {
+        batch = count - first;
+        if (batch > backend->queue_depth) {
+            batch = backend->queue_depth;
         }
-        path_part[i] = '\0';
-        inode* new_inode = _get_inode_in_dir(fd, current_inode, path_part, masterblock, inode_no); //inode_no sie nie zmieni jak sie okaze ze path_part nie jest juz katalogiem
-        free(current_inode);
-        if(new_inode == NULL || new_inode->type == INODE_EMPTY) {
-            DEBUG("Nie znaleziony inode!\n");
-            free(path_part);
-            free(new_inode);
-            return NULL;
+        if (batch > IO_PLUG_REQUESTS) {
+            batch = IO_PLUG_REQUESTS;
         }
-        current_inode = new_inode;
-        if(path[path_index] == '\0') {
-            break;
+        // kolejka zakończeń jest dwa razy dłuższa od kolejki zgłoszeń - nie przepełni się
+        while (backend->in_flight + batch > backend->queue_depth) {
+            _io_uring_wait(backend);
         }
-        path_index++;
+        unsigned tail = *backend->sq_tail;
+        unsigned i;
+        for (i = 0; i < batch; i++) {
+            io_request * request = requests + first + i;
+            void * buffer = request->buffer != NULL ? request->buffer : &request->inline_data;
+            unsigned index = tail & *backend->sq_mask;
+            struct io_uring_sqe * sqe = (struct io_uring_sqe *) backend->sqes + index;
+            memset(sqe, 0, sizeof(struct io_uring_sqe));
+            sqe->fd = 0;
+            sqe->flags = IOSQE_FIXED_FILE;
+            sqe->off = request->offset;
+            sqe->len = request->length;
+            sqe->user_data = (unsigned long) (completions + i);
+            slots[i] = request->length <= backend->staging_slot_size ? _io_uring_slot_get(backend) : -1;
+            if (slots[i] >= 0) {
+                char * slot = backend->staging + (unsigned long) slots[i] * backend->staging_slot_size;
+                if (request->write) {
+                    memcpy(slot, buffer, request->length);
+                }
+                sqe->opcode = request->write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+                sqe->addr = (unsigned long) slot;
+                sqe->buf_index = 0;
+            } else {
+                sqe->opcode = request->write ? IORING_OP_WRITE : IORING_OP_READ;
+                sqe->addr = (unsigned long) buffer;
+            }
+            backend->sq_array[index] = index;
+            completions[i].result = -ECANCELED;
+            completions[i].done = FALSE;
+            tail++;
+        }
+        __atomic_store_n(backend->sq_tail, tail, __ATOMIC_RELEASE);
+        unsigned submitted = _io_uring_enter_submit(backend, batch);
+        for (i = submitted; i < batch; i++) {
+            completions[i].done = TRUE;
+        }
+        for (i = 0; i < batch; i++) {
+            while (!completions[i].done) {
+                _io_uring_wait(backend);
+            }
+        }
+        for (i = 0; i < batch; i++) {
+            io_request * request = requests + first + i;
+            if (slots[i] >= 0) {
+                if (!request->write && completions[i].result == request->length) {
+                    void * buffer = request->buffer != NULL ? request->buffer : &request->inline_data;
+                    memcpy(buffer, backend->staging + (unsigned long) slots[i] * backend->staging_slot_size,
+                           request->length);
+                }
+                backend->free_slots[slots[i] / 64] |= 1UL << (slots[i] % 64);
+            }
+        }
+        pthread_mutex_unlock(&backend->mutex);
+        for (i = 0; i < batch; i++) {
+            io_request * request = requests + first + i;
+            void * buffer = request->buffer != NULL ? request->buffer : &request->inline_data;
+            if (completions[i].result != request->length) {
+                if (request->write) {
+                    pwrite(fsfd, buffer, request->length, request->offset);
+                } else {
+                    pread(fsfd, buffer, request->length, request->offset);
+                }
+            }
+        }
+        pthread_mutex_lock(&backend->mutex);
     }
-    free(path_part);
-    return current_inode;
+    pthread_mutex_unlock(&backend->mutex);
 }
 
 /**
- * Blokuje first free block (ekskluzywnie).
- *
- * @param fsfd deksryptor systemu plików
- * @param fl niewypełniona struktura flock
+ * Czyta fragment obrazu przez backend systemu plików.
  */
-int _block_first_free_block(int fsfd, struct flock * fl) {
-    /* F_RDLCK, F_WRLCK, F_UNLCK    */
-    fl->l_type = F_WRLCK;
-    /* SEEK_SET, SEEK_CUR, SEEK_END */
-    fl->l_whence = SEEK_SET;
-    fl->l_start = 32;
-    fl->l_len = 8;
-    fl->l_pid = getpid();
-    return fcntl(fsfd, F_SETLKW, fl);
+void _io_read_backend(mounted_fs * mounted, int fsfd, void * buffer, unsigned long length, unsigned long offset) {
+    if (mounted == NULL || mounted->io.type != IO_BACKEND_IO_URING) {
+        pread(fsfd, buffer, length, offset);
+        return;
+    }
+    io_request request;
+    request.write = FALSE;
+    request.buffer = buffer;
+    request.length = length;
+    request.offset = offset;
+    _io_uring_submit(&mounted->io, fsfd, &request, 1);
 }
 
 /**
- * Odblokowuje first free block (ekskluzywnie).
- *
- * @param fd deksryptor systemu plików
- * @param fl niewypełniona struktura flock
+ * Zapisuje fragment obrazu przez backend systemu plików. Między _io_plug i _io_unplug zapis jest tylko dodawany
+ * do zapisów gromadzonych przez wątek.
  */
-int _unblock_first_free_block(int fsfd, struct flock * fl) {
-    fl->l_type = F_UNLCK;
-    return fcntl(fsfd, F_SETLK, fl);
+void _io_write_backend(mounted_fs * mounted, int fsfd, void * data, unsigned long length, unsigned long offset) {
+    if (mounted == NULL || mounted->io.type != IO_BACKEND_IO_URING) {
+        pwrite(fsfd, data, length, offset);
+        return;
+    }
+    io_plug * plug = current_io_plug;
+    if (plug == NULL || plug->mounted != mounted) {
+        io_request request;
+        request.write = TRUE;
+        request.buffer = data;
+        request.length = length;
+        request.offset = offset;
+        _io_uring_submit(&mounted->io, fsfd, &request, 1);
+        return;
+    }
+    if (plug->count == IO_PLUG_REQUESTS) {
+        _io_uring_submit(&mounted->io, fsfd, plug->requests, plug->count);
+        plug->count = 0;
+    }
+    io_request * request = plug->requests + plug->count++;
+    request->write = TRUE;
+    request->length = length;
+    request->offset = offset;
+    if (length <= sizeof(request->inline_data)) {
+        // krótkie dane (np. zmienna lokalna wywołującego) są kopiowane
+        memcpy(&request->inline_data, data, length);
+        request->buffer = NULL;
+    } else {
+        request->buffer = data;
+    }
 }
 
 /**
- * Wyszukuje dostępne wolne bloki, nie jest cross-process-safe. Zwraca pierwszy przetwarzany number bloku dla pliku lub
- * jaroslaw_błąd (NO_FREE_BLOCKS).
- *
- * @param initialized_structures_pointer wskaźnik na zainicjalizowane struktury systemu plików
- * @param number_of_free_blocks liczba wolnych bloków do wyszukania
- * @param free_blocks tablica, gdzie zostaną zapisane identyfikatory znalezionych bloków
+ * Pobiera wyrównany bufor pośredni trybu O_DIRECT z puli (lub alokuje nowy). Gdy brakuje pamięci, czeka na bufor
+ * zapasowy - operacje nie omijają trybu O_DIRECT.
  */
-long _find_free_blocks(int fsfd, initialized_structures * initialized_structures_pointer, unsigned long number_of_free_blocks,
-                      unsigned long * free_blocks) {
-    DEBUG("In _find_free_blocks. free blocks = %d\n", number_of_free_blocks);
-    master_block * master_block = initialized_structures_pointer->master_block_pointer;
-    if (master_block->number_of_free_blocks <= number_of_free_blocks) {
-        return NO_FREE_BLOCKS;
+void * _direct_buffer_get(direct_io * direct) {
+    void * buffer = NULL;
+    pthread_mutex_lock(&direct->mutex);
+    if (direct->number_of_free_buffers > 0) {
+        buffer = direct->free_buffers[--direct->number_of_free_buffers];
     }
-    unsigned long first_free_block_number = master_block->first_free_block_number;
-    char * block_bitmap_pointer = initialized_structures_pointer->block_bitmap_pointer;
-    DEBUG("block bitmap pointer = %X\n", block_bitmap_pointer);
-
-    // wolny blok zapisany na wypadek, gdyby poszukiwanie wolnych bloków nie mogło się poprawnie zakończyć (brakuje miejsca)
-    unsigned long saved_first_free_block_number = first_free_block_number;
-    unsigned long free_block_idx = 0;
-    for (free_block_idx; free_block_idx < number_of_free_blocks; free_block_idx++) {
-        DEBUG("przebieg petli: %d\n", free_block_idx );
-
-        // zaznaczenie bloku jako zajętego
-        DEBUG("bitmap pointer %d\n", block_bitmap_pointer);
-        char * bitmap_byte = block_bitmap_pointer + ((master_block->first_free_block_number / 8) * sizeof(char));
-        unsigned int bit_in_byte = master_block->first_free_block_number % 8;
-        DEBUG("bitmap byte evaluates to %X bit in byte %d\n", *bitmap_byte, bit_in_byte);
-        (*bitmap_byte) |= (1 << bit_in_byte);
-
-        DEBUG("Po zapisie\n");
-        // zapisanie numeru wolnego bloku do tablicy
-        *(free_blocks + free_block_idx) = master_block->first_free_block_number;
-
-        DEBUG("Zmniejszenie liczby wolnych blokow\n");
-        // zmniejszenie liczby wolnych bloków
-        master_block->number_of_free_blocks--;
-        DEBUG("master_block->number_of_free_blocks = %d\n", master_block->number_of_free_blocks);
-
-        // następny blok jest pretendentem na wolny blok
-        master_block->first_free_block_number++;
-        DEBUG("Nastepny blok pretendednt %d, liczba wszystkich = %d\n", master_block->first_free_block_number, master_block->number_of_blocks);
-
-        DEBUG("przed whilem\n");
-        // wyszkanie następnego wolnego bloku, a w nim wolnego bitu
-        while (TRUE) {
-            unsigned char bytes_mask = (0xFF << ((master_block->first_free_block_number % 8) - 1));
-            DEBUG("Maska bitowa dla bajtu: %x, bajt= %x\n", bytes_mask, (*bitmap_byte));
-            DEBUG("Maska bitwa nalozona na bajt: %x, first free block number%d\n", ((*bitmap_byte) & bytes_mask), master_block->first_free_block_number);
-            if (bytes_mask == 0xFF) {
-                // przesuwamy się na następne miejsce w bitmapie (niewyrównane bloki zostaną pominięte)
-                bitmap_byte = block_bitmap_pointer + ((master_block->first_free_block_number / 8) * sizeof(char));
-            }
-
-            // jeśli istnieje wolny bit w bitmapie
-            if ((((*bitmap_byte) & bytes_mask) != bytes_mask) && master_block->first_free_block_number < master_block->number_of_blocks) {
-                char bitmap_byte_to_parse = (*bitmap_byte);
-                while (bitmap_byte_to_parse & (1 << (master_block->first_free_block_number % 8))) {
-                    master_block->first_free_block_number++;
-                }
-                break;
-            } else if (master_block->first_free_block_number >= master_block->number_of_blocks) {
-                // dotarcie do końca wszystkich bloków (pierwszy blok to plik .lock)
-                master_block->first_free_block_number = master_block->data_start_block + 1;
-                bitmap_byte = block_bitmap_pointer + 1;
-            } else {
-                master_block->first_free_block_number++;
-            }
+    pthread_mutex_unlock(&direct->mutex);
+    if (buffer == NULL && posix_memalign(&buffer, direct->buffer_size, direct->buffer_size) != 0) {
+        pthread_mutex_lock(&direct->mutex);
+        while (direct->reserve_in_use) {
+            pthread_cond_wait(&direct->reserve_free, &direct->mutex);
         }
-        DEBUG("zakonczenie wyszukiwania wolnych blokow!\n");
+        direct->reserve_in_use = TRUE;
+        pthread_mutex_unlock(&direct->mutex);
+        return direct->reserve_buffer;
     }
-    DEBUG("wyjscie z find free blocks!\n");
-    return (long) saved_first_free_block_number;
+    return buffer;
 }
 
 /**
- * Pobiera strukturę pliku na podstawie podanego identyfikatora pliku.
+ * Oddaje bufor pośredni do puli - bufory ponad DIRECT_IO_POOL_BUFFERS są zwalniane.
  */
-file * _get_file_by_fd(int fd) {
-    file* file_found;
-    HASH_FIND_INT( open_files, &fd, file_found);
-    DEBUG("Found file. mode = %d\n", file_found->mode);
-    return file_found;
+void _direct_buffer_put(direct_io * direct, void * buffer) {
+    pthread_mutex_lock(&direct->mutex);
+    if (buffer == direct->reserve_buffer) {
+        direct->reserve_in_use = FALSE;
+        pthread_cond_signal(&direct->reserve_free);
+        buffer = NULL;
+    } else if (direct->number_of_free_buffers < DIRECT_IO_POOL_BUFFERS) {
+        direct->free_buffers[direct->number_of_free_buffers++] = buffer;
+        buffer = NULL;
+    }
+    pthread_mutex_unlock(&direct->mutex);
+    free(buffer);
 }
 
 /**
- * Ładuje i-node dla podanej struktury pliku.
+ * Sprawdza, czy operacja spełnia wymagania O_DIRECT i może pominąć bufor pośredni.
  */
-inode * _load_inode_from_file_structure(initialized_structures * initialized_structures_pointer, file * file_pointer) {
-    if (file_pointer == NULL) {
-        return NULL;
-    }
-    return initialized_structures_pointer->inode_table + file_pointer->inode_no;
+int _direct_is_aligned(direct_io * direct, void * buffer, unsigned long length, unsigned long offset) {
+    unsigned long mask = direct->alignment - 1;
+    return ((unsigned long) buffer & mask) == 0 && (length & mask) == 0 && (offset & mask) == 0;
 }
 
 /**
- * Pobiera numery bloków, które aktualnie posiada plik. Jeśli number_of_free_blocks != 0 dodatkowo aktualizuje blok.
+ * Czyta fragment obrazu - w trybie O_DIRECT przez bufor pośredni obejmujący wyrównane sektory fragmentu.
+ * Fragment nie wychodzi poza jeden blok, a rozmiar bloku jest wielokrotnością wyrównania.
  */
-int _get_blocks_numbers_taken_by_file(int fsfd, unsigned long first_block_no, master_block * master_block_pointer,
-                                      int (*for_each_record)(void*, int, void*), void * additional_param,
-                                      unsigned long * blocks_table) {
-    DEBUG("\n**** _get_blocks_numbers_taken_by_file ****\n");
-    DEBUG("Pierwszy blok: %u\n", first_block_no);
+void _io_read(mounted_fs * mounted, int fsfd, void * buffer, unsigned long length, unsigned long offset) {
+    if (mounted == NULL || mounted->direct.fd == -1) {
+        _io_read_backend(mounted, fsfd, buffer, length, offset);
+        return;
+    }
+    direct_io * direct = &mounted->direct;
+    if (_direct_is_aligned(direct, buffer, length, offset)) {
+        _io_read_backend(mounted, direct->fd, buffer, length, offset);
+        return;
+    }
+    void * bounce = _direct_buffer_get(direct);
+    unsigned long start = offset & ~((unsigned long) direct->alignment - 1);
+    unsigned long end = (offset + length + direct->alignment - 1) & ~((unsigned long) direct->alignment - 1);
+    _io_read_backend(mounted, direct->fd, bounce, end - start, start);
+    memcpy(buffer, (char *) bounce + (offset - start), length);
+    _direct_buffer_put(direct, bounce);
+}
 
-    block * block_pointer = NULL;
-    int i = 0;
-    unsigned long block_no = first_block_no;
-    unsigned long next_data_block;
-    do {
-        block_pointer = _read_block(fsfd, block_no, master_block_pointer->data_start_block, master_block_pointer->block_size);
+/**
+ * Zapisuje fragment obrazu - w trybie O_DIRECT niewyrównany fragment uzupełniany jest do całych sektorów
+ * (odczyt, zmiana i zapis sektorów w buforze pośrednim).
+ */
+void _io_write(mounted_fs * mounted, int fsfd, void * data, unsigned long length, unsigned long offset) {
+    if (mounted == NULL || mounted->direct.fd == -1) {
+        _io_write_backend(mounted, fsfd, data, length, offset);
+        return;
+    }
+    direct_io * direct = &mounted->direct;
+    if (_direct_is_aligned(direct, data, length, offset)) {
+        _io_write_backend(mounted, direct->fd, data, length, offset);
+        return;
+    }
+    void * bounce = _direct_buffer_get(direct);
+    unsigned long start = offset & ~((unsigned long) direct->alignment - 1);
+    unsigned long end = (offset + length + direct->alignment - 1) & ~((unsigned long) direct->alignment - 1);
+    if (start != offset || end != offset + length) {
+        _io_read_backend(mounted, direct->fd, bounce, end - start, start);
+    }
+    memcpy((char *) bounce + (offset - start), data, length);
+    _io_write_backend(mounted, direct->fd, bounce, end - start, start);
+    _direct_buffer_put(direct, bounce);
+}
 
-        // wywołanie funkcji sprawdzającej block
-        if (for_each_record != NULL && for_each_record(block_pointer, master_block_pointer->block_size, additional_param) == 0) {
-            free(block_pointer->data);
-            free(block_pointer);
-            return -2;
+/**
+ * Wyznacza wyrównanie wymagane przez O_DIRECT - próbując odczytów coraz większymi sektorami.
+ * @return wyrównanie lub 0, jeśli żaden odczyt nie był możliwy
+ */
+unsigned int _direct_io_alignment(int direct_fd, unsigned int block_size) {
+    void * probe;
+    if (posix_memalign(&probe, block_size, block_size) != 0) {
+        return 0;
+    }
+    unsigned int alignment;
+    for (alignment = 512; alignment <= block_size; alignment *= 2) {
+        if (pread(direct_fd, probe, alignment, alignment) == alignment) {
+            break;
         }
-        blocks_table[i++] = block_no;
-        DEBUG("Zapisany numer bloku do tablicy: %d\n", block_no);
-        block_no = block_pointer->next_data_block;
-        DEBUG("nastepny blok danych: %u\n", block_no);
-        next_data_block = block_pointer->next_data_block;
-        free(block_pointer->data);
-        free(block_pointer);
-    } while (next_data_block != 0);
-    DEBUG("Wyjscie z **** _get_blocks_numbers_taken_by_file ****\n");
-    return 0;
+    }
+    free(probe);
+    return alignment <= block_size ? alignment : 0;
 }
 
 /**
- * Blokuje wybrane locki.
+ * Zamyka deskryptor O_DIRECT i zwalnia bufory pośrednie.
  */
-void _lock_file_blocks(int fsfd, master_block * master_block_pointer, unsigned long * blocks_table,
-                       unsigned long number_of_blocks, struct flock * flock_structures) {
-    unsigned long idx = 0;
-    DEBUG("\n\n******** _lock_file_blocks ********\n");
-    DEBUG("Liczba blokow: %d\n", number_of_blocks);
-    for (idx; idx < number_of_blocks; idx++) {
-        unsigned long block_offset = _get_block_offset(master_block_pointer, blocks_table[idx]);
-        DEBUG("Offset dla bloku: %u, wynosi: %u", blocks_table[idx], block_offset);
-        struct flock * flock_str = flock_structures + idx;
-        flock_str->l_type = F_WRLCK;
-        flock_str->l_whence = SEEK_SET;
-        flock_str->l_start = block_offset;
-        flock_str->l_len = master_block_pointer->block_size;
-        flock_str->l_pid = getpid();
-        fcntl(fsfd, F_SETLKW, flock_str);
+void _direct_io_disable(direct_io * direct) {
+    if (direct->fd == -1) {
+        return;
     }
+    close(direct->fd);
+    direct->fd = -1;
+    while (direct->number_of_free_buffers > 0) {
+        free(direct->free_buffers[--direct->number_of_free_buffers]);
+    }
+    free(direct->reserve_buffer);
+    pthread_cond_destroy(&direct->reserve_free);
+    pthread_mutex_destroy(&direct->mutex);
 }
 
 /**
- * Odblokowuje locki założone na bloki plików.
+ * Otwiera obraz ponownie z O_DIRECT i usuwa z pamięci hosta zbuforowane bloki danych.
+ * @return {0} sukces, {DIRECT_IO_NOT_AVAILABLE} system plików hosta nie obsługuje O_DIRECT lub brak pamięci na bufor
+ * zapasowy
  */
-void _unlock_file_blocks(int fsfd, struct flock * flock_structures, unsigned long number_of_flocks) {
-    unsigned int idx = 0;
-    for (idx; idx < number_of_flocks; idx++) {
-        struct flock * flock_str = flock_structures + idx;
-        flock_str->l_type = F_UNLCK;
-        fcntl(fsfd, F_SETLK, flock_str);
+int _direct_io_enable(mounted_fs * mounted) {
+    direct_io * direct = &mounted->direct;
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", mounted->fsfd);
+    int direct_fd = open(path, O_RDWR | O_DIRECT);
+    if (direct_fd == -1) {
+        return DIRECT_IO_NOT_AVAILABLE;
     }
+    unsigned int block_size = mounted->master_block_pointer->block_size;
+    unsigned int alignment = _direct_io_alignment(direct_fd, block_size);
+    if (alignment == 0 || block_size % alignment != 0
+        || posix_memalign(&direct->reserve_buffer, block_size, block_size) != 0) {
+        close(direct_fd);
+        return DIRECT_IO_NOT_AVAILABLE;
+    }
+    direct->reserve_in_use = FALSE;
+    pthread_cond_init(&direct->reserve_free, NULL);
+    direct->fd = direct_fd;
+    direct->alignment = alignment;
+    direct->buffer_size = block_size;
+    direct->number_of_free_buffers = 0;
+    pthread_mutex_init(&direct->mutex, NULL);
+    posix_fadvise(mounted->fsfd, _get_block_offset(mounted->master_block_pointer, 0), 0, POSIX_FADV_DONTNEED);
+    return OK;
 }
 
 /**
- * Funkcja przeprowadza rzeczywisty zapis do pliku reprezentującego system plików.
- * Zakładana jest odpowiednia wielkość wypełnionej tablicy {blocks_table}, tak aby dane mogły zostać zapisane.
+ * Zleca hostowi wczytanie z wyprzedzeniem fragmentu obrazu, nie czekając na wynik (w trybie O_DIRECT pomijane).
  */
-void _save_buffer_to_file(initialized_structures * initialized_structures_pointer, write_params * params,
-                          unsigned long * blocks_table, unsigned long real_file_offset, unsigned long number_of_all_blocks) {
-    DEBUG("\n****** save buffer to file *******\n");
-    DEBUG("params->data length = %d, file_offset =  %d\n", params->data_length, params->file_offset);
-    master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
-    unsigned int real_block_size = master_block_pointer->block_size - sizeof(long);
-    unsigned long block_to_start = real_file_offset / real_block_size;
-    unsigned int number_of_all_blocks_be_written = block_to_start + 1 + ((params->data_length - 1) / real_block_size);
-
-    unsigned int additional_block_offset = real_file_offset % real_block_size;
-    unsigned int data_offset = 0;
-
-    // jeżeli istnieje poprzedni blok (istnieje możliwa dziura), to trzeba w nim zapisać info o nowym bloku
-    if (block_to_start > 0) {
-        unsigned long previous_block_to_update = blocks_table[block_to_start - 1];
-        lseek(params->fsfd, _get_block_offset(master_block_pointer, previous_block_to_update) + real_block_size, SEEK_SET);
-        write(params->fsfd, &blocks_table[block_to_start], sizeof(unsigned long));
+void _io_advise(mounted_fs * mounted, int fsfd, unsigned long offset, unsigned long length) {
+    if (mounted != NULL && mounted->direct.fd != -1) {
+        return;
     }
+    if (mounted == NULL || mounted->io.type != IO_BACKEND_IO_URING || length > 0xFFFFFFFFUL) {
+        posix_fadvise(fsfd, offset, length, POSIX_FADV_WILLNEED);
+        return;
+    }
+    io_backend * backend = &mounted->io;
+    pthread_mutex_lock(&backend->mutex);
+    // wyniki wcześniejszych readahead są tylko zdejmowane z pierścienia; przy pełnym pierścieniu readahead jest pomijany
+    _io_uring_reap(backend);
+    if (backend->in_flight >= backend->queue_depth) {
+        pthread_mutex_unlock(&backend->mutex);
+        return;
+    }
+    unsigned tail = *backend->sq_tail;
+    unsigned index = tail & *backend->sq_mask;
+    struct io_uring_sqe * sqe = (struct io_uring_sqe *) backend->sqes + index;
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = IORING_OP_FADVISE;
+    sqe->fd = 0;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->off = offset;
+    sqe->len = length;
+    sqe->fadvise_advice = POSIX_FADV_WILLNEED;
+    sqe->user_data = 0;
+    backend->sq_array[index] = index;
+    __atomic_store_n(backend->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    _io_uring_enter_submit(backend, 1);
+    pthread_mutex_unlock(&backend->mutex);
+}
 
-    for (block_to_start; block_to_start < number_of_all_blocks_be_written; block_to_start++) {
-        unsigned long block_number = blocks_table[block_to_start];
-
-        unsigned long block_offset = _get_block_offset(master_block_pointer, block_number);
-        lseek(params->fsfd, block_offset + additional_block_offset, SEEK_SET);
-
-        unsigned long data_length_for_block = real_block_size - additional_block_offset;
-        if (params->data_length - data_offset < real_block_size - additional_block_offset) {
-            data_length_for_block = params->data_length - data_offset;
-        }
-        DEBUG("Suspicious write. params->data = %X, data_offset = %d, data_length_for_block = %d, additional_block_offset = %d\n",
-                params->data, data_offset, data_length_for_block, additional_block_offset);
-        DEBUG("Sizeof file signature is %d\n", sizeof(file_signature));
-        write(params->fsfd, params->data + sizeof(char) * data_offset, data_length_for_block);
-        additional_block_offset = 0;
-        data_offset += data_length_for_block;
+/*
+ * ---------------------------------------------------------------------------------------------------------------------
+ * Pamięć podręczna bloków danych.
+ * Każdy system plików otwarty przez simplefs_openfs ma własną pamięć podręczną, indeksowaną numerem bloku w całym
+ * systemie plików. Spójność między procesami zapewniają liczniki write_generation w master bloku: każdy zapis bloku
+ * zwiększa licznik jego pasa (już po zapisie danych), a odczyt przy liczniku innym niż zapamiętany odrzuca wszystkie
+ * bloki tego pasa. Wpisy wymieniane są algorytmem CLOCK - nowe bloki wchodzą bez bitu odwołania, więc jednorazowo
+ * czytane bloki dużych plików są wymieniane przed często używanymi blokami katalogów.
+ */
 
-        // przesunięcie wskaznika na koniec bloku dla zapisania informacji o następnym numerze bloku
-        lseek(params->fsfd, block_offset + real_block_size, SEEK_SET);
+/**
+ * Pobiera stan zamontowanego systemu plików na podstawie deskryptora.
+ * @return stan systemu plików lub NULL, jeśli deskryptor nie pochodzi z simplefs_openfs
+ */
+mounted_fs * _get_mounted_fs(int fsfd) {
+    mounted_fs * mounted;
+    HASH_FIND_INT(mounted_filesystems, &fsfd, mounted);
+    return mounted;
+}
 
+/**
+ * Bierze operations_lock na wyłączność - operacje zmieniające system plików lub stan montowania wykonują się po kolei.
+ * @return stan systemu plików (dla _operations_unlock) lub NULL, jeśli fsfd nie jest zamontowany
+ */
+mounted_fs * _operations_lock(int fsfd) {
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    if (mounted != NULL) {
+        pthread_rwlock_wrlock(&mounted->operations_lock);
+    }
+    return mounted;
+}
 
-        // zapisanie wskaznika na następny numer bloku
-        if (block_to_start != number_of_all_blocks - 1) {
-            DEBUG("Zapis!\n");
-            write(params->fsfd, &blocks_table[block_to_start + 1], sizeof(unsigned long));
-        } else {
-            // zapisanie zera jako następny numer bloku
-            unsigned long zero = 0;
-            write(params->fsfd, &zero, sizeof(unsigned long));
-        }
+void _operations_unlock(mounted_fs * mounted) {
+    if (mounted != NULL) {
+        pthread_rwlock_unlock(&mounted->operations_lock);
     }
 }
 
 /**
- * Podstawowa funkcja zapisująca podany blok danych do wskazanego pliku.
- * W normalnym przypadku pozwala na równoległy zapis wielu procesów, podanie file_offset < 0 powoduje dodatkowe
- * zablokowanie bloków danych, do których ta funkcja pisze (czyli robi append, przydatne w przypadku katalogów).
- * Na początku działania funkcji blokowany jest first free node w strukturze master block, tak aby możliwe było
- * poprawne przydzielenie wymaganych bloków dla funkcji. Po znalezieniu takich bloków i zmianie w strukturze bitmapy
- * następuje odblokowanie first free node.
+ * Przygotowuje pustą pamięć podręczną o zadanym budżecie pamięci.
  */
-int _write_unsafe(initialized_structures * initialized_structures_pointer, write_params params) {
-    struct flock flock_structure;
-    // blokada first free block
-    _block_first_free_block(params.fsfd, &flock_structure);
-
-    master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
-    unsigned int real_block_size = master_block_pointer->block_size - sizeof(long);
-
-    // załadowanie odpowiedniej struktury inode
-    file * file_structure = _get_file_by_fd(params.fd);
-    inode * file_inode = _load_inode_from_file_structure(initialized_structures_pointer, file_structure);
-    unsigned long file_size = file_inode->size;
-    DEBUG("_write_unsafe. Filze size = %d\n", file_size);
+void _cache_init(block_cache * cache, unsigned int block_size, unsigned long memory_budget, int mode) {
+    cache->mode = mode;
+    cache->block_size = block_size;
+    cache->capacity = memory_budget / block_size;
+    cache->clock_hand = 0;
+    memset(cache->generation, 0, sizeof(cache->generation));
+    memset(cache->in_flight, 0, sizeof(cache->in_flight));
+    cache->entries = cache->capacity > 0 ? calloc(cache->capacity, sizeof(cache_entry)) : NULL;
+    cache->lookup = NULL;
+    memset(cache->stripe_entries, 0, sizeof(cache->stripe_entries));
+    cache->hits = 0;
+}
 
-    // sprawdzenie poprawności dostępu do pliku
-    if (file_structure->mode == READ_MODE) {
-        _unblock_first_free_block(params.fsfd, &flock_structure);
-        DEBUG("Wrong mode\n");
-        return WRONG_MODE;
+/**
+ * Zwalnia pamięć zajmowaną przez wpisy (nie zapisuje zmienionych bloków - patrz _cache_flush).
+ */
+void _cache_destroy(block_cache * cache) {
+    unsigned long i;
+    HASH_CLEAR(hh, cache->lookup);
+    for (i = 0; i < cache->capacity; i++) {
+        free(cache->entries[i].data);
     }
+    free(cache->entries);
+    cache->entries = NULL;
+    cache->capacity = 0;
+}
 
-    // wyznaczenie prawdziwego offsetu dla pliku (< 0 => append)
-    unsigned int real_file_offset = 0;
-    if (params.file_offset < 0) {
-        real_file_offset = file_size;
-        unsigned long diff = real_block_size - file_size % real_block_size;
-        // specjalny przypadek - dodatkowo przy appendzie sprawdzamy czy blok danych do zapisu się zmieści, jeśli nie to robimy tam 'dziurę'
-        if (diff < params.data_length) {
-            real_file_offset += diff;
+/**
+ * Zwiększa licznik zapisów pasa, do którego należy blok. Jeśli od ostatniego sprawdzenia nikt inny nie pisał do
+ * bloków tego pasa, pamięć podręczna tego procesu pozostaje aktualna (własny zapis został już w niej uwzględniony).
+ * Wywoływana z zablokowanym mutexem pamięci podręcznej.
+ */
+void _cache_note_write(mounted_fs * mounted, unsigned long block_no) {
+    unsigned stripe = block_no % CACHE_GENERATION_STRIPES;
+    if (current_io_plug != NULL && current_io_plug->mounted == mounted) {
+        // zapis jeszcze nie trafił na dysk - licznik zostanie zwiększony w _io_unplug, do tego czasu bloki pasa
+        // czytane z dysku nie mogą trafić do pamięci podręcznej
+        if (!(current_io_plug->pending_stripes & (1UL << stripe))) {
+            current_io_plug->pending_stripes |= 1UL << stripe;
+            mounted->cache.in_flight[stripe]++;
         }
+        return;
+    }
+    unsigned long previous = __sync_fetch_and_add(&mounted->master_block_pointer->write_generation[stripe], 1);
+    if (previous == mounted->cache.generation[stripe]) {
+        mounted->cache.generation[stripe] = previous + 1;
+    }
+}
+
+/**
+ * Usuwa wpis z mapy haszującej i z listy jego pasa. Wywoływana z zablokowanym mutexem pamięci podręcznej.
+ */
+void _cache_remove(block_cache * cache, cache_entry * entry) {
+    HASH_DEL(cache->lookup, entry);
+    if (entry->stripe_prev != NULL) {
+        entry->stripe_prev->stripe_next = entry->stripe_next;
     } else {
-        real_file_offset = file_structure->position;
+        cache->stripe_entries[entry->block_no % CACHE_GENERATION_STRIPES] = entry->stripe_next;
     }
+    if (entry->stripe_next != NULL) {
+        entry->stripe_next->stripe_prev = entry->stripe_prev;
+    }
+    entry->block_no = 0;
+}
 
-    // wyznaczenie ile aktualnie zajmuje plik, a ile może zajmować po operacji zapisu
-    unsigned int number_of_all_taken_blocks_by_file = file_size / real_block_size;
-    if (file_size != 0) {
-        number_of_all_taken_blocks_by_file++;
+/**
+ * Odrzuca wpisy pasa zmienionego przez inny proces (przeglądana jest tylko lista wpisów tego pasa).
+ * Wywoływana z zablokowanym mutexem pamięci podręcznej.
+ * @return aktualna wartość licznika zapisów pasa bloku
+ */
+unsigned long _cache_validate(mounted_fs * mounted, unsigned long block_no) {
+    unsigned stripe = block_no % CACHE_GENERATION_STRIPES;
+    unsigned long current = mounted->master_block_pointer->write_generation[stripe];
+    if (current != mounted->cache.generation[stripe]) {
+        cache_entry * entry = mounted->cache.stripe_entries[stripe];
+        while (entry != NULL) {
+            cache_entry * next = entry->stripe_next;
+            if (!entry->dirty) {
+                _cache_remove(&mounted->cache, entry);
+            }
+            entry = next;
+        }
+        mounted->cache.generation[stripe] = current;
     }
-    unsigned int number_of_blocks_to_be_taken_by_file = 1 + ((real_file_offset + params.data_length - 1) / real_block_size);
+    return current;
+}
 
-    // przypadek specjalny - pierwszy zapis do nowo utworzonego pliku
-    if (number_of_blocks_to_be_taken_by_file == 0) {
-        number_of_blocks_to_be_taken_by_file = 1;
+/**
+ * Wyszukuje blok w pamięci podręcznej i ustawia mu bit odwołania.
+ * @return wpis lub NULL
+ */
+cache_entry * _cache_lookup(block_cache * cache, unsigned long block_no) {
+    cache_entry * entry;
+    HASH_FIND(hh, cache->lookup, &block_no, sizeof(unsigned long), entry);
+    if (entry != NULL) {
+        entry->referenced = TRUE;
     }
-    unsigned long * blocks_table = NULL;
-    if (number_of_all_taken_blocks_by_file >= number_of_blocks_to_be_taken_by_file) {
-        blocks_table = (unsigned long *) malloc(sizeof(unsigned long) * number_of_all_taken_blocks_by_file);
-    } else {
-        blocks_table = (unsigned long *) malloc(sizeof(unsigned long) * number_of_blocks_to_be_taken_by_file);
-    }
-    DEBUG("\n\n************\nLiczba wszystkich blokow zajmowanych przez plik: %d, liczba blokow do zajecia: %d\n\n", number_of_all_taken_blocks_by_file, number_of_blocks_to_be_taken_by_file);
-    // czy trzeba wyszukać nowe bloki danych dla pliku
-    unsigned int number_of_free_blocks = 0;
-    if ((number_of_blocks_to_be_taken_by_file > number_of_all_taken_blocks_by_file)
-        || file_inode->first_data_block == 0) {
-        // wyszukanie nowych bloków danych
-        number_of_free_blocks = number_of_blocks_to_be_taken_by_file - number_of_all_taken_blocks_by_file;
-        //nie wiem czemu tak
-        long first_operated_block = _find_free_blocks(params.fsfd, initialized_structures_pointer, number_of_free_blocks,
-                          blocks_table + number_of_all_taken_blocks_by_file);
-        if (first_operated_block == NO_FREE_BLOCKS) {
-            DEBUG("zle!");
-            _unblock_first_free_block(params.fsfd, &flock_structure);
-            free(blocks_table);
-            return NO_FREE_BLOCKS;
-        } else if (file_inode->first_data_block == 0) {
-            DEBUG("First operated block: %d\n", first_operated_block);
-            file_inode->first_data_block = first_operated_block;
+    return entry;
+}
+
+/**
+ * Zapisuje na dysk zmieniony blok (tryb write-back).
+ * Wywoływana z zablokowanym mutexem pamięci podręcznej.
+ */
+void _cache_write_back_entry(mounted_fs * mounted, cache_entry * entry) {
+    _io_write(mounted, mounted->fsfd, entry->data, mounted->cache.block_size, entry->block_no * mounted->cache.block_size);
+    entry->dirty = FALSE;
+    _cache_note_write(mounted, entry->block_no);
+}
+
+/**
+ * Zajmuje wpis dla nowego bloku, w razie potrzeby wymieniając inny blok algorytmem CLOCK.
+ * Wywoływana z zablokowanym mutexem pamięci podręcznej.
+ * @return wpis z zaalokowanym buforem (zawartość do wypełnienia przez wywołującego)
+ */
+cache_entry * _cache_insert(mounted_fs * mounted, unsigned long block_no) {
+    block_cache * cache = &mounted->cache;
+    cache_entry * entry;
+    while (TRUE) {
+        entry = cache->entries + cache->clock_hand;
+        cache->clock_hand = (cache->clock_hand + 1) % cache->capacity;
+        if (entry->block_no == 0) {
+            break;
+        }
+        if (entry->referenced) {
+            entry->referenced = FALSE;
+            continue;
+        }
+        if (entry->dirty) {
+            _cache_write_back_entry(mounted, entry);
         }
+        _cache_remove(cache, entry);
+        break;
+    }
+    if (entry->data == NULL && posix_memalign((void **) &entry->data, cache->block_size, cache->block_size) != 0) {
+        // wyrównanie pozwala czytać cały blok w trybie O_DIRECT bez bufora pośredniego
+        entry->data = malloc(cache->block_size);
+    }
+    entry->block_no = block_no;
+    entry->referenced = FALSE;
+    entry->dirty = FALSE;
+    HASH_ADD(hh, cache->lookup, block_no, sizeof(unsigned long), entry);
+    cache_entry ** stripe_head = cache->stripe_entries + block_no % CACHE_GENERATION_STRIPES;
+    entry->stripe_prev = NULL;
+    entry->stripe_next = *stripe_head;
+    if (*stripe_head != NULL) {
+        (*stripe_head)->stripe_prev = entry;
     }
+    *stripe_head = entry;
+    return entry;
+}
 
-    unsigned long number_of_flocks = number_of_blocks_to_be_taken_by_file;
-    if (number_of_all_taken_blocks_by_file >= number_of_blocks_to_be_taken_by_file) {
-        number_of_flocks = number_of_all_taken_blocks_by_file;
-    } else {
-        number_of_flocks = number_of_blocks_to_be_taken_by_file;
+/**
+ * Zapisuje na dysk wszystkie zmienione bloki pamięci podręcznej.
+ */
+void _cache_flush(mounted_fs * mounted) {
+    unsigned long i;
+    pthread_mutex_lock(&mounted->cache.mutex);
+    for (i = 0; i < mounted->cache.capacity; i++) {
+        if (mounted->cache.entries[i].block_no != 0 && mounted->cache.entries[i].dirty) {
+            _cache_write_back_entry(mounted, mounted->cache.entries + i);
+        }
     }
+    pthread_mutex_unlock(&mounted->cache.mutex);
+}
 
-    struct flock * flock_structures = (struct flock *) malloc(sizeof(struct flock) * number_of_flocks);
-    // czy zablokować dodatkowo wszystkie bloki danych, do których funkcja będzie zapisywać dane
-    DEBUG("Czy blokowac bloki: %d, dla liczby blokow: %d\n", params.lock_blocks, number_of_flocks);
-    if (_get_blocks_numbers_taken_by_file(params.fsfd, file_inode->first_data_block, master_block_pointer,
-                                          params.for_each_record, params.additional_param, blocks_table) == -2) {
-        free(blocks_table);
-        free(flock_structures);
-        return -2;
+/**
+ * Zapisuje na dysk blok, jeśli został zmieniony w pamięci podręcznej (tryb write-back).
+ */
+void _cache_write_back_block(mounted_fs * mounted, unsigned long block_no) {
+    if (!(mounted->cache.mode & CACHE_WRITE_BACK)) {
+        return;
     }
-    if (params.lock_blocks) {
-        _lock_file_blocks(params.fsfd, master_block_pointer, blocks_table, number_of_flocks, flock_structures);
+    cache_entry * entry;
+    pthread_mutex_lock(&mounted->cache.mutex);
+    HASH_FIND(hh, mounted->cache.lookup, &block_no, sizeof(unsigned long), entry);
+    if (entry != NULL && entry->dirty) {
+        _cache_write_back_entry(mounted, entry);
     }
+    pthread_mutex_unlock(&mounted->cache.mutex);
+}
 
-    // zapis nowej długości pliku
-    if (file_size >= real_file_offset + (unsigned long)params.data_length) {
-        file_inode->size = file_size;
-    } else {
-        file_inode->size = real_file_offset + (unsigned long)params.data_length;
-    }
+/*
+ * Współdzielona pamięć podręczna (CACHE_SHARED) - ten sam protokół liczników write_generation, ale bufory i wartości
+ * liczników, dla których są aktualne, znajdują się w segmencie pamięci dzielonej. Zmiany tablicy kubełków i zawartości
+ * buforów wykonywane są pod mutexem segmentu, czytelnicy kopiują dane bez blokady, sprawdzając wersję bufora.
+ */
 
-    // odblokowanie first free node
-    _unblock_first_free_block(params.fsfd, &flock_structure);
+long * _shared_cache_buckets(shared_cache_header * header) {
+    return (long *) (header + 1);
+}
 
-    // operacja zapisu do pliku
-    _save_buffer_to_file(initialized_structures_pointer, &params, blocks_table, real_file_offset, number_of_flocks);
+shared_buffer * _shared_cache_buffers(shared_cache_header * header) {
+    return (shared_buffer *) (_shared_cache_buckets(header) + header->number_of_buckets);
+}
 
-    // zwiększenie pozycji w strukturze file
-    file_structure->position += params.data_length;
-    DEBUG("Nowa pozycja w strukturze file: %d", file_structure->position);
+char * _shared_cache_data(shared_cache_header * header, long buffer_index) {
+    unsigned long data_offset = (unsigned long) (_shared_cache_buffers(header) + header->capacity) - (unsigned long) header;
+    data_offset = (data_offset + 63) & ~63UL;
+    return (char *) header + data_offset + buffer_index * header->block_size;
+}
 
-    // odblokowanie zablokowanych bloków danych (jeśli było to żądane)
-    if (params.lock_blocks) {
-        _unlock_file_blocks(params.fsfd, flock_structures, number_of_flocks);
-    }
-    free(flock_structures);
-    free(blocks_table);
-    return 0;
+/**
+ * Zwraca rozmiar segmentu dla zadanej liczby buforów.
+ */
+unsigned long _shared_cache_segment_size(unsigned int block_size, unsigned long capacity, unsigned long number_of_buckets) {
+    unsigned long size = sizeof(shared_cache_header) + number_of_buckets * sizeof(long) + capacity * sizeof(shared_buffer);
+    return ((size + 63) & ~63UL) + capacity * block_size;
 }
 
 /**
- * Funkcja odczytująca master block z dysku
- * @return odczytany master block
+ * Usuwa wszystkie bufory (segment pusty). Wywoływana z zablokowanym mutexem segmentu.
  */
-master_block* _get_master_block(int fsfd) {
-    DEBUG("get master block. fd = %d\n", fsfd);
-    lseek(fsfd, 0, SEEK_SET);
-    master_block* masterblock = malloc(sizeof(master_block));
-    read(fsfd, masterblock, sizeof(master_block));
-    DEBUG("Read first inode table block: %d\n", masterblock->first_inode_table_block);
-    DEBUG("Sizeof block_size is %d\n", sizeof(masterblock->block_size));
-    return masterblock;
+void _shared_cache_clear(shared_cache_header * header) {
+    unsigned long i;
+    shared_buffer * buffers = _shared_cache_buffers(header);
+    for (i = 0; i < header->number_of_buckets; i++) {
+        _shared_cache_buckets(header)[i] = -1;
+    }
+    for (i = 0; i < CACHE_GENERATION_STRIPES; i++) {
+        header->stripe_head[i] = -1;
+    }
+    for (i = 0; i < header->capacity; i++) {
+        buffers[i].block_no = 0;
+        buffers[i].version += (buffers[i].version % 2) + 2;
+        buffers[i].next_in_bucket = -1;
+        buffers[i].stripe_prev = -1;
+        buffers[i].stripe_next = -1;
+        buffers[i].referenced = FALSE;
+    }
+}
+
+void _shared_cache_lock(shared_cache_header * header) {
+    if (pthread_mutex_lock(&header->mutex) == EOWNERDEAD) {
+        // proces trzymający blokadę zakończył się - bufor mógł zostać przerwany w trakcie zmiany
+        _shared_cache_clear(header);
+        pthread_mutex_consistent(&header->mutex);
+    }
+}
+
+void _shared_cache_unlock(shared_cache_header * header) {
+    pthread_mutex_unlock(&header->mutex);
 }
 
 /**
- * Funkcja zwracająca podaną ścieżkę skróconą o ostatnią część - sluży więc do oddzielenia istniejącej ścieżki
- * od nazwy pliku (folderu), który ma być utworzony
+ * Wyszukuje bufor bloku. Wywoływana z zablokowanym mutexem segmentu.
+ * @return indeks bufora lub -1
  */
-char* _get_path_for_file(char* full_path) {
-    char* path = malloc(strlen(full_path) * sizeof(char) + 1);
-    strcpy(path, full_path);
-    int i;
-    for(i = strlen(path) - 1; i >= 0; i--) {
-        if(path[i] == '/') {
-            if(i == 0) {
-                path[i+1] = '\0';
-            } else {
-                path[i] = '\0';
-            }
-            return path;
-        }
+long _shared_cache_find(shared_cache_header * header, unsigned long block_no) {
+    long index = _shared_cache_buckets(header)[block_no % header->number_of_buckets];
+    shared_buffer * buffers = _shared_cache_buffers(header);
+    while (index != -1 && buffers[index].block_no != block_no) {
+        index = buffers[index].next_in_bucket;
     }
-    free(path);
-    return NULL;
+    return index;
 }
 
 /**
- * Funkcja umieszczająca bezpiecznie inode w pierwszym wolnym miejscu
- * @return numer umieszczonego inode'u
+ * Usuwa bufor z kubełka i z listy pasa, oznacza go jako wolny. Wywoływana z zablokowanym mutexem segmentu.
  */
-unsigned long _insert_new_inode(inode* new_inode, initialized_structures* structures, int fsfd) {
-    struct flock lock;
-    lock.l_type = F_RDLCK + F_WRLCK;
-    lock.l_whence = SEEK_SET;
-    lock.l_start = FIRST_FREE_INODE_OFFSET;
-    lock.l_len = sizeof(structures->master_block_pointer->first_free_inode);
-    lock.l_pid = getpid();
-    DEBUG("Writing new inode: masterblock pointer: %d\n", structures->master_block_pointer);
-    //lock first free inode in master block
-    fcntl(fsfd, F_SETLKW, &lock);
-    DEBUG("Writing new inode: masterblock pointer: %d\n", structures->master_block_pointer);
-    unsigned long inode_no = structures->master_block_pointer->first_free_inode;
-    if(inode_no == 0) {
-        lock.l_type = F_UNLCK;
-        fcntl(fsfd, F_SETLK, &lock);
-        return 0;
+void _shared_cache_remove(shared_cache_header * header, long buffer_index) {
+    shared_buffer * buffers = _shared_cache_buffers(header);
+    long * link = _shared_cache_buckets(header) + buffers[buffer_index].block_no % header->number_of_buckets;
+    while (*link != buffer_index) {
+        link = &buffers[*link].next_in_bucket;
     }
-    structures->inode_table[inode_no] = *new_inode;
-    //now need to find new next free inode
-    unsigned long i;
-    for(i = inode_no + 1; i < (structures->master_block_pointer->number_of_inode_table_blocks * structures->master_block_pointer->block_size)
-            / sizeof(inode); i++) {
-        if(structures->inode_table[i].type == INODE_EMPTY) {
-            structures->master_block_pointer->first_free_inode = i;
-            lock.l_type = F_UNLCK;
-            fcntl(fsfd, F_SETLK, &lock);
-            return inode_no;
+    *link = buffers[buffer_index].next_in_bucket;
+    if (buffers[buffer_index].stripe_prev != -1) {
+        buffers[buffers[buffer_index].stripe_prev].stripe_next = buffers[buffer_index].stripe_next;
+    } else {
+        header->stripe_head[buffers[buffer_index].block_no % CACHE_GENERATION_STRIPES] = buffers[buffer_index].stripe_next;
+    }
+    if (buffers[buffer_index].stripe_next != -1) {
+        buffers[buffers[buffer_index].stripe_next].stripe_prev = buffers[buffer_index].stripe_prev;
+    }
+    buffers[buffer_index].version++;
+    buffers[buffer_index].block_no = 0;
+    buffers[buffer_index].next_in_bucket = -1;
+    buffers[buffer_index].version++;
+}
+
+/**
+ * Odrzuca bufory pasa zmienionego przez proces nie korzystający z segmentu.
+ * Wywoływana z zablokowanym mutexem segmentu.
+ * @return aktualna wartość licznika zapisów pasa bloku
+ */
+unsigned long _shared_cache_validate(mounted_fs * mounted, unsigned long block_no) {
+    shared_cache_header * header = mounted->shared_cache;
+    unsigned stripe = block_no % CACHE_GENERATION_STRIPES;
+    unsigned long current = mounted->master_block_pointer->write_generation[stripe];
+    if (current != header->generation[stripe]) {
+        shared_buffer * buffers = _shared_cache_buffers(header);
+        long index = header->stripe_head[stripe];
+        while (index != -1) {
+            long next = buffers[index].stripe_next;
+            _shared_cache_remove(header, index);
+            index = next;
         }
+        header->generation[stripe] = current;
     }
-    //no free inodes!
-    //unlock
-    structures->master_block_pointer->first_free_inode = 0;
-    lock.l_type = F_UNLCK;
-    fcntl(fsfd, F_SETLK, &lock);
-    return inode_no;
+    return current;
+}
+
+/**
+ * Kopiuje fragment bloku z segmentu (bez blokady - kopia jest ważna, jeśli wersja bufora się nie zmieniła).
+ * @param generation parametr wyjściowy, licznik zapisów pasa sprzed odczytu (dla _shared_cache_fill)
+ * @return TRUE, jeśli blok był w segmencie
+ */
+int _shared_cache_read(mounted_fs * mounted, unsigned long block_no, unsigned long offset_in_block, void * buffer,
+                       unsigned long length, unsigned long * generation) {
+    shared_cache_header * header = mounted->shared_cache;
+    _shared_cache_lock(header);
+    *generation = _shared_cache_validate(mounted, block_no);
+    long index = _shared_cache_find(header, block_no);
+    unsigned long version = 0;
+    if (index != -1) {
+        version = _shared_cache_buffers(header)[index].version;
+        _shared_cache_buffers(header)[index].referenced = TRUE;
+    }
+    _shared_cache_unlock(header);
+    if (index == -1 || version % 2 != 0) {
+        return FALSE;
+    }
+    shared_buffer * shared = _shared_cache_buffers(header) + index;
+    memcpy(buffer, _shared_cache_data(header, index) + offset_in_block, length);
+    __sync_synchronize();
+    return shared->version == version && shared->block_no == block_no;
+}
+
+/**
+ * Umieszcza w segmencie blok przeczytany z dysku, jeśli w trakcie odczytu nikt nie zmienił bloków jego pasa.
+ */
+void _shared_cache_fill(mounted_fs * mounted, unsigned long block_no, void * data, unsigned long generation) {
+    shared_cache_header * header = mounted->shared_cache;
+    shared_buffer * buffers = _shared_cache_buffers(header);
+    _shared_cache_lock(header);
+    if (header->generation[block_no % CACHE_GENERATION_STRIPES] != generation || _shared_cache_find(header, block_no) != -1) {
+        _shared_cache_unlock(header);
+        return;
+    }
+    long index;
+    while (TRUE) {
+        index = header->clock_hand;
+        header->clock_hand = (header->clock_hand + 1) % header->capacity;
+        if (buffers[index].block_no == 0) {
+            break;
+        }
+        if (buffers[index].referenced) {
+            buffers[index].referenced = FALSE;
+            continue;
+        }
+        _shared_cache_remove(header, index);
+        break;
+    }
+    buffers[index].version++;
+    memcpy(_shared_cache_data(header, index), data, header->block_size);
+    buffers[index].block_no = block_no;
+    buffers[index].referenced = FALSE;
+    long * bucket = _shared_cache_buckets(header) + block_no % header->number_of_buckets;
+    buffers[index].next_in_bucket = *bucket;
+    *bucket = index;
+    long * stripe_head = header->stripe_head + block_no % CACHE_GENERATION_STRIPES;
+    buffers[index].stripe_prev = -1;
+    buffers[index].stripe_next = *stripe_head;
+    if (*stripe_head != -1) {
+        buffers[*stripe_head].stripe_prev = index;
+    }
+    *stripe_head = index;
+    __sync_synchronize();
+    buffers[index].version++;
+    _shared_cache_unlock(header);
+}
+
+/**
+ * Uaktualnia bufor zapisanego właśnie na dysk bloku i zwiększa licznik zapisów jego pasa.
+ */
+void _shared_cache_update(mounted_fs * mounted, unsigned long block_no, unsigned long offset_in_block, void * data,
+                          unsigned long length) {
+    shared_cache_header * header = mounted->shared_cache;
+    _shared_cache_lock(header);
+    long index = _shared_cache_find(header, block_no);
+    if (index != -1) {
+        shared_buffer * shared = _shared_cache_buffers(header) + index;
+        shared->version++;
+        __sync_synchronize();
+        memcpy(_shared_cache_data(header, index) + offset_in_block, data, length);
+        __sync_synchronize();
+        shared->version++;
+    }
+    unsigned stripe = block_no % CACHE_GENERATION_STRIPES;
+    unsigned long previous = __sync_fetch_and_add(&mounted->master_block_pointer->write_generation[stripe], 1);
+    if (previous == header->generation[stripe]) {
+        header->generation[stripe] = previous + 1;
+    }
+    _shared_cache_unlock(header);
+}
+
+/**
+ * Podłącza proces do segmentu pamięci dzielonej obrazu, tworząc go, jeśli jeszcze nie istnieje.
+ * Nazwa segmentu wyznaczana jest z urządzenia, numeru i-węzła hosta oraz identyfikatora obrazu.
+ * @return {0} sukces, {SHARED_MEMORY_ERROR} błąd
+ */
+int _shared_cache_attach(mounted_fs * mounted, unsigned long memory_budget) {
+    struct stat image_stat;
+    if (fstat(mounted->fsfd, &image_stat) == -1) {
+        return SHARED_MEMORY_ERROR;
+    }
+    snprintf(mounted->shared_cache_name, sizeof(mounted->shared_cache_name), "/simplefs-%lx-%lx-%lx",
+             (unsigned long) image_stat.st_dev, (unsigned long) image_stat.st_ino, mounted->master_block_pointer->image_id);
+    unsigned int block_size = mounted->master_block_pointer->block_size;
+    int created = TRUE;
+    int shm_fd = shm_open(mounted->shared_cache_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (shm_fd == -1 && errno == EEXIST) {
+        created = FALSE;
+        shm_fd = shm_open(mounted->shared_cache_name, O_RDWR, 0644);
+    }
+    if (shm_fd == -1) {
+        return SHARED_MEMORY_ERROR;
+    }
+    unsigned long size;
+    if (created) {
+        unsigned long capacity = memory_budget / block_size;
+        if (capacity == 0) {
+            capacity = 1;
+        }
+        size = _shared_cache_segment_size(block_size, capacity, capacity);
+        if (ftruncate(shm_fd, size) == -1) {
+            close(shm_fd);
+            shm_unlink(mounted->shared_cache_name);
+            return SHARED_MEMORY_ERROR;
+        }
+    } else {
+        // czekamy, aż proces tworzący segment nada mu rozmiar
+        int tries;
+        for (tries = 0; fstat(shm_fd, &image_stat) == 0 && image_stat.st_size == 0 && tries < 1000; tries++) {
+            usleep(1000);
+        }
+        size = image_stat.st_size;
+    }
+    shared_cache_header * header = (shared_cache_header *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (size == 0 || header == (shared_cache_header *) MAP_FAILED) {
+        return SHARED_MEMORY_ERROR;
+    }
+    if (created) {
+        header->block_size = block_size;
+        header->capacity = memory_budget / block_size > 0 ? memory_budget / block_size : 1;
+        header->number_of_buckets = header->capacity;
+        header->clock_hand = 0;
+        header->attached = 0;
+        memcpy(header->generation, mounted->master_block_pointer->write_generation, sizeof(header->generation));
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header->mutex, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+        _shared_cache_clear(header);
+        __sync_synchronize();
+        header->magic = SHARED_CACHE_MAGIC;
+    } else {
+        int tries;
+        for (tries = 0; header->magic != SHARED_CACHE_MAGIC && tries < 1000; tries++) {
+            usleep(1000);
+        }
+        if (header->magic != SHARED_CACHE_MAGIC || header->block_size != block_size) {
+            munmap(header, size);
+            return SHARED_MEMORY_ERROR;
+        }
+    }
+    _shared_cache_lock(header);
+    header->attached++;
+    _shared_cache_unlock(header);
+    mounted->shared_cache = header;
+    mounted->shared_cache_size = size;
+    return OK;
+}
+
+/**
+ * Odłącza proces od segmentu, ostatni proces usuwa segment.
+ */
+void _shared_cache_detach(mounted_fs * mounted) {
+    shared_cache_header * header = mounted->shared_cache;
+    if (header == NULL) {
+        return;
+    }
+    _shared_cache_lock(header);
+    int last = --header->attached == 0;
+    _shared_cache_unlock(header);
+    munmap(header, mounted->shared_cache_size);
+    if (last) {
+        // proces podłączający się w tej chwili zostanie przy starym segmencie, co nie psuje spójności -
+        // oba segmenty korzystają z tych samych liczników write_generation
+        shm_unlink(mounted->shared_cache_name);
+    }
+    mounted->shared_cache = NULL;
+}
+
+/**
+ * Czyta fragment bloku - z pamięci podręcznej lub z dysku. Przy odczycie całego bloku z dysku blok trafia do
+ * pamięci podręcznej, fragmenty (np. same wskaźniki na następny blok) nie są buforowane.
+ */
+void _read_from_block(int fsfd, unsigned long block_no, unsigned long block_size, unsigned long offset_in_block,
+                      void * buffer, unsigned long length) {
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    if (mounted != NULL && mounted->shared_cache != NULL) {
+        unsigned long generation;
+        if (_shared_cache_read(mounted, block_no, offset_in_block, buffer, length, &generation)) {
+            return;
+        }
+        _io_read(mounted, fsfd, buffer, length, block_no * block_size + offset_in_block);
+        if (length == block_size) {
+            _shared_cache_fill(mounted, block_no, buffer, generation);
+        }
+        return;
+    }
+    if (mounted == NULL || mounted->cache.capacity == 0) {
+        _io_read(mounted, fsfd, buffer, length, block_no * block_size + offset_in_block);
+        return;
+    }
+    pthread_mutex_lock(&mounted->cache.mutex);
+    unsigned long generation = _cache_validate(mounted, block_no);
+    cache_entry * entry = _cache_lookup(&mounted->cache, block_no);
+    if (entry != NULL) {
+        memcpy(buffer, entry->data + offset_in_block, length);
+        mounted->cache.hits++;
+        pthread_mutex_unlock(&mounted->cache.mutex);
+        return;
+    }
+    pthread_mutex_unlock(&mounted->cache.mutex);
+
+    if (length != block_size) {
+        _io_read(mounted, fsfd, buffer, length, block_no * block_size + offset_in_block);
+        return;
+    }
+    _io_read(mounted, fsfd, buffer, block_size, block_no * block_size);
+    pthread_mutex_lock(&mounted->cache.mutex);
+    // blok trafia do pamięci tylko, jeśli w trakcie odczytu nikt nie zmienił bloków jego pasa
+    if (mounted->cache.generation[block_no % CACHE_GENERATION_STRIPES] == generation
+        && mounted->cache.in_flight[block_no % CACHE_GENERATION_STRIPES] == 0
+        && _cache_lookup(&mounted->cache, block_no) == NULL) {
+        entry = _cache_insert(mounted, block_no);
+        memcpy(entry->data, buffer, block_size);
+    }
+    pthread_mutex_unlock(&mounted->cache.mutex);
+}
+
+void _journal_ordered_data(mounted_fs * mounted);
+
+/**
+ * Zapisuje fragment bloku. W trybie write-through dane trafiają od razu na dysk (a kopia w pamięci podręcznej jest
+ * uaktualniana), w trybie write-back blok jest tylko oznaczany jako zmieniony.
+ */
+void _write_to_block(int fsfd, unsigned long block_no, unsigned long block_offset, unsigned long block_size,
+                     unsigned long offset_in_block, void * data, unsigned long length) {
+    block_no += block_offset;
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    if (mounted == NULL) {
+        pwrite(fsfd, data, length, block_no * block_size + offset_in_block);
+        // licznik zapisów trzeba zwiększyć także bez zamontowanego systemu, żeby inne procesy odrzuciły stare kopie
+        master_block * mb = (master_block *) mmap(NULL, sizeof(master_block), PROT_READ | PROT_WRITE, MAP_SHARED, fsfd, 0);
+        if (mb != (master_block *) MAP_FAILED) {
+            __sync_fetch_and_add(&mb->write_generation[block_no % CACHE_GENERATION_STRIPES], 1);
+            munmap(mb, sizeof(master_block));
+        }
+        return;
+    }
+    if (mounted->journal.mode & JOURNAL_ORDERED) {
+        _journal_ordered_data(mounted);
+    }
+    if (mounted->shared_cache != NULL) {
+        _io_write(mounted, fsfd, data, length, block_no * block_size + offset_in_block);
+        _shared_cache_update(mounted, block_no, offset_in_block, data, length);
+        return;
+    }
+    pthread_mutex_lock(&mounted->cache.mutex);
+    if (mounted->cache.capacity > 0 && mounted->cache.mode == CACHE_WRITE_BACK) {
+        _cache_validate(mounted, block_no);
+        cache_entry * entry = _cache_lookup(&mounted->cache, block_no);
+        if (entry == NULL) {
+            entry = _cache_insert(mounted, block_no);
+            if (length != block_size) {
+                _io_read(mounted, fsfd, entry->data, block_size, block_no * block_size);
+            }
+        }
+        memcpy(entry->data + offset_in_block, data, length);
+        entry->dirty = TRUE;
+        entry->referenced = TRUE;
+        pthread_mutex_unlock(&mounted->cache.mutex);
+        return;
+    }
+    _io_write(mounted, fsfd, data, length, block_no * block_size + offset_in_block);
+    if (mounted->cache.capacity > 0) {
+        cache_entry * entry = _cache_lookup(&mounted->cache, block_no);
+        if (entry != NULL) {
+            memcpy(entry->data + offset_in_block, data, length);
+        }
+    }
+    _cache_note_write(mounted, block_no);
+    pthread_mutex_unlock(&mounted->cache.mutex);
+}
+
+/**
+ * Funkcja czytająca z dysku blok określony numerem bloku z offsetem (również podanym jako ilość bloków)
+ * @return odczytany blok
+ */
+void* _read_block(int fsfd, long block_no, long block_offset, long block_size) {
+    char* block_data = _pool_alloc(block_size);
+    block* block_read = _pool_alloc(sizeof(block));
+    _read_from_block(fsfd, block_no + block_offset, block_size, 0, block_data, block_size);
+    //next data block is stored in the last bytes of the block
+    memcpy(&(block_read->next_data_block), block_data + block_size - sizeof(unsigned long), sizeof(unsigned long));
+    block_read->data = block_data;
+    block_read->size = block_size;
+    return block_read;
+}
+
+/**
+ * Funkcja czytająca z dysku dla danego bloku tylko jego następnik
+ * @return numer następnego bloku
+ */
+unsigned long _find_next_block(int fd, long block_no, long block_offset, long block_size) {
+    unsigned long next_block = 0;
+    _read_from_block(fd, block_no + block_offset, block_size, block_size - sizeof(unsigned long), &next_block,
+                     sizeof(unsigned long));
+    return next_block;
+}
+
+void free_block_struct(block* bl) {
+    _pool_free(bl->data, bl->size);
+    _pool_free(bl, sizeof(block));
+}
+
+/**
+ * Zwraca wskaźnik następnego bloku po bloku danych block_no - z bloku lub z tablicy wskaźników (INIT_LINK_TABLE),
+ * zamapowanej przy montowaniu.
+ */
+unsigned long _get_block_link(int fsfd, master_block * master_block_pointer, unsigned long block_no) {
+    if (master_block_pointer->number_of_link_table_blocks == 0) {
+        return _find_next_block(fsfd, block_no, master_block_pointer->data_start_block, master_block_pointer->block_size);
+    }
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    if (mounted != NULL && mounted->link_table != NULL) {
+        return __atomic_load_n(&mounted->link_table[block_no], __ATOMIC_ACQUIRE);
+    }
+    unsigned long link = 0;
+    pread(fsfd, &link, sizeof(unsigned long),
+          master_block_pointer->first_link_table_block * master_block_pointer->block_size + block_no * sizeof(unsigned long));
+    return link;
+}
+
+/**
+ * Zapisuje wskaźnik następnego bloku po bloku danych block_no.
+ */
+void _set_block_link(int fsfd, master_block * master_block_pointer, unsigned long block_no, unsigned long link) {
+    if (master_block_pointer->number_of_link_table_blocks == 0) {
+        _write_to_block(fsfd, block_no, master_block_pointer->data_start_block, master_block_pointer->block_size,
+                        master_block_pointer->block_size - sizeof(unsigned long), &link, sizeof(unsigned long));
+        return;
+    }
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    if (mounted != NULL && mounted->link_table != NULL) {
+        __atomic_store_n(&mounted->link_table[block_no], link, __ATOMIC_RELEASE);
+        return;
+    }
+    pwrite(fsfd, &link, sizeof(unsigned long),
+           master_block_pointer->first_link_table_block * master_block_pointer->block_size + block_no * sizeof(unsigned long));
+}
+
+/**
+ * Czyta blok danych pliku razem ze wskaźnikiem następnego bloku, niezależnie od miejsca przechowywania wskaźników.
+ * @return odczytany blok
+ */
+block * _read_file_block(int fsfd, master_block * master_block_pointer, unsigned long block_no) {
+    block * block_read = (block *) _read_block(fsfd, block_no, master_block_pointer->data_start_block,
+                                               master_block_pointer->block_size);
+    if (master_block_pointer->number_of_link_table_blocks > 0) {
+        block_read->next_data_block = _get_block_link(fsfd, master_block_pointer, block_no);
+    }
+    return block_read;
+}
+
+/**
+ * Funkcja czytająca inode katalogu głównego /
+ * @return odczytany inode
+ */
+inode* _get_root_inode(int fd, master_block* masterblock) {
+    DEBUG("Seeking to %lu\n", masterblock->first_inode_table_block * masterblock->block_size);
+    DEBUG("first inode table block is %d and block size is %d\n", masterblock->first_inode_table_block, masterblock->block_size);
+    inode* root_inode = _pool_alloc(sizeof(inode));
+    pread(fd, root_inode, sizeof(inode), masterblock->first_inode_table_block * masterblock->block_size);
+    DEBUG("Read root inode. Name is %s. Type is %c and first data block is %lu\n", root_inode->filename, root_inode->type, root_inode->first_data_block);
+    return root_inode;
+}
+
+/**
+ * Funkcja znajdująca inode pliku znajdującego się w katalogu reprezentowanym przez dany inode
+ * @return znaleziony inode
+ */
+inode* _get_inode_in_dir(int fd, inode* parent_inode, char* name, master_block* masterblock, unsigned long* inode_no) {
+    DEBUG("_get_inode_in_dir %c\n", parent_inode->type);
+
+    if(parent_inode->type != INODE_DIR) {
+        return NULL;
+    }
+    block* dir_block = _read_file_block(fd, masterblock, parent_inode->first_data_block);
+    DEBUG("Next data block: %d\n", dir_block->next_data_block);
+    long i;
+    while(1) {
+        DEBUG("finding dir: next data block: %d\n", dir_block->next_data_block);
+        for(i = 0; i + sizeof(file_signature) <= _block_payload(masterblock); i += sizeof(file_signature)) {
+            DEBUG("indeks %d\n", i);
+            file_signature* signature = (file_signature*) (dir_block->data + i * sizeof(char));
+            if(strcmp(name, signature->name) == 0 && signature->inode_no != 0) {
+                //zapameitujemy numer inode w tablicy inodow
+                *inode_no = signature->inode_no;
+                DEBUG("Zapamiętanie w tablicy inodów: %lu\n", signature->inode_no);
+                //inody leżą w tablicy jeden za drugim - wystarczy odczytać sam inode zamiast całego bloku tablicy
+                inode* result_inode = _pool_alloc(sizeof(inode));
+                pread(fd, result_inode, sizeof(inode), masterblock->first_inode_table_block * masterblock->block_size
+                                                       + signature->inode_no * sizeof(inode));
+                free_block_struct(dir_block);
+                return result_inode;
+            }
+        }
+        if(dir_block->next_data_block == 0) {
+            DEBUG("Nie znaleziony inode!\n");
+            free_block_struct(dir_block);
+            return NULL;
+        }
+        unsigned long next_data_block = dir_block->next_data_block;
+        free_block_struct(dir_block);
+        dir_block = _read_file_block(fd, masterblock, next_data_block);
+    }
+    free_block_struct(dir_block);
+    DEBUG("wyjscie z get inode in dir\n");
+    return NULL;
+}
+
+/**
+ * Funkcja znajdująca inode pliku reprezentowanego przez pełną ścieżkę (np. /dir/file)
+ * @param inode_no, parametr wyjsciowy, do zwrocenie polozenia inoda w tablicy inodow
+ * @return znelziony inode
+ */
+inode* _get_inode_by_path(char* path, master_block* masterblock, int fd, unsigned long* inode_no) {
+    if(path[0] != '/') {
+        return NULL;
+    }
+    if(strlen(path) == 1) {
+        //root inode
+        *inode_no = 0;
+        DEBUG("In _get_inode_by_path - get root inode. Block size is %d\n", masterblock->block_size);
+        return _get_root_inode(fd, masterblock);
+    }
+    unsigned path_index = 1;
+    unsigned long path_part_size = strlen(path) * sizeof(char);
+    char* path_part = _pool_alloc(path_part_size);
+    DEBUG("Path_part %c\n", path_part);
+    inode* current_inode = _get_root_inode(fd, masterblock);
+    while(1) {
+        unsigned i = 0;
+        while(path[path_index] != '/' && path[path_index] != '\0') {
+            path_part[i++] = path[path_index++];
+        }
+        path_part[i] = '\0';
+        inode* new_inode = _get_inode_in_dir(fd, current_inode, path_part, masterblock, inode_no); //inode_no sie nie zmieni jak sie okaze ze path_part nie jest juz katalogiem
+        _pool_free(current_inode, sizeof(inode));
+        if(new_inode == NULL || new_inode->type == INODE_EMPTY) {
+            DEBUG("Nie znaleziony inode!\n");
+            _pool_free(path_part, path_part_size);
+            _pool_free(new_inode, sizeof(inode));
+            return NULL;
+        }
+        current_inode = new_inode;
+        if(path[path_index] == '\0') {
+            break;
+        }
+        path_index++;
+    }
+    _pool_free(path_part, path_part_size);
+    return current_inode;
+}
+
+/*
+ * ---------------------------------------------------------------------------------------------------------------------
+ * Dziennik metadanych.
+ * Funkcje zmieniające master block, bitmapę, tablicę i-węzłów lub bloki katalogów zapisują numery zmienionych bloków
+ * na liście wątku (_journal_dirty_*). Na końcu operacji lista trafia do otwartej transakcji w nagłówku dziennika,
+ * wspólnej dla wszystkich procesów. Transakcję utrwala proces, który pierwszy po nią przyjdzie: pod blokadą zapisu
+ * zamyka ją (nowe zmiany trafiają do następnej) i wywołuje fdatasync. Procesy czekające w tym czasie na blokadę zapisu
+ * sprawdzają po jej uzyskaniu, czy ich transakcja nie została już utrwalona - jedno fdatasync obsługuje wiele operacji.
+ * Metadane zmieniane są na miejscu przez wspólne mapowania, więc dziennik nie zapewnia spójności obrazu po awarii.
+ */
+
+__thread journal_operation current_journal_operation = { .fsfd = -1, .number_of_blocks = 0, .ordered_data_writes = 0 };
+
+/**
+ * Blokuje (F_WRLCK) lub odblokowuje (F_UNLCK) bajt nagłówka dziennika - 0 dla listy otwartej transakcji, 1 dla zapisu
+ * transakcji. Razem z blokadą fcntl brany jest mutex wykluczający wątki procesu.
+ */
+void _journal_lock(mounted_fs * mounted, pthread_mutex_t * mutex, int lock_byte, short type) {
+    master_block * mb = mounted->master_block_pointer;
+    struct flock lock;
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = mb->journal_start_block * mb->block_size + lock_byte;
+    lock.l_len = 1;
+    lock.l_pid = getpid();
+    if (type == F_UNLCK) {
+        fcntl(mounted->fsfd, F_SETLK, &lock);
+        pthread_mutex_unlock(mutex);
+    } else {
+        pthread_mutex_lock(mutex);
+        fcntl(mounted->fsfd, F_SETLKW, &lock);
+    }
+}
+
+/**
+ * Utrwala transakcję o numerze sequence (i wszystkie wcześniejsze). Jeśli utrwalił ją już inny wątek lub proces,
+ * tylko czeka na koniec tego utrwalania.
+ */
+int _journal_commit(mounted_fs * mounted, unsigned long sequence) {
+    journal_header * header = mounted->journal.header;
+    _journal_lock(mounted, &mounted->journal.commit_mutex, 1, F_WRLCK);
+    if (header->committed_sequence >= sequence) {
+        _journal_lock(mounted, &mounted->journal.commit_mutex, 1, F_UNLCK);
+        return OK;
+    }
+    // zamknięcie otwartej transakcji - kolejne zmiany trafiają do następnej
+    _journal_lock(mounted, &mounted->journal.pending_mutex, 0, F_WRLCK);
+    unsigned long closed_sequence = header->next_sequence++;
+    unsigned long number_of_blocks = header->number_of_pending_blocks;
+    header->number_of_pending_blocks = 0;
+    unsigned long ordered_data_writes = header->ordered_data_writes;
+    header->ordered_data_writes = 0;
+    _journal_lock(mounted, &mounted->journal.pending_mutex, 0, F_UNLCK);
+
+    if (ordered_data_writes > 0) {
+        // tryb uporządkowany - dane wszystkich operacji transakcji utrwalane są jedną barierą przed metadanymi
+        _cache_flush(mounted);
+        fdatasync(mounted->fsfd);
+    }
+    if (number_of_blocks > 0) {
+        // bloki katalogów mogą czekać w pamięci podręcznej
+        _cache_flush(mounted);
+    }
+    fdatasync(mounted->fsfd);
+    header->committed_sequence = closed_sequence;
+    _journal_lock(mounted, &mounted->journal.commit_mutex, 1, F_UNLCK);
+    return OK;
+}
+
+/**
+ * Przenosi bloki zmienione przez operacje wątku do otwartej transakcji (zapisując ją, jeśli się zapełni).
+ * @return numer transakcji, do której trafiły bloki
+ */
+unsigned long _journal_submit(mounted_fs * mounted, journal_operation * operation) {
+    journal_header * header = mounted->journal.header;
+    _journal_lock(mounted, &mounted->journal.pending_mutex, 0, F_WRLCK);
+    unsigned i, j;
+    for (i = 0; i < operation->number_of_blocks; i++) {
+        for (j = 0; j < header->number_of_pending_blocks && header->pending_blocks[j] != operation->blocks[i]; j++) {
+        }
+        if (j < header->number_of_pending_blocks) {
+            continue;
+        }
+        if (header->number_of_pending_blocks >= JOURNAL_TRANSACTION_BLOCKS) {
+            unsigned long full_sequence = header->next_sequence;
+            _journal_lock(mounted, &mounted->journal.pending_mutex, 0, F_UNLCK);
+            _journal_commit(mounted, full_sequence);
+            _journal_lock(mounted, &mounted->journal.pending_mutex, 0, F_WRLCK);
+            i--;
+            continue;
+        }
+        header->pending_blocks[header->number_of_pending_blocks++] = operation->blocks[i];
+    }
+    header->ordered_data_writes += operation->ordered_data_writes;
+    unsigned long sequence = header->next_sequence;
+    _journal_lock(mounted, &mounted->journal.pending_mutex, 0, F_UNLCK);
+    operation->number_of_blocks = 0;
+    operation->ordered_data_writes = 0;
+    return sequence;
+}
+
+/**
+ * Zwraca listę bloków bieżącej operacji wątku w systemie plików fsfd - zmiany operacji w innym systemie plików
+ * trafiają wcześniej do jego otwartej transakcji.
+ */
+journal_operation * _journal_operation(int fsfd) {
+    journal_operation * operation = &current_journal_operation;
+    if (operation->fsfd != fsfd && (operation->number_of_blocks > 0 || operation->ordered_data_writes > 0)) {
+        mounted_fs * previous = _get_mounted_fs(operation->fsfd);
+        if (previous != NULL && previous->journal.mode != JOURNAL_NONE) {
+            _journal_submit(previous, operation);
+        }
+        operation->number_of_blocks = 0;
+        operation->ordered_data_writes = 0;
+    }
+    operation->fsfd = fsfd;
+    return operation;
+}
+
+/**
+ * Zapamiętuje blok (numer w całym systemie plików) zmieniony przez bieżącą operację wątku.
+ */
+void _journal_dirty_block(int fsfd, unsigned long block_no) {
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    if (mounted == NULL || mounted->journal.mode == JOURNAL_NONE) {
+        return;
+    }
+    journal_operation * operation = _journal_operation(fsfd);
+    unsigned i;
+    for (i = 0; i < operation->number_of_blocks; i++) {
+        if (operation->blocks[i] == block_no) {
+            return;
+        }
+    }
+    if (operation->number_of_blocks == JOURNAL_TRANSACTION_BLOCKS) {
+        _journal_submit(mounted, operation);
+    }
+    operation->blocks[operation->number_of_blocks++] = block_no;
+}
+
+void _journal_dirty_master_block(initialized_structures * structures) {
+    _journal_dirty_block(structures->fsfd, 0);
+}
+
+void _journal_dirty_bitmap(initialized_structures * structures, unsigned long block_no) {
+    _journal_dirty_block(structures->fsfd, 1 + block_no / 8 / structures->master_block_pointer->block_size);
+}
+
+void _journal_dirty_inode(initialized_structures * structures, unsigned long inode_no) {
+    master_block * mb = structures->master_block_pointer;
+    _journal_dirty_block(structures->fsfd, mb->first_inode_table_block + inode_no * sizeof(inode) / mb->block_size);
+}
+
+void _journal_dirty_data_block(initialized_structures * structures, unsigned long block_no) {
+    _journal_dirty_block(structures->fsfd, structures->master_block_pointer->data_start_block + block_no);
+}
+
+/**
+ * Zapamiętuje zmianę wskaźnika następnego bloku po bloku danych block_no (blok danych lub blok tablicy wskaźników).
+ */
+void _journal_dirty_link(initialized_structures * structures, unsigned long block_no) {
+    master_block * mb = structures->master_block_pointer;
+    if (mb->number_of_link_table_blocks == 0) {
+        _journal_dirty_data_block(structures, block_no);
+        return;
+    }
+    _journal_dirty_block(structures->fsfd, mb->first_link_table_block + block_no * sizeof(unsigned long) / mb->block_size);
+}
+
+/**
+ * Zapamiętuje zapis bloku danych przez bieżącą operację wątku (tryb JOURNAL_ORDERED) - transakcja z jej metadanymi
+ * zostanie zapisana dopiero po utrwaleniu danych.
+ */
+void _journal_ordered_data(mounted_fs * mounted) {
+    _journal_operation(mounted->fsfd)->ordered_data_writes++;
+}
+
+/**
+ * Bariera trybu JOURNAL_ORDERED przed ustawieniem nowego rozmiaru pliku - i-węzeł leży we wspólnym mapowaniu, które
+ * host może zapisać na dysk jeszcze przed barierą transakcji, więc dane zapisu muszą zostać utrwalone wcześniej.
+ */
+void _journal_ordered_barrier(mounted_fs * mounted) {
+    _cache_flush(mounted);
+    fdatasync(mounted->fsfd);
+}
+
+/**
+ * Kończy operację zmieniającą metadane - jej bloki trafiają do otwartej transakcji, a w trybie JOURNAL_GROUP_COMMIT
+ * funkcja czeka na trwały zapis tej transakcji. Wywoływana po zwolnieniu blokad systemu plików.
+ */
+void _journal_end_operation(int fsfd) {
+    journal_operation * operation = &current_journal_operation;
+    if (operation->fsfd != fsfd || (operation->number_of_blocks == 0 && operation->ordered_data_writes == 0)) {
+        return;
+    }
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    if (mounted == NULL || mounted->journal.mode == JOURNAL_NONE) {
+        operation->number_of_blocks = 0;
+        operation->ordered_data_writes = 0;
+        return;
+    }
+    unsigned long sequence = _journal_submit(mounted, operation);
+    if ((mounted->journal.mode & ~JOURNAL_ORDERED) == JOURNAL_GROUP_COMMIT) {
+        _journal_commit(mounted, sequence);
+    }
+}
+
+/**
+ * Mapuje nagłówek dziennika zamontowanego systemu plików (jeśli obraz ma dziennik).
+ */
+void _journal_attach(mounted_fs * mounted) {
+    master_block * mb = mounted->master_block_pointer;
+    mounted->journal.mode = JOURNAL_NONE;
+    mounted->journal.header = NULL;
+    pthread_mutex_init(&mounted->journal.pending_mutex, NULL);
+    pthread_mutex_init(&mounted->journal.commit_mutex, NULL);
+    if (mb->number_of_journal_blocks == 0) {
+        return;
+    }
+    journal_header * header = (journal_header *) mmap_enhanced(NULL, sizeof(journal_header), PROT_READ | PROT_WRITE,
+                                                               MAP_SHARED, mounted->fsfd,
+                                                               mb->journal_start_block * mb->block_size,
+                                                               &mounted->journal.header_delta);
+    if ((void *) header == MAP_FAILED + mounted->journal.header_delta) {
+        return;
+    }
+    if (header->magic != JOURNAL_HEADER_MAGIC) {
+        munmap_enhanced(header, sizeof(journal_header), mounted->journal.header_delta);
+        return;
+    }
+    mounted->journal.header = header;
+}
+
+/**
+ * Zapisuje otwartą transakcję i zwalnia stan dziennika przy odmontowaniu.
+ */
+void _journal_detach(mounted_fs * mounted) {
+    if (mounted->journal.header != NULL) {
+        if (mounted->journal.mode != JOURNAL_NONE) {
+            _journal_end_operation(mounted->fsfd);
+            _journal_commit(mounted, mounted->journal.header->next_sequence);
+        }
+        munmap_enhanced(mounted->journal.header, sizeof(journal_header), mounted->journal.header_delta);
+    }
+    pthread_mutex_destroy(&mounted->journal.pending_mutex);
+    pthread_mutex_destroy(&mounted->journal.commit_mutex);
+}
+
+/**
+ * Blokuje first free block (ekskluzywnie).
+ *
+ * @param fsfd deksryptor systemu plików
+ * @param fl niewypełniona struktura flock
+ */
+int _block_first_free_block(int fsfd, struct flock * fl) {
+    /* F_RDLCK, F_WRLCK, F_UNLCK    */
+    fl->l_type = F_WRLCK;
+    /* SEEK_SET, SEEK_CUR, SEEK_END */
+    fl->l_whence = SEEK_SET;
+    fl->l_start = 32;
+    fl->l_len = 8;
+    fl->l_pid = getpid();
+    return fcntl(fsfd, F_SETLKW, fl);
+}
+
+/**
+ * Odblokowuje first free block (ekskluzywnie).
+ *
+ * @param fd deksryptor systemu plików
+ * @param fl niewypełniona struktura flock
+ */
+int _unblock_first_free_block(int fsfd, struct flock * fl) {
+    fl->l_type = F_UNLCK;
+    return fcntl(fsfd, F_SETLK, fl);
+}
+
+unsigned long _reclaim_orphan_blocks(initialized_structures * structures, int fsfd, unsigned long number_of_blocks);
+void _release_orphan_inodes(initialized_structures * structures);
+int _fragment_fits(master_block * master_block_pointer, inode * file_inode, unsigned long end);
+int _fragment_store(initialized_structures * structures, file * file_pointer, inode * file_inode,
+                    unsigned long position, char * data, unsigned long length);
+int _fragment_unpack(initialized_structures * structures, file * file_pointer, inode * file_inode);
+
+/**
+ * Liczba wolnych bloków, które nie są zarezerwowane przez opóźniony przydział.
+ */
+unsigned long _available_blocks(master_block * master_block_pointer) {
+    if (master_block_pointer->number_of_free_blocks <= master_block_pointer->number_of_reserved_blocks) {
+        return 0;
+    }
+    return master_block_pointer->number_of_free_blocks - master_block_pointer->number_of_reserved_blocks;
+}
+
+/**
+ * Przesuwa first_free_block_number na najbliższy wolny blok (od bieżącego, po końcu bitmapy od początku) - przegląda
+ * bitmapę najwyżej raz, pomijając pełne bajty. Blok 0 należy do pliku .lock.
+ * @return TRUE, jeśli znaleziono wolny blok
+ */
+int _seek_free_block(master_block * master_block_pointer, unsigned char * bitmap) {
+    unsigned long block_no = master_block_pointer->first_free_block_number;
+    unsigned long checked = 0;
+    while (checked < master_block_pointer->number_of_blocks) {
+        if (block_no == 0 || block_no >= master_block_pointer->number_of_blocks) {
+            block_no = 1;
+        }
+        if (bitmap[block_no / 8] == 0xFF) {
+            checked += 8 - block_no % 8;
+            block_no = (block_no | 7) + 1;
+        } else if (bitmap[block_no / 8] & (1 << (block_no % 8))) {
+            checked++;
+            block_no++;
+        } else {
+            master_block_pointer->first_free_block_number = block_no;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * Wyszukuje dostępne wolne bloki, nie jest cross-process-safe. Zwraca pierwszy przetwarzany number bloku dla pliku lub
+ * jaroslaw_błąd (NO_FREE_BLOCKS).
+ *
+ * @param initialized_structures_pointer wskaźnik na zainicjalizowane struktury systemu plików
+ * @param number_of_free_blocks liczba wolnych bloków do wyszukania
+ * @param free_blocks tablica, gdzie zostaną zapisane identyfikatory znalezionych bloków
+ */
+long _find_free_blocks(int fsfd, initialized_structures * initialized_structures_pointer, unsigned long number_of_free_blocks,
+                      unsigned long * free_blocks) {
+    DEBUG("In _find_free_blocks. free blocks = %d\n", number_of_free_blocks);
+    master_block * master_block = initialized_structures_pointer->master_block_pointer;
+    if (_available_blocks(master_block) <= number_of_free_blocks) {
+        // brakujące miejsce mogą zajmować bloki usuniętych plików
+        _reclaim_orphan_blocks(initialized_structures_pointer, fsfd,
+                               number_of_free_blocks + 1 - _available_blocks(master_block));
+    }
+    if (_available_blocks(master_block) <= number_of_free_blocks) {
+        return NO_FREE_BLOCKS;
+    }
+    unsigned char * block_bitmap_pointer = (unsigned char *) initialized_structures_pointer->block_bitmap_pointer;
+    DEBUG("block bitmap pointer = %X\n", block_bitmap_pointer);
+
+    unsigned long free_block_idx = 0;
+    for (free_block_idx; free_block_idx < number_of_free_blocks; free_block_idx++) {
+        DEBUG("przebieg petli: %d\n", free_block_idx );
+        if (!_seek_free_block(master_block, block_bitmap_pointer)) {
+            // licznik wolnych bloków nie zgadza się z bitmapą - wycofanie już zajętych bloków
+            while (free_block_idx-- > 0) {
+                block_bitmap_pointer[free_blocks[free_block_idx] / 8] &= ~(1 << (free_blocks[free_block_idx] % 8));
+                master_block->number_of_free_blocks++;
+            }
+            return NO_FREE_BLOCKS;
+        }
+        // zaznaczenie bloku jako zajętego i zapisanie jego numeru do tablicy
+        unsigned long block_no = master_block->first_free_block_number;
+        block_bitmap_pointer[block_no / 8] |= 1 << (block_no % 8);
+        free_blocks[free_block_idx] = block_no;
+        master_block->number_of_free_blocks--;
+        DEBUG("master_block->number_of_free_blocks = %d\n", master_block->number_of_free_blocks);
+        master_block->first_free_block_number = block_no + 1 < master_block->number_of_blocks ? block_no + 1 : 1;
+    }
+    DEBUG("wyjscie z find free blocks!\n");
+    _journal_dirty_master_block(initialized_structures_pointer);
+    for (free_block_idx = 0; free_block_idx < number_of_free_blocks; free_block_idx++) {
+        _journal_dirty_bitmap(initialized_structures_pointer, free_blocks[free_block_idx]);
+    }
+    return number_of_free_blocks > 0 ? (long) free_blocks[0] : (long) master_block->first_free_block_number;
+}
+
+/**
+ * Pobiera strukturę pliku na podstawie podanego identyfikatora pliku.
+ */
+file * _get_file_by_fd(int fd) {
+    file* file_found;
+    // simplefs_open i simplefs_close innych wątków zmieniają tablicę deskryptorów
+    pthread_mutex_lock(&open_files_write_mutex);
+    HASH_FIND_INT( open_files, &fd, file_found);
+    pthread_mutex_unlock(&open_files_write_mutex);
+    DEBUG("Found file. mode = %d\n", file_found->mode);
+    return file_found;
+}
+
+/**
+ * Ładuje i-node dla podanej struktury pliku.
+ */
+inode * _load_inode_from_file_structure(initialized_structures * initialized_structures_pointer, file * file_pointer) {
+    if (file_pointer == NULL) {
+        return NULL;
+    }
+    return initialized_structures_pointer->inode_table + file_pointer->inode_no;
+}
+
+/**
+ * Zapamiętuje w strukturze file ostatnio używany blok pliku, tak aby kolejna operacja na deskryptorze nie musiała
+ * przechodzić łańcucha bloków od początku.
+ */
+void _set_file_cursor(file * file_pointer, inode * file_inode, unsigned long block_index, unsigned long block_no) {
+    file_pointer->cursor_block_index = block_index;
+    file_pointer->cursor_block_no = block_no;
+    file_pointer->cursor_generation = file_inode->generation;
+}
+
+/**
+ * Sprawdza, czy od kursora deskryptora można dojść do bloku o zadanym indeksie. Kursor traci ważność, gdy łańcuch
+ * bloków pliku został zmieniony inaczej niż przez dopisanie bloków na końcu (np. przez inny proces).
+ */
+int _is_file_cursor_usable(file * file_pointer, inode * file_inode, unsigned long block_index) {
+    return file_pointer->cursor_block_no != 0 && file_pointer->cursor_generation == file_inode->generation
+           && file_pointer->cursor_block_index <= block_index;
+}
+
+/**
+ * Przechodzi do następnego bloku w łańcuchu pliku.
+ * @param block_no numer bieżącego bloku, zastępowany numerem następnego (0 = koniec łańcucha)
+ * @return o ile rośnie indeks logiczny (1 + długość dziury przed następnym blokiem)
+ */
+unsigned long _next_file_block(int fsfd, master_block * master_block_pointer, unsigned long * block_no) {
+    unsigned long link = _get_block_link(fsfd, master_block_pointer, *block_no);
+    *block_no = BLOCK_LINK_NUMBER(link);
+    return 1 + BLOCK_LINK_HOLE(link);
+}
+
+/**
+ * Zapamiętuje w inodzie ostatni blok łańcucha (0 = łańcuch pusty lub ostatni blok nieznany). Numer bloku jest
+ * zerowany na czas zmiany, więc równoczesny czytelnik (_get_file_tail) nie połączy nowego bloku ze starym indeksem.
+ */
+void _set_file_tail(inode * file_inode, unsigned long block_no, unsigned long block_index) {
+    if (file_inode->last_data_block == block_no && file_inode->last_block_index == block_index) {
+        return;
+    }
+    file_inode->last_data_block = 0;
+    __sync_synchronize();
+    file_inode->last_block_index = block_index;
+    __sync_synchronize();
+    file_inode->last_data_block = block_no;
+}
+
+/**
+ * Odczytuje ostatni blok łańcucha zapamiętany w inodzie.
+ * @param block_index parametr wyjściowy - indeks logiczny ostatniego bloku
+ * @return numer ostatniego bloku, 0 = nieznany (trzeba przejść łańcuch)
+ */
+unsigned long _get_file_tail(inode * file_inode, unsigned long * block_index) {
+    unsigned long block_no = file_inode->last_data_block;
+    __sync_synchronize();
+    *block_index = file_inode->last_block_index;
+    __sync_synchronize();
+    return file_inode->last_data_block == block_no ? block_no : 0;
+}
+
+/**
+ * Zapamiętuje w inodzie korzeń mapy bloków i liczbę jej poziomów. Korzeń jest zerowany na czas zmiany, więc równoczesny
+ * czytelnik (_get_block_map) nie połączy nowego korzenia ze starą liczbą poziomów.
+ */
+void _set_block_map(inode * file_inode, unsigned long node, unsigned levels) {
+    file_inode->block_map = 0;
+    __sync_synchronize();
+    file_inode->block_map_levels = levels;
+    __sync_synchronize();
+    file_inode->block_map = node;
+}
+
+/**
+ * Odczytuje korzeń mapy bloków zapamiętany w inodzie.
+ * @param levels parametr wyjściowy - liczba poziomów mapy
+ * @return numer bloku korzenia, 0 = mapa pusta lub w trakcie zmiany (trzeba przejść łańcuch)
+ */
+unsigned long _get_block_map(inode * file_inode, unsigned * levels) {
+    unsigned long node = file_inode->block_map;
+    __sync_synchronize();
+    *levels = file_inode->block_map_levels;
+    __sync_synchronize();
+    return file_inode->block_map == node ? node : 0;
+}
+
+/**
+ * @return liczba indeksów logicznych obejmowanych przez mapę bloków o levels poziomach
+ */
+unsigned long _block_map_capacity(master_block * master_block_pointer, unsigned levels) {
+    unsigned long number_of_entries = master_block_pointer->block_size / sizeof(unsigned long);
+    unsigned long capacity = 1;
+    while (levels-- > 0) {
+        if (capacity > ~0UL / number_of_entries) {
+            // mapa obejmuje wszystkie indeksy
+            return ~0UL;
+        }
+        capacity *= number_of_entries;
+    }
+    return capacity;
+}
+
+/**
+ * Wyszukuje w poddrzewie mapy bloków (węzeł node obejmujący indeksy od base) najbliższy blok pliku o indeksie nie
+ * mniejszym (forward) lub nie większym (!forward) niż block_index. Puste poddrzewa są pomijane bez ich czytania.
+ * @param block_no parametr wyjściowy - numer znalezionego bloku, 0 = brak
+ * @return indeks logiczny znalezionego bloku
+ */
+unsigned long _block_map_search(int fsfd, master_block * master_block_pointer, unsigned long node, unsigned levels,
+                                unsigned long base, unsigned long block_index, int forward, unsigned long * block_no) {
+    long number_of_entries = master_block_pointer->block_size / sizeof(unsigned long);
+    unsigned long span = _block_map_capacity(master_block_pointer, levels - 1);
+    unsigned long * entries = (unsigned long *) _pool_alloc(master_block_pointer->block_size);
+    _read_from_block(fsfd, master_block_pointer->data_start_block + node, master_block_pointer->block_size, 0, entries,
+                     master_block_pointer->block_size);
+    long k;
+    if (block_index < base) {
+        k = 0;
+    } else if ((block_index - base) / span >= number_of_entries) {
+        k = number_of_entries - 1;
+    } else {
+        k = (block_index - base) / span;
+    }
+    unsigned long found_index = block_index;
+    *block_no = 0;
+    for (; *block_no == 0 && k >= 0 && k < number_of_entries; k += forward ? 1 : -1) {
+        if (entries[k] == 0) {
+            continue;
+        }
+        if (levels == 1) {
+            *block_no = entries[k];
+            found_index = base + k;
+        } else {
+            found_index = _block_map_search(fsfd, master_block_pointer, entries[k], levels - 1, base + k * span,
+                                            block_index, forward, block_no);
+        }
+    }
+    _pool_free(entries, master_block_pointer->block_size);
+    return found_index;
+}
+
+/**
+ * Wyszukuje w mapie bloków pliku najbliższy blok o indeksie nie mniejszym (forward) lub nie większym (!forward) niż
+ * block_index.
+ * @param block_no parametr wyjściowy - numer znalezionego bloku, 0 = brak
+ * @return indeks logiczny znalezionego bloku
+ */
+unsigned long _block_map_find(int fsfd, master_block * master_block_pointer, unsigned long node, unsigned levels,
+                              unsigned long block_index, int forward, unsigned long * block_no) {
+    unsigned long capacity = _block_map_capacity(master_block_pointer, levels);
+    *block_no = 0;
+    if (node == 0 || (forward && block_index >= capacity)) {
+        return block_index;
+    }
+    return _block_map_search(fsfd, master_block_pointer, node, levels, 0,
+                             block_index < capacity ? block_index : capacity - 1, forward, block_no);
+}
+
+/**
+ * Przydziela i zeruje nowy węzeł mapy bloków. Wywoływana z zablokowanym first free block.
+ * @return {OK} sukces, {NO_FREE_BLOCKS} brak miejsca
+ */
+int _block_map_new_node(initialized_structures * structures, int fsfd, unsigned long * node) {
+    master_block * master_block_pointer = structures->master_block_pointer;
+    if (_find_free_blocks(fsfd, structures, 1, node) == NO_FREE_BLOCKS) {
+        return NO_FREE_BLOCKS;
+    }
+    char * zeros = (char *) _pool_alloc(master_block_pointer->block_size);
+    memset(zeros, 0, master_block_pointer->block_size);
+    _write_to_block(fsfd, *node, master_block_pointer->data_start_block, master_block_pointer->block_size, 0, zeros,
+                    master_block_pointer->block_size);
+    _pool_free(zeros, master_block_pointer->block_size);
+    return OK;
+}
+
+/**
+ * Tworzy brakujące węzły poddrzewa mapy bloków (węzeł node obejmujący indeksy od base) na ścieżkach do indeksów
+ * [first_index, last_index].
+ */
+int _block_map_prepare_node(initialized_structures * structures, int fsfd, unsigned long node, unsigned levels,
+                            unsigned long base, unsigned long first_index, unsigned long last_index) {
+    if (levels == 1) {
+        return OK;
+    }
+    master_block * master_block_pointer = structures->master_block_pointer;
+    unsigned long number_of_entries = master_block_pointer->block_size / sizeof(unsigned long);
+    unsigned long span = _block_map_capacity(master_block_pointer, levels - 1);
+    unsigned long * entries = (unsigned long *) _pool_alloc(master_block_pointer->block_size);
+    _read_from_block(fsfd, master_block_pointer->data_start_block + node, master_block_pointer->block_size, 0, entries,
+                     master_block_pointer->block_size);
+    unsigned long k = first_index > base ? (first_index - base) / span : 0;
+    unsigned long last_k = (last_index - base) / span < number_of_entries ? (last_index - base) / span
+                                                                          : number_of_entries - 1;
+    int result = OK;
+    for (; k <= last_k && result == OK; k++) {
+        if (entries[k] == 0) {
+            result = _block_map_new_node(structures, fsfd, &entries[k]);
+            if (result != OK) {
+                break;
+            }
+            _write_to_block(fsfd, node, master_block_pointer->data_start_block, master_block_pointer->block_size,
+                            k * sizeof(unsigned long), &entries[k], sizeof(unsigned long));
+        }
+        result = _block_map_prepare_node(structures, fsfd, entries[k], levels - 1, base + k * span, first_index,
+                                         last_index);
+    }
+    _pool_free(entries, master_block_pointer->block_size);
+    return result;
+}
+
+/**
+ * Tworzy brakujące węzły mapy bloków pliku dla indeksów [first_index, last_index], dokładając mapie kolejne poziomy,
+ * jeśli ich nie obejmuje. Węzły przydzielane są po jednym i od razu dołączane do mapy - przy braku miejsca w mapie
+ * zostają puste węzły, zwalniane razem z nią. Wywoływana z zablokowanym first free block.
+ * @return {OK} sukces, {NO_FREE_BLOCKS} brak miejsca
+ */
+int _block_map_prepare(initialized_structures * structures, int fsfd, inode * file_inode, unsigned long first_index,
+                       unsigned long last_index) {
+    master_block * master_block_pointer = structures->master_block_pointer;
+    while (file_inode->block_map == 0
+           || last_index >= _block_map_capacity(master_block_pointer, file_inode->block_map_levels)) {
+        unsigned long node;
+        if (_block_map_new_node(structures, fsfd, &node) != OK) {
+            return NO_FREE_BLOCKS;
+        }
+        if (file_inode->block_map == 0) {
+            _set_block_map(file_inode, node, 1);
+        } else {
+            // dotychczasowa mapa staje się pierwszym poddrzewem nowego korzenia
+            _write_to_block(fsfd, node, master_block_pointer->data_start_block, master_block_pointer->block_size, 0,
+                            &file_inode->block_map, sizeof(unsigned long));
+            _set_block_map(file_inode, node, file_inode->block_map_levels + 1);
+        }
+    }
+    return _block_map_prepare_node(structures, fsfd, file_inode->block_map, file_inode->block_map_levels, 0,
+                                   first_index, last_index);
+}
+
+/**
+ * Zapisuje w mapie bloków pliku numer bloku o indeksie block_index - węzły na ścieżce muszą istnieć
+ * (_block_map_prepare).
+ */
+void _block_map_set(int fsfd, master_block * master_block_pointer, inode * file_inode, unsigned long block_index,
+                    unsigned long block_no) {
+    unsigned long node = file_inode->block_map;
+    unsigned levels = file_inode->block_map_levels;
+    while (levels > 1) {
+        unsigned long span = _block_map_capacity(master_block_pointer, --levels);
+        _read_from_block(fsfd, master_block_pointer->data_start_block + node, master_block_pointer->block_size,
+                         block_index / span * sizeof(unsigned long), &node, sizeof(unsigned long));
+        block_index %= span;
+    }
+    _write_to_block(fsfd, node, master_block_pointer->data_start_block, master_block_pointer->block_size,
+                    block_index * sizeof(unsigned long), &block_no, sizeof(unsigned long));
+}
+
+/**
+ * Dopisuje numer bloku do powiększanej tablicy bloków.
+ */
+void _block_list_add(unsigned long ** blocks_table, unsigned long * number_of_blocks, unsigned long * blocks_table_size,
+                     unsigned long block_no) {
+    if (*number_of_blocks == *blocks_table_size) {
+        *blocks_table_size *= 2;
+        *blocks_table = (unsigned long *) realloc(*blocks_table, sizeof(unsigned long) * *blocks_table_size);
+    }
+    (*blocks_table)[(*number_of_blocks)++] = block_no;
+}
+
+/**
+ * Dopisuje do tablicy bloków węzły poddrzewa mapy bloków (bez bloków danych, na które wskazują liście).
+ */
+void _block_map_collect(int fsfd, master_block * master_block_pointer, unsigned long node, unsigned levels,
+                        unsigned long ** blocks_table, unsigned long * number_of_blocks,
+                        unsigned long * blocks_table_size) {
+    _block_list_add(blocks_table, number_of_blocks, blocks_table_size, node);
+    if (levels == 1) {
+        return;
+    }
+    unsigned long number_of_entries = master_block_pointer->block_size / sizeof(unsigned long);
+    unsigned long * entries = (unsigned long *) _pool_alloc(master_block_pointer->block_size);
+    _read_from_block(fsfd, master_block_pointer->data_start_block + node, master_block_pointer->block_size, 0, entries,
+                     master_block_pointer->block_size);
+    unsigned long k;
+    for (k = 0; k < number_of_entries; k++) {
+        if (entries[k] != 0) {
+            _block_map_collect(fsfd, master_block_pointer, entries[k], levels - 1, blocks_table, number_of_blocks,
+                               blocks_table_size);
+        }
+    }
+    _pool_free(entries, master_block_pointer->block_size);
+}
+
+/**
+ * Usuwa z poddrzewa mapy bloków (węzeł node obejmujący indeksy od base) wpisy o indeksach >= first_index.
+ */
+void _block_map_truncate_node(int fsfd, master_block * master_block_pointer, unsigned long node, unsigned levels,
+                              unsigned long base, unsigned long first_index, unsigned long ** blocks_table,
+                              unsigned long * number_of_blocks, unsigned long * blocks_table_size) {
+    unsigned long number_of_entries = master_block_pointer->block_size / sizeof(unsigned long);
+    unsigned long span = _block_map_capacity(master_block_pointer, levels - 1);
+    unsigned long * entries = (unsigned long *) _pool_alloc(master_block_pointer->block_size);
+    _read_from_block(fsfd, master_block_pointer->data_start_block + node, master_block_pointer->block_size, 0, entries,
+                     master_block_pointer->block_size);
+    int changed = FALSE;
+    unsigned long k;
+    for (k = 0; k < number_of_entries; k++) {
+        if (entries[k] == 0) {
+            continue;
+        }
+        if (base + k * span >= first_index) {
+            if (levels > 1) {
+                _block_map_collect(fsfd, master_block_pointer, entries[k], levels - 1, blocks_table, number_of_blocks,
+                                   blocks_table_size);
+            }
+            entries[k] = 0;
+            changed = TRUE;
+        } else if (levels > 1 && base + (k + 1) * span > first_index) {
+            _block_map_truncate_node(fsfd, master_block_pointer, entries[k], levels - 1, base + k * span, first_index,
+                                     blocks_table, number_of_blocks, blocks_table_size);
+        }
+    }
+    if (changed) {
+        _write_to_block(fsfd, node, master_block_pointer->data_start_block, master_block_pointer->block_size, 0, entries,
+                        master_block_pointer->block_size);
+    }
+    _pool_free(entries, master_block_pointer->block_size);
+}
+
+/**
+ * Usuwa z mapy bloków pliku wpisy o indeksach >= first_index. Węzły obejmujące wyłącznie takie indeksy są odłączane
+ * i dopisywane do tablicy bloków do zwolnienia - bloki danych zwalniane są osobno, z łańcucha.
+ * Wywoływana z zablokowanym first free block.
+ */
+void _block_map_release(int fsfd, master_block * master_block_pointer, inode * file_inode, unsigned long first_index,
+                        unsigned long ** blocks_table, unsigned long * number_of_blocks,
+                        unsigned long * blocks_table_size) {
+    if (file_inode->block_map == 0
+        || first_index >= _block_map_capacity(master_block_pointer, file_inode->block_map_levels)) {
+        return;
+    }
+    if (first_index == 0) {
+        _block_map_collect(fsfd, master_block_pointer, file_inode->block_map, file_inode->block_map_levels,
+                           blocks_table, number_of_blocks, blocks_table_size);
+        _set_block_map(file_inode, 0, 0);
+        return;
+    }
+    _block_map_truncate_node(fsfd, master_block_pointer, file_inode->block_map, file_inode->block_map_levels, 0,
+                             first_index, blocks_table, number_of_blocks, blocks_table_size);
+}
+
+void _free_data_blocks(initialized_structures* structures, unsigned long * blocks, unsigned long number_of_blocks);
+
+/**
+ * @return indeks logiczny wpisu number węzła B+drzewa ekstentów
+ */
+unsigned long _extent_key(extent_node * header, long number) {
+    if (header->level == 0) {
+        return ((extent *) (header + 1))[number].logical_block;
+    }
+    return ((extent_index *) (header + 1))[number].logical_block;
+}
+
+/**
+ * Wyszukiwanie binarne w węźle B+drzewa ekstentów.
+ * @return numer ostatniego wpisu o indeksie logicznym nie większym niż block_index, -1 = brak
+ */
+long _extent_position(extent_node * header, unsigned long block_index) {
+    long low = 0, high = (long) header->number_of_entries - 1, position = -1;
+    while (low <= high) {
+        long middle = (low + high) / 2;
+        if (_extent_key(header, middle) <= block_index) {
+            position = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return position;
+}
+
+/**
+ * Wyszukuje w poddrzewie B+drzewa ekstentów blok pliku o indeksie block_index, a jeśli jest on dziurą - najbliższy
+ * blok o indeksie większym (forward) lub mniejszym (!forward).
+ * @param block_no parametr wyjściowy - numer znalezionego bloku, 0 = brak
+ * @return indeks logiczny znalezionego bloku
+ */
+unsigned long _extent_search(int fsfd, master_block * master_block_pointer, unsigned long node,
+                             unsigned long block_index, int forward, unsigned long * block_no) {
+    extent_node * header = (extent_node *) _pool_alloc(master_block_pointer->block_size);
+    _read_from_block(fsfd, master_block_pointer->data_start_block + node, master_block_pointer->block_size, 0, header,
+                     master_block_pointer->block_size);
+    long number_of_entries = header->number_of_entries;
+    long k = _extent_position(header, block_index);
+    unsigned long found_index = block_index;
+    *block_no = 0;
+    if (header->level == 0) {
+        extent * entries = (extent *) (header + 1);
+        if (k >= 0 && block_index < entries[k].logical_block + entries[k].length) {
+            *block_no = entries[k].physical_block + block_index - entries[k].logical_block;
+        } else if (forward && k + 1 < number_of_entries) {
+            *block_no = entries[k + 1].physical_block;
+            found_index = entries[k + 1].logical_block;
+        } else if (!forward && k >= 0) {
+            *block_no = entries[k].physical_block + entries[k].length - 1;
+            found_index = entries[k].logical_block + entries[k].length - 1;
+        }
+    } else {
+        extent_index * entries = (extent_index *) (header + 1);
+        for (k = k < 0 ? 0 : k; *block_no == 0 && k >= 0 && k < number_of_entries; k += forward ? 1 : -1) {
+            found_index = _extent_search(fsfd, master_block_pointer, entries[k].node, block_index, forward, block_no);
+        }
+    }
+    _pool_free(header, master_block_pointer->block_size);
+    return found_index;
+}
+
+/**
+ * Liczy węzły, które trzeba przydzielić na podziały przy wstawianiu ekstentu o indeksie block_index - pełne węzły
+ * na ścieżce od liścia w górę.
+ */
+unsigned long _extent_nodes_needed(int fsfd, master_block * master_block_pointer, unsigned long node,
+                                   unsigned long block_index) {
+    extent_node * header = (extent_node *) _pool_alloc(master_block_pointer->block_size);
+    _read_from_block(fsfd, master_block_pointer->data_start_block + node, master_block_pointer->block_size, 0, header,
+                     master_block_pointer->block_size);
+    unsigned long nodes_needed = 0;
+    int full = header->number_of_entries >= EXTENT_NODE_ENTRIES(master_block_pointer->block_size, header->level);
+    if (header->level > 0) {
+        long k = _extent_position(header, block_index);
+        nodes_needed = _extent_nodes_needed(fsfd, master_block_pointer,
+                                            ((extent_index *) (header + 1))[k < 0 ? 0 : k].node, block_index);
+        // wpis dokłada temu węzłowi tylko podział dziecka
+        full = full && nodes_needed > 0;
+    }
+    _pool_free(header, master_block_pointer->block_size);
+    return full ? nodes_needed + 1 : nodes_needed;
+}
+
+/**
+ * Wstawia ekstent do poddrzewa B+drzewa ekstentów, łącząc go z przylegającymi ekstentami tego samego liścia.
+ * Przepełniony węzeł dzielony jest na pół, prawa połowa trafia do węzła z puli new_nodes.
+ * @param split parametr wyjściowy - wpis prawej połowy do wstawienia w węźle nadrzędnym
+ * @return TRUE, jeśli węzeł został podzielony
+ */
+int _extent_insert_node(int fsfd, master_block * master_block_pointer, unsigned long node, extent * new_extent,
+                        unsigned long * new_nodes, unsigned long * number_of_new_nodes, extent_index * split) {
+    unsigned long block_size = master_block_pointer->block_size;
+    // miejsce na jeden wpis ponad pojemność węzła
+    extent_node * header = (extent_node *) _pool_alloc(2 * block_size);
+    _read_from_block(fsfd, master_block_pointer->data_start_block + node, block_size, 0, header, block_size);
+    long number_of_entries = header->number_of_entries;
+    long k = _extent_position(header, new_extent->logical_block);
+    unsigned long entry_size;
+    if (header->level > 0) {
+        extent_index * entries = (extent_index *) (header + 1);
+        entry_size = sizeof(extent_index);
+        k = k < 0 ? 0 : k;
+        extent_index child_split;
+        if (!_extent_insert_node(fsfd, master_block_pointer, entries[k].node, new_extent, new_nodes,
+                                 number_of_new_nodes, &child_split)) {
+            _pool_free(header, 2 * block_size);
+            return FALSE;
+        }
+        memmove(entries + k + 2, entries + k + 1, (number_of_entries - k - 1) * entry_size);
+        entries[k + 1] = child_split;
+        number_of_entries++;
+    } else {
+        extent * entries = (extent *) (header + 1);
+        entry_size = sizeof(extent);
+        if (k >= 0 && entries[k].logical_block + entries[k].length == new_extent->logical_block
+            && entries[k].physical_block + entries[k].length == new_extent->physical_block) {
+            entries[k].length += new_extent->length;
+        } else {
+            k++;
+            memmove(entries + k + 1, entries + k, (number_of_entries - k) * entry_size);
+            entries[k] = *new_extent;
+            number_of_entries++;
+        }
+        if (k + 1 < number_of_entries && entries[k].logical_block + entries[k].length == entries[k + 1].logical_block
+            && entries[k].physical_block + entries[k].length == entries[k + 1].physical_block) {
+            entries[k].length += entries[k + 1].length;
+            memmove(entries + k + 1, entries + k + 2, (number_of_entries - k - 2) * entry_size);
+            number_of_entries--;
+        }
+    }
+    header->number_of_entries = number_of_entries;
+    int is_split = number_of_entries > EXTENT_NODE_ENTRIES(block_size, header->level);
+    if (is_split) {
+        extent_node * right = (extent_node *) _pool_alloc(block_size);
+        memset(right, 0, block_size);
+        right->level = header->level;
+        right->number_of_entries = number_of_entries - number_of_entries / 2;
+        header->number_of_entries = number_of_entries / 2;
+        memcpy(right + 1, (char *) (header + 1) + header->number_of_entries * entry_size,
+               right->number_of_entries * entry_size);
+        split->logical_block = _extent_key(right, 0);
+        split->node = new_nodes[--(*number_of_new_nodes)];
+        _write_to_block(fsfd, split->node, master_block_pointer->data_start_block, block_size, 0, right, block_size);
+        _pool_free(right, block_size);
+    }
+    _write_to_block(fsfd, node, master_block_pointer->data_start_block, block_size, 0, header, block_size);
+    _pool_free(header, 2 * block_size);
+    return is_split;
+}
+
+/**
+ * Dopisuje do tablicy bloków węzły poddrzewa B+drzewa ekstentów.
+ */
+void _extent_collect(int fsfd, master_block * master_block_pointer, unsigned long node, unsigned long ** blocks_table,
+                     unsigned long * number_of_blocks, unsigned long * blocks_table_size) {
+    _block_list_add(blocks_table, number_of_blocks, blocks_table_size, node);
+    extent_node * header = (extent_node *) _pool_alloc(master_block_pointer->block_size);
+    _read_from_block(fsfd, master_block_pointer->data_start_block + node, master_block_pointer->block_size, 0, header,
+                     master_block_pointer->block_size);
+    unsigned long k;
+    for (k = 0; header->level > 0 && k < header->number_of_entries; k++) {
+        _extent_collect(fsfd, master_block_pointer, ((extent_index *) (header + 1))[k].node, blocks_table,
+                        number_of_blocks, blocks_table_size);
+    }
+    _pool_free(header, master_block_pointer->block_size);
+}
+
+/**
+ * Porzuca B+drzewo ekstentów pliku i zwalnia jego węzły - pliki FILE_LAYOUT_EXTENTS bez drzewa wyszukują bloki
+ * w łańcuchu, a drzewo odbudowywane jest przy następnym przydziale (_extent_rebuild).
+ * Wywoływana z zablokowanym first free block.
+ */
+void _extent_discard(initialized_structures * structures, int fsfd, inode * file_inode) {
+    if (file_inode->block_map == 0) {
+        return;
+    }
+    unsigned long number_of_blocks = 0;
+    unsigned long blocks_table_size = 64;
+    unsigned long * blocks_table = (unsigned long *) malloc(sizeof(unsigned long) * blocks_table_size);
+    _extent_collect(fsfd, structures->master_block_pointer, file_inode->block_map, &blocks_table, &number_of_blocks,
+                    &blocks_table_size);
+    _set_block_map(file_inode, 0, 0);
+    _free_data_blocks(structures, blocks_table, number_of_blocks);
+    free(blocks_table);
+}
+
+/**
+ * Wstawia ekstent do B+drzewa ekstentów pliku. Węzły potrzebne na podziały przydzielane są przed zmianą drzewa, więc
+ * przy braku miejsca drzewo pozostaje niezmienione. Wywoływana z zablokowanym first free block.
+ * @return {OK} sukces, {NO_FREE_BLOCKS} brak miejsca
+ */
+int _extent_insert(initialized_structures * structures, int fsfd, inode * file_inode, extent * new_extent) {
+    master_block * master_block_pointer = structures->master_block_pointer;
+    unsigned long block_size = master_block_pointer->block_size;
+    unsigned long new_nodes_size = sizeof(unsigned long) * (file_inode->block_map_levels + 1);
+    unsigned long * new_nodes = (unsigned long *) _pool_alloc(new_nodes_size);
+    unsigned long number_of_new_nodes = file_inode->block_map == 0 ? 1
+            : _extent_nodes_needed(fsfd, master_block_pointer, file_inode->block_map, new_extent->logical_block);
+    if (file_inode->block_map != 0 && number_of_new_nodes == file_inode->block_map_levels) {
+        // podział korzenia - nowy korzeń
+        number_of_new_nodes++;
+    }
+    if (number_of_new_nodes > 0
+        && _find_free_blocks(fsfd, structures, number_of_new_nodes, new_nodes) == NO_FREE_BLOCKS) {
+        _pool_free(new_nodes, new_nodes_size);
+        return NO_FREE_BLOCKS;
+    }
+    extent_node * header = (extent_node *) _pool_alloc(block_size);
+    memset(header, 0, block_size);
+    extent_index split;
+    if (file_inode->block_map == 0) {
+        header->number_of_entries = 1;
+        *(extent *) (header + 1) = *new_extent;
+        _write_to_block(fsfd, new_nodes[0], master_block_pointer->data_start_block, block_size, 0, header, block_size);
+        _set_block_map(file_inode, new_nodes[0], 1);
+        number_of_new_nodes = 0;
+    } else if (_extent_insert_node(fsfd, master_block_pointer, file_inode->block_map, new_extent, new_nodes,
+                                   &number_of_new_nodes, &split)) {
+        // podzielony korzeń - drzewo rośnie o poziom
+        extent_index * entries = (extent_index *) (header + 1);
+        header->number_of_entries = 2;
+        header->level = file_inode->block_map_levels;
+        entries[0].logical_block = 0;
+        entries[0].node = file_inode->block_map;
+        entries[1] = split;
+        _write_to_block(fsfd, new_nodes[0], master_block_pointer->data_start_block, block_size, 0, header, block_size);
+        _set_block_map(file_inode, new_nodes[0], file_inode->block_map_levels + 1);
+        number_of_new_nodes = 0;
+    }
+    // ekstent połączony z sąsiednim nie dzieli pełnego węzła
+    _free_data_blocks(structures, new_nodes, number_of_new_nodes);
+    _pool_free(new_nodes, new_nodes_size);
+    _pool_free(header, block_size);
+    return OK;
+}
+
+/**
+ * Odbudowuje B+drzewo ekstentów pliku z łańcucha bloków (po porzuceniu drzewa przy braku miejsca).
+ * Wywoływana z zablokowanym first free block.
+ */
+void _extent_rebuild(initialized_structures * structures, int fsfd, inode * file_inode) {
+    master_block * master_block_pointer = structures->master_block_pointer;
+    unsigned long block_no = BLOCK_LINK_NUMBER(file_inode->first_data_block);
+    unsigned long block_index = BLOCK_LINK_HOLE(file_inode->first_data_block);
+    extent current = {block_index, block_no, 0};
+    while (block_no != 0) {
+        if (current.logical_block + current.length != block_index || current.physical_block + current.length != block_no) {
+            if (_extent_insert(structures, fsfd, file_inode, &current) != OK) {
+                _extent_discard(structures, fsfd, file_inode);
+                return;
+            }
+            current.logical_block = block_index;
+            current.physical_block = block_no;
+            current.length = 0;
+        }
+        current.length++;
+        block_index += _next_file_block(fsfd, master_block_pointer, &block_no);
+    }
+    if (current.length > 0 && _extent_insert(structures, fsfd, file_inode, &current) != OK) {
+        _extent_discard(structures, fsfd, file_inode);
+    }
+}
+
+/**
+ * Usuwa z poddrzewa B+drzewa ekstentów indeksy >= first_index - ekstent obejmujący first_index jest przycinany,
+ * poddrzewa, które zostały puste, dopisywane są do tablicy bloków do zwolnienia.
+ * @return liczba wpisów, które pozostały w węźle
+ */
+unsigned long _extent_truncate_node(int fsfd, master_block * master_block_pointer, unsigned long node,
+                                    unsigned long first_index, unsigned long ** blocks_table,
+                                    unsigned long * number_of_blocks, unsigned long * blocks_table_size) {
+    unsigned long block_size = master_block_pointer->block_size;
+    extent_node * header = (extent_node *) _pool_alloc(block_size);
+    _read_from_block(fsfd, master_block_pointer->data_start_block + node, block_size, 0, header, block_size);
+    long k = _extent_position(header, first_index - 1);
+    unsigned long number_of_entries = header->number_of_entries;
+    if (header->level == 0) {
+        extent * entries = (extent *) (header + 1);
+        if (k >= 0 && entries[k].logical_block + entries[k].length > first_index) {
+            entries[k].length = first_index - entries[k].logical_block;
+        }
+        header->number_of_entries = k + 1;
+    } else {
+        extent_index * entries = (extent_index *) (header + 1);
+        unsigned long i;
+        k = k < 0 ? 0 : k;
+        for (i = k + 1; i < number_of_entries; i++) {
+            _extent_collect(fsfd, master_block_pointer, entries[i].node, blocks_table, number_of_blocks,
+                            blocks_table_size);
+        }
+        header->number_of_entries = k + 1;
+        if (_extent_truncate_node(fsfd, master_block_pointer, entries[k].node, first_index, blocks_table,
+                                  number_of_blocks, blocks_table_size) == 0) {
+            _block_list_add(blocks_table, number_of_blocks, blocks_table_size, entries[k].node);
+            header->number_of_entries = k;
+        }
+    }
+    _write_to_block(fsfd, node, master_block_pointer->data_start_block, block_size, 0, header, block_size);
+    number_of_entries = header->number_of_entries;
+    _pool_free(header, block_size);
+    return number_of_entries;
+}
+
+/**
+ * Usuwa z B+drzewa ekstentów pliku indeksy >= first_index. Zwolnione węzły, a także korzenie z jednym wpisem (drzewo
+ * obniża się o poziom), dopisywane są do tablicy bloków do zwolnienia. Wywoływana z zablokowanym first free block.
+ */
+void _extent_release(int fsfd, master_block * master_block_pointer, inode * file_inode, unsigned long first_index,
+                     unsigned long ** blocks_table, unsigned long * number_of_blocks,
+                     unsigned long * blocks_table_size) {
+    if (file_inode->block_map == 0) {
+        return;
+    }
+    if (first_index == 0 || _extent_truncate_node(fsfd, master_block_pointer, file_inode->block_map, first_index,
+                                                  blocks_table, number_of_blocks, blocks_table_size) == 0) {
+        _extent_collect(fsfd, master_block_pointer, file_inode->block_map, blocks_table, number_of_blocks,
+                        blocks_table_size);
+        _set_block_map(file_inode, 0, 0);
+        return;
+    }
+    extent_node * header = (extent_node *) _pool_alloc(master_block_pointer->block_size);
+    unsigned long node = file_inode->block_map;
+    unsigned levels = file_inode->block_map_levels;
+    while (levels > 1) {
+        _read_from_block(fsfd, master_block_pointer->data_start_block + node, master_block_pointer->block_size, 0,
+                         header, master_block_pointer->block_size);
+        if (header->number_of_entries > 1) {
+            break;
+        }
+        _block_list_add(blocks_table, number_of_blocks, blocks_table_size, node);
+        node = ((extent_index *) (header + 1))[0].node;
+        levels--;
+    }
+    _set_block_map(file_inode, node, levels);
+    _pool_free(header, master_block_pointer->block_size);
+}
+
+/**
+ * Wyszukuje w mapie bloków pliku (FILE_LAYOUT_MAPPED lub FILE_LAYOUT_EXTENTS) o korzeniu node blok o indeksie
+ * block_index, a jeśli jest on dziurą - najbliższy blok o indeksie większym (forward) lub mniejszym (!forward).
+ * @param block_no parametr wyjściowy - numer znalezionego bloku, 0 = brak
+ * @return indeks logiczny znalezionego bloku
+ */
+unsigned long _file_map_find(int fsfd, master_block * master_block_pointer, inode * file_inode, unsigned long node,
+                             unsigned levels, unsigned long block_index, int forward, unsigned long * block_no) {
+    if (file_inode->layout == FILE_LAYOUT_MAPPED) {
+        return _block_map_find(fsfd, master_block_pointer, node, levels, block_index, forward, block_no);
+    }
+    *block_no = 0;
+    return node == 0 ? block_index : _extent_search(fsfd, master_block_pointer, node, block_index, forward, block_no);
+}
+
+/**
+ * Dopisuje do tablicy bloków wszystkie bloki mapy bloków pliku.
+ */
+void _file_map_collect(int fsfd, master_block * master_block_pointer, inode * file_inode, unsigned long ** blocks_table,
+                       unsigned long * number_of_blocks, unsigned long * blocks_table_size) {
+    if (file_inode->block_map == 0) {
+        return;
+    }
+    if (file_inode->layout == FILE_LAYOUT_MAPPED) {
+        _block_map_collect(fsfd, master_block_pointer, file_inode->block_map, file_inode->block_map_levels,
+                           blocks_table, number_of_blocks, blocks_table_size);
+    } else {
+        _extent_collect(fsfd, master_block_pointer, file_inode->block_map, blocks_table, number_of_blocks,
+                        blocks_table_size);
+    }
+}
+
+/**
+ * Usuwa z mapy bloków pliku indeksy >= first_index, zwalniane bloki mapy dopisuje do tablicy bloków.
+ * Wywoływana z zablokowanym first free block.
+ */
+void _file_map_release(int fsfd, master_block * master_block_pointer, inode * file_inode, unsigned long first_index,
+                       unsigned long ** blocks_table, unsigned long * number_of_blocks,
+                       unsigned long * blocks_table_size) {
+    if (file_inode->layout == FILE_LAYOUT_MAPPED) {
+        _block_map_release(fsfd, master_block_pointer, file_inode, first_index, blocks_table, number_of_blocks,
+                           blocks_table_size);
+    } else if (file_inode->layout == FILE_LAYOUT_EXTENTS) {
+        _extent_release(fsfd, master_block_pointer, file_inode, first_index, blocks_table, number_of_blocks,
+                        blocks_table_size);
+    }
+}
+
+/**
+ * Przechodzi łańcuch bloków pliku (od kursora deskryptora, jeśli to możliwe) do pierwszego bloku o indeksie logicznym
+ * nie mniejszym niż block_index - jeśli blok o tym indeksie jest dziurą, będzie to pierwszy blok za nią. Indeksy od
+ * ostatniego bloku łańcucha wyznaczane są bez przechodzenia łańcucha, a w plikach z mapą bloków (FILE_LAYOUT_MAPPED,
+ * FILE_LAYOUT_EXTENTS) blok wyszukiwany jest w mapie.
+ * @param block_no parametr wyjściowy - numer znalezionego bloku, 0 = plik nie ma bloków od block_index
+ * @return indeks logiczny znalezionego bloku
+ */
+unsigned long _find_file_block(int fsfd, master_block * master_block_pointer, file * file_pointer, inode * file_inode,
+                               unsigned long block_index, unsigned long * block_no) {
+    unsigned long tail_index;
+    unsigned long tail_block = _get_file_tail(file_inode, &tail_index);
+    if (tail_block != 0 && block_index >= tail_index) {
+        *block_no = block_index == tail_index ? tail_block : 0;
+        return block_index == tail_index ? tail_index : tail_index + 1;
+    }
+    unsigned levels;
+    unsigned long map_root = file_inode->layout != FILE_LAYOUT_CHAIN ? _get_block_map(file_inode, &levels) : 0;
+    if (map_root != 0) {
+        return _file_map_find(fsfd, master_block_pointer, file_inode, map_root, levels, block_index, TRUE, block_no);
+    }
+    unsigned long current_index = BLOCK_LINK_HOLE(file_inode->first_data_block);
+    *block_no = BLOCK_LINK_NUMBER(file_inode->first_data_block);
+    if (file_pointer != NULL && _is_file_cursor_usable(file_pointer, file_inode, block_index)) {
+        current_index = file_pointer->cursor_block_index;
+        *block_no = file_pointer->cursor_block_no;
+    }
+    while (*block_no != 0 && current_index < block_index) {
+        current_index += _next_file_block(fsfd, master_block_pointer, block_no);
+    }
+    return current_index;
+}
+
+/**
+ * @return liczba bloków w łańcuchu pliku - wynikająca z rozmiaru lub większa, jeśli bloki przydzielono z góry
+ */
+unsigned long _get_number_of_taken_blocks(inode * file_inode, unsigned long real_block_size) {
+    unsigned long number_of_taken_blocks = (file_inode->size + real_block_size - 1) / real_block_size;
+    if (number_of_taken_blocks == 0 && file_inode->first_data_block != 0) {
+        // pusty plik może mieć już przydzielony pierwszy blok (np. katalog po usunięciu wszystkich plików)
+        number_of_taken_blocks = 1;
+    }
+    if (file_inode->allocated_blocks > number_of_taken_blocks) {
+        number_of_taken_blocks = file_inode->allocated_blocks;
+    }
+    return number_of_taken_blocks;
+}
+
+/**
+ * Zeruje dane pliku w zakresie [from, to) - tylko w blokach, które plik już posiada (dziury są zerami).
+ */
+void _zero_file_range(initialized_structures * initialized_structures_pointer, file * file_pointer,
+                      inode * file_inode, unsigned long from, unsigned long to) {
+    master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
+    unsigned long real_block_size = _block_payload(master_block_pointer);
+    unsigned long block_no;
+    unsigned long block_index = _find_file_block(file_pointer->fsfd, master_block_pointer, file_pointer, file_inode,
+                                                 from / real_block_size, &block_no);
+    char * zeros = _pool_alloc(real_block_size);
+    memset(zeros, 0, real_block_size);
+    while (block_no != 0 && block_index * real_block_size < to) {
+        unsigned long block_from = block_index * real_block_size > from ? block_index * real_block_size : from;
+        unsigned long block_to = (block_index + 1) * real_block_size < to ? (block_index + 1) * real_block_size : to;
+        _write_to_block(file_pointer->fsfd, block_no, master_block_pointer->data_start_block,
+                        master_block_pointer->block_size, block_from - block_index * real_block_size, zeros,
+                        block_to - block_from);
+        block_index += _next_file_block(file_pointer->fsfd, master_block_pointer, &block_no);
+    }
+    _pool_free(zeros, real_block_size);
+}
+
+/**
+ * Przygotowuje do zapisu [data_from, data_to) bloki pliku oznaczone jako niezapisane (BLOCK_LINK_UNWRITTEN), leżące
+ * w zakresie [from, to): zeruje ich części, których zapis nie pokryje, i zdejmuje oznaczenie. Przy pustym zakresie
+ * danych bloki zerowane są w całości. Wywoływana z zablokowanym plikiem .lock.
+ */
+void _clear_unwritten_blocks(initialized_structures * initialized_structures_pointer, file * file_pointer,
+                             inode * file_inode, unsigned long from, unsigned long to, unsigned long data_from,
+                             unsigned long data_to) {
+    master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
+    unsigned long real_block_size = _block_payload(master_block_pointer);
+    int fsfd = file_pointer->fsfd;
+    unsigned long block_no;
+    unsigned long block_index = _find_file_block(fsfd, master_block_pointer, file_pointer, file_inode,
+                                                 from / real_block_size, &block_no);
+    char * zeros = NULL;
+    while (block_no != 0 && block_index * real_block_size < to) {
+        unsigned long link = _get_block_link(fsfd, master_block_pointer, block_no);
+        if (link & BLOCK_LINK_UNWRITTEN) {
+            if (zeros == NULL) {
+                zeros = _pool_alloc(real_block_size);
+                memset(zeros, 0, real_block_size);
+            }
+            unsigned long block_start = block_index * real_block_size;
+            unsigned long block_end = block_start + real_block_size;
+            if (data_from >= data_to || data_from >= block_end || data_to <= block_start) {
+                _write_to_block(fsfd, block_no, master_block_pointer->data_start_block, master_block_pointer->block_size,
+                                0, zeros, real_block_size);
+            } else {
+                if (data_from > block_start) {
+                    _write_to_block(fsfd, block_no, master_block_pointer->data_start_block,
+                                    master_block_pointer->block_size, 0, zeros, data_from - block_start);
+                }
+                if (data_to < block_end) {
+                    _write_to_block(fsfd, block_no, master_block_pointer->data_start_block,
+                                    master_block_pointer->block_size, data_to - block_start, zeros, block_end - data_to);
+                }
+            }
+            _set_block_link(fsfd, master_block_pointer, block_no, link & ~BLOCK_LINK_UNWRITTEN);
+            if (master_block_pointer->number_of_link_table_blocks > 0) {
+                _journal_dirty_link(initialized_structures_pointer, block_no);
+            }
+        }
+        block_no = BLOCK_LINK_NUMBER(link);
+        block_index += 1 + BLOCK_LINK_HOLE(link);
+    }
+    if (zeros != NULL) {
+        _pool_free(zeros, real_block_size);
+    }
+}
+
+/**
+ * Zeruje w buforze odczytu [position, position + length) części przypadające na bloki oznaczone jako niezapisane.
+ */
+void _read_zero_unwritten(int fsfd, master_block * master_block_pointer, file * file_pointer, inode * file_inode,
+                          unsigned long position, char * buf, unsigned long length) {
+    unsigned long from = position > file_inode->unwritten_start ? position : file_inode->unwritten_start;
+    unsigned long to = position + length < file_inode->unwritten_end ? position + length : file_inode->unwritten_end;
+    if (from >= to) {
+        return;
+    }
+    unsigned long real_block_size = _block_payload(master_block_pointer);
+    unsigned long block_no;
+    unsigned long block_index = _find_file_block(fsfd, master_block_pointer, file_pointer, file_inode,
+                                                 from / real_block_size, &block_no);
+    while (block_no != 0 && block_index * real_block_size < to) {
+        unsigned long link = _get_block_link(fsfd, master_block_pointer, block_no);
+        if (link & BLOCK_LINK_UNWRITTEN) {
+            unsigned long block_from = block_index * real_block_size > from ? block_index * real_block_size : from;
+            unsigned long block_to = (block_index + 1) * real_block_size < to ? (block_index + 1) * real_block_size : to;
+            memset(buf + (block_from - position), 0, block_to - block_from);
+        }
+        block_no = BLOCK_LINK_NUMBER(link);
+        block_index += 1 + BLOCK_LINK_HOLE(link);
+    }
+}
+
+/**
+ * Zapewnia plikowi bloki o indeksach logicznych [first_index, last_index]. Dziury w tym zakresie oraz indeksy za końcem
+ * łańcucha dostają nowe bloki (jednym przydziałem), wstawiane do łańcucha na swoje miejsca - indeksy istniejących
+ * bloków się nie zmieniają, więc kursory deskryptorów pozostają ważne. W nowych blokach zerowane są części leżące
+ * w pliku przed pozycją zero_to, których wywołujący nie zapisze (poza zakresem [data_from, data_to)); z unwritten
+ * nowe bloki sięgające za zero_to oznaczane są jako niezapisane (BLOCK_LINK_UNWRITTEN). Nowe bloki pliku z mapą bloków
+ * (FILE_LAYOUT_MAPPED, FILE_LAYOUT_EXTENTS) trafiają też do mapy. Wywoływana z zablokowanym first free block.
+ * @param blocks_table parametr wyjściowy - numery bloków o indeksach od first_index do last_index
+ * @return {OK} sukces, {NO_FREE_BLOCKS} brak miejsca, {CANNOT_EXTEND_FILE} dziura dłuższa niż BLOCK_LINK_MAX_HOLE
+ */
+int _map_file_blocks(initialized_structures * initialized_structures_pointer, file * file_pointer, inode * file_inode,
+                     unsigned long first_index, unsigned long last_index, unsigned long * blocks_table,
+                     unsigned long data_from, unsigned long data_to, unsigned long zero_to, int unwritten) {
+    master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
+    unsigned long real_block_size = _block_payload(master_block_pointer);
+    unsigned long number_of_blocks = last_index - first_index + 1;
+    int fsfd = file_pointer->fsfd;
+
+    // istniejące bloki zakresu oraz jego poprzednik i następnik w łańcuchu (0 = brak)
+    unsigned long previous_block = 0;
+    unsigned long previous_index = 0;
+    unsigned long block_no = BLOCK_LINK_NUMBER(file_inode->first_data_block);
+    unsigned long block_index = BLOCK_LINK_HOLE(file_inode->first_data_block);
+    unsigned long tail_index;
+    unsigned long tail_block = _get_file_tail(file_inode, &tail_index);
+    unsigned long i;
+    if (file_inode->layout == FILE_LAYOUT_EXTENTS && file_inode->block_map == 0
+        && BLOCK_LINK_NUMBER(file_inode->first_data_block) != 0) {
+        _extent_rebuild(initialized_structures_pointer, fsfd, file_inode);
+    }
+    // mapa bloków pokrywa cały łańcuch - albo plik nie ma jeszcze bloków
+    int mapped = file_inode->layout != FILE_LAYOUT_CHAIN
+                 && (file_inode->block_map != 0 || BLOCK_LINK_NUMBER(file_inode->first_data_block) == 0);
+    memset(blocks_table, 0, sizeof(unsigned long) * number_of_blocks);
+    if (tail_block != 0 && first_index > tail_index) {
+        // zakres za końcem łańcucha - jego poprzednikiem jest ostatni blok
+        block_no = 0;
+        previous_block = tail_block;
+        previous_index = tail_index;
+    } else if (mapped && file_inode->block_map != 0) {
+        // mapa bloków - bloki zakresu, poprzednik i następnik bez przechodzenia łańcucha
+        if (first_index > 0) {
+            previous_index = _file_map_find(fsfd, master_block_pointer, file_inode, file_inode->block_map,
+                                            file_inode->block_map_levels, first_index - 1, FALSE, &previous_block);
+        }
+        block_index = _file_map_find(fsfd, master_block_pointer, file_inode, file_inode->block_map,
+                                     file_inode->block_map_levels, first_index, TRUE, &block_no);
+        while (block_no != 0 && block_index <= last_index) {
+            blocks_table[block_index - first_index] = block_no;
+            block_index = _file_map_find(fsfd, master_block_pointer, file_inode, file_inode->block_map,
+                                         file_inode->block_map_levels, block_index + 1, TRUE, &block_no);
+        }
+    } else if (first_index > 0 && _is_file_cursor_usable(file_pointer, file_inode, first_index - 1)) {
+        block_no = file_pointer->cursor_block_no;
+        block_index = file_pointer->cursor_block_index;
+    }
+    while (block_no != 0 && block_index <= last_index) {
+        if (block_index < first_index) {
+            previous_block = block_no;
+            previous_index = block_index;
+        } else {
+            blocks_table[block_index - first_index] = block_no;
+        }
+        block_index += _next_file_block(fsfd, master_block_pointer, &block_no);
+    }
+    unsigned long next_block = block_no;
+    unsigned long next_index = block_index;
+
+    unsigned long number_of_new_blocks = 0;
+    for (i = 0; i < number_of_blocks; i++) {
+        if (blocks_table[i] == 0) {
+            number_of_new_blocks++;
+        }
+    }
+    if (number_of_new_blocks == 0) {
+        if (next_block == 0) {
+            _set_file_tail(file_inode, blocks_table[number_of_blocks - 1], last_index);
+        }
+        return OK;
+    }
+    unsigned long leading_hole = previous_block != 0 ? first_index - previous_index - 1 : first_index;
+    if (blocks_table[0] == 0 && leading_hole > BLOCK_LINK_MAX_HOLE) {
+        return CANNOT_EXTEND_FILE;
+    }
+    if (mapped && file_inode->layout == FILE_LAYOUT_MAPPED
+        && _block_map_prepare(initialized_structures_pointer, fsfd, file_inode, first_index, last_index) == NO_FREE_BLOCKS) {
+        return NO_FREE_BLOCKS;
+    }
+    unsigned long * new_blocks = (unsigned long *) _pool_alloc(sizeof(unsigned long) * number_of_new_blocks);
+    if (_find_free_blocks(fsfd, initialized_structures_pointer, number_of_new_blocks, new_blocks) == NO_FREE_BLOCKS) {
+        _pool_free(new_blocks, sizeof(unsigned long) * number_of_new_blocks);
+        return NO_FREE_BLOCKS;
+    }
+
+    char * zeros = (char *) _pool_alloc(real_block_size);
+    memset(zeros, 0, real_block_size);
+    char * is_new = (char *) _pool_alloc(number_of_blocks);
+    unsigned long new_block_index = 0;
+    for (i = 0; i < number_of_blocks; i++) {
+        is_new[i] = blocks_table[i] == 0;
+        if (!is_new[i]) {
+            continue;
+        }
+        blocks_table[i] = new_blocks[new_block_index++];
+        // części nowego bloku w pliku, których nie pokryje zapis
+        unsigned long block_start = (first_index + i) * real_block_size;
+        unsigned long block_end = block_start + real_block_size < zero_to ? block_start + real_block_size : zero_to;
+        if (block_start < block_end && block_start < data_from) {
+            _write_to_block(fsfd, blocks_table[i], master_block_pointer->data_start_block, master_block_pointer->block_size,
+                            0, zeros, (data_from < block_end ? data_from : block_end) - block_start);
+        }
+        if (block_start < block_end && data_to < block_end) {
+            unsigned long zero_from = data_to > block_start ? data_to : block_start;
+            _write_to_block(fsfd, blocks_table[i], master_block_pointer->data_start_block, master_block_pointer->block_size,
+                            zero_from - block_start, zeros, block_end - zero_from);
+        }
+    }
+
+    // połączenie bloków - przepisywane są wskaźniki nowych bloków i bloków, po których następuje nowy blok (istniejące
+    // bloki zachowują oznaczenie BLOCK_LINK_UNWRITTEN)
+    if (is_new[0]) {
+        unsigned long link = BLOCK_LINK(blocks_table[0], leading_hole);
+        if (previous_block != 0) {
+            link |= _get_block_link(fsfd, master_block_pointer, previous_block) & BLOCK_LINK_UNWRITTEN;
+            _set_block_link(fsfd, master_block_pointer, previous_block, link);
+            if (file_inode->type == INODE_DIR || master_block_pointer->number_of_link_table_blocks > 0) {
+                _journal_dirty_link(initialized_structures_pointer, previous_block);
+            }
+        } else {
+            file_inode->first_data_block = link;
+        }
+    }
+    for (i = 0; i < number_of_blocks; i++) {
+        if (!is_new[i] && (i + 1 == number_of_blocks || !is_new[i + 1])) {
+            continue;
+        }
+        unsigned long link = 0;
+        if (i + 1 < number_of_blocks) {
+            link = blocks_table[i + 1];
+        } else if (next_block != 0) {
+            link = BLOCK_LINK(next_block, next_index - last_index - 1);
+        }
+        if (!is_new[i]) {
+            link |= _get_block_link(fsfd, master_block_pointer, blocks_table[i]) & BLOCK_LINK_UNWRITTEN;
+        } else if (unwritten && (first_index + i + 1) * real_block_size > zero_to) {
+            link |= BLOCK_LINK_UNWRITTEN;
+        }
+        _set_block_link(fsfd, master_block_pointer, blocks_table[i], link);
+        if (master_block_pointer->number_of_link_table_blocks > 0) {
+            _journal_dirty_link(initialized_structures_pointer, blocks_table[i]);
+        }
+    }
+    for (i = 0; mapped && file_inode->layout == FILE_LAYOUT_MAPPED && i < number_of_blocks; i++) {
+        if (is_new[i]) {
+            _block_map_set(fsfd, master_block_pointer, file_inode, first_index + i, blocks_table[i]);
+        }
+    }
+    // nowe bloki trafiają do B+drzewa ekstentami - ciągami bloków o kolejnych numerach; przy braku miejsca na węzły
+    // drzewo jest porzucane i odbudowywane przy następnym przydziale
+    for (i = 0; mapped && file_inode->layout == FILE_LAYOUT_EXTENTS && i < number_of_blocks; i++) {
+        if (!is_new[i]) {
+            continue;
+        }
+        extent new_extent = {first_index + i, blocks_table[i], 1};
+        while (i + 1 < number_of_blocks && is_new[i + 1] && blocks_table[i + 1] == blocks_table[i] + 1) {
+            new_extent.length++;
+            i++;
+        }
+        if (_extent_insert(initialized_structures_pointer, fsfd, file_inode, &new_extent) != OK) {
+            _extent_discard(initialized_structures_pointer, fsfd, file_inode);
+            break;
+        }
+    }
+    if (next_block == 0) {
+        _set_file_tail(file_inode, blocks_table[number_of_blocks - 1], last_index);
+    }
+    _pool_free(is_new, number_of_blocks);
+    _pool_free(zeros, real_block_size);
+    _pool_free(new_blocks, sizeof(unsigned long) * number_of_new_blocks);
+    return OK;
+}
+
+/**
+ * Pobiera numery bloków, które aktualnie posiada plik - od bloku first_block_no o indeksie first_block_index do bloku
+ * o indeksie last_block_index lub do końca łańcucha. Bloki są wczytywane w całości tylko wtedy, gdy podano
+ * for_each_record, w p.p. czytane są same wskaźniki na następne bloki.
+ */
+int _get_blocks_numbers_taken_by_file(int fsfd, unsigned long first_block_no, unsigned long first_block_index,
+                                      unsigned long last_block_index, master_block * master_block_pointer,
+                                      int (*for_each_record)(void*, int, void*), void * additional_param,
+                                      unsigned long * blocks_table) {
+    DEBUG("\n**** _get_blocks_numbers_taken_by_file ****\n");
+    DEBUG("Pierwszy blok: %u\n", first_block_no);
+
+    block * block_pointer = NULL;
+    unsigned long i = first_block_index;
+    unsigned long block_no = BLOCK_LINK_NUMBER(first_block_no);
+    unsigned long next_data_block;
+    do {
+        if (for_each_record != NULL) {
+            block_pointer = _read_file_block(fsfd, master_block_pointer, block_no);
+
+            // wywołanie funkcji sprawdzającej block
+            if (for_each_record(block_pointer, master_block_pointer->block_size, additional_param) == 0) {
+                free_block_struct(block_pointer);
+                return -2;
+            }
+            next_data_block = block_pointer->next_data_block;
+            free_block_struct(block_pointer);
+        } else {
+            next_data_block = _get_block_link(fsfd, master_block_pointer, block_no);
+        }
+        blocks_table[i++] = block_no;
+        DEBUG("Zapisany numer bloku do tablicy: %d\n", block_no);
+        // katalogi nie mają dziur, maska chroni jedynie przed błędnym odczytem
+        next_data_block = BLOCK_LINK_NUMBER(next_data_block);
+        block_no = next_data_block;
+        DEBUG("nastepny blok danych: %u\n", block_no);
+    } while (next_data_block != 0 && i <= last_block_index);
+    DEBUG("Wyjscie z **** _get_blocks_numbers_taken_by_file ****\n");
+    return 0;
+}
+
+/**
+ * Blokuje wybrane locki.
+ */
+void _lock_file_blocks(int fsfd, master_block * master_block_pointer, unsigned long * blocks_table,
+                       unsigned long number_of_blocks, struct flock * flock_structures) {
+    unsigned long idx = 0;
+    DEBUG("\n\n******** _lock_file_blocks ********\n");
+    DEBUG("Liczba blokow: %d\n", number_of_blocks);
+    for (idx; idx < number_of_blocks; idx++) {
+        unsigned long block_offset = _get_block_offset(master_block_pointer, blocks_table[idx]);
+        DEBUG("Offset dla bloku: %u, wynosi: %u", blocks_table[idx], block_offset);
+        struct flock * flock_str = flock_structures + idx;
+        flock_str->l_type = F_WRLCK;
+        flock_str->l_whence = SEEK_SET;
+        flock_str->l_start = block_offset;
+        flock_str->l_len = master_block_pointer->block_size;
+        flock_str->l_pid = getpid();
+        fcntl(fsfd, F_SETLKW, flock_str);
+    }
+}
+
+/**
+ * Odblokowuje locki założone na bloki plików.
+ */
+void _unlock_file_blocks(int fsfd, struct flock * flock_structures, unsigned long number_of_flocks) {
+    unsigned int idx = 0;
+    for (idx; idx < number_of_flocks; idx++) {
+        struct flock * flock_str = flock_structures + idx;
+        flock_str->l_type = F_UNLCK;
+        fcntl(fsfd, F_SETLK, flock_str);
+    }
+}
+
+/*
+ * ---------------------------------------------------------------------------------------------------------------------
+ * Równoległe odczyty i zapisy.
+ * Zadanie to funkcja wywoływana dla każdego indeksu z zakresu [0, liczba indeksów). Zakres dzielony jest po równo
+ * między wątek wywołujący i wątki pomocnicze; wykonawca, który skończy swoją część, przejmuje połowę pozostałej części
+ * innego wykonawcy.
+ */
+
+/**
+ * Pobiera kolejny indeks dla wykonawcy - z własnego zakresu lub przejmując część zakresu innego wykonawcy.
+ * @return TRUE, jeśli pobrano indeks
+ */
+int _parallel_take(unsigned worker, unsigned long * index) {
+    unsigned number_of_ranges = parallel_operations.number_of_threads + 1;
+    parallel_range * own = parallel_operations.ranges + worker;
+    pthread_mutex_lock(&own->mutex);
+    if (own->next < own->end) {
+        *index = own->next++;
+        pthread_mutex_unlock(&own->mutex);
+        return TRUE;
+    }
+    pthread_mutex_unlock(&own->mutex);
+    unsigned i;
+    for (i = 1; i < number_of_ranges; i++) {
+        parallel_range * victim = parallel_operations.ranges + (worker + i) % number_of_ranges;
+        pthread_mutex_lock(&victim->mutex);
+        unsigned long remaining = victim->end - victim->next;
+        if (remaining == 0) {
+            pthread_mutex_unlock(&victim->mutex);
+            continue;
+        }
+        unsigned long stolen_start = victim->end - (remaining + 1) / 2;
+        unsigned long stolen_end = victim->end;
+        victim->end = stolen_start;
+        pthread_mutex_unlock(&victim->mutex);
+        *index = stolen_start;
+        pthread_mutex_lock(&own->mutex);
+        own->next = stolen_start + 1;
+        own->end = stolen_end;
+        pthread_mutex_unlock(&own->mutex);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void _parallel_run(unsigned worker) {
+    unsigned long index;
+    while (_parallel_take(worker, &index)) {
+        parallel_operations.process(parallel_operations.job, index);
+    }
+}
+
+void _io_plug(mounted_fs * mounted, io_plug * plug);
+void _io_unplug(io_plug * plug);
+
+/**
+ * Pętla wątku pomocniczego. Jeśli wywołujący gromadzi zapisy, wątek gromadzi swoje zapisy we własnym io_plug i wysyła
+ * je przed zgłoszeniem końca zadania - wywołujący wraca z _parallel_for dopiero po zakończeniu zapisów wszystkich wątków.
+ */
+void * _parallel_thread(void * argument) {
+    unsigned worker = (unsigned) (unsigned long) argument;
+    pthread_mutex_lock(&parallel_operations.mutex);
+    // wątek uruchamiany jest przed zleceniem pierwszego zadania, na które ma czekać
+    unsigned long seen_job = parallel_operations.started_job_number;
+    while (TRUE) {
+        while (parallel_operations.job_number == seen_job && !parallel_operations.stopping) {
+            pthread_cond_wait(&parallel_operations.job_started, &parallel_operations.mutex);
+        }
+        if (parallel_operations.stopping) {
+            break;
+        }
+        seen_job = parallel_operations.job_number;
+        mounted_fs * plugged = parallel_operations.plugged;
+        pthread_mutex_unlock(&parallel_operations.mutex);
+        io_plug plug;
+        _io_plug(plugged, &plug);
+        _parallel_run(worker);
+        _io_unplug(&plug);
+        pthread_mutex_lock(&parallel_operations.mutex);
+        if (--parallel_operations.active == 0) {
+            pthread_cond_signal(&parallel_operations.job_finished);
+        }
+    }
+    pthread_mutex_unlock(&parallel_operations.mutex);
+    return NULL;
+}
+
+/**
+ * Zatrzymuje wątki pomocnicze. Wywoływana z zablokowanym job_mutex.
+ */
+void _parallel_stop() {
+    unsigned i;
+    if (parallel_operations.threads == NULL) {
+        return;
+    }
+    if (parallel_operations.owner == getpid()) {
+        pthread_mutex_lock(&parallel_operations.mutex);
+        parallel_operations.stopping = TRUE;
+        pthread_cond_broadcast(&parallel_operations.job_started);
+        pthread_mutex_unlock(&parallel_operations.mutex);
+        for (i = 0; i < parallel_operations.number_of_threads; i++) {
+            pthread_join(parallel_operations.threads[i], NULL);
+        }
+    }
+    free(parallel_operations.threads);
+    free(parallel_operations.ranges);
+    parallel_operations.threads = NULL;
+    parallel_operations.ranges = NULL;
+    parallel_operations.stopping = FALSE;
+}
+
+/**
+ * Uruchamia wątki pomocnicze. Wywoływana z zablokowanym job_mutex.
+ * @return TRUE, jeśli wszystkie wątki zostały uruchomione
+ */
+int _parallel_start() {
+    unsigned i;
+    parallel_operations.ranges = (parallel_range *) malloc(sizeof(parallel_range) * (parallel_operations.number_of_threads + 1));
+    for (i = 0; i <= parallel_operations.number_of_threads; i++) {
+        pthread_mutex_init(&parallel_operations.ranges[i].mutex, NULL);
+        parallel_operations.ranges[i].next = 0;
+        parallel_operations.ranges[i].end = 0;
+    }
+    parallel_operations.threads = (pthread_t *) malloc(sizeof(pthread_t) * parallel_operations.number_of_threads);
+    parallel_operations.owner = getpid();
+    parallel_operations.started_job_number = parallel_operations.job_number;
+    unsigned requested = parallel_operations.number_of_threads;
+    for (i = 0; i < requested; i++) {
+        if (pthread_create(parallel_operations.threads + i, NULL, _parallel_thread, (void *) (unsigned long) (i + 1)) != 0) {
+            parallel_operations.number_of_threads = i;
+            _parallel_stop();
+            parallel_operations.number_of_threads = requested;
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * Wywołuje process(job, index) dla każdego indeksu z [0, count) - równolegle, jeśli zadanie jest dostatecznie duże,
+ * a pula nie wykonuje właśnie innego zadania.
+ */
+void _parallel_for(unsigned long count, void (*process)(void *, unsigned long), void * job) {
+    unsigned long index;
+    if (count < parallel_operations.min_blocks || parallel_operations.number_of_threads == 0
+        || pthread_mutex_trylock(&parallel_operations.job_mutex) != 0) {
+        for (index = 0; index < count; index++) {
+            process(job, index);
+        }
+        return;
+    }
+    if (parallel_operations.threads != NULL && parallel_operations.owner != getpid()) {
+        // wątki pomocnicze procesu macierzystego nie istnieją po fork
+        _parallel_stop();
+    }
+    if (parallel_operations.threads == NULL && !_parallel_start()) {
+        pthread_mutex_unlock(&parallel_operations.job_mutex);
+        for (index = 0; index < count; index++) {
+            process(job, index);
+        }
+        return;
+    }
+    unsigned number_of_ranges = parallel_operations.number_of_threads + 1;
+    unsigned i;
+    for (i = 0; i < number_of_ranges; i++) {
+        parallel_operations.ranges[i].next = count * i / number_of_ranges;
+        parallel_operations.ranges[i].end = count * (i + 1) / number_of_ranges;
+    }
+    pthread_mutex_lock(&parallel_operations.mutex);
+    parallel_operations.process = process;
+    parallel_operations.job = job;
+    parallel_operations.plugged = current_io_plug != NULL ? current_io_plug->mounted : NULL;
+    parallel_operations.active = parallel_operations.number_of_threads;
+    parallel_operations.job_number++;
+    pthread_cond_broadcast(&parallel_operations.job_started);
+    pthread_mutex_unlock(&parallel_operations.mutex);
+
+    _parallel_run(0);
+
+    pthread_mutex_lock(&parallel_operations.mutex);
+    while (parallel_operations.active > 0) {
+        pthread_cond_wait(&parallel_operations.job_finished, &parallel_operations.mutex);
+    }
+    pthread_mutex_unlock(&parallel_operations.mutex);
+    pthread_mutex_unlock(&parallel_operations.job_mutex);
+}
+
+int simplefs_parallel_configure(unsigned number_of_threads, unsigned long min_blocks) {
+    pthread_mutex_lock(&parallel_operations.job_mutex);
+    _parallel_stop();
+    parallel_operations.number_of_threads = number_of_threads;
+    parallel_operations.min_blocks = min_blocks;
+    pthread_mutex_unlock(&parallel_operations.job_mutex);
+    return OK;
+}
+
+/**
+ * Rozpoczyna gromadzenie zapisów wątku do systemu plików - zapisy bloków wysyłane są razem w _io_unplug.
+ * Nie działa dla backendu synchronicznego ani przy pamięci podręcznej write-back lub współdzielonej.
+ */
+void _io_plug(mounted_fs * mounted, io_plug * plug) {
+    plug->mounted = NULL;
+    plug->count = 0;
+    plug->pending_stripes = 0;
+    if (mounted == NULL || mounted->io.type != IO_BACKEND_IO_URING || mounted->shared_cache != NULL
+        || mounted->direct.fd != -1 || (mounted->cache.capacity > 0 && mounted->cache.mode == CACHE_WRITE_BACK)) {
+        return;
+    }
+    plug->mounted = mounted;
+    current_io_plug = plug;
+}
+
+/**
+ * Wysyła zgromadzone zapisy, czeka na ich zakończenie i dopiero wtedy zwiększa liczniki zapisów zmienionych pasów.
+ */
+void _io_unplug(io_plug * plug) {
+    mounted_fs * mounted = plug->mounted;
+    if (mounted == NULL) {
+        return;
+    }
+    current_io_plug = NULL;
+    _io_uring_submit(&mounted->io, mounted->fsfd, plug->requests, plug->count);
+    pthread_mutex_lock(&mounted->cache.mutex);
+    unsigned stripe;
+    for (stripe = 0; stripe < CACHE_GENERATION_STRIPES; stripe++) {
+        if (plug->pending_stripes & (1UL << stripe)) {
+            mounted->cache.in_flight[stripe]--;
+            _cache_note_write(mounted, stripe);
+        }
+    }
+    pthread_mutex_unlock(&mounted->cache.mutex);
+}
+
+/**
+ * Zapis bufora do kolejnych bloków pliku - jeden blok na indeks zadania (_parallel_for).
+ */
+typedef struct block_write_job_t {
+    write_params * params;
+    master_block * master_block_pointer;
+    unsigned long * blocks_table;           // numery zapisywanych bloków
+    unsigned int first_block_offset;        // pozycja zapisu w pierwszym bloku
+} block_write_job;
+
+/**
+ * Zapisuje do bloku jego część bufora.
+ */
+void _save_block_of_buffer(void * job_pointer, unsigned long index) {
+    block_write_job * job = (block_write_job *) job_pointer;
+    master_block * master_block_pointer = job->master_block_pointer;
+    unsigned int real_block_size = _block_payload(master_block_pointer);
+    unsigned long block_number = job->blocks_table[index];
+    unsigned long offset_in_block = index == 0 ? job->first_block_offset : 0;
+    unsigned long data_offset = index == 0 ? 0 : real_block_size - job->first_block_offset + (index - 1) * real_block_size;
+    unsigned long data_length_for_block = real_block_size - offset_in_block;
+    if (job->params->data_length - data_offset < data_length_for_block) {
+        data_length_for_block = job->params->data_length - data_offset;
+    }
+    _write_to_block(job->params->fsfd, block_number, master_block_pointer->data_start_block, master_block_pointer->block_size,
+                    offset_in_block, job->params->data + data_offset, data_length_for_block);
+}
+
+/**
+ * Funkcja przeprowadza rzeczywisty zapis do pliku reprezentującego system plików.
+ * Tablica {blocks_table} zawiera numery wszystkich zapisywanych bloków, od bloku z pozycją real_file_offset - bloki są
+ * już połączone w łańcuch (_map_file_blocks).
+ */
+void _save_buffer_to_file(initialized_structures * initialized_structures_pointer, write_params * params,
+                          const block_geometry * geometry, unsigned long * blocks_table, unsigned long real_file_offset) {
+    DEBUG("\n****** save buffer to file *******\n");
+    DEBUG("params->data length = %d, file_offset =  %d\n", params->data_length, params->file_offset);
+    master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
+    unsigned long additional_block_offset;
+    _block_split(geometry, real_file_offset, &additional_block_offset);
+    unsigned long number_of_blocks_to_write = _block_count(geometry, additional_block_offset + params->data_length);
+    io_plug plug;
+    _io_plug(_get_mounted_fs(params->fsfd), &plug);
+
+    // duże zapisy dzielone są między wątki puli (bloki są niezależne - numery wszystkich bloków są już znane)
+    block_write_job job;
+    job.params = params;
+    job.master_block_pointer = master_block_pointer;
+    job.blocks_table = blocks_table;
+    job.first_block_offset = additional_block_offset;
+    _parallel_for(number_of_blocks_to_write, _save_block_of_buffer, &job);
+    _io_unplug(&plug);
+}
+
+/**
+ * Podstawowa funkcja zapisująca podany blok danych do wskazanego pliku.
+ * W normalnym przypadku pozwala na równoległy zapis wielu procesów, podanie file_offset < 0 powoduje dodatkowe
+ * zablokowanie bloków danych, do których ta funkcja pisze (czyli robi append, przydatne w przypadku katalogów).
+ * Na początku działania funkcji blokowany jest first free node w strukturze master block, tak aby możliwe było
+ * poprawne przydzielenie wymaganych bloków dla funkcji. Po znalezieniu takich bloków i zmianie w strukturze bitmapy
+ * następuje odblokowanie first free node.
+ */
+int _write_unsafe(initialized_structures * initialized_structures_pointer, write_params params) {
+    struct flock flock_structure;
+    // blokada first free block
+    _block_first_free_block(params.fsfd, &flock_structure);
+
+    master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
+    unsigned int real_block_size = _block_payload(master_block_pointer);
+
+    // załadowanie odpowiedniej struktury inode
+    file * file_structure = _get_file_by_fd(params.fd);
+    inode * file_inode = _load_inode_from_file_structure(initialized_structures_pointer, file_structure);
+    unsigned long file_size = file_inode->size;
+    DEBUG("_write_unsafe. Filze size = %d\n", file_size);
+
+    // rezerwacja opóźnionego przydziału jest zwalniana - zapis przydzieli bloki z puli wolnych
+    if (file_structure->reserved_blocks > 0) {
+        master_block_pointer->number_of_reserved_blocks -= file_structure->reserved_blocks;
+        _journal_dirty_master_block(initialized_structures_pointer);
+    }
+    file_structure->reserved_blocks = 0;
+    file_structure->reserved_end = 0;
+    unsigned long free_blocks_before_write = master_block_pointer->number_of_free_blocks;
+
+    // sprawdzenie poprawności dostępu do pliku
+    if (file_structure->mode == READ_MODE) {
+        _unblock_first_free_block(params.fsfd, &flock_structure);
+        DEBUG("Wrong mode\n");
+        return WRONG_MODE;
+    }
+
+    // wyznaczenie prawdziwego offsetu dla pliku (< 0 => append)
+    unsigned long real_file_offset = 0;
+    if (params.file_offset < 0) {
+        real_file_offset = file_size;
+        unsigned long offset_in_last_block;
+        _block_split(&file_structure->geometry, file_size, &offset_in_last_block);
+        unsigned long diff = real_block_size - offset_in_last_block;
+        // specjalny przypadek - dodatkowo przy appendzie sprawdzamy czy blok danych do zapisu się zmieści, jeśli nie to robimy tam 'dziurę'
+        if (diff < params.data_length) {
+            real_file_offset += diff;
+        }
+    } else {
+        real_file_offset = file_structure->position;
+    }
+
+    if (params.data_length == 0) {
+        _unblock_first_free_block(params.fsfd, &flock_structure);
+        return 0;
+    }
+    unsigned long data_end = real_file_offset + (unsigned long) params.data_length;
+
+    // mały plik w fragmentach - zapis w miejscu lub przeniesienie do fragmentów albo do łańcucha bloków
+    if (file_inode->fragment != 0 || _fragment_fits(master_block_pointer, file_inode, data_end)) {
+        int result = OK;
+        if (_fragment_fits(master_block_pointer, file_inode, data_end)) {
+            result = _fragment_store(initialized_structures_pointer, file_structure, file_inode, real_file_offset,
+                                     params.data, params.data_length);
+            _unblock_first_free_block(params.fsfd, &flock_structure);
+            if (result == OK) {
+                file_structure->position += params.data_length;
+            }
+            return result;
+        }
+        result = _fragment_unpack(initialized_structures_pointer, file_structure, file_inode);
+        if (result != OK) {
+            _unblock_first_free_block(params.fsfd, &flock_structure);
+            return result;
+        }
+    }
+    unsigned long new_file_size = file_size >= data_end ? file_size : data_end;
+    const block_geometry * geometry = &file_structure->geometry;
+    unsigned long offset_in_block;
+    unsigned long first_block_index = _block_split(geometry, real_file_offset, &offset_in_block);
+    unsigned long number_of_blocks_to_write = _block_split(geometry, data_end - 1, &offset_in_block)
+                                              - first_block_index + 1;
+
+    // sprawdzanie rekordów i blokowanie bloków (katalogi) wymagają całego łańcucha - katalogi nie mają dziur
+    unsigned long number_of_all_taken_blocks_by_file = 0;
+    unsigned long chain_table_size = 0;
+    unsigned long * chain_table = NULL;
+    if (params.for_each_record != NULL || params.lock_blocks) {
+        number_of_all_taken_blocks_by_file = _get_number_of_taken_blocks(file_inode, real_block_size);
+        chain_table_size = sizeof(unsigned long) * (number_of_all_taken_blocks_by_file + number_of_blocks_to_write);
+        chain_table = (unsigned long *) _pool_alloc(chain_table_size);
+        if (number_of_all_taken_blocks_by_file > 0
+            && _get_blocks_numbers_taken_by_file(params.fsfd, file_inode->first_data_block, 0,
+                                                 number_of_all_taken_blocks_by_file - 1, master_block_pointer,
+                                                 params.for_each_record, params.additional_param, chain_table) == -2) {
+            _unblock_first_free_block(params.fsfd, &flock_structure);
+            _pool_free(chain_table, chain_table_size);
+            return -2;
+        }
+    }
+
+    // zapis za końcem pliku - końcówka bloku z dotychczasowym końcem pliku staje się częścią pliku
+    unsigned long end_offset;
+    unsigned long end_block_index = _block_split(geometry, file_size, &end_offset);
+    if (params.file_offset >= 0 && real_file_offset > file_size && end_offset != 0) {
+        unsigned long block_end = (end_block_index + 1) * real_block_size;
+        _zero_file_range(initialized_structures_pointer, file_structure, file_inode, file_size,
+                         real_file_offset < block_end ? real_file_offset : block_end);
+    }
+
+    // bloki zapisywanego zakresu - brakujące (dziury, koniec pliku) są przydzielane
+    unsigned long blocks_table_size = sizeof(unsigned long) * number_of_blocks_to_write;
+    unsigned long * blocks_table = (unsigned long *) _pool_alloc(blocks_table_size);
+    int result = _map_file_blocks(initialized_structures_pointer, file_structure, file_inode, first_block_index,
+                                  first_block_index + number_of_blocks_to_write - 1, blocks_table, real_file_offset,
+                                  data_end, new_file_size, FALSE);
+    if (result != OK) {
+        DEBUG("zle!");
+        _unblock_first_free_block(params.fsfd, &flock_structure);
+        _pool_free(chain_table, chain_table_size);
+        _pool_free(blocks_table, blocks_table_size);
+        return result;
+    }
+
+    // zablokowanie wszystkich bloków pliku, do których funkcja będzie zapisywać dane (jeśli było to żądane)
+    unsigned long number_of_flocks = 0;
+    struct flock * flock_structures = NULL;
+    if (params.lock_blocks) {
+        // bloki dopisane na końcu łańcucha
+        unsigned long first_new_block = number_of_all_taken_blocks_by_file > first_block_index
+                                        ? number_of_all_taken_blocks_by_file - first_block_index : 0;
+        if (first_new_block < number_of_blocks_to_write) {
+            memcpy(chain_table + number_of_all_taken_blocks_by_file, blocks_table + first_new_block,
+                   sizeof(unsigned long) * (number_of_blocks_to_write - first_new_block));
+            number_of_all_taken_blocks_by_file += number_of_blocks_to_write - first_new_block;
+        }
+        number_of_flocks = number_of_all_taken_blocks_by_file;
+        flock_structures = (struct flock *) _pool_alloc(sizeof(struct flock) * number_of_flocks);
+        DEBUG("Czy blokowac bloki: %d, dla liczby blokow: %d\n", params.lock_blocks, number_of_flocks);
+        _lock_file_blocks(params.fsfd, master_block_pointer, chain_table, number_of_flocks, flock_structures);
+    }
+
+    // tryb uporządkowany - dane zapisu wydłużającego plik lub przydzielającego bloki trafiają do bloków, zanim nowy
+    // rozmiar stanie się widoczny; zapis odbywa się jeszcze pod blokadą first free block, a nowy rozmiar ustawiany jest
+    // dopiero po utrwaleniu danych
+    mounted_fs * mounted = _get_mounted_fs(params.fsfd);
+    int ordered = mounted != NULL && (mounted->journal.mode & JOURNAL_ORDERED)
+                  && (new_file_size > file_size || master_block_pointer->number_of_free_blocks != free_blocks_before_write);
+    if (ordered) {
+        _save_buffer_to_file(initialized_structures_pointer, &params, &file_structure->geometry, blocks_table,
+                             real_file_offset);
+        if (new_file_size > file_size) {
+            _journal_ordered_barrier(mounted);
+        }
+    }
+
+    // zapis nowej długości pliku
+    file_inode->size = new_file_size;
+    _journal_dirty_inode(initialized_structures_pointer, file_structure->inode_no);
+    if (file_inode->type == INODE_DIR) {
+        unsigned long i;
+        for (i = 0; i < number_of_blocks_to_write; i++) {
+            _journal_dirty_data_block(initialized_structures_pointer, blocks_table[i]);
+        }
+    }
+
+    // odblokowanie first free node
+    _unblock_first_free_block(params.fsfd, &flock_structure);
+
+    // operacja zapisu do pliku
+    if (!ordered) {
+        _save_buffer_to_file(initialized_structures_pointer, &params, &file_structure->geometry, blocks_table,
+                             real_file_offset);
+    }
+
+    // zapamiętanie ostatniego zapisanego bloku dla kolejnych operacji na deskryptorze
+    _set_file_cursor(file_structure, file_inode, first_block_index + number_of_blocks_to_write - 1,
+                     blocks_table[number_of_blocks_to_write - 1]);
+
+    // zwiększenie pozycji w strukturze file
+    file_structure->position += params.data_length;
+    DEBUG("Nowa pozycja w strukturze file: %d", file_structure->position);
+
+    // odblokowanie zablokowanych bloków danych (jeśli było to żądane)
+    if (params.lock_blocks) {
+        _unlock_file_blocks(params.fsfd, flock_structures, number_of_flocks);
+        _pool_free(flock_structures, sizeof(struct flock) * number_of_flocks);
+    }
+    _pool_free(chain_table, chain_table_size);
+    _pool_free(blocks_table, blocks_table_size);
+    return 0;
+}
+
+/**
+ * Funkcja odczytująca master block z dysku
+ * @return odczytany master block
+ */
+master_block* _get_master_block(int fsfd) {
+    DEBUG("get master block. fd = %d\n", fsfd);
+    master_block* masterblock = _pool_alloc(sizeof(master_block));
+    pread(fsfd, masterblock, sizeof(master_block), 0);
+    DEBUG("Read first inode table block: %d\n", masterblock->first_inode_table_block);
+    DEBUG("Sizeof block_size is %d\n", sizeof(masterblock->block_size));
+    return masterblock;
+}
+
+/**
+ * Funkcja zwracająca podaną ścieżkę skróconą o ostatnią część - sluży więc do oddzielenia istniejącej ścieżki
+ * od nazwy pliku (folderu), który ma być utworzony
+ */
+char* _get_path_for_file(char* full_path) {
+    char* path = malloc(strlen(full_path) * sizeof(char) + 1);
+    strcpy(path, full_path);
+    int i;
+    for(i = strlen(path) - 1; i >= 0; i--) {
+        if(path[i] == '/') {
+            if(i == 0) {
+                path[i+1] = '\0';
+            } else {
+                path[i] = '\0';
+            }
+            return path;
+        }
+    }
+    free(path);
+    return NULL;
+}
+
+/**
+ * Funkcja umieszczająca bezpiecznie inode w pierwszym wolnym miejscu
+ * @return numer umieszczonego inode'u
+ */
+unsigned long _insert_new_inode(inode* new_inode, initialized_structures* structures, int fsfd) {
+    struct flock lock;
+    lock.l_type = F_RDLCK + F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = FIRST_FREE_INODE_OFFSET;
+    lock.l_len = sizeof(structures->master_block_pointer->first_free_inode);
+    lock.l_pid = getpid();
+    DEBUG("Writing new inode: masterblock pointer: %d\n", structures->master_block_pointer);
+    //lock first free inode in master block
+    fcntl(fsfd, F_SETLKW, &lock);
+    DEBUG("Writing new inode: masterblock pointer: %d\n", structures->master_block_pointer);
+    unsigned long inode_no = structures->master_block_pointer->first_free_inode;
+    if(inode_no == 0 && structures->master_block_pointer->first_orphan_inode != 0) {
+        //wolne inode'y mogą zajmować usunięte pliki czekające na zwolnienie bloków
+        struct flock flock_structure;
+        _block_first_free_block(fsfd, &flock_structure);
+        _reclaim_orphan_blocks(structures, fsfd, structures->master_block_pointer->number_of_blocks);
+        _release_orphan_inodes(structures);
+        _unblock_first_free_block(fsfd, &flock_structure);
+        inode_no = structures->master_block_pointer->first_free_inode;
+    }
+    if(inode_no == 0) {
+        lock.l_type = F_UNLCK;
+        fcntl(fsfd, F_SETLK, &lock);
+        return 0;
+    }
+    //generation rośnie przy każdym użyciu inode'u, żeby unieważnić kursory deskryptorów starego pliku
+    new_inode->generation = structures->inode_table[inode_no].generation + 1;
+    structures->inode_table[inode_no] = *new_inode;
+    _journal_dirty_inode(structures, inode_no);
+    _journal_dirty_master_block(structures);
+    //now need to find new next free inode
+    unsigned long i;
+    for(i = inode_no + 1; i < (structures->master_block_pointer->number_of_inode_table_blocks * structures->master_block_pointer->block_size)
+            / sizeof(inode); i++) {
+        if(structures->inode_table[i].type == INODE_EMPTY) {
+            structures->master_block_pointer->first_free_inode = i;
+            lock.l_type = F_UNLCK;
+            fcntl(fsfd, F_SETLK, &lock);
+            return inode_no;
+        }
+    }
+    //no free inodes!
+    //unlock
+    structures->master_block_pointer->first_free_inode = 0;
+    lock.l_type = F_UNLCK;
+    fcntl(fsfd, F_SETLK, &lock);
+    return inode_no;
 }
 
 /**
@@ -804,10 +3896,17 @@ int _check_duplicate_file_names_in_block(block* data_block, int block_size, void
 }
 
 int simplefs_init(char * path, unsigned block_size, unsigned number_of_blocks) { //Michał
+    return simplefs_init_flags(path, block_size, number_of_blocks, 0);
+}
+
+int simplefs_init_flags(char * path, unsigned block_size, unsigned number_of_blocks, int flags) {
 
     if(block_size < 1024) {
         return BLOCK_SIZE_TOO_SMALL;
     }
+    if(block_size > MAX_BLOCK_SIZE) {
+        return BLOCK_SIZE_TOO_LARGE;
+    }
     if(block_size % sizeof(inode) != 0) {
         return WRONG_BLOCK_SIZE;
     }
@@ -827,9 +3926,10 @@ int simplefs_init(char * path, unsigned block_size, unsigned number_of_blocks) {
     }
 
     //get master block
-    master_block masterblock = get_initial_master_block(block_size, number_of_blocks);
-    unsigned fs_size = (1 + masterblock.number_of_bitmap_blocks + masterblock.number_of_inode_table_blocks +
-            masterblock.number_of_blocks) * masterblock.block_size;
+    master_block masterblock = get_initial_master_block(block_size, number_of_blocks, flags);
+    unsigned long fs_size = (1 + masterblock.number_of_bitmap_blocks + masterblock.number_of_inode_table_blocks +
+            masterblock.number_of_link_table_blocks +
+            masterblock.number_of_blocks + masterblock.number_of_journal_blocks) * masterblock.block_size;
 
     //insert master block
     write(fd, &masterblock, sizeof(master_block));
@@ -850,42 +3950,366 @@ int simplefs_init(char * path, unsigned block_size, unsigned number_of_blocks) {
     root_inode.type = INODE_DIR;
     write(fd, &root_inode, sizeof(inode));
 
-    //insert .lock inode
-    inode lock_inode;
-    memset(&lock_inode, 0, sizeof(inode));
-    strcpy(lock_inode.filename, ".lock");
-    lock_inode.type = INODE_FILE;
-    write(fd, &lock_inode, sizeof(inode));
+    //insert .lock inode
+    inode lock_inode;
+    memset(&lock_inode, 0, sizeof(inode));
+    strcpy(lock_inode.filename, ".lock");
+    lock_inode.type = INODE_FILE;
+    write(fd, &lock_inode, sizeof(inode));
+
+    //insert journal header
+    if (masterblock.number_of_journal_blocks > 0) {
+        journal_header header;
+        memset(&header, 0, sizeof(journal_header));
+        header.magic = JOURNAL_HEADER_MAGIC;
+        header.next_sequence = 1;
+        lseek(fd, masterblock.journal_start_block * masterblock.block_size, SEEK_SET);
+        write(fd, &header, sizeof(journal_header));
+    }
+
+    //allocate space for data
+    lseek(fd, fs_size - 1, SEEK_SET);
+    write(fd, "\0", 1);
+    DEBUG("Allocated %lu bytes\n", fs_size);
+
+    close(fd);
+    return 0;
+}
+
+/**
+ * Bierze blokadę montowania - bajt MOUNT_LOCK_OFFSET (za końcem obrazu), który każdy proces z zamontowanym obrazem
+ * blokuje współdzielnie do zamknięcia obrazu. Proces, któremu uda się go zablokować na wyłączność, jest jedynym
+ * montującym - trzyma blokadę wyłączną do _mount_lock_share, więc kolejni montujący czekają na zakończenie naprawy.
+ * @return TRUE, jeśli obraz nie jest zamontowany przez inny proces ani wcześniej przez ten proces
+ */
+int _mount_lock(int fsfd) {
+    struct stat image_stat;
+    struct stat mounted_stat;
+    int exclusive = fstat(fsfd, &image_stat) == 0;
+    // blokady fcntl nie wykluczają montowań w tym samym procesie
+    mounted_fs * mounted;
+    mounted_fs * tmp;
+    pthread_mutex_lock(&mounted_filesystems_write_mutex);
+    HASH_ITER(hh, mounted_filesystems, mounted, tmp) {
+        if (fstat(mounted->fsfd, &mounted_stat) == 0 && mounted_stat.st_dev == image_stat.st_dev
+            && mounted_stat.st_ino == image_stat.st_ino) {
+            exclusive = FALSE;
+        }
+    }
+    pthread_mutex_unlock(&mounted_filesystems_write_mutex);
+    struct flock lock;
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = MOUNT_LOCK_OFFSET;
+    lock.l_len = 1;
+    lock.l_pid = getpid();
+    if (exclusive && fcntl(fsfd, F_SETLK, &lock) == 0) {
+        return TRUE;
+    }
+    lock.l_type = F_RDLCK;
+    fcntl(fsfd, F_SETLKW, &lock);
+    return FALSE;
+}
+
+/**
+ * Zamienia wyłączną blokadę montowania (_mount_lock) na współdzieloną.
+ */
+void _mount_lock_share(int fsfd) {
+    struct flock lock;
+    lock.l_type = F_RDLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = MOUNT_LOCK_OFFSET;
+    lock.l_len = 1;
+    lock.l_pid = getpid();
+    fcntl(fsfd, F_SETLK, &lock);
+}
+
+/**
+ * Naprawia stan pozostawiony przez procesy zakończone w trakcie pracy - wywoływana przy montowaniu przez jedynego
+ * montującego. Liczba wolnych bloków liczona jest od nowa z bitmapy, a rezerwacje opóźnionego przydziału procesów,
+ * które nie zapisały swoich buforów, są zwalniane. Kursor dopisywania plików tylko do
+ * dopisywania cofany jest do ich rozmiaru (zakresy niedokończonych zapisów przepadają), licznik pliku .lock zerowany,
+ * a otwarta transakcja dziennika opróżniana.
+ */
+void _repair_mount_state(int fsfd) {
+    initialized_structures * structures = _initialize_structures(fsfd, 1);
+    if (structures == NULL) {
+        return;
+    }
+    master_block * master_block_pointer = structures->master_block_pointer;
+    unsigned char * bitmap = (unsigned char *) structures->block_bitmap_pointer;
+    unsigned long taken_blocks = 0;
+    unsigned long block_no;
+    for (block_no = 0; block_no < master_block_pointer->number_of_blocks; block_no++) {
+        taken_blocks += (bitmap[block_no / 8] >> (block_no % 8)) & 1;
+    }
+    if (master_block_pointer->number_of_free_blocks != master_block_pointer->number_of_blocks - taken_blocks
+        || master_block_pointer->number_of_reserved_blocks != 0) {
+        master_block_pointer->number_of_free_blocks = master_block_pointer->number_of_blocks - taken_blocks;
+        master_block_pointer->number_of_reserved_blocks = 0;
+        _journal_dirty_master_block(structures);
+    }
+    unsigned long number_of_inodes = master_block_pointer->number_of_inode_table_blocks * master_block_pointer->block_size
+                                     / sizeof(inode);
+    unsigned long inode_no;
+    for (inode_no = 0; inode_no < number_of_inodes; inode_no++) {
+        inode * file_inode = &structures->inode_table[inode_no];
+        if (file_inode->type == INODE_FILE && file_inode->append_only && file_inode->append_cursor != file_inode->size) {
+            file_inode->append_cursor = file_inode->size;
+            _journal_dirty_inode(structures, inode_no);
+        }
+    }
+    int counter = 0;
+    pwrite(fsfd, &counter, sizeof(counter), master_block_pointer->data_start_block * master_block_pointer->block_size);
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    if (mounted != NULL && mounted->journal.header != NULL) {
+        // otwarta transakcja przerwanych operacji nie zostanie już utrwalona
+        journal_header * header = mounted->journal.header;
+        header->number_of_pending_blocks = 0;
+        header->ordered_data_writes = 0;
+        if (header->next_sequence <= header->committed_sequence) {
+            header->next_sequence = header->committed_sequence + 1;
+        }
+    }
+    _uninitilize_structures(structures);
+    _journal_end_operation(fsfd);
+}
+
+int simplefs_openfs(char *path) { //Adam
+    int fd = open(path, O_RDWR, 0644);
+    DEBUG("OPEN FS. fd = %d\n", fd);
+    if(fd == -1) {
+        return -1;
+    }
+    master_block * mb = _get_master_block(fd);
+    int magic_check_result = check_magic_number(mb);
+    if(check_magic_number(mb) == -1) {
+        _pool_free(mb, sizeof(master_block));
+        close(fd);
+        return -1;
+    }
+    mounted_fs * mounted = malloc(sizeof(mounted_fs));
+    mounted->fsfd = fd;
+    mounted->master_block_pointer = (master_block *) mmap(NULL, sizeof(master_block), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mounted->master_block_pointer == (master_block *) MAP_FAILED) {
+        free(mounted);
+        _pool_free(mb, sizeof(master_block));
+        close(fd);
+        return -1;
+    }
+    _block_geometry_init(&mounted->geometry, mb);
+    mounted->link_table = NULL;
+    if (mb->number_of_link_table_blocks > 0) {
+        unsigned long * link_table = (unsigned long *) mmap_enhanced(NULL, mb->number_of_link_table_blocks * mb->block_size,
+                                                                     PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                                                                     mb->first_link_table_block * mb->block_size,
+                                                                     &mounted->link_table_delta);
+        if ((void *) link_table != MAP_FAILED + mounted->link_table_delta) {
+            mounted->link_table = link_table;
+        }
+    }
+    pthread_mutex_init(&mounted->cache.mutex, NULL);
+    _cache_init(&mounted->cache, mb->block_size, 0, CACHE_WRITE_THROUGH);
+    mounted->shared_cache = NULL;
+    mounted->io.type = IO_BACKEND_SYNC;
+    mounted->direct.fd = -1;
+    _journal_attach(mounted);
+    memset(&mounted->sync, 0, sizeof(sync_batch));
+    mounted->sync.gathering = 1;
+    pthread_mutex_init(&mounted->sync.mutex, NULL);
+    pthread_cond_init(&mounted->sync.done, NULL);
+    pthread_rwlock_init(&mounted->operations_lock, NULL);
+    int exclusive = _mount_lock(fd);
+    pthread_mutex_lock(&mounted_filesystems_write_mutex);
+    HASH_ADD_INT(mounted_filesystems, fsfd, mounted);
+    pthread_mutex_unlock(&mounted_filesystems_write_mutex);
+    _pool_free(mb, sizeof(master_block));
+    if (exclusive) {
+        _repair_mount_state(fd);
+        _mount_lock_share(fd);
+    }
+    // dokończenie zwalniania bloków plików usuniętych przed montowaniem
+    simplefs_reclaim_orphans(fd);
+    return fd;
+}
+
+int _flush_write_buffer(file * file_pointer);
+
+int simplefs_closefs(int fsfd) { //Adam
+    file * file_pointer;
+    file * tmp;
+    int result = OK;
+    mounted_fs * mounted = _operations_lock(fsfd);
+    HASH_ITER(hh, open_files, file_pointer, tmp) {
+        if (file_pointer->fsfd == fsfd) {
+            int flush_result = _flush_write_buffer(file_pointer);
+            if (result == OK) {
+                result = flush_result;
+            }
+        }
+    }
+    if (mounted != NULL) {
+        _cache_flush(mounted);
+        _journal_detach(mounted);
+        _operations_unlock(mounted);
+        pthread_mutex_lock(&mounted_filesystems_write_mutex);
+        HASH_DEL(mounted_filesystems, mounted);
+        pthread_mutex_unlock(&mounted_filesystems_write_mutex);
+        _cache_destroy(&mounted->cache);
+        pthread_mutex_destroy(&mounted->cache.mutex);
+        _shared_cache_detach(mounted);
+        _io_uring_teardown(&mounted->io);
+        _direct_io_disable(&mounted->direct);
+        pthread_mutex_destroy(&mounted->sync.mutex);
+        pthread_cond_destroy(&mounted->sync.done);
+        pthread_rwlock_destroy(&mounted->operations_lock);
+        if (mounted->link_table != NULL) {
+            munmap_enhanced(mounted->link_table, mounted->master_block_pointer->number_of_link_table_blocks
+                                                 * mounted->master_block_pointer->block_size + mounted->link_table_delta,
+                            mounted->link_table_delta);
+        }
+        munmap(mounted->master_block_pointer, sizeof(master_block));
+        free(mounted);
+    }
+    close(fsfd);
+    return result;
+}
+
+/**
+ * Zmiana pamięci podręcznej bez blokady operations_lock - simplefs_cache_configure.
+ */
+int _cache_configure_unlocked(mounted_fs * mounted, unsigned long memory_budget, int mode) {
+    if ((mode & CACHE_SHARED) && (mode & CACHE_WRITE_BACK)) {
+        // bufory segmentu muszą odpowiadać zawartości dysku, inne procesy mogą czytać obraz bez segmentu
+        return CACHE_MODE_NOT_SUPPORTED;
+    }
+    _cache_flush(mounted);
+    pthread_mutex_lock(&mounted->cache.mutex);
+    unsigned int block_size = mounted->cache.block_size;
+    _cache_destroy(&mounted->cache);
+    _cache_init(&mounted->cache, block_size, (mode & CACHE_SHARED) ? 0 : memory_budget, mode & ~CACHE_SHARED);
+    pthread_mutex_unlock(&mounted->cache.mutex);
+    if (!(mode & CACHE_SHARED) || memory_budget == 0) {
+        _shared_cache_detach(mounted);
+        return OK;
+    }
+    if (mounted->shared_cache != NULL) {
+        return OK;
+    }
+    return _shared_cache_attach(mounted, memory_budget);
+}
+
+int simplefs_cache_configure(int fsfd, unsigned long memory_budget, int mode) {
+    mounted_fs * mounted = _operations_lock(fsfd);
+    if (mounted == NULL) {
+        return UNKNOWN_DESCRIPTOR;
+    }
+    int result = _cache_configure_unlocked(mounted, memory_budget, mode);
+    _operations_unlock(mounted);
+    return result;
+}
+
+/**
+ * Zmiana backendu wejścia-wyjścia bez blokady operations_lock - simplefs_io_configure.
+ */
+int _io_configure_unlocked(mounted_fs * mounted, int backend, unsigned queue_depth) {
+    // dane write-back zapisywane są jeszcze przez dotychczasowy backend
+    _cache_flush(mounted);
+    _io_uring_teardown(&mounted->io);
+    if (backend != IO_BACKEND_IO_URING) {
+        return OK;
+    }
+    return _io_uring_setup(&mounted->io, mounted->direct.fd != -1 ? mounted->direct.fd : mounted->fsfd,
+                           queue_depth > 0 ? queue_depth : DEFAULT_IO_QUEUE_DEPTH, mounted->master_block_pointer->block_size);
+}
 
-    //allocate space for data
-    lseek(fd, fs_size - 1, SEEK_SET);
-    write(fd, "\0", 1);
-    DEBUG("Allocated %d bytes\n", fs_size);
+int simplefs_io_configure(int fsfd, int backend, unsigned queue_depth) {
+    mounted_fs * mounted = _operations_lock(fsfd);
+    if (mounted == NULL) {
+        return UNKNOWN_DESCRIPTOR;
+    }
+    int result = _io_configure_unlocked(mounted, backend, queue_depth);
+    _operations_unlock(mounted);
+    return result;
+}
 
-    close(fd);
-    return 0;
+/**
+ * Włączenie lub wyłączenie O_DIRECT bez blokady operations_lock - simplefs_direct_io_configure.
+ */
+int _direct_io_configure_unlocked(mounted_fs * mounted, int enabled) {
+    _cache_flush(mounted);
+    if ((mounted->direct.fd != -1) == (enabled != FALSE)) {
+        return OK;
+    }
+    // pierścień io_uring ma zarejestrowany deskryptor, przez który idą operacje - trzeba go utworzyć ponownie
+    int io_type = mounted->io.type;
+    unsigned queue_depth = mounted->io.queue_depth;
+    _io_uring_teardown(&mounted->io);
+    int result = OK;
+    if (enabled) {
+        result = _direct_io_enable(mounted);
+    } else {
+        _direct_io_disable(&mounted->direct);
+    }
+    if (io_type == IO_BACKEND_IO_URING) {
+        _io_uring_setup(&mounted->io, mounted->direct.fd != -1 ? mounted->direct.fd : mounted->fsfd, queue_depth,
+                        mounted->master_block_pointer->block_size);
+    }
+    return result;
 }
 
-int simplefs_openfs(char *path) { //Adam
-    int fd = open(path, O_RDWR, 0644);
-    DEBUG("OPEN FS. fd = %d\n", fd);
-    if(fd == -1) {
-        return -1;
+int simplefs_direct_io_configure(int fsfd, int enabled) {
+    mounted_fs * mounted = _operations_lock(fsfd);
+    if (mounted == NULL) {
+        return UNKNOWN_DESCRIPTOR;
     }
-    master_block * mb = _get_master_block(fd);
-    int magic_check_result = check_magic_number(mb);
-    if(check_magic_number(mb) == -1) {
-        free(mb);
-        close(fd);
-        return -1;
+    int result = _direct_io_configure_unlocked(mounted, enabled);
+    _operations_unlock(mounted);
+    return result;
+}
+
+/**
+ * Zmiana trybu dziennika bez blokady operations_lock - simplefs_journal_configure.
+ */
+int _journal_configure_unlocked(mounted_fs * mounted, int mode) {
+    if (mounted->journal.header == NULL) {
+        return mode == JOURNAL_NONE ? OK : JOURNAL_NOT_AVAILABLE;
     }
-    free(mb);
-    return fd;
+    if (mode == JOURNAL_ORDERED) {
+        return JOURNAL_MODE_NOT_SUPPORTED;
+    }
+    if (mode == JOURNAL_NONE && mounted->journal.mode != JOURNAL_NONE) {
+        // zmiany zgromadzone w otwartej transakcji są jeszcze zapisywane
+        _journal_end_operation(mounted->fsfd);
+        _journal_commit(mounted, mounted->journal.header->next_sequence);
+    }
+    mounted->journal.mode = mode;
+    return OK;
 }
 
-int simplefs_closefs(int fsfd) { //Adam
-    close(fsfd);
-    return 0;
+int simplefs_journal_configure(int fsfd, int mode) {
+    mounted_fs * mounted = _operations_lock(fsfd);
+    if (mounted == NULL) {
+        return UNKNOWN_DESCRIPTOR;
+    }
+    int result = _journal_configure_unlocked(mounted, mode);
+    _operations_unlock(mounted);
+    return result;
+}
+
+int simplefs_journal_commit(int fsfd) {
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    if (mounted == NULL) {
+        return UNKNOWN_DESCRIPTOR;
+    }
+    if (mounted->journal.header == NULL) {
+        return JOURNAL_NOT_AVAILABLE;
+    }
+    if (mounted->journal.mode == JOURNAL_NONE) {
+        return OK;
+    }
+    _journal_end_operation(fsfd);
+    return _journal_commit(mounted, mounted->journal.header->next_sequence);
 }
 
 int simplefs_open(char *name, int mode, int fsfd) { //Michal
@@ -896,13 +4320,13 @@ int simplefs_open(char *name, int mode, int fsfd) { //Michal
     DEBUG("\nSimplefs open - rozpoczęcie poszukiwania inoda.\n");
     inode* file_inode = _get_inode_by_path(name, masterblock, fsfd, &tmp);
     if (file_inode == NULL) {
-        free(file_inode);
+        _pool_free(masterblock, sizeof(master_block));
         return FILE_DOESNT_EXIST;
     }
     DEBUG("\n\nSimplefs open, pobrany inode: typ = %c size = %d\n", file_inode->type, file_inode->size);
     if(file_inode == NULL) {
-        free(masterblock);
-        free(file_inode);
+        _pool_free(masterblock, sizeof(master_block));
+        _pool_free(file_inode, sizeof(inode));
         return FILE_DOESNT_EXIST;
     }
     //file_inode now points to the real file
@@ -924,24 +4348,55 @@ int simplefs_open(char *name, int mode, int fsfd) { //Michal
     new_file->position = 0;
     new_file->inode_no = tmp;
     new_file->mode = (char) mode;
+    new_file->last_read_end = 0;
+    new_file->readahead_window = 0;
+    new_file->readahead_next_index = 0;
+    new_file->cursor_block_index = 0;
+    new_file->cursor_block_no = 0;
+    new_file->cursor_generation = 0;
+    new_file->fsfd = fsfd;
+    new_file->write_buffer = NULL;
+    new_file->write_buffer_size = 0;
+    new_file->write_buffer_length = 0;
+    new_file->write_buffer_position = 0;
+    new_file->delayed_allocation = FALSE;
+    new_file->reserved_blocks = 0;
+    new_file->reserved_end = 0;
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    if (mounted != NULL) {
+        new_file->geometry = mounted->geometry;
+    } else {
+        _block_geometry_init(&new_file->geometry, masterblock);
+    }
     HASH_ADD_INT(open_files, fd, new_file);
     pthread_mutex_unlock(&open_files_write_mutex);
-    free(masterblock);
-    free(file_inode);
+    _pool_free(masterblock, sizeof(master_block));
+    _pool_free(file_inode, sizeof(inode));
     return i;
 }
 
+/**
+ * Porównanie numerów bloków dla qsort.
+ */
+int _compare_block_numbers(const void * first, const void * second) {
+    unsigned long first_block = *(const unsigned long *) first;
+    unsigned long second_block = *(const unsigned long *) second;
+    return first_block < second_block ? -1 : first_block > second_block;
+}
+
 /**
  * Funkcja oznaczająca dany blok danych jako wolny w bitmapie oraz uaktualniająca w miarę potrzeby numer
  * pierwszego wolnego bloku w master bloku
  */
 int _free_data_block(initialized_structures* structures, unsigned long block_no) {
     //free block in bitmap
-    unsigned long bitmap_block_no = block_no / (8 * structures->master_block_pointer->block_size);
-    DEBUG("\n\n                      Numer bitmapy do zwolnienia %d\n\n", bitmap_block_no);
+    unsigned long bitmap_byte_no = block_no / 8;
+    DEBUG("\n\n                      Numer bajtu bitmapy do zwolnienia %d\n\n", bitmap_byte_no);
     char bit_offset = block_no % 8;
-    structures->block_bitmap_pointer[bitmap_block_no] &= ~(1 << bit_offset);
+    structures->block_bitmap_pointer[bitmap_byte_no] &= ~(1 << bit_offset);
     structures->master_block_pointer->number_of_free_blocks++;
+    _journal_dirty_master_block(structures);
+    _journal_dirty_bitmap(structures, block_no);
     if(block_no < structures->master_block_pointer->first_free_block_number) {
         //update first free block no
         structures->master_block_pointer->first_free_block_number = block_no;
@@ -949,7 +4404,450 @@ int _free_data_block(initialized_structures* structures, unsigned long block_no)
     return 0;
 }
 
-int simplefs_unlink(char *name, int fsfd) { //Michal
+/**
+ * Zwalnia w bitmapie podane bloki. Numery są sortowane, a bity czyszczone całymi słowami bitmapy - jedna operacja
+ * na słowo zamiast jednej na blok. Rozmiar bloku jest wielokrotnością rozmiaru inode'a, więc bitmapa składa się
+ * z całych, wyrównanych słów (bit bloku n to bit n % 8 bajtu n / 8, czyli na little-endian bit n % 64 słowa n / 64).
+ * @param blocks numery zwalnianych bloków (tablica jest sortowana)
+ */
+void _free_data_blocks(initialized_structures* structures, unsigned long * blocks, unsigned long number_of_blocks) {
+    if (number_of_blocks == 0) {
+        return;
+    }
+    qsort(blocks, number_of_blocks, sizeof(unsigned long), _compare_block_numbers);
+    unsigned long * bitmap_words = (unsigned long *) structures->block_bitmap_pointer;
+    unsigned long bits_in_word = sizeof(unsigned long) * 8;
+    unsigned long word_no = blocks[0] / bits_in_word;
+    unsigned long mask = 0;
+    unsigned long i;
+    for (i = 0; i < number_of_blocks; i++) {
+        if (blocks[i] / bits_in_word != word_no) {
+            bitmap_words[word_no] &= ~mask;
+            word_no = blocks[i] / bits_in_word;
+            mask = 0;
+        }
+        mask |= 1UL << (blocks[i] % bits_in_word);
+        _journal_dirty_bitmap(structures, blocks[i]);
+    }
+    bitmap_words[word_no] &= ~mask;
+    structures->master_block_pointer->number_of_free_blocks += number_of_blocks;
+    _journal_dirty_master_block(structures);
+    if (blocks[0] < structures->master_block_pointer->first_free_block_number) {
+        structures->master_block_pointer->first_free_block_number = blocks[0];
+    }
+}
+
+/**
+ * Odcina od łańcucha pliku bloki o indeksach logicznych >= first_index i zwalnia je w bitmapie jednym wywołaniem
+ * _free_data_blocks. Odłączone bloki zachowują swoje wskaźniki - każdy przydział ustawia je na nowo. W pliku z mapą
+ * bloków zwalniane są też węzły mapy obejmujące wyłącznie odcięte indeksy. Wywoływana z zablokowanym first free block.
+ * @return liczba zwolnionych bloków
+ */
+unsigned long _release_file_blocks(initialized_structures * structures, file * file_pointer, inode * file_inode,
+                                   unsigned long first_index) {
+    master_block * master_block_pointer = structures->master_block_pointer;
+    int fsfd = file_pointer->fsfd;
+    unsigned long tail_index;
+    if (_get_file_tail(file_inode, &tail_index) != 0 && first_index > tail_index) {
+        return 0;
+    }
+    unsigned long previous_block = 0;
+    unsigned long previous_index = 0;
+    unsigned long block_no = BLOCK_LINK_NUMBER(file_inode->first_data_block);
+    unsigned long block_index = BLOCK_LINK_HOLE(file_inode->first_data_block);
+    if (file_inode->layout != FILE_LAYOUT_CHAIN && file_inode->block_map != 0) {
+        if (first_index > 0) {
+            previous_index = _file_map_find(fsfd, master_block_pointer, file_inode, file_inode->block_map,
+                                            file_inode->block_map_levels, first_index - 1, FALSE, &previous_block);
+        }
+        block_index = _file_map_find(fsfd, master_block_pointer, file_inode, file_inode->block_map,
+                                     file_inode->block_map_levels, first_index, TRUE, &block_no);
+    } else if (first_index > 0 && _is_file_cursor_usable(file_pointer, file_inode, first_index - 1)) {
+        block_no = file_pointer->cursor_block_no;
+        block_index = file_pointer->cursor_block_index;
+    }
+    while (block_no != 0 && block_index < first_index) {
+        previous_block = block_no;
+        previous_index = block_index;
+        block_index += _next_file_block(fsfd, master_block_pointer, &block_no);
+    }
+    if (block_no == 0) {
+        return 0;
+    }
+
+    unsigned long number_of_blocks = 0;
+    unsigned long blocks_table_size = 64;
+    unsigned long * blocks_table = (unsigned long *) malloc(sizeof(unsigned long) * blocks_table_size);
+    while (block_no != 0) {
+        _block_list_add(&blocks_table, &number_of_blocks, &blocks_table_size, block_no);
+        _next_file_block(fsfd, master_block_pointer, &block_no);
+    }
+    _file_map_release(fsfd, master_block_pointer, file_inode, first_index, &blocks_table, &number_of_blocks,
+                      &blocks_table_size);
+    if (previous_block != 0) {
+        _set_block_link(fsfd, master_block_pointer, previous_block,
+                        _get_block_link(fsfd, master_block_pointer, previous_block) & BLOCK_LINK_UNWRITTEN);
+        if (master_block_pointer->number_of_link_table_blocks > 0) {
+            _journal_dirty_link(structures, previous_block);
+        }
+    } else {
+        file_inode->first_data_block = 0;
+    }
+    _set_file_tail(file_inode, previous_block, previous_index);
+    _free_data_blocks(structures, blocks_table, number_of_blocks);
+    free(blocks_table);
+    return number_of_blocks;
+}
+
+/*
+ * ---------------------------------------------------------------------------------------------------------------------
+ * Fragmenty (INIT_FRAGMENTS).
+ * Mały plik regularny (do FRAGMENT_MAX_UNITS fragmentów) trzyma całą zawartość w ciągu fragmentów jednego bloku
+ * fragmentów, zamiast w łańcuchu bloków. Blok fragmentów jest zwykłym blokiem danych z nagłówkiem w pierwszym
+ * fragmencie; bloki z wolnymi fragmentami tworzą listę zaczynającą się w master bloku. Plik, który przestaje mieścić
+ * się we fragmentach, przenoszony jest do pierwszego bloku łańcucha (_fragment_unpack). Przydział i zwalnianie
+ * fragmentów odbywa się z zablokowanym first free block.
+ */
+
+/**
+ * Sprawdza, czy zawartość pliku (z zapisem kończącym się na pozycji end) może leżeć we fragmentach.
+ */
+int _fragment_fits(master_block * master_block_pointer, inode * file_inode, unsigned long end) {
+    return master_block_pointer->fragment_size > 0 && file_inode->type == INODE_FILE
+           && file_inode->layout == FILE_LAYOUT_CHAIN && !file_inode->append_only
+           && BLOCK_LINK_NUMBER(file_inode->first_data_block) == 0 && file_inode->allocated_blocks == 0
+           && end <= FRAGMENT_MAX_UNITS * master_block_pointer->fragment_size
+           && file_inode->size <= FRAGMENT_MAX_UNITS * master_block_pointer->fragment_size;
+}
+
+void _fragment_read_header(int fsfd, master_block * master_block_pointer, unsigned long block_no,
+                           fragment_block_header * header) {
+    _read_from_block(fsfd, master_block_pointer->data_start_block + block_no, master_block_pointer->block_size, 0,
+                     header, sizeof(fragment_block_header));
+}
+
+void _fragment_write_header(initialized_structures * structures, int fsfd, unsigned long block_no,
+                            fragment_block_header * header) {
+    master_block * master_block_pointer = structures->master_block_pointer;
+    _write_to_block(fsfd, block_no, master_block_pointer->data_start_block, master_block_pointer->block_size, 0,
+                    header, sizeof(fragment_block_header));
+    _journal_dirty_data_block(structures, block_no);
+}
+
+/**
+ * Ustawia następnik bloku poprzedzającego na liście bloków z wolnymi fragmentami (0 = początek listy w master bloku).
+ */
+void _fragment_set_next(initialized_structures * structures, int fsfd, unsigned long previous_block,
+                        unsigned long next_block) {
+    if (previous_block == 0) {
+        structures->master_block_pointer->first_fragment_block = next_block;
+        _journal_dirty_master_block(structures);
+        return;
+    }
+    fragment_block_header header;
+    _fragment_read_header(fsfd, structures->master_block_pointer, previous_block, &header);
+    header.next_fragment_block = next_block;
+    _fragment_write_header(structures, fsfd, previous_block, &header);
+}
+
+/**
+ * Przydziela ciąg units wolnych fragmentów - z bloku z listy lub z nowego bloku fragmentów.
+ * @return fragment (FRAGMENT) lub 0 przy braku miejsca
+ */
+unsigned long _fragment_alloc(initialized_structures * structures, int fsfd, unsigned long units) {
+    master_block * master_block_pointer = structures->master_block_pointer;
+    unsigned long run = units == 64 ? ~0UL : (1UL << units) - 1;
+    unsigned long previous_block = 0;
+    unsigned long block_no = master_block_pointer->first_fragment_block;
+    fragment_block_header header;
+    while (block_no != 0) {
+        _fragment_read_header(fsfd, master_block_pointer, block_no, &header);
+        unsigned long first_unit;
+        for (first_unit = 1; first_unit + units <= FRAGMENTS_PER_BLOCK; first_unit++) {
+            if ((header.used_units & (run << first_unit)) == 0) {
+                header.used_units |= run << first_unit;
+                unsigned long next_block = header.next_fragment_block;
+                if (header.used_units == ~0UL) {
+                    // pełny blok opuszcza listę
+                    header.next_fragment_block = 0;
+                    _fragment_write_header(structures, fsfd, block_no, &header);
+                    _fragment_set_next(structures, fsfd, previous_block, next_block);
+                } else {
+                    _fragment_write_header(structures, fsfd, block_no, &header);
+                }
+                return FRAGMENT(block_no, first_unit, units);
+            }
+        }
+        previous_block = block_no;
+        block_no = header.next_fragment_block;
+    }
+    if (_find_free_blocks(fsfd, structures, 1, &block_no) == NO_FREE_BLOCKS) {
+        return 0;
+    }
+    header.used_units = 1 | (run << 1);
+    header.next_fragment_block = master_block_pointer->first_fragment_block;
+    _fragment_write_header(structures, fsfd, block_no, &header);
+    _fragment_set_next(structures, fsfd, 0, block_no);
+    return FRAGMENT(block_no, 1, units);
+}
+
+/**
+ * Zwalnia fragmenty - pusty blok fragmentów wraca do bitmapy, blok, który był pełny, wraca na listę.
+ */
+void _fragment_free(initialized_structures * structures, int fsfd, unsigned long fragment) {
+    master_block * master_block_pointer = structures->master_block_pointer;
+    unsigned long block_no = FRAGMENT_BLOCK(fragment);
+    unsigned long units = FRAGMENT_UNITS(fragment);
+    unsigned long run = units == 64 ? ~0UL : (1UL << units) - 1;
+    fragment_block_header header;
+    _fragment_read_header(fsfd, master_block_pointer, block_no, &header);
+    int was_full = header.used_units == ~0UL;
+    header.used_units &= ~(run << FRAGMENT_FIRST_UNIT(fragment));
+    if (was_full) {
+        header.next_fragment_block = master_block_pointer->first_fragment_block;
+        _fragment_write_header(structures, fsfd, block_no, &header);
+        _fragment_set_next(structures, fsfd, 0, block_no);
+    } else if (header.used_units == 1) {
+        // blok jest na liście - odszukanie poprzednika
+        unsigned long previous_block = 0;
+        unsigned long current_block = master_block_pointer->first_fragment_block;
+        while (current_block != 0 && current_block != block_no) {
+            fragment_block_header current_header;
+            _fragment_read_header(fsfd, master_block_pointer, current_block, &current_header);
+            previous_block = current_block;
+            current_block = current_header.next_fragment_block;
+        }
+        _fragment_set_next(structures, fsfd, previous_block, header.next_fragment_block);
+        _free_data_block(structures, block_no);
+    } else {
+        _fragment_write_header(structures, fsfd, block_no, &header);
+    }
+}
+
+/**
+ * Czyta length bajtów zawartości pliku od pozycji position z jego fragmentów.
+ */
+void _fragment_read(int fsfd, master_block * master_block_pointer, unsigned long fragment, unsigned long position,
+                    void * buf, unsigned long length) {
+    _read_from_block(fsfd, master_block_pointer->data_start_block + FRAGMENT_BLOCK(fragment),
+                     master_block_pointer->block_size,
+                     FRAGMENT_FIRST_UNIT(fragment) * master_block_pointer->fragment_size + position, buf, length);
+}
+
+/**
+ * Zapisuje do fragmentów pliku length bajtów od pozycji position (data == NULL - zera), przenosząc zawartość
+ * do większego ciągu fragmentów, jeśli się nie mieści. Wywoływana z zablokowanym first free block, gdy
+ * _fragment_fits(position + length).
+ * @return {OK} sukces, {NO_FREE_BLOCKS} brak miejsca
+ */
+int _fragment_store(initialized_structures * structures, file * file_pointer, inode * file_inode,
+                    unsigned long position, char * data, unsigned long length) {
+    master_block * master_block_pointer = structures->master_block_pointer;
+    int fsfd = file_pointer->fsfd;
+    unsigned long fragment_size = master_block_pointer->fragment_size;
+    unsigned long size = file_inode->size;
+    unsigned long end = position + length;
+    unsigned long new_size = end > size ? end : size;
+    unsigned long units_needed = new_size == 0 ? 1 : (new_size + fragment_size - 1) / fragment_size;
+    unsigned long fragment = file_inode->fragment;
+    if (fragment == 0 || FRAGMENT_UNITS(fragment) < units_needed) {
+        // nowy ciąg fragmentów - liczba fragmentów zaokrąglana do potęgi dwójki, żeby kolejne dopisania go nie zmieniały
+        unsigned long units = 1;
+        while (units < units_needed) {
+            units *= 2;
+        }
+        unsigned long new_fragment = _fragment_alloc(structures, fsfd, units);
+        if (new_fragment == 0) {
+            return NO_FREE_BLOCKS;
+        }
+        char * content = (char *) _pool_alloc(units * fragment_size);
+        memset(content, 0, units * fragment_size);
+        if (fragment != 0 && size > 0) {
+            _fragment_read(fsfd, master_block_pointer, fragment, 0, content, size);
+        }
+        if (data != NULL) {
+            memcpy(content + position, data, length);
+        }
+        _write_to_block(fsfd, FRAGMENT_BLOCK(new_fragment), master_block_pointer->data_start_block,
+                        master_block_pointer->block_size, FRAGMENT_FIRST_UNIT(new_fragment) * fragment_size, content,
+                        new_size);
+        _pool_free(content, units * fragment_size);
+        file_inode->fragment = new_fragment;
+        if (fragment != 0) {
+            _fragment_free(structures, fsfd, fragment);
+        }
+    } else {
+        unsigned long data_start = FRAGMENT_FIRST_UNIT(fragment) * fragment_size;
+        // bajty za dotychczasowym końcem pliku mogą zawierać dane sprzed skrócenia
+        unsigned long zero_from = size < position ? size : position;
+        unsigned long zero_to = data == NULL ? end : position;
+        if (zero_from < zero_to) {
+            char * zeros = (char *) _pool_alloc(zero_to - zero_from);
+            memset(zeros, 0, zero_to - zero_from);
+            _write_to_block(fsfd, FRAGMENT_BLOCK(fragment), master_block_pointer->data_start_block,
+                            master_block_pointer->block_size, data_start + zero_from, zeros, zero_to - zero_from);
+            _pool_free(zeros, zero_to - zero_from);
+        }
+        if (data != NULL) {
+            _write_to_block(fsfd, FRAGMENT_BLOCK(fragment), master_block_pointer->data_start_block,
+                            master_block_pointer->block_size, data_start + position, data, length);
+        }
+    }
+    file_inode->size = new_size;
+    _journal_dirty_inode(structures, file_pointer->inode_no);
+    return OK;
+}
+
+/**
+ * Przenosi zawartość pliku z fragmentów do pierwszego bloku łańcucha i zwalnia fragmenty. Wywoływana z zablokowanym
+ * first free block.
+ * @return {OK} sukces, {NO_FREE_BLOCKS} brak miejsca
+ */
+int _fragment_unpack(initialized_structures * structures, file * file_pointer, inode * file_inode) {
+    unsigned long fragment = file_inode->fragment;
+    if (fragment == 0) {
+        return OK;
+    }
+    master_block * master_block_pointer = structures->master_block_pointer;
+    int fsfd = file_pointer->fsfd;
+    unsigned long size = file_inode->size;
+    if (size > 0) {
+        unsigned long block_no;
+        int result = _map_file_blocks(structures, file_pointer, file_inode, 0, 0, &block_no, 0, size, size, FALSE);
+        if (result != OK) {
+            return result;
+        }
+        char * content = (char *) _pool_alloc(size);
+        _fragment_read(fsfd, master_block_pointer, fragment, 0, content, size);
+        _write_to_block(fsfd, block_no, master_block_pointer->data_start_block, master_block_pointer->block_size, 0,
+                        content, size);
+        _pool_free(content, size);
+    }
+    // czytelnik widzi fragmenty albo gotowy już blok
+    file_inode->fragment = 0;
+    _fragment_free(structures, fsfd, fragment);
+    _journal_dirty_inode(structures, file_pointer->inode_no);
+    return OK;
+}
+
+/**
+ * Zwalnia bloki plików z listy osieroconych, poczynając od jej początku, aż zwolni co najmniej number_of_blocks bloków
+ * lub listę wyczerpie. Zwolnione bloki odcinane są od początku łańcucha inode'a przed wyczyszczeniem bitmapy, więc
+ * przerwane zwalnianie kontynuuje kolejne wywołanie. Inode'y bez bloków pozostają na liście do simplefs_reclaim_orphans.
+ * Wywoływana z zablokowanym first free block.
+ * @return liczba zwolnionych bloków
+ */
+unsigned long _reclaim_orphan_blocks(initialized_structures * structures, int fsfd, unsigned long number_of_blocks) {
+    master_block * master_block_pointer = structures->master_block_pointer;
+    unsigned long * blocks_table = (unsigned long *) _pool_alloc(sizeof(unsigned long) * ORPHAN_RECLAIM_BATCH);
+    unsigned long blocks_freed = 0;
+    unsigned long inode_no = master_block_pointer->first_orphan_inode;
+    while (inode_no != 0 && blocks_freed < number_of_blocks) {
+        inode * orphan = &structures->inode_table[inode_no];
+        if (orphan->fragment != 0) {
+            unsigned long fragment = orphan->fragment;
+            orphan->fragment = 0;
+            _journal_dirty_inode(structures, inode_no);
+            _fragment_free(structures, fsfd, fragment);
+        }
+        unsigned long block_no = BLOCK_LINK_NUMBER(orphan->first_data_block);
+        unsigned long number_of_batch_blocks = 0;
+        while (block_no != 0 && number_of_batch_blocks < ORPHAN_RECLAIM_BATCH) {
+            blocks_table[number_of_batch_blocks++] = block_no;
+            block_no = BLOCK_LINK_NUMBER(_get_block_link(fsfd, master_block_pointer, block_no));
+        }
+        orphan->first_data_block = block_no;
+        _journal_dirty_inode(structures, inode_no);
+        _free_data_blocks(structures, blocks_table, number_of_batch_blocks);
+        blocks_freed += number_of_batch_blocks;
+        if (block_no == 0 && orphan->layout != FILE_LAYOUT_CHAIN && orphan->block_map != 0) {
+            // po blokach danych zwalniana jest mapa bloków
+            unsigned long number_of_map_blocks = 0;
+            unsigned long map_blocks_size = 64;
+            unsigned long * map_blocks = (unsigned long *) malloc(sizeof(unsigned long) * map_blocks_size);
+            _file_map_release(fsfd, master_block_pointer, orphan, 0, &map_blocks, &number_of_map_blocks,
+                              &map_blocks_size);
+            _free_data_blocks(structures, map_blocks, number_of_map_blocks);
+            blocks_freed += number_of_map_blocks;
+            free(map_blocks);
+        }
+        if (block_no == 0) {
+            inode_no = orphan->next_orphan_inode;
+        }
+    }
+    _pool_free(blocks_table, sizeof(unsigned long) * ORPHAN_RECLAIM_BATCH);
+    return blocks_freed;
+}
+
+/**
+ * Usuwa z listy osieroconych inode'y, których bloki zostały już zwolnione, i oznacza je jako wolne.
+ * Wywoływana z zablokowanym first free block.
+ */
+void _release_orphan_inodes(initialized_structures * structures) {
+    unsigned long * inode_no_pointer = &structures->master_block_pointer->first_orphan_inode;
+    unsigned long previous_inode_no = 0;
+    while (*inode_no_pointer != 0) {
+        unsigned long inode_no = *inode_no_pointer;
+        inode * orphan = &structures->inode_table[inode_no];
+        if (BLOCK_LINK_NUMBER(orphan->first_data_block) == 0 && orphan->fragment == 0) {
+            *inode_no_pointer = orphan->next_orphan_inode;
+            orphan->next_orphan_inode = 0;
+            _mark_inode_as_empty(structures, inode_no);
+            if (previous_inode_no != 0) {
+                _journal_dirty_inode(structures, previous_inode_no);
+            }
+        } else {
+            inode_no_pointer = &orphan->next_orphan_inode;
+            previous_inode_no = inode_no;
+        }
+    }
+}
+
+/**
+ * Zwalnianie bloków osieroconych bez blokady operations_lock - simplefs_reclaim_orphans.
+ */
+long _reclaim_orphans_unlocked(int fsfd) {
+    initialized_structures * structures = _initialize_structures(fsfd, 1);
+    if (structures == NULL) {
+        return -1;
+    }
+    master_block * master_block_pointer = structures->master_block_pointer;
+    struct flock flock_structure;
+    long blocks_freed = 0;
+    unsigned long batch_blocks_freed;
+    do {
+        _block_first_free_block(fsfd, &flock_structure);
+        batch_blocks_freed = _reclaim_orphan_blocks(structures, fsfd, ORPHAN_RECLAIM_BATCH);
+        _unblock_first_free_block(fsfd, &flock_structure);
+        blocks_freed += batch_blocks_freed;
+    } while (batch_blocks_freed > 0);
+
+    _lock_lock_inode(master_block_pointer, fsfd);
+    _block_first_free_block(fsfd, &flock_structure);
+    _release_orphan_inodes(structures);
+    _unblock_first_free_block(fsfd, &flock_structure);
+    _unlock_lock_inode(master_block_pointer, fsfd);
+    _uninitilize_structures(structures);
+    _journal_end_operation(fsfd);
+    return blocks_freed;
+}
+
+long simplefs_reclaim_orphans(int fsfd) {
+    mounted_fs * mounted = _operations_lock(fsfd);
+    long result = _reclaim_orphans_unlocked(fsfd);
+    _operations_unlock(mounted);
+    return result;
+}
+
+long simplefs_lseek_unsafe(int fd, initialized_structures * initialized_structures_pointer, int whence, long offset,
+                          int fsfd);
+
+int _close_unlocked(int fd);
+
+/**
+ * Usuwanie pliku bez blokady operations_lock - simplefs_unlink.
+ */
+int _unlink_unlocked(char *name, int fsfd) {
     //extract file name
     int path_length = strlen(name);
     if(path_length < 1) {
@@ -972,7 +4870,7 @@ int simplefs_unlink(char *name, int fsfd) { //Michal
         _unlock_lock_inode(structures->master_block_pointer, fsfd);
         _uninitilize_structures(structures);
         free(path);
-        free(file_inode);
+        _pool_free(file_inode, sizeof(inode));
         return FILE_DOESNT_EXIST;
     }
 
@@ -991,44 +4889,31 @@ int simplefs_unlink(char *name, int fsfd) { //Michal
                 _unlock_lock_file(structures->master_block_pointer, fsfd);
                 _unlock_lock_inode(structures->master_block_pointer, fsfd);
                 _uninitilize_structures(structures);
-                simplefs_close(file_fd);
+                _close_unlocked(file_fd);
                 free(path);
-                free(file_inode);
+                _pool_free(file_inode, sizeof(inode));
                 return DIR_NOT_EMPTY;
             }
         }
-        simplefs_close(file_fd);
+        _close_unlocked(file_fd);
     }
-    //zwolnienie bloków
-    unsigned long blocks_freed = 0;
-    unsigned long current_block_no = file_inode->first_data_block;
-    unsigned long zero = 0;
-    while(current_block_no != 0) {
-        //update no of free blocks in mb
-        structures->master_block_pointer->number_of_free_blocks++;
-
-        _free_data_block(structures, current_block_no);
-        block* current_block = _read_block(fsfd, current_block_no, structures->master_block_pointer->data_start_block,
-                                        structures->master_block_pointer->block_size);
-        unsigned long old_block_no = current_block_no;
-        current_block_no = current_block->next_data_block;
-
-        //clear next data block pointer
-        lseek(fsfd, (structures->master_block_pointer->data_start_block + old_block_no + 1) *
-                        structures->master_block_pointer->block_size - sizeof(unsigned long), SEEK_SET);
-        write(fsfd, &zero, sizeof(unsigned long));
-        blocks_freed++;
-
-        free(current_block->data);
-        free(current_block);
-    }
-    structures->master_block_pointer->number_of_free_blocks += blocks_freed;
-    _mark_inode_as_empty(structures, inode_no);
+    //bloki zwalniane są później - inode trafia na listę osieroconych (chronioną blokadą first free block)
+    struct flock flock_structure;
+    _block_first_free_block(fsfd, &flock_structure);
+    inode * orphan = &structures->inode_table[inode_no];
+    orphan->type = INODE_ORPHAN;
+    orphan->generation++;
+    orphan->next_orphan_inode = structures->master_block_pointer->first_orphan_inode;
+    _set_file_tail(orphan, 0, 0);
+    structures->master_block_pointer->first_orphan_inode = inode_no;
+    _journal_dirty_inode(structures, inode_no);
+    _journal_dirty_master_block(structures);
+    _unblock_first_free_block(fsfd, &flock_structure);
 
     //remove file signature from parent directory
     char* dir_path = _get_path_for_file(name);
     int dir_fd = simplefs_open(dir_path, READ_AND_WRITE, fsfd);
-    unsigned block_data_size = structures->master_block_pointer->block_size - sizeof(long);
+    unsigned block_data_size = _block_payload(structures->master_block_pointer);
     unsigned signatures_in_block = block_data_size / sizeof(file_signature);
     unsigned dir_block_padding = block_data_size % sizeof(file_signature);
     int i;
@@ -1039,8 +4924,7 @@ int simplefs_unlink(char *name, int fsfd) { //Michal
         DEBUG("\n\n\n%d. signature.inode_no = %d, strcmp = %d, signature.name = %s, name = %s\n\n\n", i, signature.inode_no, strcmp(signature.name, name + filename_position + 1), signature.name, name + filename_position + 1);
         if(strcmp(signature.name, name + filename_position + 1) == 0 && signature.inode_no != 0) {
             //now navigate to the last signature in this dir so we can replace the old one with that
-            file* dir_file_struct;
-            HASH_FIND_INT(open_files, &dir_fd, dir_file_struct);
+            file* dir_file_struct = _get_file_by_fd(dir_fd);
             unsigned long saved_position = dir_file_struct->position;
             unsigned long dir_inode_no;
             inode* dir_inode = _get_inode_by_path(dir_path, structures->master_block_pointer, fsfd, &dir_inode_no);
@@ -1052,7 +4936,7 @@ int simplefs_unlink(char *name, int fsfd) { //Michal
                             _load_inode_from_file_structure(structures, _get_file_by_fd(dir_fd))->size);
 
                 //clear the last signature
-                simplefs_lseek_unsafe(dir_fd, structures, SEEK_CUR, -sizeof(unsigned long), fsfd);
+                simplefs_lseek_unsafe(dir_fd, structures, SEEK_CUR, -(long) sizeof(unsigned long), fsfd);
                 unsigned long zero = 0;
 
                 write_params params;
@@ -1076,7 +4960,7 @@ int simplefs_unlink(char *name, int fsfd) { //Michal
             } else {
                 //just last signature to remove
                 //clear the last signature
-                simplefs_lseek_unsafe(dir_fd, structures, SEEK_CUR, -sizeof(unsigned long), fsfd);
+                simplefs_lseek_unsafe(dir_fd, structures, SEEK_CUR, -(long) sizeof(unsigned long), fsfd);
                 unsigned long zero = 0;
                 write_params params;
                 params.for_each_record = NULL;
@@ -1090,37 +4974,34 @@ int simplefs_unlink(char *name, int fsfd) { //Michal
                 _write_unsafe(structures, params);
             }
             structures->inode_table[dir_inode_no].size -= sizeof(file_signature);
-            //we may need to free the block
-            if(structures->inode_table[dir_inode_no].size % structures->master_block_pointer->block_size == 0) {
-                unsigned long current_dir_block_no = dir_inode->first_data_block;
-                if(current_dir_block_no != 0) {
-                    unsigned long previous_dir_block_no = 0;
-                    while(current_dir_block_no != 0) {
-                        block* current_dir_block = _read_block(fsfd, current_dir_block_no, structures->master_block_pointer->data_start_block, structures->master_block_pointer->block_size);
-                        previous_dir_block_no = current_dir_block_no;
-                        current_dir_block_no = current_dir_block->next_data_block;
-                        free(current_dir_block->data);
-                        free(current_dir_block);
-                    }
+            _journal_dirty_inode(structures, dir_inode_no);
+            //we may need to free the blocks at the end of the directory (the first one is always kept)
+            unsigned long dir_blocks_needed = (structures->inode_table[dir_inode_no].size + block_data_size - 1) / block_data_size;
+            if(dir_blocks_needed == 0) {
+                dir_blocks_needed = 1;
+            }
+            unsigned long current_dir_block_no = structures->inode_table[dir_inode_no].first_data_block;
+            unsigned long last_kept_dir_block_no = 0;
+            unsigned long dir_block_index;
+            for(dir_block_index = 0; current_dir_block_no != 0 && dir_block_index < dir_blocks_needed; dir_block_index++) {
+                last_kept_dir_block_no = current_dir_block_no;
+                current_dir_block_no = _get_block_link(fsfd, structures->master_block_pointer, current_dir_block_no);
+            }
+            if(current_dir_block_no != 0) {
+                structures->inode_table[dir_inode_no].generation++;
+                _set_block_link(fsfd, structures->master_block_pointer, last_kept_dir_block_no, 0);
+                _journal_dirty_link(structures, last_kept_dir_block_no);
+                _set_file_tail(&structures->inode_table[dir_inode_no], last_kept_dir_block_no, dir_block_index - 1);
+                while(current_dir_block_no != 0) {
+                    unsigned long next_dir_block_no = _get_block_link(fsfd, structures->master_block_pointer,
+                                                                      current_dir_block_no);
+                    _set_block_link(fsfd, structures->master_block_pointer, current_dir_block_no, 0);
                     _free_data_block(structures, current_dir_block_no);
-                    if(previous_dir_block_no == 0) {
-                        structures->inode_table[dir_inode_no].first_data_block = 0;
-                    }
-                    else {
-                        lseek(fsfd, (structures->master_block_pointer->data_start_block + previous_dir_block_no + 1)
-                                                    * structures->master_block_pointer->block_size - sizeof(unsigned long), SEEK_SET);
-                        unsigned long zero = 0;
-                        write(fsfd, &zero, sizeof(unsigned long));
-                    }
+                    current_dir_block_no = next_dir_block_no;
                 }
-                simplefs_lseek_unsafe(dir_fd, structures, SEEK_SET, 0, fsfd);
-                char* dir_block = malloc(structures->master_block_pointer->block_size - sizeof(unsigned long));
-                _read_unsafe(dir_fd, &dir_block, sizeof(block), fsfd,
-                            _load_inode_from_file_structure(structures, _get_file_by_fd(dir_fd))->size);
-                free(dir_block);
             }
 
-            free(dir_inode);
+            _pool_free(dir_inode, sizeof(inode));
             break;
         }
         //kiedy w bloku nie mieści się więcej sygnatur, przeskocz o różnicę
@@ -1135,15 +5016,23 @@ int simplefs_unlink(char *name, int fsfd) { //Michal
         _try_lock_lock_inode(structures->master_block_pointer, fsfd);
     }
     _uninitilize_structures(structures);
-    simplefs_close(dir_fd);
+    _close_unlocked(dir_fd);
     free(path);
     free(dir_path);
-    free(file_inode);
+    _pool_free(file_inode, sizeof(inode));
+    _journal_end_operation(fsfd);
     return OK;
 }
 
+int simplefs_unlink(char *name, int fsfd) { //Michal
+    mounted_fs * mounted = _operations_lock(fsfd);
+    int result = _unlink_unlocked(name, fsfd);
+    _operations_unlock(mounted);
+    return result;
+}
+
 int simplefs_mkdir(char *name, int fsfd) { //Michal
-    return _create_file_or_dir(name, fsfd, TRUE);
+    return _create_file_or_dir(name, fsfd, TRUE, FILE_LAYOUT_CHAIN);
 }
 
 void _try_lock_lock_inode(master_block * mb, int fsfd) {
@@ -1196,7 +5085,8 @@ void _lock_lock_file(master_block * mb, int fsfd) {
     DEBUG("mmapped counter, address = %d\n", counter);
     DEBUG("Co wychodzi? %X\n", (mb->data_start_block * mb->block_size) & ~(sysconf(_SC_PAGE_SIZE) - 1));
     DEBUG("Counter = %d", *counter);
-    (*counter)++;
+    // licznik zmieniają także wątki tego procesu, których blokada fcntl nie wyklucza (pula operacji asynchronicznych)
+    __sync_fetch_and_add(counter, 1);
     DEBUG("Counter = %d", *counter);
     DEBUG("Munmap result = %d\n", munmap_enhanced(counter, sizeof(int), delta));
     //unlock lock block
@@ -1216,50 +5106,269 @@ void _unlock_lock_file(master_block * mb, int fsfd) {
     unsigned delta;
     int * counter = (int *) mmap_enhanced(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED,
                     fsfd, mb->data_start_block * mb->block_size, &delta);
-    (*counter)--;
-    int value = *counter;
+    int value = __sync_sub_and_fetch(counter, 1);
     munmap_enhanced(counter, sizeof(int), delta);
     if(value != 0) {
         _try_lock_lock_inode(mb, fsfd);
     } else {
         _unlock_lock_inode(mb, fsfd);
     }
-    //unlock lock block
-    lock_block.l_type = F_UNLCK;
-    fcntl(fsfd, F_SETLK, &lock_block);
+    //unlock lock block
+    lock_block.l_type = F_UNLCK;
+    fcntl(fsfd, F_SETLK, &lock_block);
+}
+
+/**
+ * Zwraca wartość licznika pliku .lock
+ */
+int _get_lock_counter(int fsfd, master_block* masterblock) {
+    //licznik jest zmieniany przez mmap, więc czytany jest z pominięciem pamięci podręcznej bloków
+    int counter;
+    pread(fsfd, &counter, sizeof(int), masterblock->data_start_block * masterblock->block_size);
+    return counter;
+}
+
+/**
+ * Funkcja oznaczajaca inode jako pusty i uaktualniająca w masterblocku wpis pierwszego wolnego inode'u, jeśli to konieczne
+ */
+void _mark_inode_as_empty(initialized_structures* structures, unsigned long inode_no) {
+    //mark inode as empty
+    structures->inode_table[inode_no].type = INODE_EMPTY;
+    structures->inode_table[inode_no].generation++;
+    _journal_dirty_inode(structures, inode_no);
+    _journal_dirty_master_block(structures);
+    //update first free inode if applicable
+    if(inode_no < structures->master_block_pointer->first_free_inode || structures->master_block_pointer->first_free_inode == 0) {
+        structures->master_block_pointer->first_free_inode = inode_no;
+    }
+}
+
+/**
+ * Dopisuje dane do pliku tylko do dopisywania (simplefs_set_append_only), niezależnie od pozycji deskryptora.
+ * Zakres rezerwowany jest atomowym zwiększeniem append_cursor w inodzie, pod blokadą first free block przydzielane są
+ * tylko brakujące bloki zakresu (bez zerowania - każdy bajt pliku zapisze jego rezerwujący), a dane kopiowane są już
+ * bez blokady. Zarezerwowany zakres zwracany jest w [*range_start, *range_end) - rozmiar pliku przesuwa za niego
+ * _append_publish, już po zwolnieniu pliku .lock.
+ * Wywoływana z zablokowanym plikiem .lock.
+ */
+int _write_append_unsafe(initialized_structures * initialized_structures_pointer, file * file_pointer,
+                         inode * file_inode, char * buf, int len, int fsfd, unsigned long * range_start,
+                         unsigned long * range_end) {
+    *range_start = 0;
+    *range_end = 0;
+    if (file_pointer->mode == READ_MODE) {
+        return WRONG_MODE;
+    }
+    if (len <= 0) {
+        return OK;
+    }
+    master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
+    unsigned long start = __sync_fetch_and_add(&file_inode->append_cursor, (unsigned long) len);
+    unsigned long end = start + len;
+    *range_start = start;
+    *range_end = end;
+    const block_geometry * geometry = &file_pointer->geometry;
+    unsigned long offset_in_block;
+    unsigned long first_index = _block_split(geometry, start, &offset_in_block);
+    unsigned long number_of_blocks = _block_split(geometry, end - 1, &offset_in_block) - first_index + 1;
+    unsigned long blocks_table_size = sizeof(unsigned long) * number_of_blocks;
+    unsigned long * blocks_table = (unsigned long *) _pool_alloc(blocks_table_size);
+
+    struct flock flock_structure;
+    _block_first_free_block(fsfd, &flock_structure);
+    if (file_pointer->reserved_blocks > 0) {
+        master_block_pointer->number_of_reserved_blocks -= file_pointer->reserved_blocks;
+        _journal_dirty_master_block(initialized_structures_pointer);
+    }
+    file_pointer->reserved_blocks = 0;
+    file_pointer->reserved_end = 0;
+    int result = _map_file_blocks(initialized_structures_pointer, file_pointer, file_inode, first_index,
+                                  first_index + number_of_blocks - 1, blocks_table, start, end, 0, FALSE);
+    _journal_dirty_inode(initialized_structures_pointer, file_pointer->inode_no);
+    _unblock_first_free_block(fsfd, &flock_structure);
+
+    if (result == OK) {
+        write_params params;
+        params.data = buf;
+        params.data_length = len;
+        params.fd = file_pointer->fd;
+        params.fsfd = fsfd;
+        params.lock_blocks = 0;
+        params.file_offset = start;
+        params.for_each_record = NULL;
+        params.additional_param = NULL;
+        _save_buffer_to_file(initialized_structures_pointer, &params, &file_pointer->geometry, blocks_table, start);
+        _set_file_cursor(file_pointer, file_inode, first_index + number_of_blocks - 1,
+                         blocks_table[number_of_blocks - 1]);
+    } else {
+        // zakresu nie można już oddać - staje się zerami: dziurą lub wyzerowaną częścią bloków sąsiednich zapisów
+        _zero_file_range(initialized_structures_pointer, file_pointer, file_inode, start, end);
+    }
+    _pool_free(blocks_table, blocks_table_size);
+    return result;
+}
+
+/**
+ * Przesuwa rozmiar pliku tylko do dopisywania - granicę widoczną dla czytelników - ze start na end, gdy zakończą się
+ * wszystkie zapisy zakresów zarezerwowanych przed [start, end). Czeka co najwyżej APPEND_PUBLISH_TIMEOUT_MS; zapis
+ * procesu zakończonego w trakcie pracy wstrzymuje wzrost rozmiaru do ponownego montowania obrazu przez jedynego
+ * montującego (_repair_mount_state). Wywoływana bez blokady pliku .lock.
+ * @return {OK} sukces, {APPEND_TIMEOUT} wcześniejszy zapis się nie zakończył lub plik został usunięty
+ */
+int _append_publish(file * file_pointer, inode * file_inode, unsigned long start, unsigned long end) {
+    unsigned long generation = file_inode->generation;
+    unsigned tries;
+    for (tries = 0; !__sync_bool_compare_and_swap(&file_inode->size, start, end); tries++) {
+        if (tries >= APPEND_PUBLISH_TIMEOUT_MS + APPEND_PUBLISH_SPINS || file_inode->type != INODE_FILE
+            || file_inode->generation != generation) {
+            return APPEND_TIMEOUT;
+        }
+        if (tries < APPEND_PUBLISH_SPINS) {
+            sched_yield();
+        } else {
+            usleep(1000);
+        }
+    }
+    file_pointer->position = end;
+    return OK;
+}
+
+/**
+ * Zapis od bieżącej pozycji deskryptora z pominięciem bufora zapisów.
+ */
+int _write_direct(int fd, char *buf, int len, int fsfd) {
+    initialized_structures * initialized_structures_pointer = _initialize_structures(fsfd, 1);
+    if (initialized_structures_pointer == NULL) {
+        DEBUG("Blad");
+        return -1;
+    }
+    file * file_pointer = _get_file_by_fd(fd);
+    if (file_pointer == NULL) {
+        _uninitilize_structures(initialized_structures_pointer);
+        return FD_NOT_FOUND;
+    }
+    _try_lock_lock_inode(initialized_structures_pointer->master_block_pointer, fsfd);
+    _lock_lock_file(initialized_structures_pointer->master_block_pointer, fsfd);
+
+    inode * file_inode = _load_inode_from_file_structure(initialized_structures_pointer, file_pointer);
+    if (file_inode->append_only) {
+        unsigned long start;
+        unsigned long end;
+        int result = _write_append_unsafe(initialized_structures_pointer, file_pointer, file_inode, buf, len, fsfd,
+                                          &start, &end);
+        _unlock_lock_file(initialized_structures_pointer->master_block_pointer, fsfd);
+        _unlock_lock_inode(initialized_structures_pointer->master_block_pointer, fsfd);
+        // czekający na wcześniejsze zapisy nie trzyma licznika .lock - nie wstrzymuje usuwania plików
+        if (start != end) {
+            mounted_fs * mounted = _get_mounted_fs(fsfd);
+            if (result == OK && mounted != NULL && (mounted->journal.mode & JOURNAL_ORDERED)) {
+                _journal_ordered_barrier(mounted);
+            }
+            int publish_result = _append_publish(file_pointer, file_inode, start, end);
+            if (result == OK) {
+                result = publish_result;
+            }
+        }
+        _uninitilize_structures(initialized_structures_pointer);
+        _journal_end_operation(fsfd);
+        return result;
+    }
+
+    // bloki zapisu przydzielone bez zerowania (simplefs_fallocate) - zerowane są tylko ich części poza zapisem
+    unsigned long position = file_pointer->position;
+    const block_geometry * geometry = &file_pointer->geometry;
+    unsigned long offset_in_block;
+    unsigned long write_from = _block_split(geometry, position, &offset_in_block) * geometry->real_block_size;
+    unsigned long write_to = len > 0 ? (_block_split(geometry, position + len - 1, &offset_in_block) + 1)
+                                       * geometry->real_block_size : write_from;
+    int unwritten = file_inode->unwritten_start < file_inode->unwritten_end && write_from < write_to
+                    && write_from < file_inode->unwritten_end && write_to > file_inode->unwritten_start;
+    if (unwritten) {
+        _clear_unwritten_blocks(initialized_structures_pointer, file_pointer, file_inode, write_from, write_to,
+                                position, position + len);
+    }
+
+    write_params write_params_structure;
+    write_params_structure.data_length = len;
+    write_params_structure.data = buf;
+    write_params_structure.fsfd = fsfd;
+    write_params_structure.fd = fd;
+    write_params_structure.lock_blocks = 0;
+    write_params_structure.file_offset = file_pointer->position;
+    write_params_structure.for_each_record = NULL;
+    int result = _write_unsafe(initialized_structures_pointer, write_params_structure);
+    if (unwritten) {
+        // bloki zapisu nie są już oznaczone - zakres w inodzie zmniejsza się, jeśli zapis pokrył jego początek lub koniec
+        if (file_inode->unwritten_start >= write_from) {
+            file_inode->unwritten_start = write_to;
+        }
+        if (file_inode->unwritten_end <= write_to) {
+            file_inode->unwritten_end = write_from;
+        }
+        if (file_inode->unwritten_start >= file_inode->unwritten_end) {
+            file_inode->unwritten_start = 0;
+            file_inode->unwritten_end = 0;
+        }
+        _journal_dirty_inode(initialized_structures_pointer, file_pointer->inode_no);
+    }
+
+    _unlock_lock_file(initialized_structures_pointer->master_block_pointer, fsfd);
+    _unlock_lock_inode(initialized_structures_pointer->master_block_pointer, fsfd);
+
+    _uninitilize_structures(initialized_structures_pointer);
+    _journal_end_operation(fsfd);
+    return result;
 }
 
 /**
- * Zwraca wartość licznika pliku .lock
+ * Zapisuje zawartość bufora zapisów deskryptora od pozycji pierwszego zgromadzonego bajtu, nie zmieniając pozycji
+ * deskryptora (jest już przesunięta za buforowane dane). Po błędzie dane zostają w buforze.
  */
-int _get_lock_counter(int fsfd, master_block* masterblock) {
-    block* lock_block = _read_block(fsfd, 0, masterblock->data_start_block, masterblock->block_size);
-    int counter = *((int*) lock_block->data);
-    free(lock_block->data);
-    free(lock_block);
-    return counter;
+int _flush_write_buffer(file * file_pointer) {
+    if (file_pointer->write_buffer_length == 0) {
+        return OK;
+    }
+    unsigned long position = file_pointer->position;
+    file_pointer->position = file_pointer->write_buffer_position;
+    int result = _write_direct(file_pointer->fd, file_pointer->write_buffer, file_pointer->write_buffer_length,
+                               file_pointer->fsfd);
+    file_pointer->position = position;
+    if (result == OK) {
+        file_pointer->write_buffer_length = 0;
+    }
+    return result;
 }
 
 /**
- * Funkcja oznaczajaca inode jako pusty i uaktualniająca w masterblocku wpis pierwszego wolnego inode'u, jeśli to konieczne
+ * Zamknięcie deskryptora bez blokady operations_lock - simplefs_close.
  */
-void _mark_inode_as_empty(initialized_structures* structures, unsigned long inode_no) {
-    //mark inode as empty
-    structures->inode_table[inode_no].type = INODE_EMPTY;
-    //update first free inode if applicable
-    if(inode_no < structures->master_block_pointer->first_free_inode || structures->master_block_pointer->first_free_inode == 0) {
-        structures->master_block_pointer->first_free_inode = inode_no;
+int _close_unlocked(int fd) {
+    file* file_found = _get_file_by_fd(fd);
+    if(file_found == NULL) {
+        return UNKNOWN_DESCRIPTOR;
     }
+    int result = _flush_write_buffer(file_found);
+    if (result != OK) {
+        // buforowane dane zostają - zamknięcie można powtórzyć
+        return result;
+    }
+    pthread_mutex_lock(&open_files_write_mutex);
+    HASH_DEL(open_files, file_found);
+    pthread_mutex_unlock(&open_files_write_mutex);
+    free(file_found->write_buffer);
+    free(file_found);
+    return result;
 }
 
 int simplefs_close(int fd) {
-    file* file_found;
-    HASH_FIND_INT( open_files, &fd, file_found);
-    if(file_found == NULL) {
+    file * file_pointer = _get_file_by_fd(fd);
+    if (file_pointer == NULL) {
         return UNKNOWN_DESCRIPTOR;
     }
-    HASH_DEL(open_files, file_found);
-    free(file_found);
+    mounted_fs * mounted = _operations_lock(file_pointer->fsfd);
+    int result = _close_unlocked(fd);
+    _operations_unlock(mounted);
+    return result;
 }
 
 /**
@@ -1267,7 +5376,7 @@ int simplefs_close(int fd) {
  * @param is_dir jeśli 0, tworzony jest plik, jeśli 1 - katalog
  * @return 0 lub kod błędu
  */
-int _create_file_or_dir(char *name, int fsfd, int is_dir) {
+int _create_file_or_dir_unlocked(char *name, int fsfd, int is_dir, int layout) {
 
     int result = OK;
     int full_path_length = strlen(name);
@@ -1319,6 +5428,19 @@ int _create_file_or_dir(char *name, int fsfd, int is_dir) {
         new_file.type = (is_dir ? 'D' : 'F');
         new_file.size = 0;
         new_file.first_data_block = 0;
+        new_file.generation = 0;
+        new_file.allocated_blocks = 0;
+        new_file.unwritten_start = 0;
+        new_file.unwritten_end = 0;
+        new_file.next_orphan_inode = 0;
+        new_file.last_data_block = 0;
+        new_file.last_block_index = 0;
+        new_file.append_only = FALSE;
+        new_file.append_cursor = 0;
+        new_file.layout = layout;
+        new_file.block_map_levels = 0;
+        new_file.block_map = 0;
+        new_file.fragment = 0;
         unsigned long inode_no = _insert_new_inode(&new_file, is, fsfd);
         if(inode_no == 0) {
             result =  NO_FREE_INODES;
@@ -1351,18 +5473,141 @@ int _create_file_or_dir(char *name, int fsfd, int is_dir) {
         if(result == NO_FREE_BLOCKS || result == FILE_ALREADY_EXISTS) {
             _mark_inode_as_empty(is, inode_no);
         }
-        simplefs_close(fd);
+        _close_unlocked(fd);
     } while( FALSE );
     _unlock_lock_file(is->master_block_pointer, fsfd);
     _uninitilize_structures(is);
-    free(parent_node);
+    _pool_free(parent_node, sizeof(inode));
     free(path);
     free(file_name);
+    _journal_end_operation(fsfd);
+    return result;
+}
+
+/**
+ * Tworzenie pliku lub katalogu z blokadą operations_lock.
+ */
+int _create_file_or_dir(char *name, int fsfd, int is_dir, int layout) {
+    mounted_fs * mounted = _operations_lock(fsfd);
+    int result = _create_file_or_dir_unlocked(name, fsfd, is_dir, layout);
+    _operations_unlock(mounted);
     return result;
 }
 
 int simplefs_creat(char *name, int fsfd) { //Adam
-    return _create_file_or_dir(name, fsfd, FALSE);
+    return _create_file_or_dir(name, fsfd, FALSE, FILE_LAYOUT_CHAIN);
+}
+
+int simplefs_creat_layout(char *name, int layout, int fsfd) {
+    if (layout != FILE_LAYOUT_CHAIN && layout != FILE_LAYOUT_MAPPED && layout != FILE_LAYOUT_EXTENTS) {
+        return WRONG_MODE;
+    }
+    return _create_file_or_dir(name, fsfd, FALSE, layout);
+}
+
+/**
+ * Funkcja zlecająca hostowi wczytanie z wyprzedzeniem kolejnych bloków pliku czytanego sekwencyjnie.
+ * Okno readahead jest podwajane przy kolejnych odczytach sekwencyjnych (do READAHEAD_MAX_BLOCKS) i zerowane przy
+ * odczycie losowym. Kolejne okno zlecane jest, gdy czytelnik minie połowę poprzedniego. Bloki okna wyznaczane są
+ * z łańcucha pliku, a każdy ciągły fragment zlecany jest jednym wywołaniem.
+ * @param start_position pozycja w pliku, od której zaczął się bieżący odczyt
+ * @param next_block_number numer następnego bloku do przeczytania (0 = koniec łańcucha)
+ * @param next_block_index indeks tego bloku w pliku
+ * @param file_blocks liczba bloków zajmowanych przez plik
+ */
+void _readahead(int fsfd, master_block * masterblock, file * file_pointer, unsigned long start_position,
+                unsigned long next_block_number, unsigned long next_block_index, unsigned long file_blocks) {
+    if (start_position != file_pointer->last_read_end) {
+        // odczyt losowy - wyłączenie readahead
+        file_pointer->readahead_window = 0;
+        file_pointer->readahead_next_index = 0;
+        return;
+    }
+    if (next_block_number == 0 || next_block_index >= file_blocks) {
+        return;
+    }
+    if (file_pointer->readahead_window != 0
+        && next_block_index + file_pointer->readahead_window / 2 < file_pointer->readahead_next_index) {
+        // czytelnik jest jeszcze w pierwszej połowie zleconego okna
+        return;
+    }
+    if (file_pointer->readahead_window == 0) {
+        file_pointer->readahead_window = READAHEAD_MIN_BLOCKS;
+    } else if (file_pointer->readahead_window < READAHEAD_MAX_BLOCKS) {
+        file_pointer->readahead_window *= 2;
+    }
+
+    unsigned long first_index = next_block_index;
+    if (file_pointer->readahead_next_index > first_index) {
+        first_index = file_pointer->readahead_next_index;
+    }
+    unsigned long last_index = next_block_index + file_pointer->readahead_window;
+    if (last_index > file_blocks) {
+        last_index = file_blocks;
+    }
+    if (first_index >= last_index) {
+        return;
+    }
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    unsigned long block_no = next_block_number;
+    unsigned long block_index = next_block_index;
+    unsigned long run_start = 0, run_length = 0;
+    while (block_no != 0 && block_no < masterblock->number_of_blocks && block_index < last_index) {
+        if (block_index >= first_index) {
+            if (run_length > 0 && block_no == run_start + run_length) {
+                run_length++;
+            } else {
+                if (run_length > 0) {
+                    _io_advise(mounted, fsfd, _get_block_offset(masterblock, run_start), run_length * masterblock->block_size);
+                }
+                run_start = block_no;
+                run_length = 1;
+            }
+        }
+        if (block_index + 1 >= last_index) {
+            break;
+        }
+        block_index += _next_file_block(fsfd, masterblock, &block_no);
+    }
+    if (run_length > 0) {
+        _io_advise(mounted, fsfd, _get_block_offset(masterblock, run_start), run_length * masterblock->block_size);
+    }
+    DEBUG("Readahead: bloki pliku %lu - %lu (okno %lu)\n", first_index, last_index, file_pointer->readahead_window);
+    file_pointer->readahead_next_index = last_index;
+}
+
+/**
+ * Odczyt z kolejnych bloków pliku - jeden blok na indeks zadania (_parallel_for).
+ */
+typedef struct block_read_job_t {
+    int fsfd;
+    master_block * masterblock;
+    unsigned long block_data_size;
+    unsigned long * blocks;                 // numery czytanych bloków
+    unsigned long first_block_position;     // pozycja w pliku początku pierwszego bloku
+    unsigned long position;                 // pozycja w pliku początku odczytu
+    unsigned long length;
+    char * buf;
+} block_read_job;
+
+/**
+ * Kopiuje do bufora część odczytu przypadającą na blok.
+ */
+void _read_block_of_buffer(void * job_pointer, unsigned long index) {
+    block_read_job * job = (block_read_job *) job_pointer;
+    unsigned long block_data_size = job->block_data_size;
+    unsigned long block_start = job->first_block_position + index * block_data_size;
+    unsigned long from = block_start > job->position ? block_start : job->position;
+    unsigned long to = block_start + block_data_size;
+    if (to > job->position + job->length) {
+        to = job->position + job->length;
+    }
+    if (job->blocks[index] == 0) {
+        memset(job->buf + (from - job->position), 0, to - from);
+        return;
+    }
+    _read_from_block(job->fsfd, job->blocks[index] + job->masterblock->data_start_block, job->masterblock->block_size,
+                     from - block_start, job->buf + (from - job->position), to - from);
 }
 
 /**
@@ -1380,108 +5625,542 @@ int _read_unsafe(int fd, char* buf, int len, int fsfd, unsigned long file_size)
     }
 
     unsigned long position = file_pointer->position;
-    unsigned long current_block_number = _load_inode_from_file_structure(initialized_structures_pointer, file_pointer)->first_data_block;
-    unsigned long current_position = 0;
-    block t;
-    unsigned long block_data_size =  masterblock->block_size - sizeof(t.next_data_block); //realny rozmiar bloku
-    //przesuwamu sie przez dane które nasz position ignoruje
-    while (current_position + block_data_size <= position && current_block_number != 0 && current_position + block_data_size <= file_size) {
-        current_block_number = _find_next_block(fsfd, current_block_number,  masterblock->data_start_block, masterblock->block_size);
-        current_position += block_data_size;
-    }
+    inode * file_inode = _load_inode_from_file_structure(initialized_structures_pointer, file_pointer);
+    const block_geometry * geometry = &file_pointer->geometry;
+    unsigned long block_data_size = geometry->real_block_size; //realny rozmiar bloku
+    unsigned long position_in_read_block;
+    //blok, od którego zaczyna się odczyt, lub pierwszy blok za dziurą, w której się zaczyna
+    unsigned long first_index = _block_split(geometry, position, &position_in_read_block);
+    unsigned long current_block_number;
+    unsigned long current_block_index = _find_file_block(fsfd, masterblock, file_pointer, file_inode, first_index,
+                                                         &current_block_number);
     unsigned long data_read = 0;
-    block * current_block;
-    unsigned first_block = 1;
-    while (current_block_number != 0 && data_read < len && current_position < file_size) { //dopoki mozna czytac
-        current_block = _read_block(fsfd, current_block_number, masterblock->data_start_block, masterblock->block_size);
-        if (first_block) { //pierwszy czytany blok
-            unsigned long position_in_read_block = (position == current_position ? 0 : position - current_position);
-            current_position += position_in_read_block;
-            unsigned long portion_to_read = block_data_size - position_in_read_block; //ile chcemy wczytac
-            if (portion_to_read > len) { //jak wiecej niz powinnismy
-                portion_to_read = len;
+    unsigned long to_read = position < file_size ? file_size - position : 0;
+    if (to_read > len) {
+        to_read = len;
+    }
+    unsigned long fragment = file_inode->fragment;
+    if (fragment != 0 && to_read > 0) {
+        //mały plik - cała zawartość we fragmentach
+        _fragment_read(fsfd, masterblock, fragment, position, buf, to_read);
+        data_read = to_read;
+    }
+    unsigned long last_offset;
+    unsigned long number_of_blocks_to_read = to_read == 0 ? 0
+                                             : _block_split(geometry, position + to_read - 1, &last_offset) - first_index + 1;
+    if (current_block_number != 0 && number_of_blocks_to_read >= parallel_operations.min_blocks
+        && parallel_operations.number_of_threads > 0) {
+        //duży odczyt - po wyznaczeniu numerów bloków (0 = dziura) dane kopiowane są równolegle przez wątki puli
+        unsigned long * blocks = (unsigned long *) _pool_alloc(sizeof(unsigned long) * number_of_blocks_to_read);
+        unsigned long i;
+        for (i = 0; i < number_of_blocks_to_read; i++) {
+            if (current_block_number != 0 && current_block_index == first_index + i) {
+                blocks[i] = current_block_number;
+                _set_file_cursor(file_pointer, file_inode, current_block_index, current_block_number);
+                current_block_index += _next_file_block(fsfd, masterblock, &current_block_number);
+            } else {
+                blocks[i] = 0;
+            }
+        }
+        block_read_job job;
+        job.fsfd = fsfd;
+        job.masterblock = masterblock;
+        job.block_data_size = block_data_size;
+        job.blocks = blocks;
+        job.first_block_position = position - position_in_read_block;
+        job.position = position;
+        job.length = to_read;
+        job.buf = buf;
+        _parallel_for(number_of_blocks_to_read, _read_block_of_buffer, &job);
+        _pool_free(blocks, sizeof(unsigned long) * number_of_blocks_to_read);
+        data_read = to_read;
+    }
+    unsigned long block_index = first_index;
+    while (data_read < to_read) { //dopoki mozna czytac
+        unsigned long portion_to_read = block_data_size - position_in_read_block;
+        if (portion_to_read > to_read - data_read) {
+            portion_to_read = to_read - data_read;
+        }
+        if (current_block_number != 0 && current_block_index == block_index) {
+            block * current_block = _read_file_block(fsfd, masterblock, current_block_number);
+            memcpy(buf + data_read, current_block->data + position_in_read_block, portion_to_read);
+            _set_file_cursor(file_pointer, file_inode, current_block_index, current_block_number);
+            current_block_number = BLOCK_LINK_NUMBER(current_block->next_data_block);
+            current_block_index += 1 + BLOCK_LINK_HOLE(current_block->next_data_block);
+            free_block_struct(current_block);
+        } else {
+            //dziura - zera bez odczytu z dysku
+            memset(buf + data_read, 0, portion_to_read);
+        }
+        data_read += portion_to_read;
+        block_index++;
+        position_in_read_block = 0;
+    }
+    _readahead(fsfd, masterblock, file_pointer, position, current_block_number, current_block_index,
+               _block_count(geometry, file_size));
+    //bloki przydzielone bez zerowania czytane są jako zera
+    if (file_inode->unwritten_start < file_inode->unwritten_end) {
+        _read_zero_unwritten(fsfd, masterblock, file_pointer, file_inode, position, buf, data_read);
+    }
+    file_pointer->position += data_read;
+    file_pointer->last_read_end = file_pointer->position;
+    _uninitilize_structures(initialized_structures_pointer);
+    return data_read;
+}
+
+/**
+ * Odczyt bez blokady operations_lock - simplefs_read.
+ */
+int _read_unlocked(int fd, char *buf, int len, int fsfd) {
+    file * file_pointer = _get_file_by_fd(fd);
+    if (file_pointer == NULL) {
+        return FD_NOT_FOUND;
+    }
+    initialized_structures * initialized_structures_pointer = _initialize_structures(fsfd, 1);
+    _lock_lock_file(initialized_structures_pointer->master_block_pointer, fsfd);
+    unsigned long file_size = _load_inode_from_file_structure(initialized_structures_pointer, file_pointer)->size;
+    _unlock_lock_file(initialized_structures_pointer->master_block_pointer, fsfd);
+    _uninitilize_structures(initialized_structures_pointer);
+    return _read_unsafe(fd, buf, len, fsfd, file_size);
+}
+
+int simplefs_read(int fd, char *buf, int len, int fsfd) { //Adam
+    // zapis bufora przydziela bloki - nie może się odbywać pod blokadą współdzieloną
+    int flush_result = simplefs_flush(fd, fsfd);
+    if (flush_result != OK) {
+        return flush_result;
+    }
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    if (mounted == NULL) {
+        return _read_unlocked(fd, buf, len, fsfd);
+    }
+    pthread_rwlock_rdlock(&mounted->operations_lock);
+    int result = _read_unlocked(fd, buf, len, fsfd);
+    pthread_rwlock_unlock(&mounted->operations_lock);
+    return result;
+}
+
+/**
+ * Rezerwuje bloki potrzebne, by plik deskryptora sięgał pozycji end - zwiększa licznik zarezerwowanych bloków
+ * w master bloku bez wybierania bloków.
+ * @return {OK} sukces, {NO_FREE_BLOCKS} brak miejsca (rezerwacja nie zmienia się)
+ */
+int _reserve_blocks(file * file_pointer, unsigned long end) {
+    if (end <= file_pointer->reserved_end) {
+        return OK;
+    }
+    initialized_structures * initialized_structures_pointer = _initialize_structures(file_pointer->fsfd, 1);
+    if (initialized_structures_pointer == NULL) {
+        return -1;
+    }
+    master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
+    unsigned long real_block_size = _block_payload(master_block_pointer);
+    struct flock flock_structure;
+    _block_first_free_block(file_pointer->fsfd, &flock_structure);
+
+    inode * file_inode = _load_inode_from_file_structure(initialized_structures_pointer, file_pointer);
+    unsigned long taken_blocks = _get_number_of_taken_blocks(file_inode, real_block_size);
+    unsigned long needed_blocks = (end + real_block_size - 1) / real_block_size;
+    int result = OK;
+    if (needed_blocks > taken_blocks + file_pointer->reserved_blocks) {
+        unsigned long missing_blocks = needed_blocks - taken_blocks - file_pointer->reserved_blocks;
+        // jak w _find_free_blocks - ostatni wolny blok nie jest przydzielany
+        if (_available_blocks(master_block_pointer) <= missing_blocks) {
+            _reclaim_orphan_blocks(initialized_structures_pointer, file_pointer->fsfd,
+                                   missing_blocks + 1 - _available_blocks(master_block_pointer));
+        }
+        if (_available_blocks(master_block_pointer) <= missing_blocks) {
+            result = NO_FREE_BLOCKS;
+        } else {
+            master_block_pointer->number_of_reserved_blocks += missing_blocks;
+            file_pointer->reserved_blocks += missing_blocks;
+            _journal_dirty_master_block(initialized_structures_pointer);
+        }
+    }
+    if (result == OK) {
+        file_pointer->reserved_end = (taken_blocks + file_pointer->reserved_blocks) * real_block_size;
+    }
+
+    _unblock_first_free_block(file_pointer->fsfd, &flock_structure);
+    _uninitilize_structures(initialized_structures_pointer);
+    return result;
+}
+
+/**
+ * Zapis bez blokady operations_lock - simplefs_write.
+ */
+int _write_unlocked(int fd, char *buf, int len, int fsfd) {
+    file * file_pointer = _get_file_by_fd(fd);
+    if (file_pointer == NULL) {
+        return FD_NOT_FOUND;
+    }
+    if (file_pointer->write_buffer == NULL) {
+        return _write_direct(fd, buf, len, fsfd);
+    }
+    if (file_pointer->mode == READ_MODE) {
+        return WRONG_MODE;
+    }
+    // bufor przyjmuje tylko dane bezpośrednio za już zgromadzonymi
+    int result = OK;
+    if (file_pointer->write_buffer_length > 0
+        && (file_pointer->write_buffer_position + file_pointer->write_buffer_length != file_pointer->position
+            || (file_pointer->write_buffer_length + len > file_pointer->write_buffer_size
+                && !file_pointer->delayed_allocation))) {
+        result = _flush_write_buffer(file_pointer);
+        if (result != OK) {
+            return result;
+        }
+    }
+    if (file_pointer->delayed_allocation) {
+        result = _reserve_blocks(file_pointer, file_pointer->position + len);
+        if (result != OK) {
+            return result;
+        }
+        if (file_pointer->write_buffer_length + len > file_pointer->write_buffer_size) {
+            unsigned long new_size = file_pointer->write_buffer_size * 2;
+            if (new_size < file_pointer->write_buffer_length + len) {
+                new_size = file_pointer->write_buffer_length + len;
+            }
+            char * new_buffer = realloc(file_pointer->write_buffer, new_size);
+            if (new_buffer == NULL) {
+                return _write_direct(fd, buf, len, fsfd);
+            }
+            file_pointer->write_buffer = new_buffer;
+            file_pointer->write_buffer_size = new_size;
+        }
+    } else if (len > file_pointer->write_buffer_size) {
+        return _write_direct(fd, buf, len, fsfd);
+    }
+    if (file_pointer->write_buffer_length == 0) {
+        file_pointer->write_buffer_position = file_pointer->position;
+    }
+    memcpy(file_pointer->write_buffer + file_pointer->write_buffer_length, buf, len);
+    file_pointer->write_buffer_length += len;
+    file_pointer->position += len;
+    if (file_pointer->write_buffer_length == file_pointer->write_buffer_size) {
+        result = _flush_write_buffer(file_pointer);
+    }
+    return result;
+}
+
+int simplefs_write(int fd, char *buf, int len, int fsfd) { //Mateusz
+    mounted_fs * mounted = _operations_lock(fsfd);
+    int result = _write_unlocked(fd, buf, len, fsfd);
+    _operations_unlock(mounted);
+    return result;
+}
+
+int simplefs_flush(int fd, int fsfd) {
+    file * file_pointer = _get_file_by_fd(fd);
+    if (file_pointer == NULL) {
+        return FD_NOT_FOUND;
+    }
+    if (file_pointer->write_buffer_length == 0) {
+        return OK;
+    }
+    mounted_fs * mounted = _operations_lock(fsfd);
+    int result = _flush_write_buffer(file_pointer);
+    _operations_unlock(mounted);
+    return result;
+}
+
+int simplefs_set_write_buffer(int fd, unsigned long buffer_size, int fsfd) {
+    file * file_pointer = _get_file_by_fd(fd);
+    if (file_pointer == NULL) {
+        return FD_NOT_FOUND;
+    }
+    mounted_fs * mounted = _operations_lock(fsfd);
+    int result = _flush_write_buffer(file_pointer);
+    if (result != OK) {
+        _operations_unlock(mounted);
+        return result;
+    }
+    free(file_pointer->write_buffer);
+    file_pointer->write_buffer = buffer_size > 0 ? malloc(buffer_size) : NULL;
+    file_pointer->write_buffer_size = buffer_size;
+    if (buffer_size == 0) {
+        file_pointer->delayed_allocation = FALSE;
+    }
+    _operations_unlock(mounted);
+    return result;
+}
+
+int simplefs_set_delayed_allocation(int fd, int enabled, int fsfd) {
+    file * file_pointer = _get_file_by_fd(fd);
+    if (file_pointer == NULL) {
+        return FD_NOT_FOUND;
+    }
+    mounted_fs * mounted = _operations_lock(fsfd);
+    int result = _flush_write_buffer(file_pointer);
+    if (enabled && file_pointer->write_buffer == NULL) {
+        file_pointer->write_buffer = malloc(DELAYED_ALLOCATION_BUFFER);
+        file_pointer->write_buffer_size = DELAYED_ALLOCATION_BUFFER;
+    }
+    file_pointer->delayed_allocation = enabled ? TRUE : FALSE;
+    _operations_unlock(mounted);
+    return result;
+}
+
+/**
+ * Przydział bloków bez blokady operations_lock - simplefs_fallocate.
+ */
+int _fallocate_unlocked(int fd, int mode, unsigned long offset, unsigned long length, int fsfd) {
+    file * file_pointer = _get_file_by_fd(fd);
+    if (file_pointer == NULL) {
+        return FD_NOT_FOUND;
+    }
+    if (file_pointer->mode == READ_MODE) {
+        return WRONG_MODE;
+    }
+    int result = _flush_write_buffer(file_pointer);
+    if (result != OK) {
+        return result;
+    }
+    initialized_structures * initialized_structures_pointer = _initialize_structures(fsfd, 1);
+    if (initialized_structures_pointer == NULL) {
+        return -1;
+    }
+    master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
+    _try_lock_lock_inode(master_block_pointer, fsfd);
+    _lock_lock_file(master_block_pointer, fsfd);
+    struct flock flock_structure;
+    _block_first_free_block(fsfd, &flock_structure);
+
+    inode * file_inode = _load_inode_from_file_structure(initialized_structures_pointer, file_pointer);
+    unsigned long real_block_size = _block_payload(master_block_pointer);
+    unsigned long end = offset + length;
+    unsigned long old_size = file_inode->size;
+    unsigned long first_index = offset / real_block_size;
+    unsigned long last_index = length == 0 ? first_index : (end - 1) / real_block_size;
+    if (file_inode->type != INODE_FILE) {
+        result = NOT_FILE_FD;
+    } else if (file_inode->append_only && (!(mode & FALLOCATE_KEEP_SIZE) || (mode & FALLOCATE_UNWRITTEN))) {
+        // rozmiar pliku tylko do dopisywania zmieniają wyłącznie zapisy
+        result = WRONG_MODE;
+    } else if (length > 0 && (result = _fragment_unpack(initialized_structures_pointer, file_pointer, file_inode)) == OK) {
+        // przydział z góry dotyczy bloków - mały plik opuszcza fragmenty
+        if (!(mode & FALLOCATE_KEEP_SIZE) && end > old_size) {
+            // końcówka bloku z dotychczasowym końcem pliku staje się częścią pliku
+            unsigned long block_end = (old_size / real_block_size + 1) * real_block_size;
+            _zero_file_range(initialized_structures_pointer, file_pointer, file_inode, old_size,
+                             end < block_end ? end : block_end);
+        }
+        // nowe bloki są zerowane w całości, z FALLOCATE_UNWRITTEN tylko w części leżącej w pliku - pozostałe są
+        // oznaczane jako niezapisane
+        unsigned long * blocks_table = (unsigned long *) _pool_alloc(sizeof(unsigned long) * (last_index - first_index + 1));
+        result = _map_file_blocks(initialized_structures_pointer, file_pointer, file_inode, first_index, last_index,
+                                  blocks_table, 0, 0, mode & FALLOCATE_UNWRITTEN ? old_size : (last_index + 1) * real_block_size,
+                                  mode & FALLOCATE_UNWRITTEN);
+        _pool_free(blocks_table, sizeof(unsigned long) * (last_index - first_index + 1));
+        if (result == OK && file_inode->allocated_blocks < last_index + 1) {
+            file_inode->allocated_blocks = last_index + 1;
+        }
+    }
+
+    if (result == OK && length > 0) {
+        if (mode & FALLOCATE_UNWRITTEN) {
+            // zakres w inodzie obejmuje wszystkie oznaczone bloki - nowe oznaczone bloki sięgają za old_size
+            unsigned long first_unwritten = old_size / real_block_size > first_index ? old_size / real_block_size
+                                                                                      : first_index;
+            if (file_inode->unwritten_start >= file_inode->unwritten_end
+                || file_inode->unwritten_start > first_unwritten * real_block_size) {
+                file_inode->unwritten_start = first_unwritten * real_block_size;
             }
-            if (current_position + portion_to_read > file_size) { //jak wyskakuje poza to obicnamy
-                portion_to_read = file_size - current_position;
+            if (file_inode->unwritten_end < (last_index + 1) * real_block_size) {
+                file_inode->unwritten_end = (last_index + 1) * real_block_size;
             }
+        }
+        if (!(mode & FALLOCATE_KEEP_SIZE) && end > old_size) {
+            file_inode->size = end;
+        }
+    }
+
+    if (result == OK) {
+        _journal_dirty_inode(initialized_structures_pointer, file_pointer->inode_no);
+    }
+    _unblock_first_free_block(fsfd, &flock_structure);
+    _unlock_lock_file(master_block_pointer, fsfd);
+    _unlock_lock_inode(master_block_pointer, fsfd);
+    _uninitilize_structures(initialized_structures_pointer);
+    _journal_end_operation(fsfd);
+    return result;
+}
+
+int simplefs_fallocate(int fd, int mode, unsigned long offset, unsigned long length, int fsfd) {
+    mounted_fs * mounted = _operations_lock(fsfd);
+    int result = _fallocate_unlocked(fd, mode, offset, length, fsfd);
+    _operations_unlock(mounted);
+    return result;
+}
+
+/**
+ * Zmiana rozmiaru pliku bez blokady operations_lock - simplefs_ftruncate.
+ */
+int _ftruncate_unlocked(int fd, unsigned long length, int fsfd) {
+    file * file_pointer = _get_file_by_fd(fd);
+    if (file_pointer == NULL) {
+        return FD_NOT_FOUND;
+    }
+    if (file_pointer->mode == READ_MODE) {
+        return WRONG_MODE;
+    }
+    int result = _flush_write_buffer(file_pointer);
+    if (result != OK) {
+        return result;
+    }
+    initialized_structures * initialized_structures_pointer = _initialize_structures(fsfd, 1);
+    if (initialized_structures_pointer == NULL) {
+        return -1;
+    }
+    master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
+    _try_lock_lock_inode(master_block_pointer, fsfd);
+    _lock_lock_file(master_block_pointer, fsfd);
+    struct flock flock_structure;
+    _block_first_free_block(fsfd, &flock_structure);
 
-            memcpy(buf + data_read, current_block->data + position_in_read_block, portion_to_read);
-            data_read += portion_to_read;
-            current_position += portion_to_read;
-            first_block = 0;
-        } else { //tutaj czytamy od poczatku bloku
-            unsigned long portion_to_read = block_data_size;
-            if(data_read + portion_to_read > file_size) {
-                portion_to_read = file_size - data_read;
-            }
-            if(data_read + portion_to_read > len) {
-                portion_to_read = len - data_read;
-            }
-            memcpy(buf + data_read, current_block->data, portion_to_read);
-            data_read += portion_to_read;
-            current_position += portion_to_read;
+    inode * file_inode = _load_inode_from_file_structure(initialized_structures_pointer, file_pointer);
+    unsigned long real_block_size = _block_payload(master_block_pointer);
+    unsigned long old_size = file_inode->size;
+    if (file_inode->type != INODE_FILE) {
+        result = NOT_FILE_FD;
+    } else if (file_inode->append_only) {
+        result = WRONG_MODE;
+    } else if (file_inode->fragment != 0 && _fragment_fits(master_block_pointer, file_inode, length)) {
+        // mały plik pozostaje we fragmentach - bajty za nowym końcem zeruje następny zapis
+        if (length == 0) {
+            unsigned long fragment = file_inode->fragment;
+            file_inode->fragment = 0;
+            _fragment_free(initialized_structures_pointer, fsfd, fragment);
+            file_inode->size = 0;
+        } else if (length > old_size) {
+            result = _fragment_store(initialized_structures_pointer, file_pointer, file_inode, old_size, NULL,
+                                     length - old_size);
+        } else {
+            file_inode->size = length;
+        }
+    } else if (length > old_size
+               && (result = _fragment_unpack(initialized_structures_pointer, file_pointer, file_inode)) == OK) {
+        // powiększenie zostawia dziurę - zerowana jest tylko końcówka bloku z dotychczasowym końcem pliku
+        unsigned long block_end = (old_size / real_block_size + 1) * real_block_size;
+        _zero_file_range(initialized_structures_pointer, file_pointer, file_inode, old_size,
+                         length < block_end ? length : block_end);
+        file_inode->size = length;
+    } else if (length <= old_size) {
+        // zwalniane są też bloki przydzielone z góry za końcem pliku
+        unsigned long number_of_kept_blocks = (length + real_block_size - 1) / real_block_size;
+        _release_file_blocks(initialized_structures_pointer, file_pointer, file_inode, number_of_kept_blocks);
+        if (file_inode->allocated_blocks > number_of_kept_blocks) {
+            file_inode->allocated_blocks = number_of_kept_blocks;
+        }
+        if (file_inode->unwritten_end > number_of_kept_blocks * real_block_size) {
+            file_inode->unwritten_end = number_of_kept_blocks * real_block_size;
         }
-        current_block_number = current_block->next_data_block;
-        free(current_block->data);
-        free(current_block);
+        if (file_inode->unwritten_start >= file_inode->unwritten_end) {
+            file_inode->unwritten_start = 0;
+            file_inode->unwritten_end = 0;
+        }
+        file_inode->size = length;
+        // kursory deskryptorów mogą wskazywać zwolnione bloki
+        file_inode->generation++;
     }
-    file_pointer->position += data_read;
+
+    if (result == OK) {
+        _journal_dirty_inode(initialized_structures_pointer, file_pointer->inode_no);
+    }
+    _unblock_first_free_block(fsfd, &flock_structure);
+    _unlock_lock_file(master_block_pointer, fsfd);
+    _unlock_lock_inode(master_block_pointer, fsfd);
     _uninitilize_structures(initialized_structures_pointer);
-    return data_read;
+    _journal_end_operation(fsfd);
+    return result;
 }
 
-int simplefs_read(int fd, char *buf, int len, int fsfd) { //Adam
-    initialized_structures * initialized_structures_pointer = _initialize_structures(fsfd, 1);
-    file * file_pointer = _get_file_by_fd(fd);
-    _lock_lock_file(initialized_structures_pointer->master_block_pointer, fsfd);
-    unsigned long file_size = _load_inode_from_file_structure(initialized_structures_pointer, file_pointer)->size;
-    _unlock_lock_file(initialized_structures_pointer->master_block_pointer, fsfd);
-    _uninitilize_structures(initialized_structures_pointer);
-    return _read_unsafe(fd, buf, len, fsfd, file_size);
+int simplefs_ftruncate(int fd, unsigned long length, int fsfd) {
+    mounted_fs * mounted = _operations_lock(fsfd);
+    int result = _ftruncate_unlocked(fd, length, fsfd);
+    _operations_unlock(mounted);
+    return result;
 }
 
-int simplefs_write(int fd, char *buf, int len, int fsfd) { //Mateusz
-    initialized_structures * initialized_structures_pointer = _initialize_structures(fsfd, 1);
-    if (initialized_structures_pointer == NULL) {
-        DEBUG("Blad");
-        return -1;
-    }
+/**
+ * Zmiana trybu dopisywania bez blokady operations_lock - simplefs_set_append_only.
+ */
+int _set_append_only_unlocked(int fd, int enabled, int fsfd) {
     file * file_pointer = _get_file_by_fd(fd);
     if (file_pointer == NULL) {
         return FD_NOT_FOUND;
     }
-    _try_lock_lock_inode(initialized_structures_pointer->master_block_pointer, fsfd);
-    _lock_lock_file(initialized_structures_pointer->master_block_pointer, fsfd);
-
-    write_params write_params_structure;
-    write_params_structure.data_length = len;
-    write_params_structure.data = buf;
-    write_params_structure.fsfd = fsfd;
-    write_params_structure.fd = fd;
-    write_params_structure.lock_blocks = 0;
-    write_params_structure.file_offset = file_pointer->position;
-    write_params_structure.for_each_record = NULL;
-    int result = _write_unsafe(initialized_structures_pointer, write_params_structure);
+    if (file_pointer->mode == READ_MODE) {
+        return WRONG_MODE;
+    }
+    int result = _flush_write_buffer(file_pointer);
+    if (result != OK) {
+        return result;
+    }
+    initialized_structures * initialized_structures_pointer = _initialize_structures(fsfd, 1);
+    if (initialized_structures_pointer == NULL) {
+        return -1;
+    }
+    master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
+    _try_lock_lock_inode(master_block_pointer, fsfd);
+    _lock_lock_file(master_block_pointer, fsfd);
+    struct flock flock_structure;
+    _block_first_free_block(fsfd, &flock_structure);
 
-    _unlock_lock_file(initialized_structures_pointer->master_block_pointer, fsfd);
-    _unlock_lock_inode(initialized_structures_pointer->master_block_pointer, fsfd);
+    inode * file_inode = _load_inode_from_file_structure(initialized_structures_pointer, file_pointer);
+    if (file_inode->type != INODE_FILE) {
+        result = NOT_FILE_FD;
+    } else if (enabled && !file_inode->append_only
+               && (result = _fragment_unpack(initialized_structures_pointer, file_pointer, file_inode)) == OK) {
+        // zapisy dopisujące nie sprawdzają oznaczeń bloków - bloki niezapisane są zerowane od razu
+        if (file_inode->unwritten_start < file_inode->unwritten_end) {
+            _clear_unwritten_blocks(initialized_structures_pointer, file_pointer, file_inode,
+                                    file_inode->unwritten_start, file_inode->unwritten_end, 0, 0);
+            file_inode->unwritten_start = 0;
+            file_inode->unwritten_end = 0;
+        }
+        file_inode->append_cursor = file_inode->size;
+        file_inode->append_only = TRUE;
+    } else if (!enabled && file_inode->append_only) {
+        if (file_inode->append_cursor != file_inode->size) {
+            result = APPENDS_IN_PROGRESS;
+        } else {
+            file_inode->append_only = FALSE;
+        }
+    }
 
+    if (result == OK) {
+        _journal_dirty_inode(initialized_structures_pointer, file_pointer->inode_no);
+    }
+    _unblock_first_free_block(fsfd, &flock_structure);
+    _unlock_lock_file(master_block_pointer, fsfd);
+    _unlock_lock_inode(master_block_pointer, fsfd);
     _uninitilize_structures(initialized_structures_pointer);
+    _journal_end_operation(fsfd);
+    return result;
+}
+
+int simplefs_set_append_only(int fd, int enabled, int fsfd) {
+    mounted_fs * mounted = _operations_lock(fsfd);
+    int result = _set_append_only_unlocked(fd, enabled, fsfd);
+    _operations_unlock(mounted);
     return result;
 }
 
 /**
  * Funkcja zakłada poprawną inicjalizację struktur.
  */
-int simplefs_lseek_unsafe(int fd, initialized_structures * initialized_structures_pointer, int whence, int offset, int fsfd) {
+long simplefs_lseek_unsafe(int fd, initialized_structures * initialized_structures_pointer, int whence, long offset,
+                          int fsfd) {
 
     file * file_pointer =_get_file_by_fd(fd);
     if (file_pointer == NULL) {
         _unlock_lock_file(initialized_structures_pointer->master_block_pointer, fsfd);
         return FD_NOT_FOUND;
     }
-    int effective_offset = 0;
-    unsigned long file_size = _load_inode_from_file_structure(initialized_structures_pointer, file_pointer)->size;
+    long effective_offset = 0;
+    inode * file_inode = _load_inode_from_file_structure(initialized_structures_pointer, file_pointer);
+    unsigned long file_size = file_inode->size;
     switch(whence) {
         case SEEK_SET:
             effective_offset = offset;
@@ -1493,27 +6172,624 @@ int simplefs_lseek_unsafe(int fd, initialized_structures * initialized_structure
             effective_offset = file_size + offset;
 
             break;
+        case SEEK_DATA:
+        case SEEK_HOLE: {
+            if (offset < 0 || offset >= file_size) {
+                return NO_DATA_AFTER_OFFSET;
+            }
+            if (file_inode->fragment != 0) {
+                // mały plik - dane we fragmentach bez dziur
+                effective_offset = whence == SEEK_DATA ? offset : file_size;
+                break;
+            }
+            master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
+            unsigned long real_block_size = _block_payload(master_block_pointer);
+            unsigned long block_index = offset / real_block_size;
+            unsigned long block_no;
+            unsigned long current_index = _find_file_block(fsfd, master_block_pointer, file_pointer, file_inode,
+                                                           block_index, &block_no);
+            if (whence == SEEK_DATA) {
+                if (block_no == 0 || current_index * real_block_size >= file_size) {
+                    return NO_DATA_AFTER_OFFSET;
+                }
+                effective_offset = current_index == block_index ? offset : current_index * real_block_size;
+            } else if (block_no == 0 || current_index != block_index) {
+                // offset leży w dziurze
+                effective_offset = offset;
+            } else {
+                // koniec ciągu kolejnych bloków
+                unsigned long holes;
+                do {
+                    current_index++;
+                    holes = _next_file_block(fsfd, master_block_pointer, &block_no) - 1;
+                } while (block_no != 0 && holes == 0);
+                effective_offset = current_index * real_block_size < file_size ? current_index * real_block_size
+                                                                               : file_size;
+            }
+            break;
+        }
         default:
             _unlock_lock_file(initialized_structures_pointer->master_block_pointer, fsfd);
-            return - 1;
+            return WRONG_WHENCE;
     }
     if (effective_offset < 0) {
         effective_offset = 0;
-    } else if (effective_offset > file_size) {
-        effective_offset = file_size;
     }
     file_pointer->position = effective_offset;
+    return effective_offset;
 }
 
-int simplefs_lseek(int fd, int whence, int offset, int fsfd) { //Mateusz
+long simplefs_lseek(int fd, int whence, long offset, int fsfd) { //Mateusz
+    // pozycja za końcem pliku liczona jest z rozmiaru uwzględniającego buforowane dane
+    simplefs_flush(fd, fsfd);
     initialized_structures * initialized_structures_pointer = _initialize_structures(fsfd, 1);
     if (initialized_structures_pointer == NULL) {
         DEBUG("Blad");
         return -1;
     }
     _lock_lock_file(initialized_structures_pointer->master_block_pointer, fsfd);
-    simplefs_lseek_unsafe(fd, initialized_structures_pointer, whence, offset, fsfd);
+    long result = simplefs_lseek_unsafe(fd, initialized_structures_pointer, whence, offset, fsfd);
     _unlock_lock_file(initialized_structures_pointer->master_block_pointer, fsfd);
     _uninitilize_structures(initialized_structures_pointer);
-    return 0;
+    return result;
+}
+
+/*
+ * ---------------------------------------------------------------------------------------------------------------------
+ * Utrwalanie danych.
+ * simplefs_fsync i simplefs_fdatasync utrwalają tylko zakresy obrazu należące do pliku: metadane (leżące przed
+ * pierwszym blokiem danych) przez msync tymczasowego mapowania, bloki danych przez sync_file_range. Zakresy zgłaszane
+ * są do partii zamontowanego systemu plików - utrwala ją jeden wątek naraz, a zgłoszenia nadchodzące w tym czasie
+ * trafiają do następnej partii, którą utrwali pierwszy z czekających (jedno wywołanie na zakres dla wielu wątków).
+ */
+
+int _compare_sync_ranges(const void * first, const void * second) {
+    unsigned long first_offset = ((sync_range *) first)->offset;
+    unsigned long second_offset = ((sync_range *) second)->offset;
+    return first_offset < second_offset ? -1 : first_offset > second_offset;
+}
+
+/**
+ * Utrwala zakresy obrazu - sortuje je i łączy nachodzące na siebie.
+ * @return {OK} sukces, {SYNC_ERROR} błąd
+ */
+int _sync_ranges(mounted_fs * mounted, sync_range * ranges, unsigned number_of_ranges) {
+    master_block * mb = mounted->master_block_pointer;
+    unsigned long metadata_size = (unsigned long) mb->data_start_block * mb->block_size;
+    unsigned long page_mask = sysconf(_SC_PAGE_SIZE) - 1;
+    qsort(ranges, number_of_ranges, sizeof(sync_range), _compare_sync_ranges);
+    unsigned i, merged = 0;
+    for (i = 0; i < number_of_ranges; i++) {
+        if (merged > 0 && ranges[i].offset <= ranges[merged - 1].offset + ranges[merged - 1].length) {
+            unsigned long end = ranges[i].offset + ranges[i].length;
+            if (end > ranges[merged - 1].offset + ranges[merged - 1].length) {
+                ranges[merged - 1].length = end - ranges[merged - 1].offset;
+            }
+        } else {
+            ranges[merged++] = ranges[i];
+        }
+    }
+    char * metadata = NULL;
+    int result = OK;
+    for (i = 0; i < merged; i++) {
+        if (ranges[i].offset < metadata_size) {
+            // mapowanie całych metadanych - msync wymaga adresu wyrównanego do strony
+            if (metadata == NULL) {
+                metadata = (char *) mmap(NULL, metadata_size, PROT_READ, MAP_SHARED, mounted->fsfd, 0);
+                if (metadata == MAP_FAILED) {
+                    return SYNC_ERROR;
+                }
+            }
+            unsigned long start = ranges[i].offset & ~page_mask;
+            if (msync(metadata + start, ranges[i].offset + ranges[i].length - start, MS_SYNC) != 0) {
+                result = SYNC_ERROR;
+            }
+        } else if (sync_file_range(mounted->fsfd, ranges[i].offset, ranges[i].length,
+                                   SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) != 0) {
+            result = SYNC_ERROR;
+        }
+    }
+    if (metadata != NULL) {
+        munmap(metadata, metadata_size);
+    }
+    return result;
+}
+
+/**
+ * Zgłasza zakresy do utrwalenia i czeka na utrwalenie partii, do której trafiły. Jeśli żaden wątek nie utrwala w tej
+ * chwili partii, zgłaszający zabiera zebraną partię i utrwala ją sam.
+ * @param whole_image TRUE - utrwalany jest cały obraz (fdatasync)
+ * @return {OK} sukces, {SYNC_ERROR} błąd
+ */
+int _sync_submit(mounted_fs * mounted, sync_range * ranges, unsigned number_of_ranges, int whole_image) {
+    sync_batch * batch = &mounted->sync;
+    pthread_mutex_lock(&batch->mutex);
+    if (whole_image) {
+        batch->whole_image = TRUE;
+    }
+    unsigned i, j;
+    for (i = 0; i < number_of_ranges && !batch->whole_image; i++) {
+        unsigned long end = ranges[i].offset + ranges[i].length;
+        for (j = 0; j < batch->number_of_ranges; j++) {
+            sync_range * gathered = batch->ranges + j;
+            if (ranges[i].offset <= gathered->offset + gathered->length && gathered->offset <= end) {
+                if (end < gathered->offset + gathered->length) {
+                    end = gathered->offset + gathered->length;
+                }
+                if (ranges[i].offset < gathered->offset) {
+                    gathered->offset = ranges[i].offset;
+                }
+                gathered->length = end - gathered->offset;
+                break;
+            }
+        }
+        if (j < batch->number_of_ranges) {
+            continue;
+        }
+        if (batch->number_of_ranges == SYNC_BATCH_RANGES) {
+            batch->whole_image = TRUE;
+        } else {
+            batch->ranges[batch->number_of_ranges++] = ranges[i];
+        }
+    }
+    unsigned long ticket = batch->gathering;
+    while (batch->completed < ticket) {
+        if (batch->running) {
+            pthread_cond_wait(&batch->done, &batch->mutex);
+            continue;
+        }
+        // zabranie zebranej partii - kolejne zgłoszenia trafiają do następnej
+        sync_range taken[SYNC_BATCH_RANGES];
+        unsigned number_of_taken = batch->number_of_ranges;
+        int taken_whole_image = batch->whole_image;
+        memcpy(taken, batch->ranges, sizeof(sync_range) * number_of_taken);
+        unsigned long number = batch->gathering++;
+        batch->number_of_ranges = 0;
+        batch->whole_image = FALSE;
+        batch->running = TRUE;
+        pthread_mutex_unlock(&batch->mutex);
+        int result;
+        if (taken_whole_image) {
+            result = fdatasync(mounted->fsfd) == 0 ? OK : SYNC_ERROR;
+        } else {
+            result = _sync_ranges(mounted, taken, number_of_taken);
+        }
+        pthread_mutex_lock(&batch->mutex);
+        batch->completed = number;
+        if (result != OK) {
+            batch->last_failed = number;
+        }
+        batch->running = FALSE;
+        pthread_cond_broadcast(&batch->done);
+    }
+    // błąd zgłaszają wszyscy, którzy czekali w czasie nieudanego utrwalenia
+    int result = batch->last_failed >= ticket ? SYNC_ERROR : OK;
+    pthread_mutex_unlock(&batch->mutex);
+    return result;
+}
+
+/**
+ * Wspólna część simplefs_fsync i simplefs_fdatasync - zbiera zakresy obrazu należące do pliku i zgłasza je do utrwalenia.
+ * @param with_metadata TRUE - utrwalany jest też master block i otwarta transakcja dziennika
+ */
+int _sync_file(int fd, int fsfd, int with_metadata) {
+    file * file_pointer = _get_file_by_fd(fd);
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    if (file_pointer == NULL || mounted == NULL) {
+        return FD_NOT_FOUND;
+    }
+    int result = simplefs_flush(fd, fsfd);
+    if (result != OK) {
+        return result;
+    }
+    if (with_metadata && mounted->journal.mode != JOURNAL_NONE) {
+        _journal_end_operation(fsfd);
+        if (mounted->journal.header->number_of_pending_blocks > 0) {
+            // fdatasync transakcji utrwala cały obraz, razem z danymi pliku
+            return _journal_commit(mounted, mounted->journal.header->next_sequence);
+        }
+    }
+    initialized_structures * initialized_structures_pointer = _initialize_structures(fsfd, 1);
+    if (initialized_structures_pointer == NULL) {
+        return SYNC_ERROR;
+    }
+    master_block * master_block_pointer = initialized_structures_pointer->master_block_pointer;
+    _lock_lock_file(master_block_pointer, fsfd);
+    inode * file_inode = _load_inode_from_file_structure(initialized_structures_pointer, file_pointer);
+
+    // ostatnie cztery zakresy zostają na inode, bitmapę, tablicę wskaźników i master block
+    sync_range ranges[SYNC_BATCH_RANGES];
+    unsigned number_of_ranges = 0;
+    int whole_image = FALSE;
+    unsigned long block_size = master_block_pointer->block_size;
+    unsigned long lowest_block = 0, highest_block = 0;
+    // bloki danych z łańcucha, a za nimi węzły mapy bloków
+    unsigned long number_of_map_blocks = 0;
+    unsigned long map_blocks_size = 64;
+    unsigned long * map_blocks = (unsigned long *) malloc(sizeof(unsigned long) * map_blocks_size);
+    if (file_inode->layout != FILE_LAYOUT_CHAIN) {
+        _file_map_collect(fsfd, master_block_pointer, file_inode, &map_blocks, &number_of_map_blocks, &map_blocks_size);
+    }
+    unsigned long map_block_index = 0;
+    unsigned long block_no = BLOCK_LINK_NUMBER(file_inode->first_data_block);
+    if (block_no == 0 && number_of_map_blocks > 0) {
+        block_no = map_blocks[map_block_index++];
+    }
+    while (block_no != 0) {
+        _cache_write_back_block(mounted, master_block_pointer->data_start_block + block_no);
+        unsigned long offset = _get_block_offset(master_block_pointer, block_no);
+        if (number_of_ranges > 0 && ranges[number_of_ranges - 1].offset + ranges[number_of_ranges - 1].length == offset) {
+            ranges[number_of_ranges - 1].length += block_size;
+        } else if (number_of_ranges == SYNC_BATCH_RANGES - 4) {
+            // plik zbyt pofragmentowany - taniej utrwalić cały obraz
+            whole_image = TRUE;
+        } else if (!whole_image) {
+            ranges[number_of_ranges].offset = offset;
+            ranges[number_of_ranges++].length = block_size;
+        }
+        if (lowest_block == 0 || block_no < lowest_block) {
+            lowest_block = block_no;
+        }
+        if (block_no > highest_block) {
+            highest_block = block_no;
+        }
+        if (map_block_index > 0) {
+            block_no = map_block_index < number_of_map_blocks ? map_blocks[map_block_index++] : 0;
+        } else {
+            _next_file_block(fsfd, master_block_pointer, &block_no);
+            if (block_no == 0 && number_of_map_blocks > 0) {
+                block_no = map_blocks[map_block_index++];
+            }
+        }
+    }
+    free(map_blocks);
+    if (file_inode->fragment != 0) {
+        // mały plik nie ma łańcucha - utrwalany jest jego blok fragmentów
+        block_no = FRAGMENT_BLOCK(file_inode->fragment);
+        _cache_write_back_block(mounted, master_block_pointer->data_start_block + block_no);
+        ranges[number_of_ranges].offset = _get_block_offset(master_block_pointer, block_no);
+        ranges[number_of_ranges++].length = block_size;
+        lowest_block = block_no;
+        highest_block = block_no;
+    }
+    ranges[number_of_ranges].offset = master_block_pointer->first_inode_table_block * block_size
+                                      + file_pointer->inode_no * sizeof(inode);
+    ranges[number_of_ranges++].length = sizeof(inode);
+    if (highest_block != 0) {
+        ranges[number_of_ranges].offset = block_size + lowest_block / 8;
+        ranges[number_of_ranges++].length = highest_block / 8 - lowest_block / 8 + 1;
+        if (master_block_pointer->number_of_link_table_blocks > 0) {
+            ranges[number_of_ranges].offset = master_block_pointer->first_link_table_block * block_size
+                                              + lowest_block * sizeof(unsigned long);
+            ranges[number_of_ranges++].length = (highest_block - lowest_block + 1) * sizeof(unsigned long);
+        }
+    }
+    if (with_metadata) {
+        ranges[number_of_ranges].offset = 0;
+        ranges[number_of_ranges++].length = sizeof(master_block);
+    }
+    _unlock_lock_file(master_block_pointer, fsfd);
+    _uninitilize_structures(initialized_structures_pointer);
+    return _sync_submit(mounted, ranges, number_of_ranges, whole_image);
+}
+
+int simplefs_fsync(int fd, int fsfd) {
+    return _sync_file(fd, fsfd, TRUE);
+}
+
+int simplefs_fdatasync(int fd, int fsfd) {
+    return _sync_file(fd, fsfd, FALSE);
+}
+
+int simplefs_syncfs(int fsfd) {
+    mounted_fs * mounted = _get_mounted_fs(fsfd);
+    if (mounted == NULL) {
+        return UNKNOWN_DESCRIPTOR;
+    }
+    int result = OK;
+    file * file_pointer;
+    file * tmp;
+    _operations_lock(fsfd);
+    HASH_ITER(hh, open_files, file_pointer, tmp) {
+        if (file_pointer->fsfd == fsfd) {
+            int flush_result = _flush_write_buffer(file_pointer);
+            if (result == OK) {
+                result = flush_result;
+            }
+        }
+    }
+    _operations_unlock(mounted);
+    _cache_flush(mounted);
+    if (mounted->journal.mode != JOURNAL_NONE) {
+        _journal_end_operation(fsfd);
+        if (mounted->journal.header->number_of_pending_blocks > 0) {
+            _journal_commit(mounted, mounted->journal.header->next_sequence);
+            return result;
+        }
+    }
+    int sync_result = _sync_submit(mounted, NULL, 0, TRUE);
+    return result != OK ? result : sync_result;
+}
+
+/*
+ * ---------------------------------------------------------------------------------------------------------------------
+ * Operacje asynchroniczne.
+ * Żądania trafiają do kolejki zleconych, z której biorą je wątki puli. Wątek pomija żądania deskryptorów obsługiwanych
+ * właśnie przez inny wątek, więc operacje na jednym deskryptorze wykonują się w kolejności zlecenia. Wykluczanie wątków
+ * zapewniają simplefs_read i simplefs_write (operations_lock zamontowanego systemu plików), jak przy wywołaniach
+ * synchronicznych.
+ */
+
+/**
+ * Sprawdza, czy deskryptor jest obsługiwany przez któryś z wątków puli. Wywoływana z zablokowanym mutexem puli.
+ */
+int _async_is_fd_running(int fd) {
+    unsigned i;
+    for (i = 0; i < async_operations.number_of_workers; i++) {
+        if (async_operations.running_fds[i] == fd) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * Wyjmuje z kolejki zleconych najstarsze żądanie, którego deskryptor nie jest obsługiwany przez inny wątek.
+ * Wywoływana z zablokowanym mutexem puli.
+ * @return żądanie lub NULL
+ */
+async_request * _async_take_request() {
+    async_request * previous = NULL;
+    async_request * request = async_operations.submitted_head;
+    while (request != NULL && _async_is_fd_running(request->fd)) {
+        previous = request;
+        request = request->next;
+    }
+    if (request == NULL) {
+        return NULL;
+    }
+    if (previous == NULL) {
+        async_operations.submitted_head = request->next;
+    } else {
+        previous->next = request->next;
+    }
+    if (async_operations.submitted_tail == request) {
+        async_operations.submitted_tail = previous;
+    }
+    request->next = NULL;
+    return request;
+}
+
+/**
+ * Pętla wątku puli - kończy się, gdy pula jest zatrzymywana, a w kolejce nie ma żądań możliwych do wykonania.
+ */
+void * _async_worker(void * argument) {
+    unsigned worker = (unsigned) (unsigned long) argument;
+    pthread_mutex_lock(&async_operations.mutex);
+    while (TRUE) {
+        async_request * request = _async_take_request();
+        if (request == NULL) {
+            if (async_operations.stopping) {
+                break;
+            }
+            pthread_cond_wait(&async_operations.submitted, &async_operations.mutex);
+            continue;
+        }
+        async_operations.running_fds[worker] = request->fd;
+        pthread_mutex_unlock(&async_operations.mutex);
+
+        int result;
+        if (request->write) {
+            result = simplefs_write(request->fd, request->buf, request->len, request->fsfd);
+        } else {
+            result = simplefs_read(request->fd, request->buf, request->len, request->fsfd);
+        }
+
+        pthread_mutex_lock(&async_operations.mutex);
+        async_operations.running_fds[worker] = -1;
+        request->result = result;
+        request->done = TRUE;
+        if (request->callback != NULL) {
+            HASH_DEL(async_operations.requests, request);
+            pthread_mutex_unlock(&async_operations.mutex);
+            request->callback(request->request, result, request->user_data);
+            free(request);
+            pthread_mutex_lock(&async_operations.mutex);
+        } else {
+            if (async_operations.completed_tail == NULL) {
+                async_operations.completed_head = request;
+            } else {
+                async_operations.completed_tail->next = request;
+            }
+            async_operations.completed_tail = request;
+            uint64_t one = 1;
+            write(async_operations.event_fd, &one, sizeof(one));
+            pthread_cond_broadcast(&async_operations.completed);
+        }
+        // zwolniony deskryptor może odblokować kolejne żądania
+        pthread_cond_broadcast(&async_operations.submitted);
+    }
+    pthread_mutex_unlock(&async_operations.mutex);
+    return NULL;
+}
+
+/**
+ * Zatrzymuje wątki puli po wykonaniu zleconych żądań. Wywoływana z zablokowanym mutexem puli.
+ */
+void _async_stop() {
+    unsigned i;
+    async_operations.stopping = TRUE;
+    pthread_cond_broadcast(&async_operations.submitted);
+    pthread_mutex_unlock(&async_operations.mutex);
+    for (i = 0; i < async_operations.number_of_workers; i++) {
+        pthread_join(async_operations.workers[i], NULL);
+    }
+    pthread_mutex_lock(&async_operations.mutex);
+    free(async_operations.workers);
+    free(async_operations.running_fds);
+    async_operations.workers = NULL;
+    async_operations.running_fds = NULL;
+    async_operations.number_of_workers = 0;
+    async_operations.stopping = FALSE;
+}
+
+/**
+ * Uruchamia wątki puli. Wywoływana z zablokowanym mutexem puli.
+ * @return {0} sukces, {ASYNC_POOL_ERROR} błąd
+ */
+int _async_start(unsigned number_of_workers) {
+    if (async_operations.event_fd == -1) {
+        async_operations.event_fd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+        if (async_operations.event_fd == -1) {
+            return ASYNC_POOL_ERROR;
+        }
+    }
+    async_operations.workers = (pthread_t *) malloc(sizeof(pthread_t) * number_of_workers);
+    async_operations.running_fds = (int *) malloc(sizeof(int) * number_of_workers);
+    unsigned i;
+    for (i = 0; i < number_of_workers; i++) {
+        async_operations.running_fds[i] = -1;
+    }
+    for (i = 0; i < number_of_workers; i++) {
+        if (pthread_create(async_operations.workers + i, NULL, _async_worker, (void *) (unsigned long) i) != 0) {
+            async_operations.number_of_workers = i;
+            _async_stop();
+            return ASYNC_POOL_ERROR;
+        }
+        async_operations.number_of_workers = i + 1;
+    }
+    return OK;
+}
+
+/**
+ * Dodaje żądanie do kolejki zleconych, przy pierwszym żądaniu uruchamiając pulę.
+ * @return uchwyt żądania lub kod błędu
+ */
+int _async_submit(int write, int fd, char * buf, int len, int fsfd, simplefs_async_callback callback, void * user_data) {
+    if (_get_file_by_fd(fd) == NULL) {
+        return FD_NOT_FOUND;
+    }
+    pthread_mutex_lock(&async_operations.mutex);
+    if (async_operations.workers == NULL && _async_start(DEFAULT_ASYNC_WORKERS) != OK) {
+        pthread_mutex_unlock(&async_operations.mutex);
+        return ASYNC_POOL_ERROR;
+    }
+    async_request * request = (async_request *) malloc(sizeof(async_request));
+    request->write = write;
+    request->fd = fd;
+    request->buf = buf;
+    request->len = len;
+    request->fsfd = fsfd;
+    request->callback = callback;
+    request->user_data = user_data;
+    request->result = 0;
+    request->done = FALSE;
+    request->next = NULL;
+    do {
+        request->request = async_operations.next_request;
+        async_operations.next_request = async_operations.next_request == INT32_MAX ? 0 : async_operations.next_request + 1;
+        async_request * in_use;
+        HASH_FIND_INT(async_operations.requests, &request->request, in_use);
+        if (in_use == NULL) {
+            break;
+        }
+    } while (TRUE);
+    HASH_ADD_INT(async_operations.requests, request, request);
+    if (async_operations.submitted_tail == NULL) {
+        async_operations.submitted_head = request;
+    } else {
+        async_operations.submitted_tail->next = request;
+    }
+    async_operations.submitted_tail = request;
+    pthread_cond_signal(&async_operations.submitted);
+    int handle = request->request;
+    pthread_mutex_unlock(&async_operations.mutex);
+    return handle;
+}
+
+int simplefs_read_async(int fd, char *buf, int len, int fsfd, simplefs_async_callback callback, void * user_data) {
+    return _async_submit(FALSE, fd, buf, len, fsfd, callback, user_data);
+}
+
+int simplefs_write_async(int fd, char *buf, int len, int fsfd, simplefs_async_callback callback, void * user_data) {
+    return _async_submit(TRUE, fd, buf, len, fsfd, callback, user_data);
+}
+
+int simplefs_async_completion_fd() {
+    pthread_mutex_lock(&async_operations.mutex);
+    if (async_operations.event_fd == -1) {
+        async_operations.event_fd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    int event_fd = async_operations.event_fd;
+    pthread_mutex_unlock(&async_operations.mutex);
+    return event_fd == -1 ? ASYNC_POOL_ERROR : event_fd;
+}
+
+/**
+ * Usuwa zakończone żądanie z kolejki zakończonych i mapy żądań. Wywoływana z zablokowanym mutexem puli.
+ */
+void _async_release_completed(async_request * request) {
+    async_request * previous = NULL;
+    async_request * current = async_operations.completed_head;
+    while (current != request) {
+        previous = current;
+        current = current->next;
+    }
+    if (previous == NULL) {
+        async_operations.completed_head = request->next;
+    } else {
+        previous->next = request->next;
+    }
+    if (async_operations.completed_tail == request) {
+        async_operations.completed_tail = previous;
+    }
+    uint64_t value;
+    read(async_operations.event_fd, &value, sizeof(value));
+    HASH_DEL(async_operations.requests, request);
+    free(request);
+}
+
+int simplefs_async_reap(int * request, int * result) {
+    pthread_mutex_lock(&async_operations.mutex);
+    async_request * completed = async_operations.completed_head;
+    if (completed == NULL) {
+        pthread_mutex_unlock(&async_operations.mutex);
+        return NO_COMPLETED_REQUESTS;
+    }
+    *request = completed->request;
+    *result = completed->result;
+    _async_release_completed(completed);
+    pthread_mutex_unlock(&async_operations.mutex);
+    return OK;
+}
+
+int simplefs_async_wait(int request, int * result) {
+    async_request * waited;
+    pthread_mutex_lock(&async_operations.mutex);
+    while (TRUE) {
+        // żądanie mogło zostać w międzyczasie zdjęte przez simplefs_async_reap
+        HASH_FIND_INT(async_operations.requests, &request, waited);
+        if (waited == NULL || waited->callback != NULL) {
+            pthread_mutex_unlock(&async_operations.mutex);
+            return UNKNOWN_REQUEST;
+        }
+        if (waited->done) {
+            break;
+        }
+        pthread_cond_wait(&async_operations.completed, &async_operations.mutex);
+    }
+    *result = waited->result;
+    _async_release_completed(waited);
+    pthread_mutex_unlock(&async_operations.mutex);
+    return OK;
+}
+
+int simplefs_async_configure(unsigned number_of_workers) {
+    pthread_mutex_lock(&async_operations.mutex);
+    if (async_operations.workers != NULL) {
+        _async_stop();
+    }
+    int result = _async_start(number_of_workers > 0 ? number_of_workers : DEFAULT_ASYNC_WORKERS);
+    pthread_mutex_unlock(&async_operations.mutex);
+    return result;
 }
@@ -7,24 +7,96 @@
  */
 
 #ifndef _SIMPLEFS_H
-#define _SIMPLEFSH_
+#define _SIMPLEFS_H
 
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
 #include "uthash.h"
 
 #define TRUE 1
 #define FALSE 0
 
-#define SIMPLEFS_MAGIC_NUMBER 0x4A5B
-#define FILE_NAME_LENGTH (256 - 2 * sizeof(long) - 2 * sizeof(char))
+//zmieniany przy każdej niezgodnej zmianie formatu obrazu - obrazy starszego formatu nie są montowane
+#define SIMPLEFS_MAGIC_NUMBER 0x4A69
+//maksymalna długość nazwy pliku - inode ma 256 bajtów, więc przy 64-bitowym long nazwa ma co najwyżej 156 bajtów
+#define FILE_NAME_LENGTH (256 - 12 * sizeof(long) - 4 * sizeof(char))
 
 #define INODES_IN_BLOCK masterblock->block_size / sizeof(inode)
 
-#define FIRST_FREE_INODE_OFFSET sizeof(master_block) - sizeof(int) - sizeof(long)
+//Wskaźnik na następny blok pliku (i first_data_block w inodzie) - numer bloku w młodszych bitach, liczba bloków dziury
+//poprzedzającej ten blok w starszych. Najstarszy bit wskaźnika przechowywanego przy bloku oznacza, że ten blok
+//przydzielono bez zerowania (FALLOCATE_UNWRITTEN) - do pierwszego zapisu czytany jest jako zera
+#define BLOCK_LINK_HOLE_SHIFT 40
+#define BLOCK_LINK_UNWRITTEN (1UL << 63)
+#define BLOCK_LINK_MAX_HOLE ((1UL << (63 - BLOCK_LINK_HOLE_SHIFT)) - 1)
+#define BLOCK_LINK_NUMBER(link) ((link) & ((1UL << BLOCK_LINK_HOLE_SHIFT) - 1))
+#define BLOCK_LINK_HOLE(link) (((link) & ~BLOCK_LINK_UNWRITTEN) >> BLOCK_LINK_HOLE_SHIFT)
+#define BLOCK_LINK(block_no, hole) ((block_no) | ((unsigned long) (hole) << BLOCK_LINK_HOLE_SHIFT))
+
+//Największy rozmiar bloku (simplefs_init)
+#define MAX_BLOCK_SIZE (1024 * 1024)
+
+//Fragmenty (INIT_FRAGMENTS) - liczba fragmentów bloku fragmentów (pierwszy zajmuje nagłówek) i największa liczba
+//fragmentów pliku; fragment pliku zapisany jest w inodzie jako numer bloku, pierwszy fragment i liczba fragmentów
+#define FRAGMENTS_PER_BLOCK 64
+#define FRAGMENT_MAX_UNITS 32
+#define FRAGMENT(block_no, first_unit, units) (((unsigned long) (block_no) << 12) | ((first_unit) << 6) | ((units) - 1))
+#define FRAGMENT_BLOCK(fragment) ((fragment) >> 12)
+#define FRAGMENT_FIRST_UNIT(fragment) (((fragment) >> 6) & 63)
+#define FRAGMENT_UNITS(fragment) (((fragment) & 63) + 1)
+
+#define FIRST_FREE_INODE_OFFSET offsetof(master_block, first_free_inode)
+
+//Bajt blokady montowania (blokowany współdzielnie przez procesy z zamontowanym obrazem) - za końcem każdego obrazu
+#define MOUNT_LOCK_OFFSET (1L << 62)
+
+//Readahead dla odczytów sekwencyjnych - okno w blokach, podwajane przy kolejnych odczytach sekwencyjnych
+#define READAHEAD_MIN_BLOCKS 4
+#define READAHEAD_MAX_BLOCKS 256
+
+//Pamięć podręczna bloków (domyślnie wyłączona) - typowy budżet pamięci i liczba pasów liczników zapisów w master bloku
+#define DEFAULT_CACHE_SIZE (1024 * 1024)
+#define CACHE_GENERATION_STRIPES 16
+
+//Backend wejścia-wyjścia - domyślna głębokość kolejki io_uring i liczba zapisów gromadzonych przed wysłaniem
+#define DEFAULT_IO_QUEUE_DEPTH 64
+#define IO_PLUG_REQUESTS 64
+//Liczba wyrównanych buforów pośrednich trybu O_DIRECT przechowywanych do ponownego użycia
+#define DIRECT_IO_POOL_BUFFERS 32
+//Początkowy rozmiar bufora zapisów deskryptora z opóźnionym przydziałem bloków, jeśli nie ustawiono go wcześniej
+#define DELAYED_ALLOCATION_BUFFER (64 * 1024)
+//Liczba bloków usuniętych plików zwalnianych jednorazowo (pod jedną blokadą first free block)
+#define ORPHAN_RECLAIM_BATCH 1024
+//Pliki tylko do dopisywania - jak długo zapis czeka na zakończenie wcześniejszych zapisów (najpierw sched_yield,
+//potem co milisekundę)
+#define APPEND_PUBLISH_SPINS 100
+#define APPEND_PUBLISH_TIMEOUT_MS 5000
+
+//Dziennik metadanych (INIT_JOURNAL) - obszar za blokami danych mieści nagłówek z listą bloków otwartej transakcji
+#define JOURNAL_TRANSACTION_BLOCKS 64
+#define JOURNAL_HEADER_MAGIC 0x4A524E32UL
+
+//Utrwalanie danych - liczba zakresów obrazu gromadzonych przez wywołania równoczesne do wspólnego utrwalenia
+#define SYNC_BATCH_RANGES 64
+
+//Operacje asynchroniczne - domyślna liczba wątków puli uruchamianej przy pierwszym żądaniu
+#define DEFAULT_ASYNC_WORKERS 4
+
+//Równoległe odczyty i zapisy - domyślna liczba wątków pomocniczych i minimalna liczba bloków operacji
+#define DEFAULT_PARALLEL_THREADS 3
+#define PARALLEL_IO_MIN_BLOCKS 64
+
+//Pula buforów - klasy rozmiarów od 2^BUFFER_POOL_MIN_SHIFT do 2^BUFFER_POOL_MAX_SHIFT bajtów i liczba wolnych
+//buforów każdej klasy przechowywanych przez wątek
+#define BUFFER_POOL_MIN_SHIFT 6
+#define BUFFER_POOL_MAX_SHIFT 20
+#define BUFFER_POOL_MAGAZINE 16
 
 /**
  * Tworzy system plików pod zadaną ścieżkę
  * @param path - ścieżka do tworzonego systemu plików
- * @param block_size - rozmiar bloku w bajtach - minimalnie 1024 B
+ * @param block_size - rozmiar bloku w bajtach - minimalnie 1024 B, maksymalnie MAX_BLOCK_SIZE
  * @param number_of_blocks - liczba bloków
  *
  * @return {0} sukces, {-1} błąd
@@ -36,9 +108,23 @@ int simplefs_init(char *path, unsigned block_size, unsigned number_of_blocks);
 #define BLOCK_SIZE_TOO_SMALL -2
 #define NUMBER_OF_BLOCKS_ZERO -3
 #define WRONG_BLOCK_SIZE -4
+#define BLOCK_SIZE_TOO_LARGE -5
+
+/**
+ * Tworzy system plików pod zadaną ścieżkę, z opcjami formatu obrazu (patrz niżej).
+ * @param flags - suma opcji INIT_*, 0 = format simplefs_init
+ *
+ * @return {0} sukces, kody błędów jak dla simplefs_init
+ */
+int simplefs_init_flags(char *path, unsigned block_size, unsigned number_of_blocks, int flags);
+
+#define INIT_LINK_TABLE 1 //wskaźniki następnych bloków w osobnej tablicy (jak FAT) - bloki zawierają tylko dane
+#define INIT_FRAGMENTS 2 //małe pliki (do połowy bloku) we fragmentach współdzielonych bloków
+#define INIT_JOURNAL 4 //nagłówek dziennika metadanych za blokami danych (simplefs_journal_configure)
 
 /**
- * Otwiera plik zawierający system plików spod zadanej ścieżki
+ * Otwiera plik zawierający system plików spod zadanej ścieżki. Jedyny montujący naprawia stan pozostawiony przez
+ * przerwane procesy; obrazy o innym SIMPLEFS_MAGIC_NUMBER nie są otwierane.
  * @param path - ścieżka do systemu plików
  *
  * @return {deskryptor} sukces, {-1} błąd
@@ -50,10 +136,90 @@ int simplefs_openfs(char *path);
  * Zamyka system plików - należy ją wywołać po zakończeniu pracy z systemem plików
  * @param fsfd - deskryptor systemu plików zwrócony przez simplefs_openfs
  *
- * @return {0} sukces, {-1} błąd
+ * @return {0} sukces, {-1} błąd, {<0} błąd zapisu bufora zapisów (jak dla simplefs_write)
  */
 int simplefs_closefs(int fsfd);
 
+/**
+ * Konfiguruje pamięć podręczną bloków danych (domyślnie wyłączoną). Tryb write-back tylko, gdy z obrazu korzysta jeden
+ * proces; CACHE_SHARED - pamięć wspólna procesów hosta, które otworzyły ten sam obraz z tą flagą.
+ * @param fsfd - deskryptor systemu plików zwrócony przez simplefs_openfs
+ * @param memory_budget - maksymalna pamięć w bajtach przeznaczona na bloki (0 wyłącza pamięć podręczną)
+ * @param mode - tryb {patrz niżej}
+ *
+ * @return {0} sukces, {-1, -2, -3} błąd (patrz niżej)
+ */
+int simplefs_cache_configure(int fsfd, unsigned long memory_budget, int mode);
+
+//Tryby pamięci podręcznej
+#define CACHE_WRITE_THROUGH 0x01
+#define CACHE_WRITE_BACK 0x02
+#define CACHE_SHARED 0x04
+//Błędy
+//UNKNOWN_DESCRIPTOR -1 //zadeklarowane niżej
+#define CACHE_MODE_NOT_SUPPORTED -2
+#define SHARED_MEMORY_ERROR -3
+
+/**
+ * Wybiera backend odczytów, zapisów i readahead bloków danych (domyślnie synchroniczne pread/pwrite). Pierścień
+ * io_uring należy do procesu, który go utworzył - proces potomny powinien otworzyć system plików ponownie.
+ * @param fsfd - deskryptor systemu plików zwrócony przez simplefs_openfs
+ * @param backend - backend {patrz niżej}
+ * @param queue_depth - głębokość kolejki io_uring (0 = DEFAULT_IO_QUEUE_DEPTH)
+ *
+ * @return {0} sukces, {-1, -2} błąd (patrz niżej)
+ */
+int simplefs_io_configure(int fsfd, int backend, unsigned queue_depth);
+
+//Backendy
+#define IO_BACKEND_SYNC 0
+#define IO_BACKEND_IO_URING 1
+//Błędy
+//UNKNOWN_DESCRIPTOR -1 //zadeklarowane niżej
+#define IO_BACKEND_NOT_AVAILABLE -2
+
+/**
+ * Włącza lub wyłącza odczyt i zapis bloków danych z pominięciem pamięci podręcznej hosta (O_DIRECT). Niewyrównane
+ * fragmenty bloków przechodzą przez wyrównane bufory pośrednie (zapis czyta i zapisuje całe sektory).
+ * @param fsfd - deskryptor systemu plików zwrócony przez simplefs_openfs
+ * @param enabled - TRUE włącza, FALSE wyłącza O_DIRECT
+ *
+ * @return {0} sukces, {-1, -2} błąd (patrz niżej)
+ */
+int simplefs_direct_io_configure(int fsfd, int enabled);
+
+//Błędy
+//UNKNOWN_DESCRIPTOR -1 //zadeklarowane niżej
+#define DIRECT_IO_NOT_AVAILABLE -2
+
+/**
+ * Ustawia tryb dziennika metadanych - zmiany operacji kończących się jednocześnie utrwalane są jednym fdatasync
+ * (trwałość zakończonych operacji, bez odtwarzania spójności po awarii).
+ * @param fsfd - deskryptor systemu plików zwrócony przez simplefs_openfs
+ * @param mode - tryb {patrz niżej}
+ *
+ * @return {0} sukces, {-1, -2, -3} błąd (patrz niżej)
+ */
+int simplefs_journal_configure(int fsfd, int mode);
+
+//Tryby
+#define JOURNAL_NONE 0          //bez dziennika (domyślnie)
+#define JOURNAL_GROUP_COMMIT 1  //operacja kończy się po trwałym zapisie transakcji z jej zmianami
+#define JOURNAL_DEFERRED 2      //transakcja zapisywana po zapełnieniu lub przez simplefs_journal_commit
+#define JOURNAL_ORDERED 4       //flaga (z JOURNAL_GROUP_COMMIT lub JOURNAL_DEFERRED) - dane przed metadanymi
+//Błędy
+//UNKNOWN_DESCRIPTOR -1 //zadeklarowane niżej
+#define JOURNAL_NOT_AVAILABLE -2    //obraz utworzony bez INIT_JOURNAL
+#define JOURNAL_MODE_NOT_SUPPORTED -3
+
+/**
+ * Zapisuje trwale otwartą transakcję dziennika (wraz ze zmianami innych procesów).
+ * @param fsfd - deskryptor systemu plików zwrócony przez simplefs_openfs
+ *
+ * @return {0} sukces, {-1, -2} błąd (jak dla simplefs_journal_configure)
+ */
+int simplefs_journal_commit(int fsfd);
+
 /**
  * Otwiera plik o podanej nazzwie w danym trybie, w systemie z danego deskryptora
  * @param name - nazwa pliku
@@ -74,6 +240,7 @@ int simplefs_open(char *name, int mode, int fsfd);
 
 /**
  * Usuwa plik o podanej nazwie w systemie plików, w systemie z danego deskryptor
+ * Bloki pliku zwalnia później simplefs_reclaim_orphans (także przy montowaniu i przy braku wolnych bloków).
  * @param name - nazwa pliku
  * @param fsfd - deskryptor do systemu plików
  *
@@ -86,6 +253,15 @@ int simplefs_unlink(char *name, int fsfd);
 #define FILE_DOESNT_EXIST -1
 #define DIR_NOT_EMPTY -2
 
+/**
+ * Zwalnia bloki i inode'y usuniętych plików z listy osieroconych, partiami po ORPHAN_RECLAIM_BATCH bloków (może ją
+ * wywoływać osobny proces porządkujący).
+ * @param fsfd - deskryptor do systemu plików
+ *
+ * @return liczba zwolnionych bloków, {-1} bład
+ */
+long simplefs_reclaim_orphans(int fsfd);
+
 /**
  * Tworzy katalog o pełnej ścieżce, gdzie kolejne katalogi są oddzielone znakiem ‘/’,  różne od ‘.’ oraz ‘..’
  * @param name - nazwa katalogu
@@ -102,7 +278,7 @@ int simplefs_mkdir (char *name, int fsfd);
 /**
  * Funkcja zamykająca otwarty plik w systemie plików simple fs
  * @param fd - deskryptor pliku simple_fs
- * @return 0 lub kod błędu
+ * @return 0 lub kod błędu (błąd zapisu bufora zapisów - deskryptor pozostaje otwarty)
  */
 int simplefs_close(int fd);
 
@@ -110,6 +286,7 @@ int simplefs_close(int fd);
 
 /**
  * Tworzy plik o podanej nazwie (razem ze ścieżką oraz trybie praw, zapis/odczyt)
+ * Nazwa pliku (bez ścieżki) może mieć co najwyżej FILE_NAME_LENGTH bajtów.
  * @param name - nazwa pliku wraz ze ścieżką
  * @param mode - tryb
  * @param fsfd - deskryptor do systemu plików
@@ -128,6 +305,21 @@ int simplefs_creat (char *name, int fsfd);
 #define NO_FREE_BLOCKS -5
 #define NO_FREE_INODES -6
 
+/**
+ * Tworzy plik jak simplefs_creat, z wybranym układem bloków na dysku (patrz niżej).
+ * @param name - nazwa pliku wraz ze ścieżką
+ * @param layout - układ bloków {patrz niżej}
+ * @param fsfd - deskryptor do systemu plików
+ *
+ * @return {0} sukces, {-1, -2, -3, -4, -5, -6} błąd (jak simplefs_creat, WRONG_MODE - nieznany układ)
+ */
+int simplefs_creat_layout(char *name, int layout, int fsfd);
+
+//Układy bloków pliku
+#define FILE_LAYOUT_CHAIN 0 //łańcuch bloków (simplefs_creat)
+#define FILE_LAYOUT_MAPPED 1 //dodatkowo drzewo bloków indeksowych - blok w tylu odczytach, ile poziomów ma mapa
+#define FILE_LAYOUT_EXTENTS 2 //B+drzewo ekstentów (ciągłych zakresów bloków) - blok w O(log n) odczytach
+
 /**
  * 	Czyta plik do podanego bufora o podanej długości.
  * @param fd - deskryptor do pliku
@@ -145,6 +337,7 @@ int simplefs_read(int fd, char *buf, int len, int fsfd);
 
 /**
  * Zapisuje z zawartość bufora o podanej długości do pliku określonego przez deskryptor
+ * Operacje zmieniające system plików wykonują się w wątkach procesu po kolei, odczyty współbieżnie.
  * @param fd - deskryptor do pliku
  * @param buf - bufor, z którego będzie zapisywana informacja
  * @param len - rozmiar bufora
@@ -160,27 +353,243 @@ int simplefs_write(int fd, char *buf, int len, int fsfd);
 #define WRONG_MODE -2
 #define NOT_FILE_FD -3
 #define FD_NOT_FOUND -4
+#define APPEND_TIMEOUT -7 //plik tylko do dopisywania - wcześniejszy zapis się nie zakończył (simplefs_set_append_only)
+
+/**
+ * Włącza buforowanie zapisów na deskryptorze - bufor zapisywany jest po zapełnieniu, przy simplefs_flush,
+ * simplefs_close oraz przed odczytem i zmianą pozycji (przy błędzie dane zostają w buforze).
+ * @param fd - deskryptor pliku
+ * @param buffer_size - rozmiar bufora w bajtach (0 wyłącza buforowanie, wcześniej zapisując bufor)
+ * @param fsfd - deskryptor do systemu plików
+ *
+ * @return {0} sukces, {<0} bład (jak dla simplefs_write)
+ */
+int simplefs_set_write_buffer(int fd, unsigned long buffer_size, int fsfd);
+
+/**
+ * Zapisuje dane zgromadzone w buforze zapisu deskryptora.
+ * @param fd - deskryptor pliku
+ * @param fsfd - deskryptor do systemu plików
+ *
+ * @return {0} sukces, {<0} bład (jak dla simplefs_write - dane zostają w buforze)
+ */
+int simplefs_flush(int fd, int fsfd);
+
+/**
+ * Włącza opóźniony przydział bloków na deskryptorze - dopisywane dane gromadzone są w pamięci, a ich bloki tylko
+ * rezerwowane i przydzielane jednym przydziałem przy zapisie bufora. Brak miejsca zgłasza już simplefs_write.
+ * @param fd - deskryptor pliku
+ * @param enabled - TRUE włącza, FALSE wyłącza (wcześniej zapisując bufor)
+ * @param fsfd - deskryptor do systemu plików
+ *
+ * @return {0} sukces, {<0} bład (jak dla simplefs_write)
+ */
+int simplefs_set_delayed_allocation(int fd, int enabled, int fsfd);
+
+/**
+ * Przydziela z góry (jednym przydziałem) bloki zakresu [offset, offset + length), wypełniając leżące w nim dziury.
+ * Domyślnie nowe bloki są zerowane, a rozmiar pliku rośnie do offset + length.
+ * @param fd - deskryptor pliku
+ * @param mode - 0 lub suma flag (patrz niżej)
+ * @param offset - początek zakresu w pliku
+ * @param length - długość zakresu
+ * @param fsfd - deskryptor do systemu plików
+ *
+ * @return {0} sukces, {<0} bład (patrz niżej)
+ */
+int simplefs_fallocate(int fd, int mode, unsigned long offset, unsigned long length, int fsfd);
+
+//Flagi
+#define FALLOCATE_KEEP_SIZE 1 //rozmiar pliku się nie zmienia, bloki czekają za końcem pliku
+#define FALLOCATE_UNWRITTEN 2 //nowe bloki nie są zerowane - do pierwszego zapisu czytane są jako zera
+
+//Błędy
+#define WRONG_MODE -2
+#define NOT_FILE_FD -3
+#define FD_NOT_FOUND -4
+#define NO_FREE_BLOCKS -5
+
+/**
+ * Ustawia rozmiar pliku. Skrócenie zwalnia wszystkie bloki za nowym końcem pliku, powiększenie nie przydziela bloków
+ * (nowy zakres jest dziurą czytaną jako zera).
+ * @param fd - deskryptor pliku
+ * @param length - nowy rozmiar pliku
+ * @param fsfd - deskryptor do systemu plików
+ *
+ * @return {0} sukces, {<0} bład (patrz niżej)
+ */
+int simplefs_ftruncate(int fd, unsigned long length, int fsfd);
+
+//Błędy
+#define WRONG_MODE -2
+#define NOT_FILE_FD -3
+#define FD_NOT_FOUND -4
+
+/**
+ * Utrwala dane i metadane pliku (bufor zapisów, bloki pliku, inode, bitmapę, master block i otwartą transakcję
+ * dziennika). Wpis w katalogu nadrzędnym utrwala simplefs_syncfs.
+ * @param fd - deskryptor pliku
+ * @param fsfd - deskryptor do systemu plików
+ *
+ * @return {0} sukces, {<0} bład (patrz niżej oraz jak dla simplefs_write)
+ */
+int simplefs_fsync(int fd, int fsfd);
+
+//Błędy
+#define FD_NOT_FOUND -4
+#define SYNC_ERROR -6
+
+/**
+ * Jak simplefs_fsync, ale utrwala tylko dane pliku i metadane potrzebne do ich odczytu (inode i bitmapę) - pomija
+ * master block i dziennik.
+ * @param fd - deskryptor pliku
+ * @param fsfd - deskryptor do systemu plików
+ *
+ * @return {0} sukces, {<0} bład (jak dla simplefs_fsync)
+ */
+int simplefs_fdatasync(int fd, int fsfd);
+
+/**
+ * Utrwala cały obraz - bufory zapisów wszystkich deskryptorów systemu plików, pamięć podręczną, otwartą transakcję
+ * dziennika i wszystkie zamapowane metadane. Wywołania równoczesne są łączone w jedno fdatasync.
+ * @param fsfd - deskryptor systemu plików zwrócony przez simplefs_openfs
+ *
+ * @return {0} sukces, {-1, -6} błąd (patrz niżej)
+ */
+int simplefs_syncfs(int fsfd);
+
+//Błędy
+//UNKNOWN_DESCRIPTOR -1 //zadeklarowane niżej
+//SYNC_ERROR -6 //zadeklarowane wyżej
+
+/**
+ * Włącza lub wyłącza tryb tylko do dopisywania pliku (w inodzie) - simplefs_write dopisuje na końcu pliku bez
+ * czekania na zapisy innych procesów, a rozmiar rośnie w kolejności rezerwacji zakresów.
+ * @param fd - deskryptor pliku
+ * @param enabled - TRUE włącza, FALSE wyłącza
+ * @param fsfd - deskryptor do systemu plików
+ *
+ * @return {0} sukces, {<0} bład (patrz niżej)
+ */
+int simplefs_set_append_only(int fd, int enabled, int fsfd);
+
+//Błędy
+#define WRONG_MODE -2
+#define NOT_FILE_FD -3
+#define FD_NOT_FOUND -4
+#define APPENDS_IN_PROGRESS -5 //wyłączenie trybu w trakcie zapisów
 
 /**
  * Przesuwa pozycję o podany offset w pliku, pod warunkami określonymi przez whence
  * @param fd - deskryptor pliku
- * @param whence - jedna z trzech wartości (patrz niżej)
+ * @param whence - jedna z wartości SEEK_* (patrz niżej)
  * @param offset - liczba bajtów, o które chcemy się przesunąć
  * @param fsfd - deskryptor do systemu plików
  *
- * @return {0} sukces, {-1} bład
+ * Pozycja może wskazywać za koniec pliku (zapis zostawia wtedy dziurę czytaną jako zera). SEEK_DATA i SEEK_HOLE
+ * przyjmują offset od początku pliku, koniec pliku jest dziurą.
+ *
+ * @return nowa pozycja w pliku, {<0} bład (patrz niżej)
+ */
+long simplefs_lseek(int fd, int whence, long offset, int fsfd);
+
+//Błędy
+#define WRONG_WHENCE -1
+#define FD_NOT_FOUND -4
+#define NO_DATA_AFTER_OFFSET -5
+
+/**
+ * Funkcja wywoływana po zakończeniu operacji asynchronicznej (w wątku puli).
+ * @param request - uchwyt zakończonego żądania
+ * @param result - wynik operacji (jak dla simplefs_read lub simplefs_write)
+ * @param user_data - wskaźnik przekazany przy zleceniu operacji
+ */
+typedef void (*simplefs_async_callback)(int request, int result, void * user_data);
+
+/**
+ * Zleca odczyt (simplefs_read) wykonywany przez pulę wątków, w kolejności zleceń na jednym deskryptorze. Bez callbacku
+ * żądanie trafia do kolejki zakończonych (simplefs_async_reap, simplefs_async_wait).
+ * @param fd - deskryptor do pliku
+ * @param buf - bufor, do którego zostanie wczytana zawartość pliku
+ * @param len - rozmiar bufora
+ * @param fsfd - deskryptor do systemu plików
+ * @param callback - funkcja wywoływana po zakończeniu lub NULL
+ * @param user_data - wskaźnik przekazywany do callbacku
+ *
+ * @return {uchwyt żądania >= 0} sukces, {<0} bład (patrz niżej)
+ */
+int simplefs_read_async(int fd, char *buf, int len, int fsfd, simplefs_async_callback callback, void * user_data);
+
+/**
+ * Zleca zapis (simplefs_write) wykonywany przez pulę wątków - zasady jak dla simplefs_read_async.
+ *
+ * @return {uchwyt żądania >= 0} sukces, {<0} bład (patrz niżej)
+ */
+int simplefs_write_async(int fd, char *buf, int len, int fsfd, simplefs_async_callback callback, void * user_data);
+
+//Błędy
+//FD_NOT_FOUND -4 //zadeklarowane wyżej
+#define ASYNC_POOL_ERROR -5
+
+/**
+ * Zwraca deskryptor eventfd gotowy do odczytu, gdy kolejka zakończonych żądań nie jest pusta (do użycia z poll/epoll).
+ * Deskryptor należy do biblioteki - nie należy go czytać ani zamykać.
+ *
+ * @return {deskryptor} sukces, {ASYNC_POOL_ERROR} błąd
  */
+int simplefs_async_completion_fd();
 
-int simplefs_lseek(int fd, int whence, int offset, int fsfd);
+/**
+ * Zdejmuje z kolejki najstarsze zakończone żądanie (bez oczekiwania).
+ * @param request - parametr wyjściowy, uchwyt żądania
+ * @param result - parametr wyjściowy, wynik operacji
+ *
+ * @return {0} sukces, {-1} kolejka pusta
+ */
+int simplefs_async_reap(int * request, int * result);
+
+#define NO_COMPLETED_REQUESTS -1
+
+/**
+ * Czeka na zakończenie żądania zleconego bez callbacku i zdejmuje je z kolejki zakończonych.
+ * @param request - uchwyt żądania
+ * @param result - parametr wyjściowy, wynik operacji
+ *
+ * @return {0} sukces, {-1} nieznany uchwyt
+ */
+int simplefs_async_wait(int request, int * result);
+
+#define UNKNOWN_REQUEST -1
+
+/**
+ * Zmienia liczbę wątków puli operacji asynchronicznych (czeka na zakończenie trwających operacji).
+ * @param number_of_workers - liczba wątków (0 = DEFAULT_ASYNC_WORKERS)
+ *
+ * @return {0} sukces, {ASYNC_POOL_ERROR} błąd
+ */
+int simplefs_async_configure(unsigned number_of_workers);
+
+/**
+ * Konfiguruje dzielenie odczytów i zapisów co najmniej min_blocks bloków między wątek wywołujący i wątki pomocnicze
+ * (domyślnie DEFAULT_PARALLEL_THREADS i PARALLEL_IO_MIN_BLOCKS).
+ * @param number_of_threads - liczba wątków pomocniczych (0 wyłącza dzielenie operacji)
+ * @param min_blocks - minimalna liczba bloków dzielonej operacji
+ *
+ * @return {0} sukces
+ */
+int simplefs_parallel_configure(unsigned number_of_threads, unsigned long min_blocks);
 
 //Whence
 #define SEEK_SET 0 //ustawienie pozycji za początkiem pliku
 #define SEEK_CUR 1 //ustawienie pozycji po aktualnej pozycji
 #define SEEK_END 2 //ustawienie pozycji za końcem pliku
+#define SEEK_DATA 3 //ustawienie pozycji na pierwszych danych od offsetu
+#define SEEK_HOLE 4 //ustawienie pozycji na pierwszej dziurze (lub końcu pliku) od offsetu
 
 #define INODE_DIR 'D'
 #define INODE_FILE 'F'
 #define INODE_EMPTY '\0'
+#define INODE_ORPHAN 'O' //usunięty plik, którego bloki czekają na zwolnienie
 
 /**
  * Struktura metryczki dla pliku na dysku.
@@ -188,10 +597,53 @@ int simplefs_lseek(int fd, int whence, int offset, int fsfd);
 typedef struct inode_t {
     char filename[FILE_NAME_LENGTH];
     char type;
+    char append_only;           //TRUE - plik tylko do dopisywania (simplefs_set_append_only)
+    char layout;                //układ bloków pliku (FILE_LAYOUT_*), wybierany przy tworzeniu
+    char block_map_levels;      //liczba poziomów mapy bloków lub wysokość B+drzewa ekstentów
     unsigned long size;
     unsigned long first_data_block;
+    unsigned long generation;   //zwiększana przy każdej zmianie łańcucha bloków innej niż dopisanie na końcu
+    unsigned long allocated_blocks; //długość łańcucha bloków, jeśli simplefs_fallocate przydzielił bloki za końcem pliku
+    unsigned long unwritten_start;  //zakres [unwritten_start, unwritten_end), w którym leżą bloki BLOCK_LINK_UNWRITTEN
+    unsigned long unwritten_end;
+    unsigned long next_orphan_inode; //następny inode na liście osieroconych (INODE_ORPHAN), 0 = koniec listy
+    unsigned long last_data_block;  //ostatni blok łańcucha (0 = pusty lub nieznany) - dopisywanie bez przechodzenia łańcucha
+    unsigned long last_block_index; //jego indeks logiczny; zapełnienie ostatniego bloku wynika z size
+    unsigned long append_cursor;    //koniec zarezerwowanych zapisów pliku tylko do dopisywania (size - koniec zakończonych)
+    unsigned long block_map;        //korzeń mapy bloków (FILE_LAYOUT_MAPPED) lub B+drzewa ekstentów (FILE_LAYOUT_EXTENTS)
+    unsigned long fragment;         //fragmenty z całą zawartością małego pliku (FRAGMENT), 0 = dane w łańcuchu bloków
 } inode;
 
+/**
+ * Ekstent pliku FILE_LAYOUT_EXTENTS - length bloków o kolejnych indeksach logicznych od logical_block, leżących
+ * w kolejnych blokach od physical_block.
+ */
+typedef struct extent_t {
+    unsigned long logical_block;
+    unsigned long physical_block;
+    unsigned long length;
+} extent;
+
+/**
+ * Wpis węzła wewnętrznego B+drzewa ekstentów - najmniejszy indeks logiczny poddrzewa i blok jego korzenia.
+ * Indeks pierwszego wpisu węzła nie jest używany przy wyszukiwaniu (poddrzewo obejmuje też mniejsze indeksy).
+ */
+typedef struct extent_index_t {
+    unsigned long logical_block;
+    unsigned long node;
+} extent_index;
+
+/**
+ * Nagłówek węzła B+drzewa ekstentów (cały blok danych) - za nim wpisy extent (liść) lub extent_index.
+ */
+typedef struct extent_node_t {
+    unsigned long number_of_entries;
+    unsigned long level;            //0 = liść
+} extent_node;
+
+#define EXTENT_NODE_ENTRIES(block_size, level) \
+    (((block_size) - sizeof(extent_node)) / ((level) == 0 ? sizeof(extent) : sizeof(extent_index)))
+
 /**
  * Struktura pierwszego bloku na dysku.
  */
@@ -206,16 +658,35 @@ typedef struct master_block_t {
     unsigned long first_inode_table_block;
     unsigned long first_free_inode;
     unsigned int magic_number;
+    unsigned long write_generation[CACHE_GENERATION_STRIPES]; //liczniki zapisów bloków danych (pas = numer bloku % CACHE_GENERATION_STRIPES)
+    unsigned long image_id;                       //losowy identyfikator obrazu nadawany przy simplefs_init
+    unsigned long first_orphan_inode;             //lista usuniętych plików czekających na zwolnienie bloków (0 = pusta)
+    unsigned long journal_start_block;            //numer bloku w całym systemie plików - nagłówek dziennika
+    unsigned long number_of_journal_blocks;       //0 = obraz bez dziennika
+    unsigned long first_link_table_block;         //tablica wskaźników następnych bloków (INIT_LINK_TABLE)
+    unsigned long number_of_link_table_blocks;    //0 = wskaźniki w ostatnich bajtach bloków danych
+    unsigned long fragment_size;                  //rozmiar fragmentu (INIT_FRAGMENTS), 0 = obraz bez fragmentów
+    unsigned long first_fragment_block;           //lista bloków fragmentów z wolnymi fragmentami (0 = pusta)
+    unsigned long number_of_reserved_blocks;      //wolne bloki zarezerwowane przez opóźniony przydział (0 po montowaniu)
     /* TODO struct inode root_node; */
 } master_block;
 
+/**
+ * Nagłówek bloku fragmentów, zajmujący jego pierwszy fragment.
+ */
+typedef struct fragment_block_header_t {
+    unsigned long used_units;           //maska zajętych fragmentów
+    unsigned long next_fragment_block;  //następny blok listy bloków z wolnymi fragmentami
+} fragment_block_header;
+
 /**
  * Struktura reprezentująca blok zawierający fragment danych jednego pliku.
  */
 typedef struct block_t {
-	//data length is block_size - 8 (next_data_block)
+	//data length is block_size - 8 (next_data_block), or block_size with INIT_LINK_TABLE
 	char* data;
     unsigned long next_data_block;
+    unsigned long size;         //rozmiar bufora data (zwracanego do puli buforów)
 } block;
 
 typedef struct file_signature_t {
@@ -223,6 +694,17 @@ typedef struct file_signature_t {
     unsigned long inode_no; //inode_no == 0 oznacza sygnaturę nieważną
 } file_signature;
 
+/**
+ * Stałe arytmetyki pozycji w pliku, wyliczane raz przy montowaniu (i otwarciu pliku) - dzielenie przez rozmiar danych
+ * bloku zastępuje przesunięcie (potęga dwójki) albo mnożenie przez odwrotność.
+ */
+typedef struct block_geometry_t {
+    unsigned int block_size;
+    unsigned int real_block_size;      /* rozmiar danych w bloku */
+    unsigned int shift;                /* log2(real_block_size), gdy jest potęgą dwójki */
+    unsigned long reciprocal;          /* floor((2^64 - 1) / real_block_size), 0 dla potęgi dwójki */
+} block_geometry;
+
 /**
  * Struktura reprezentująca unixową strukturę file - tutaj zawiera pozycję w otwartym pliku. Dla każdego wywołania
  * simplefs_open() będzie tworzona nowa taka struktura. Kolejne instancje tej strukturą będą przechowywane w mapie haszującej
@@ -233,6 +715,21 @@ typedef struct file_t {
     unsigned long position;
     unsigned long inode_no;
     char mode; /* tryb dostepu */
+    unsigned long last_read_end;        /* pozycja, na której skończył się ostatni odczyt (wykrywanie sekwencyjności) */
+    unsigned long readahead_window;     /* aktualne okno readahead w blokach, 0 = odczyt losowy */
+    unsigned long readahead_next_index; /* indeks logiczny bloku, do którego zlecono już readahead */
+    unsigned long cursor_block_index;   /* indeks w pliku ostatnio używanego bloku */
+    unsigned long cursor_block_no;      /* numer tego bloku, 0 = kursor nieważny */
+    unsigned long cursor_generation;    /* generation inode'u, dla której kursor jest ważny */
+    int fsfd;                           /* deskryptor systemu plików, w którym otwarto plik */
+    char * write_buffer;                /* bufor zapisów (simplefs_set_write_buffer), NULL = zapisy niebuforowane */
+    unsigned long write_buffer_size;
+    unsigned long write_buffer_length;  /* liczba zgromadzonych bajtów */
+    unsigned long write_buffer_position;/* pozycja w pliku pierwszego zgromadzonego bajtu */
+    int delayed_allocation;             /* bufor rośnie zamiast być zapisywany, bloki są tylko rezerwowane */
+    unsigned long reserved_blocks;      /* bloki zarezerwowane dla danych w buforze */
+    unsigned long reserved_end;         /* pozycja w pliku, do której dane mają bloki przydzielone lub zarezerwowane */
+    block_geometry geometry;            /* arytmetyka pozycji dla rozmiaru bloku systemu plików */
     UT_hash_handle hh; //makes the struct hashable
 } file;
 
@@ -242,6 +739,307 @@ typedef struct initialized_structures_t {
     inode * inode_table;
     unsigned bitmap_delta;
     unsigned inode_delta;
+    int fsfd;
 } initialized_structures;
 
+/**
+ * Wpis pamięci podręcznej - kopia całego bloku (razem ze wskaźnikiem na następny blok).
+ */
+typedef struct cache_entry_t {
+    unsigned long block_no;     // numer bloku w całym systemie plików, 0 = wpis wolny
+    char * data;
+    char referenced;            // bit odwołania algorytmu CLOCK
+    char dirty;                 // blok zmieniony i jeszcze niezapisany (tryb write-back)
+    struct cache_entry_t * stripe_prev; // lista wpisów tego samego pasa liczników zapisów
+    struct cache_entry_t * stripe_next;
+    UT_hash_handle hh;
+} cache_entry;
+
+/**
+ * Pamięć podręczna bloków danych jednego zamontowanego systemu plików.
+ */
+typedef struct block_cache_t {
+    int mode;
+    unsigned int block_size;
+    unsigned long capacity;     // liczba wpisów
+    unsigned long clock_hand;
+    unsigned long generation[CACHE_GENERATION_STRIPES]; // wartości write_generation, dla których wpisy są aktualne
+    unsigned int in_flight[CACHE_GENERATION_STRIPES];   // liczba wątków z niezakończonymi zapisami pasa (_io_plug)
+    cache_entry * entries;
+    cache_entry * lookup;       // mapa haszująca numer bloku -> wpis
+    cache_entry * stripe_entries[CACHE_GENERATION_STRIPES]; // wpisy każdego pasa (unieważnianie pasa)
+    unsigned long hits;         // odczyty obsłużone z pamięci podręcznej (statystyka)
+    pthread_mutex_t mutex;
+} block_cache;
+
+#define SHARED_CACHE_MAGIC 0x5C5D
+
+/**
+ * Nagłówek współdzielonej pamięci podręcznej - segmentu pamięci dzielonej wspólnego dla procesów, które otworzyły
+ * ten sam obraz. Za nagłówkiem znajdują się kolejno: tablica kubełków, deskryptory buforów i dane bloków.
+ */
+typedef struct shared_cache_header_t {
+    unsigned int magic;                  // ustawiany na końcu inicjalizacji segmentu
+    unsigned int block_size;
+    unsigned long capacity;              // liczba buforów
+    unsigned long number_of_buckets;
+    unsigned long clock_hand;
+    unsigned long attached;              // liczba podłączonych procesów
+    unsigned long generation[CACHE_GENERATION_STRIPES];
+    long stripe_head[CACHE_GENERATION_STRIPES]; // indeks pierwszego bufora pasa, -1 = pas pusty
+    pthread_mutex_t mutex;               // robust, process-shared - chroni kubełki, wskazówkę zegara i zmiany buforów
+} shared_cache_header;
+
+/**
+ * Deskryptor bufora współdzielonej pamięci podręcznej.
+ */
+typedef struct shared_buffer_t {
+    unsigned long block_no;              // 0 = bufor wolny
+    unsigned long version;               // nieparzysta w trakcie zmiany bufora - czytelnicy kopiują dane bez blokady
+    long next_in_bucket;                 // indeks następnego bufora w kubełku, -1 = koniec listy
+    long stripe_prev;                    // lista buforów tego samego pasa liczników zapisów, -1 = koniec listy
+    long stripe_next;
+    char referenced;                     // bit odwołania algorytmu CLOCK
+} shared_buffer;
+
+/**
+ * Stan backendu wejścia-wyjścia - pierścienie io_uring zamapowane z jądra i zarejestrowany bufor pośredni
+ * (jeden slot o rozmiarze bloku na każdy wpis kolejki).
+ */
+typedef struct io_backend_t {
+    int type;
+    int ring_fd;
+    unsigned queue_depth;
+    void * sq_ring;
+    unsigned long sq_ring_size;
+    void * cq_ring;                      // równy sq_ring, jeśli jądro mapuje oba pierścienie razem
+    unsigned long cq_ring_size;
+    void * sqes;
+    unsigned long sqes_size;
+    unsigned * sq_head;
+    unsigned * sq_tail;
+    unsigned * sq_mask;
+    unsigned * sq_array;
+    unsigned * cq_head;
+    unsigned * cq_tail;
+    unsigned * cq_mask;
+    void * cqes;
+    char * staging;                      // NULL, jeśli nie udało się zarejestrować buforów
+    unsigned int staging_slot_size;
+    unsigned long * free_slots;          // mapa wolnych slotów bufora pośredniego (bit 1 = wolny)
+    unsigned in_flight;                  // operacje przyjęte przez jądro, których zakończeń nie zdjęto z pierścienia
+    unsigned long submitted;             // wszystkie zgłoszenia przyjęte przez jądro (statystyka)
+    int reaping;                         // wątek czeka w jądrze na zakończenia (bez mutexu)
+    pthread_mutex_t mutex;               // kolejki pierścienia, sloty i liczniki
+    pthread_cond_t completed;            // zdjęto zakończenia z pierścienia
+} io_backend;
+
+/**
+ * Wynik operacji w pierścieniu io_uring - user_data zgłoszenia to adres tej struktury.
+ */
+typedef struct io_completion_t {
+    int result;
+    int done;
+} io_completion;
+
+/**
+ * Stan trybu O_DIRECT - drugi deskryptor obrazu otwarty z O_DIRECT i pula wyrównanych buforów pośrednich.
+ */
+typedef struct direct_io_t {
+    int fd;                              // -1 = tryb wyłączony
+    unsigned int alignment;              // wymagane wyrównanie pozycji, długości i adresu bufora
+    unsigned int buffer_size;            // rozmiar bufora pośredniego (rozmiar bloku)
+    void * free_buffers[DIRECT_IO_POOL_BUFFERS];
+    unsigned number_of_free_buffers;
+    void * reserve_buffer;               // bufor przydzielony przy włączeniu trybu - gdy brakuje pamięci na nowy
+    int reserve_in_use;
+    pthread_cond_t reserve_free;
+    pthread_mutex_t mutex;
+} direct_io;
+
+/**
+ * Pojedyncza operacja wejścia-wyjścia na obrazie.
+ */
+typedef struct io_request_t {
+    int write;
+    void * buffer;                       // NULL = dane w inline_data
+    unsigned long length;
+    unsigned long offset;
+    unsigned long inline_data;           // kopia krótkich danych (wskaźniki łańcucha bloków)
+} io_request;
+
+/**
+ * Zapisy gromadzone przez wątek między _io_plug i _io_unplug, wysyłane razem.
+ */
+typedef struct io_plug_t {
+    struct mounted_fs_t * mounted;       // NULL = zapisy wykonywane od razu
+    io_request requests[IO_PLUG_REQUESTS];
+    unsigned count;
+    unsigned long pending_stripes;       // pasy, których liczniki zapisów trzeba zwiększyć po zakończeniu zapisów
+} io_plug;
+
+/**
+ * Nagłówek dziennika (obszar dziennika) - stale zamapowany przez wszystkie procesy. Zmienione bloki operacji trafiają
+ * na listę otwartej transakcji, którą utrwala pierwszy proces czekający na jej utrwalenie.
+ */
+typedef struct journal_header_t {
+    unsigned long magic;
+    unsigned long committed_sequence;     // ostatnia trwale zapisana transakcja
+    unsigned long next_sequence;          // numer otwartej transakcji
+    unsigned long number_of_pending_blocks;
+    unsigned long ordered_data_writes;    // zapisy bloków danych operacji otwartej transakcji (JOURNAL_ORDERED)
+    unsigned long pending_blocks[JOURNAL_TRANSACTION_BLOCKS]; // bloki otwartej transakcji (numery w całym systemie)
+} journal_header;
+
+/**
+ * Stan dziennika zamontowanego systemu plików.
+ */
+typedef struct journal_t {
+    int mode;
+    journal_header * header;              // NULL = obraz bez dziennika
+    unsigned header_delta;
+    pthread_mutex_t pending_mutex;        // blokady fcntl nie wykluczają wątków jednego procesu
+    pthread_mutex_t commit_mutex;
+} journal;
+
+/**
+ * Bloki zmienione przez bieżące operacje wątku, przekazywane do otwartej transakcji na końcu operacji.
+ */
+typedef struct journal_operation_t {
+    int fsfd;
+    unsigned number_of_blocks;
+    unsigned long blocks[JOURNAL_TRANSACTION_BLOCKS];
+    unsigned long ordered_data_writes;
+} journal_operation;
+
+/**
+ * Zakres obrazu do utrwalenia (w bajtach).
+ */
+typedef struct sync_range_t {
+    unsigned long offset;
+    unsigned long length;
+} sync_range;
+
+/**
+ * Zakresy zgłoszone do utrwalenia przez wątki procesu. Utrwala je jeden wątek naraz - zgłoszenia nadchodzące w tym
+ * czasie trafiają do następnej partii, którą utrwali pierwszy z czekających.
+ */
+typedef struct sync_batch_t {
+    sync_range ranges[SYNC_BATCH_RANGES];
+    unsigned number_of_ranges;
+    int whole_image;                      // zakresy się nie zmieściły lub simplefs_syncfs - utrwalany cały obraz
+    unsigned long gathering;              // numer zbieranej partii
+    unsigned long completed;              // partie o numerach <= są utrwalone
+    unsigned long last_failed;            // numer ostatniej partii, której utrwalenie się nie powiodło
+    int running;
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+} sync_batch;
+
+/**
+ * Stan systemu plików otwartego przez simplefs_openfs, przechowywany w mapie haszującej po deskryptorze.
+ */
+typedef struct mounted_fs_t {
+    int fsfd;
+    master_block * master_block_pointer; // stale zamapowany master block (liczniki write_generation)
+    block_geometry geometry;             // arytmetyka pozycji wybrana przy montowaniu
+    unsigned long * link_table;          // zamapowana tablica wskaźników następnych bloków, NULL = wskaźniki w blokach
+    unsigned link_table_delta;
+    block_cache cache;
+    shared_cache_header * shared_cache;  // NULL, jeśli nie włączono CACHE_SHARED
+    unsigned long shared_cache_size;
+    char shared_cache_name[64];
+    io_backend io;
+    direct_io direct;
+    journal journal;
+    sync_batch sync;
+    pthread_rwlock_t operations_lock;    // odczyty współdzielone, zapisy na wyłączność - fcntl nie wyklucza wątków
+    UT_hash_handle hh;
+} mounted_fs;
+
+/**
+ * Żądanie operacji asynchronicznej, przechowywane w mapie haszującej po uchwycie.
+ */
+typedef struct async_request_t {
+    int request;
+    int write;
+    int fd;
+    char * buf;
+    int len;
+    int fsfd;
+    simplefs_async_callback callback;
+    void * user_data;
+    int result;
+    int done;
+    struct async_request_t * next;       // następne żądanie w kolejce zleconych lub zakończonych
+    UT_hash_handle hh;
+} async_request;
+
+/**
+ * Pula wątków wykonujących operacje asynchroniczne.
+ */
+typedef struct async_pool_t {
+    pthread_t * workers;
+    int * running_fds;                   // deskryptory obsługiwane przez wątki, -1 = wątek wolny
+    unsigned number_of_workers;
+    int stopping;
+    async_request * submitted_head;
+    async_request * submitted_tail;
+    async_request * completed_head;
+    async_request * completed_tail;
+    async_request * requests;
+    int next_request;
+    int event_fd;
+    pthread_mutex_t mutex;
+    pthread_cond_t submitted;
+    pthread_cond_t completed;
+} async_pool;
+
+/**
+ * Zakres indeksów zadania przydzielony jednemu wykonawcy - właściciel bierze indeksy od początku, inni wykonawcy
+ * przejmują połowę pozostałych od końca.
+ */
+typedef struct parallel_range_t {
+    unsigned long next;
+    unsigned long end;
+    pthread_mutex_t mutex;
+} parallel_range;
+
+/**
+ * Pula wątków pomocniczych dużych odczytów i zapisów.
+ */
+typedef struct parallel_pool_t {
+    pthread_t * threads;
+    unsigned number_of_threads;          // wątki pomocnicze, wywołujący jest dodatkowym wykonawcą
+    unsigned long min_blocks;
+    pid_t owner;                         // proces, w którym uruchomiono wątki (proces potomny uruchamia własne)
+    parallel_range * ranges;             // number_of_threads + 1 zakresów
+    void (*process)(void *, unsigned long);
+    void * job;
+    struct mounted_fs_t * plugged;       // system plików, do którego wywołujący gromadzi zapisy (_io_plug), lub NULL
+    unsigned long job_number;            // zwiększany przy każdym zadaniu - budzi wątki pomocnicze
+    unsigned long started_job_number;    // job_number w chwili uruchomienia wątków
+    unsigned active;                     // wątki pomocnicze, które nie skończyły bieżącego zadania
+    int stopping;
+    pthread_mutex_t mutex;
+    pthread_mutex_t job_mutex;           // pula wykonuje naraz jedno zadanie
+    pthread_cond_t job_started;
+    pthread_cond_t job_finished;
+} parallel_pool;
+
+/**
+ * Wolne bufory jednej klasy rozmiaru.
+ */
+typedef struct buffer_magazine_t {
+    unsigned count;
+    void * buffers[BUFFER_POOL_MAGAZINE];
+} buffer_magazine;
+
+/**
+ * Pula buforów wątku - bloki, inody, master bloki i tablice numerów bloków wracają do niej zamiast do free().
+ */
+typedef struct buffer_pool_t {
+    buffer_magazine magazines[BUFFER_POOL_MAX_SHIFT - BUFFER_POOL_MIN_SHIFT + 1];
+} buffer_pool;
+
 #endif //_SIMPLEFS_H
@@ -0,0 +1,57 @@
+/**
+ * @file simplefs_internal.h
+ * @brief Funkcje wewnętrzne systemu plików, używane przez testy
+ */
+
+#ifndef _SIMPLEFS_INTERNAL_H
+#define _SIMPLEFS_INTERNAL_H
+
+#include "simplefs.h"
+
+/**
+ * Odczytuje master block z dysku (do zwolnienia przez free).
+ */
+master_block* _get_master_block(int fsfd);
+
+/**
+ * Wyszukuje inode pliku o podanej ścieżce (kopia do zwolnienia przez free).
+ */
+inode* _get_inode_by_path(char* path, master_block* masterblock, int fd, unsigned long* inode_no);
+
+/**
+ * Odczytuje blok danych (do zwolnienia przez free_block_struct).
+ */
+void* _read_block(int fsfd, long block_no, long block_offset, long block_size);
+
+/**
+ * @return numer następnego bloku łańcucha zapisany w bloku danych
+ */
+unsigned long _find_next_block(int fd, long block_no, long block_offset, long block_size);
+
+/**
+ * @return wskaźnik na następny blok łańcucha - z tablicy wskaźników (INIT_LINK_TABLE) lub z bloku danych
+ */
+unsigned long _get_block_link(int fsfd, master_block * master_block_pointer, unsigned long block_no);
+
+/**
+ * @return struktura otwartego pliku o podanym deskryptorze lub NULL
+ */
+file * _get_file_by_fd(int fd);
+
+/**
+ * @return stan zamontowanego systemu plików o podanym deskryptorze lub NULL
+ */
+mounted_fs * _get_mounted_fs(int fsfd);
+
+/**
+ * Bufory z puli wątku (_pool_free zwraca bufor do puli, z której przydzieli go kolejny _pool_alloc).
+ */
+void * _pool_alloc(unsigned long size);
+void _pool_free(void * buffer, unsigned long size);
+
+/**
+ * Pula wątków pomocniczych dużych odczytów i zapisów.
+ */
+extern parallel_pool parallel_operations;
+
+#endif //_SIMPLEFS_INTERNAL_H
@@ -1,9 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <poll.h>
 #include "CUnit/Basic.h"
 #include "CUnit/CUnit.h"
-#include "simplefs.h"
+#include "simplefs_internal.h"
 
 /* Pointer to the file used by the tests. */
 static FILE* temp_file = NULL;
@@ -381,6 +386,1552 @@ void test_read() {
     CU_ASSERT(OK == simplefs_unlink("/b.txt", fdfs));
 }
 
+#define CHUNK_TEST_LEN 12000
+#define CHUNK_LEN 100
+
+/*
+ * Zapis i odczyt pliku małymi porcjami - kolejne operacje na deskryptorze zaczynają od zapamiętanego bloku.
+ */
+void test_chunked_read_write() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(OK == simplefs_creat("/chunks.txt", fdfs));
+    int fd = simplefs_open("/chunks.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(0 <= fd);
+    if (fd < 0) {
+        return;
+    }
+    char message[CHUNK_TEST_LEN], read[CHUNK_TEST_LEN];
+    int i;
+    for(i = 0; i < CHUNK_TEST_LEN; ++i) {
+        message[i] = 'a' + (i / 7) % 26;
+        read[i] = 0;
+    }
+    for(i = 0; i < CHUNK_TEST_LEN; i += CHUNK_LEN) {
+        CU_ASSERT(OK == simplefs_write(fd, message + i, CHUNK_LEN, fdfs));
+    }
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    for(i = 0; i < CHUNK_TEST_LEN; i += CHUNK_LEN) {
+        CU_ASSERT(CHUNK_LEN == simplefs_read(fd, read + i, CHUNK_LEN, fdfs));
+    }
+    CU_ASSERT(0 == memcmp(message, read, CHUNK_TEST_LEN));
+
+    //cofnięcie się przed zapamiętany blok
+    simplefs_lseek(fd, SEEK_SET, 50, fdfs);
+    CU_ASSERT(CHUNK_LEN == simplefs_read(fd, read, CHUNK_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message + 50, read, CHUNK_LEN));
+
+    //nadpisanie środka pliku i odczyt za końcem zapisanego fragmentu
+    simplefs_lseek(fd, SEEK_SET, 5000, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, "XYZ", 3, fdfs));
+    simplefs_lseek(fd, SEEK_SET, 4999, fdfs);
+    CU_ASSERT(5 == simplefs_read(fd, read, 5, fdfs));
+    CU_ASSERT(0 == memcmp(read + 1, "XYZ", 3));
+    CU_ASSERT(read[4] == message[5003]);
+
+    //odczyt przez koniec pliku zwraca tylko pozostałe dane
+    simplefs_lseek(fd, SEEK_SET, CHUNK_TEST_LEN - 10, fdfs);
+    CU_ASSERT(10 == simplefs_read(fd, read, CHUNK_LEN, fdfs));
+
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/chunks.txt", fdfs));
+}
+
+/*
+ * Okno readahead rośnie przy odczycie sekwencyjnym pliku, którego bloki przeplatają się z blokami innego pliku,
+ * i jest zerowane przy odczycie losowym.
+ */
+void test_readahead() {
+    unlink("testfs_readahead");
+    CU_ASSERT(0 == simplefs_init("testfs_readahead", 1024, 64));
+    int fdfs = simplefs_openfs("testfs_readahead");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(OK == simplefs_creat("/a.txt", fdfs));
+    CU_ASSERT(OK == simplefs_creat("/b.txt", fdfs));
+    int fd_a = simplefs_open("/a.txt", READ_AND_WRITE, fdfs);
+    int fd_b = simplefs_open("/b.txt", WRITE_MODE, fdfs);
+    CU_ASSERT(0 <= fd_a && 0 <= fd_b);
+    if (fd_a < 0 || fd_b < 0) {
+        return;
+    }
+    unsigned long real_block_size = 1024 - sizeof(long);
+    char block[1024];
+    int i;
+    for (i = 0; i < 8; ++i) {
+        memset(block, 'a' + i, real_block_size);
+        CU_ASSERT(OK == simplefs_write(fd_a, block, real_block_size, fdfs));
+        CU_ASSERT(OK == simplefs_write(fd_b, block, real_block_size, fdfs));
+    }
+    // kolejne bloki pliku nie leżą obok siebie
+    master_block * masterblock = _get_master_block(fdfs);
+    unsigned long inode_no;
+    inode * file_inode = _get_inode_by_path("/a.txt", masterblock, fdfs, &inode_no);
+    unsigned long first_block = BLOCK_LINK_NUMBER(file_inode->first_data_block);
+    CU_ASSERT(first_block + 1 != BLOCK_LINK_NUMBER(_get_block_link(fdfs, masterblock, first_block)));
+    free(file_inode);
+    free(masterblock);
+
+    file * file_pointer = _get_file_by_fd(fd_a);
+    CU_ASSERT(0 == simplefs_lseek(fd_a, SEEK_SET, 0, fdfs));
+    CU_ASSERT(real_block_size == simplefs_read(fd_a, block, real_block_size, fdfs));
+    CU_ASSERT(READAHEAD_MIN_BLOCKS == file_pointer->readahead_window);
+    CU_ASSERT(1 + READAHEAD_MIN_BLOCKS == file_pointer->readahead_next_index);
+    // w pierwszej połowie okna kolejne okno nie jest zlecane
+    CU_ASSERT(real_block_size == simplefs_read(fd_a, block, real_block_size, fdfs));
+    CU_ASSERT(READAHEAD_MIN_BLOCKS == file_pointer->readahead_window);
+    // okno podwojone, ale ograniczone końcem pliku
+    CU_ASSERT(real_block_size == simplefs_read(fd_a, block, real_block_size, fdfs));
+    CU_ASSERT(2 * READAHEAD_MIN_BLOCKS == file_pointer->readahead_window);
+    CU_ASSERT(8 == file_pointer->readahead_next_index);
+    CU_ASSERT(0 == memcmp(block, "ccc", 3));
+    // odczyt losowy
+    CU_ASSERT(real_block_size == simplefs_lseek(fd_a, SEEK_SET, real_block_size, fdfs));
+    CU_ASSERT(real_block_size == simplefs_read(fd_a, block, real_block_size, fdfs));
+    CU_ASSERT(0 == file_pointer->readahead_window);
+    CU_ASSERT(0 == file_pointer->readahead_next_index);
+
+    simplefs_close(fd_a);
+    simplefs_close(fd_b);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    unlink("testfs_readahead");
+}
+
+/*
+ * Zapis w trybie write-back trafia na dysk przy zamknięciu systemu plików.
+ */
+void test_cache_write_back() {
+    CU_ASSERT(UNKNOWN_DESCRIPTOR == simplefs_cache_configure(-1, DEFAULT_CACHE_SIZE, CACHE_WRITE_BACK));
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(OK == simplefs_cache_configure(fdfs, 16 * 4096, CACHE_WRITE_BACK));
+    CU_ASSERT(OK == simplefs_creat("/cached.txt", fdfs));
+    int fd = simplefs_open("/cached.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(0 <= fd);
+    if (fd < 0) {
+        return;
+    }
+    char message[CHUNK_TEST_LEN], read[CHUNK_TEST_LEN];
+    int i;
+    for(i = 0; i < CHUNK_TEST_LEN; ++i) {
+        message[i] = 'z' - i % 26;
+    }
+    CU_ASSERT(OK == simplefs_write(fd, message, CHUNK_TEST_LEN, fdfs));
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    block_cache * cache = &_get_mounted_fs(fdfs)->cache;
+    unsigned long hits = cache->hits;
+    CU_ASSERT(CHUNK_TEST_LEN == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, CHUNK_TEST_LEN));
+    //zapisane bloki czytane są z pamięci podręcznej
+    CU_ASSERT(hits < cache->hits);
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+
+    //po ponownym otwarciu dane czytane są z dysku
+    fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(OK == simplefs_cache_configure(fdfs, 16 * 4096, CACHE_WRITE_THROUGH));
+    fd = simplefs_open("/cached.txt", READ_MODE, fdfs);
+    CU_ASSERT(0 <= fd);
+    memset(read, 0, CHUNK_TEST_LEN);
+    CU_ASSERT(CHUNK_TEST_LEN == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, CHUNK_TEST_LEN));
+
+    //zapis innego procesu unieważnia wpisy jego pasa w pamięci podręcznej tego procesu
+    pid_t child = fork();
+    if (child == 0) {
+        int child_fdfs = simplefs_openfs("testfs3");
+        int child_fd = simplefs_open("/cached.txt", WRITE_MODE, child_fdfs);
+        int result = simplefs_write(child_fd, "bbbbb", 5, child_fdfs);
+        simplefs_close(child_fd);
+        simplefs_closefs(child_fdfs);
+        _exit(result == OK ? 0 : 1);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    CU_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(CHUNK_TEST_LEN == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp("bbbbb", read, 5));
+    CU_ASSERT(0 == memcmp(message + 5, read + 5, CHUNK_TEST_LEN - 5));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/cached.txt", fdfs));
+}
+
+void test_cache_shared() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(CACHE_MODE_NOT_SUPPORTED == simplefs_cache_configure(fdfs, 16 * 4096, CACHE_SHARED | CACHE_WRITE_BACK));
+    CU_ASSERT(OK == simplefs_cache_configure(fdfs, 16 * 4096, CACHE_SHARED | CACHE_WRITE_THROUGH));
+    CU_ASSERT(OK == simplefs_creat("/shared.txt", fdfs));
+    int fd = simplefs_open("/shared.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(0 <= fd);
+    if (fd < 0) {
+        return;
+    }
+    char read[10];
+    CU_ASSERT(OK == simplefs_write(fd, "aaaaaaaaaa", 10, fdfs));
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(10 == simplefs_read(fd, read, 10, fdfs));
+
+    //proces potomny nadpisuje początek pliku przez własny segment
+    pid_t child = fork();
+    if (child == 0) {
+        int child_fdfs = simplefs_openfs("testfs3");
+        simplefs_cache_configure(child_fdfs, 16 * 4096, CACHE_SHARED | CACHE_WRITE_THROUGH);
+        int child_fd = simplefs_open("/shared.txt", WRITE_MODE, child_fdfs);
+        simplefs_lseek(child_fd, SEEK_SET, 0, child_fdfs);
+        int result = simplefs_write(child_fd, "bbbbb", 5, child_fdfs);
+        simplefs_close(child_fd);
+        simplefs_closefs(child_fdfs);
+        _exit(result == OK ? 0 : 1);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    CU_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(10 == simplefs_read(fd, read, 10, fdfs));
+    CU_ASSERT(0 == memcmp("bbbbbaaaaa", read, 10));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/shared.txt", fdfs));
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
+void test_write_buffer() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(FD_NOT_FOUND == simplefs_flush(-1, fdfs));
+    CU_ASSERT(OK == simplefs_creat("/buffered.txt", fdfs));
+    int fd = simplefs_open("/buffered.txt", WRITE_MODE, fdfs);
+    int reader = simplefs_open("/buffered.txt", READ_MODE, fdfs);
+    CU_ASSERT(0 <= fd && 0 <= reader);
+    if (fd < 0 || reader < 0) {
+        return;
+    }
+    CU_ASSERT(OK == simplefs_set_write_buffer(fd, 1000, fdfs));
+    char message[CHUNK_TEST_LEN], read[CHUNK_TEST_LEN];
+    int i;
+    for(i = 0; i < CHUNK_TEST_LEN; ++i) {
+        message[i] = 'a' + i % 23;
+    }
+    for(i = 0; i < 25; ++i) {
+        CU_ASSERT(OK == simplefs_write(fd, message + i * CHUNK_LEN, CHUNK_LEN, fdfs));
+    }
+    //dwa pełne bufory są już zapisane, reszta czeka na simplefs_flush
+    CU_ASSERT(2000 == simplefs_read(reader, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(OK == simplefs_flush(fd, fdfs));
+    CU_ASSERT(500 == simplefs_read(reader, read + 2000, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 2500));
+
+    //zapis większy niż bufor oraz dane zapisane przy zamknięciu
+    CU_ASSERT(OK == simplefs_write(fd, message + 2500, 5000, fdfs));
+    CU_ASSERT(OK == simplefs_write(fd, message + 7500, CHUNK_TEST_LEN - 7500, fdfs));
+    CU_ASSERT(OK == simplefs_close(fd));
+    simplefs_lseek(reader, SEEK_SET, 0, fdfs);
+    memset(read, 0, CHUNK_TEST_LEN);
+    CU_ASSERT(CHUNK_TEST_LEN == simplefs_read(reader, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, CHUNK_TEST_LEN));
+    simplefs_close(reader);
+
+    //dane, których nie udało się zapisać, zostają w buforze - zamknięcie zgłasza błąd i można je powtórzyć
+    master_block * mb = _get_master_block(fdfs);
+    unsigned long length = (mb->number_of_free_blocks - mb->number_of_reserved_blocks) * (mb->block_size - sizeof(long));
+    free(mb);
+    char * big_message = malloc(length);
+    char * big_read = malloc(length);
+    memset(big_message, 'q', length);
+    CU_ASSERT(OK == simplefs_creat("/buffered_full.txt", fdfs));
+    fd = simplefs_open("/buffered_full.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_set_write_buffer(fd, length + 1, fdfs));
+    CU_ASSERT(OK == simplefs_write(fd, big_message, length, fdfs));
+    CU_ASSERT(NO_FREE_BLOCKS == simplefs_flush(fd, fdfs));
+    CU_ASSERT(NO_FREE_BLOCKS == simplefs_close(fd));
+    CU_ASSERT(OK == simplefs_unlink("/buffered.txt", fdfs));
+    CU_ASSERT(OK == simplefs_flush(fd, fdfs));
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(length == simplefs_read(fd, big_read, length, fdfs));
+    CU_ASSERT(0 == memcmp(big_message, big_read, length));
+    CU_ASSERT(OK == simplefs_close(fd));
+    CU_ASSERT(OK == simplefs_unlink("/buffered_full.txt", fdfs));
+    free(big_message);
+    free(big_read);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
+/*
+ * Sprawdza na tymczasowym obrazie, czy host obsługuje io_uring (direct == FALSE) lub O_DIRECT (direct == TRUE).
+ */
+int backend_available(int direct) {
+    unlink("testfs_probe");
+    simplefs_init("testfs_probe", 4096, 8);
+    int fdfs = simplefs_openfs("testfs_probe");
+    int result = direct ? simplefs_direct_io_configure(fdfs, TRUE) : simplefs_io_configure(fdfs, IO_BACKEND_IO_URING, 8);
+    simplefs_closefs(fdfs);
+    unlink("testfs_probe");
+    return OK == result;
+}
+
+void test_io_uring_backend() {
+    CU_ASSERT(UNKNOWN_DESCRIPTOR == simplefs_io_configure(-1, IO_BACKEND_IO_URING, 0));
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    //test pomijany, gdy jądro nie udostępnia io_uring (backend_available)
+    CU_ASSERT(OK == simplefs_io_configure(fdfs, IO_BACKEND_IO_URING, 8));
+    io_backend * backend = &_get_mounted_fs(fdfs)->io;
+    CU_ASSERT(IO_BACKEND_IO_URING == backend->type);
+    CU_ASSERT(OK == simplefs_creat("/uring.txt", fdfs));
+    int fd = simplefs_open("/uring.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(0 <= fd);
+    if (fd < 0) {
+        return;
+    }
+    char message[CHUNK_TEST_LEN], read[CHUNK_TEST_LEN];
+    int i;
+    for(i = 0; i < CHUNK_TEST_LEN; ++i) {
+        message[i] = 'A' + i % 19;
+    }
+    unsigned long submitted = backend->submitted;
+    CU_ASSERT(OK == simplefs_write(fd, message, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(submitted < backend->submitted);
+    submitted = backend->submitted;
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    for(i = 0; i < CHUNK_TEST_LEN; i += CHUNK_LEN) {
+        CU_ASSERT(CHUNK_LEN == simplefs_read(fd, read + i, CHUNK_LEN, fdfs));
+    }
+    CU_ASSERT(0 == memcmp(message, read, CHUNK_TEST_LEN));
+    CU_ASSERT(submitted < backend->submitted);
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_io_configure(fdfs, IO_BACKEND_SYNC, 0));
+    CU_ASSERT(IO_BACKEND_SYNC == backend->type);
+    fd = simplefs_open("/uring.txt", READ_MODE, fdfs);
+    memset(read, 0, CHUNK_TEST_LEN);
+    CU_ASSERT(CHUNK_TEST_LEN == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, CHUNK_TEST_LEN));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/uring.txt", fdfs));
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
+void count_async_completion(int request, int result, void * user_data) {
+    if (result == CHUNK_LEN) {
+        __sync_fetch_and_add((int *) user_data, 1);
+    }
+}
+
+void test_async_operations() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(FD_NOT_FOUND == simplefs_write_async(-1, NULL, 0, fdfs, NULL, NULL));
+    CU_ASSERT(OK == simplefs_async_configure(2));
+    CU_ASSERT(OK == simplefs_creat("/async.txt", fdfs));
+    int fd = simplefs_open("/async.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(0 <= fd);
+    if (fd < 0) {
+        return;
+    }
+    char message[CHUNK_TEST_LEN], read[CHUNK_TEST_LEN];
+    int requests[CHUNK_TEST_LEN / CHUNK_LEN];
+    int i, result;
+    for(i = 0; i < CHUNK_TEST_LEN; ++i) {
+        message[i] = 'a' + i % 17;
+    }
+    //zapisy na jednym deskryptorze wykonywane są w kolejności zlecenia
+    for(i = 0; i < CHUNK_TEST_LEN / CHUNK_LEN; ++i) {
+        requests[i] = simplefs_write_async(fd, message + i * CHUNK_LEN, CHUNK_LEN, fdfs, NULL, NULL);
+        CU_ASSERT(0 <= requests[i]);
+    }
+    for(i = 0; i < CHUNK_TEST_LEN / CHUNK_LEN; ++i) {
+        CU_ASSERT(OK == simplefs_async_wait(requests[i], &result));
+        CU_ASSERT(OK == result);
+    }
+    CU_ASSERT(UNKNOWN_REQUEST == simplefs_async_wait(requests[0], &result));
+
+    //odczyt zgłaszany przez kolejkę zakończonych i eventfd
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    int request = simplefs_read_async(fd, read, CHUNK_TEST_LEN, fdfs, NULL, NULL);
+    struct pollfd completion;
+    completion.fd = simplefs_async_completion_fd();
+    completion.events = POLLIN;
+    CU_ASSERT(1 == poll(&completion, 1, 5000));
+    int reaped;
+    CU_ASSERT(OK == simplefs_async_reap(&reaped, &result));
+    CU_ASSERT(request == reaped);
+    CU_ASSERT(CHUNK_TEST_LEN == result);
+    CU_ASSERT(0 == memcmp(message, read, CHUNK_TEST_LEN));
+    CU_ASSERT(NO_COMPLETED_REQUESTS == simplefs_async_reap(&reaped, &result));
+
+    //odczyty z callbackiem na osobnych deskryptorach
+    int completed = 0;
+    int readers[4];
+    for(i = 0; i < 4; ++i) {
+        readers[i] = simplefs_open("/async.txt", READ_MODE, fdfs);
+        CU_ASSERT(0 <= simplefs_read_async(readers[i], read + i * CHUNK_LEN, CHUNK_LEN, fdfs, count_async_completion, &completed));
+    }
+    CU_ASSERT(OK == simplefs_async_configure(0));
+    CU_ASSERT(4 == completed);
+    for(i = 0; i < 4; ++i) {
+        CU_ASSERT(0 == memcmp(message, read + i * CHUNK_LEN, CHUNK_LEN));
+        simplefs_close(readers[i]);
+    }
+
+    //odczyt zapisuje bufor zapisów deskryptora, gdy inne wątki tworzą i usuwają pliki
+    char name[32];
+    CU_ASSERT(OK == simplefs_async_configure(2));
+    for(i = 0; i < 2; ++i) {
+        sprintf(name, "/async_%d.txt", i);
+        CU_ASSERT(OK == simplefs_creat(name, fdfs));
+        readers[i] = simplefs_open(name, READ_AND_WRITE, fdfs);
+        CU_ASSERT(OK == simplefs_set_write_buffer(readers[i], 4096, fdfs));
+        CU_ASSERT(0 <= (requests[2 * i] = simplefs_write_async(readers[i], message, CHUNK_LEN, fdfs, NULL, NULL)));
+        CU_ASSERT(0 <= (requests[2 * i + 1] = simplefs_read_async(readers[i], read, CHUNK_LEN, fdfs, NULL, NULL)));
+    }
+    for(i = 0; i < 4; ++i) {
+        CU_ASSERT(OK == simplefs_creat("/async_tmp.txt", fdfs));
+        CU_ASSERT(OK == simplefs_unlink("/async_tmp.txt", fdfs));
+    }
+    for(i = 0; i < 2; ++i) {
+        CU_ASSERT(OK == simplefs_async_wait(requests[2 * i], &result));
+        CU_ASSERT(OK == result);
+        CU_ASSERT(OK == simplefs_async_wait(requests[2 * i + 1], &result));
+        CU_ASSERT(0 == result);
+        simplefs_lseek(readers[i], SEEK_SET, 0, fdfs);
+        CU_ASSERT(CHUNK_LEN == simplefs_read(readers[i], read, CHUNK_TEST_LEN, fdfs));
+        CU_ASSERT(0 == memcmp(message, read, CHUNK_LEN));
+        simplefs_close(readers[i]);
+        sprintf(name, "/async_%d.txt", i);
+        CU_ASSERT(OK == simplefs_unlink(name, fdfs));
+    }
+    CU_ASSERT(OK == simplefs_async_configure(0));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/async.txt", fdfs));
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
+void test_parallel_read_write() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    //obraz testowy jest mały - operacje dzielone są już od dwóch bloków
+    CU_ASSERT(OK == simplefs_parallel_configure(3, 2));
+    CU_ASSERT(OK == simplefs_creat("/parallel.txt", fdfs));
+    int fd = simplefs_open("/parallel.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(0 <= fd);
+    if (fd < 0) {
+        return;
+    }
+    char message[CHUNK_TEST_LEN], read[CHUNK_TEST_LEN];
+    int i;
+    for(i = 0; i < CHUNK_TEST_LEN; ++i) {
+        message[i] = 'a' + i % 13;
+    }
+    //zapis i odczyt wielu bloków przekazywane są puli wątków jako zadania
+    unsigned long jobs = parallel_operations.job_number;
+    CU_ASSERT(OK == simplefs_write(fd, message, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(jobs < parallel_operations.job_number);
+    jobs = parallel_operations.job_number;
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(CHUNK_TEST_LEN == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, CHUNK_TEST_LEN));
+    CU_ASSERT(jobs + 1 == parallel_operations.job_number);
+    CU_ASSERT(3 == parallel_operations.number_of_threads);
+
+    //nadpisanie środka pliku i odczyt od pozycji w środku pierwszego bloku
+    memset(message + 3000, 'X', 6000);
+    simplefs_lseek(fd, SEEK_SET, 3000, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message + 3000, 6000, fdfs));
+    simplefs_lseek(fd, SEEK_SET, 100, fdfs);
+    memset(read, 0, CHUNK_TEST_LEN);
+    CU_ASSERT(CHUNK_TEST_LEN - 100 == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message + 100, read, CHUNK_TEST_LEN - 100));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_parallel_configure(DEFAULT_PARALLEL_THREADS, PARALLEL_IO_MIN_BLOCKS));
+    CU_ASSERT(OK == simplefs_unlink("/parallel.txt", fdfs));
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
+void test_direct_io() {
+    CU_ASSERT(UNKNOWN_DESCRIPTOR == simplefs_direct_io_configure(-1, TRUE));
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    //test pomijany, gdy system plików hosta nie obsługuje O_DIRECT (backend_available)
+    CU_ASSERT(OK == simplefs_direct_io_configure(fdfs, TRUE));
+    direct_io * direct = &_get_mounted_fs(fdfs)->direct;
+    CU_ASSERT(-1 != direct->fd);
+    CU_ASSERT(0 == direct->buffer_size % direct->alignment);
+    CU_ASSERT(NULL != direct->reserve_buffer);
+    int result = simplefs_io_configure(fdfs, IO_BACKEND_IO_URING, 0);
+    CU_ASSERT(OK == result || IO_BACKEND_NOT_AVAILABLE == result);
+    CU_ASSERT(OK == simplefs_creat("/direct.txt", fdfs));
+    int fd = simplefs_open("/direct.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(0 <= fd);
+    if (fd < 0) {
+        return;
+    }
+    char message[CHUNK_TEST_LEN], read[CHUNK_TEST_LEN];
+    int i;
+    for(i = 0; i < CHUNK_TEST_LEN; ++i) {
+        message[i] = 'a' + i % 11;
+    }
+    //niewyrównane fragmenty przechodzą przez bufory pośrednie
+    for(i = 0; i < CHUNK_TEST_LEN; i += CHUNK_LEN) {
+        CU_ASSERT(OK == simplefs_write(fd, message + i, CHUNK_LEN, fdfs));
+    }
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(CHUNK_TEST_LEN == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, CHUNK_TEST_LEN));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_direct_io_configure(fdfs, FALSE));
+    CU_ASSERT(-1 == direct->fd);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+
+    fdfs = simplefs_openfs("testfs3");
+    fd = simplefs_open("/direct.txt", READ_MODE, fdfs);
+    memset(read, 0, CHUNK_TEST_LEN);
+    CU_ASSERT(CHUNK_TEST_LEN == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, CHUNK_TEST_LEN));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/direct.txt", fdfs));
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
+void test_buffer_pool() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(OK == simplefs_mkdir("/pool", fdfs));
+    CU_ASSERT(OK == simplefs_creat("/pool/pooled.txt", fdfs));
+    int fd = simplefs_open("/pool/pooled.txt", WRITE_MODE, fdfs);
+    CU_ASSERT(0 <= fd);
+    if (fd < 0) {
+        return;
+    }
+    char message[CHUNK_TEST_LEN], read[CHUNK_TEST_LEN];
+    int i;
+    for(i = 0; i < CHUNK_TEST_LEN; ++i) {
+        message[i] = 'A' + i % 23;
+    }
+    CU_ASSERT(OK == simplefs_write(fd, message, CHUNK_TEST_LEN, fdfs));
+    simplefs_close(fd);
+    //kolejne wyszukiwania, odczyty i zapisy korzystają z buforów zwróconych do puli przez poprzednie
+    for(i = 0; i < 50; ++i) {
+        fd = simplefs_open("/pool/pooled.txt", READ_MODE, fdfs);
+        CU_ASSERT(0 <= fd);
+        memset(read, 0, CHUNK_TEST_LEN);
+        CU_ASSERT(CHUNK_TEST_LEN == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+        CU_ASSERT(0 == memcmp(message, read, CHUNK_TEST_LEN));
+        simplefs_close(fd);
+        CU_ASSERT(FILE_DOESNT_EXIST == simplefs_open("/pool/missing.txt", READ_MODE, fdfs));
+    }
+    CU_ASSERT(OK == simplefs_unlink("/pool/pooled.txt", fdfs));
+    CU_ASSERT(FILE_DOESNT_EXIST == simplefs_open("/pool/pooled.txt", READ_MODE, fdfs));
+    //zwrócony bufor jest ponownie wydawany z puli wątku - także dla innego rozmiaru tej samej klasy
+    void * buffer = _pool_alloc(4096);
+    CU_ASSERT(NULL != buffer);
+    _pool_free(buffer, 4096);
+    CU_ASSERT(buffer == _pool_alloc(4000));
+    _pool_free(buffer, 4000);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
+void test_delayed_allocation() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(FD_NOT_FOUND == simplefs_set_delayed_allocation(-1, TRUE, fdfs));
+    CU_ASSERT(OK == simplefs_creat("/delayed_a.txt", fdfs));
+    CU_ASSERT(OK == simplefs_creat("/delayed_b.txt", fdfs));
+    int fd_a = simplefs_open("/delayed_a.txt", WRITE_MODE, fdfs);
+    int fd_b = simplefs_open("/delayed_b.txt", WRITE_MODE, fdfs);
+    CU_ASSERT(0 <= fd_a && 0 <= fd_b);
+    if (fd_a < 0 || fd_b < 0) {
+        return;
+    }
+    CU_ASSERT(OK == simplefs_set_delayed_allocation(fd_a, TRUE, fdfs));
+    CU_ASSERT(OK == simplefs_set_delayed_allocation(fd_b, TRUE, fdfs));
+    master_block * mb = _get_master_block(fdfs);
+    unsigned long free_blocks = mb->number_of_free_blocks;
+    free(mb);
+
+    char message[CHUNK_TEST_LEN], read[CHUNK_TEST_LEN];
+    int i;
+    for(i = 0; i < CHUNK_TEST_LEN; ++i) {
+        message[i] = 'a' + i % 19;
+    }
+    //zapisy na przemian do dwóch plików - bloki są tylko rezerwowane
+    for(i = 0; i < 2; ++i) {
+        CU_ASSERT(OK == simplefs_write(fd_a, message + i * 2500, 2500, fdfs));
+        CU_ASSERT(OK == simplefs_write(fd_b, message + i * 2500, 2500, fdfs));
+    }
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks == mb->number_of_free_blocks);
+    CU_ASSERT(4 == mb->number_of_reserved_blocks);
+    free(mb);
+    //brak miejsca zgłasza już zapis, rezerwacja się nie zmienia
+    CU_ASSERT(NO_FREE_BLOCKS == simplefs_write(fd_a, message, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(NO_FREE_BLOCKS == simplefs_write(fd_a, message, CHUNK_TEST_LEN, fdfs));
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(4 == mb->number_of_reserved_blocks);
+    CU_ASSERT(OK == simplefs_close(fd_a));
+    CU_ASSERT(OK == simplefs_close(fd_b));
+    free(mb);
+
+    //każdy plik dostał bloki jednym przydziałem - leżą obok siebie
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 4 == mb->number_of_free_blocks);
+    CU_ASSERT(0 == mb->number_of_reserved_blocks);
+    unsigned long inode_no;
+    inode * file_inode = _get_inode_by_path("/delayed_a.txt", mb, fdfs, &inode_no);
+    CU_ASSERT(5000 == file_inode->size);
+    CU_ASSERT(file_inode->first_data_block + 1
+              == _find_next_block(fdfs, file_inode->first_data_block, mb->data_start_block, mb->block_size));
+    free(file_inode);
+    free(mb);
+
+    fd_b = simplefs_open("/delayed_b.txt", READ_MODE, fdfs);
+    CU_ASSERT(5000 == simplefs_read(fd_b, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 5000));
+    simplefs_close(fd_b);
+    CU_ASSERT(OK == simplefs_unlink("/delayed_a.txt", fdfs));
+    CU_ASSERT(OK == simplefs_unlink("/delayed_b.txt", fdfs));
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+
+    //rezerwacja procesu zakończonego bez zapisania bufora wraca przy montowaniu przez jedynego montującego
+    unlink("testfs_reserve");
+    CU_ASSERT(0 == simplefs_init("testfs_reserve", 4096, 8));
+    fdfs = simplefs_openfs("testfs_reserve");
+    CU_ASSERT(OK == simplefs_creat("/delayed_c.txt", fdfs));
+    mb = _get_master_block(fdfs);
+    free_blocks = mb->number_of_free_blocks;
+    free(mb);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int child_fdfs = simplefs_openfs("testfs_reserve");
+        int fd = simplefs_open("/delayed_c.txt", WRITE_MODE, child_fdfs);
+        simplefs_set_delayed_allocation(fd, TRUE, child_fdfs);
+        simplefs_write(fd, message, 2500, child_fdfs);
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks == mb->number_of_free_blocks);
+    CU_ASSERT(1 == mb->number_of_reserved_blocks);
+    free(mb);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    fdfs = simplefs_openfs("testfs_reserve");
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks == mb->number_of_free_blocks);
+    CU_ASSERT(0 == mb->number_of_reserved_blocks);
+    free(mb);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    unlink("testfs_reserve");
+}
+
+void test_fallocate() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(FD_NOT_FOUND == simplefs_fallocate(-1, 0, 0, 100, fdfs));
+    int dir_fd = simplefs_open("/", READ_AND_WRITE, fdfs);
+    CU_ASSERT(NOT_FILE_FD == simplefs_fallocate(dir_fd, 0, 0, 100, fdfs));
+    simplefs_close(dir_fd);
+    CU_ASSERT(OK == simplefs_creat("/falloc.txt", fdfs));
+    int fd = simplefs_open("/falloc.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(0 <= fd);
+    if (fd < 0) {
+        return;
+    }
+    char message[CHUNK_TEST_LEN], read[CHUNK_TEST_LEN], zeros[CHUNK_TEST_LEN];
+    int i;
+    for(i = 0; i < CHUNK_TEST_LEN; ++i) {
+        message[i] = 'a' + i % 17;
+    }
+    memset(zeros, 0, CHUNK_TEST_LEN);
+    master_block * mb = _get_master_block(fdfs);
+    unsigned long free_blocks = mb->number_of_free_blocks;
+    free(mb);
+
+    //przydział z rozszerzeniem pliku - zera, zapisy w zakresie nie przydzielają bloków
+    CU_ASSERT(OK == simplefs_fallocate(fd, 0, 0, 6000, fdfs));
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 2 == mb->number_of_free_blocks);
+    free(mb);
+    CU_ASSERT(6000 == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(zeros, read, 6000));
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 100, fdfs));
+    //FALLOCATE_KEEP_SIZE - bloki czekają za końcem pliku
+    CU_ASSERT(OK == simplefs_fallocate(fd, FALLOCATE_KEEP_SIZE, 0, 10000, fdfs));
+    simplefs_lseek(fd, SEEK_SET, 6000, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message + 6000, 3000, fdfs));
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 3 == mb->number_of_free_blocks);
+    free(mb);
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(9000 == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 100));
+    CU_ASSERT(0 == memcmp(zeros, read + 100, 5900));
+    CU_ASSERT(0 == memcmp(message + 6000, read + 6000, 3000));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/falloc.txt", fdfs));
+    simplefs_reclaim_orphans(fdfs);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks == mb->number_of_free_blocks);
+    free(mb);
+
+    //FALLOCATE_UNWRITTEN - bloki po usuniętym pliku nie są zerowane, ale czytane są zera
+    CU_ASSERT(OK == simplefs_creat("/unwritten.txt", fdfs));
+    fd = simplefs_open("/unwritten.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_fallocate(fd, FALLOCATE_UNWRITTEN, 0, 8000, fdfs));
+    CU_ASSERT(8000 == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(zeros, read, 8000));
+    simplefs_lseek(fd, SEEK_SET, 5000, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 10, fdfs));
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(8000 == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(zeros, read, 5000));
+    CU_ASSERT(0 == memcmp(message, read + 5000, 10));
+    CU_ASSERT(0 == memcmp(zeros, read + 5010, 2990));
+    //zapis w drugim bloku nie zeruje pierwszego - ten pozostaje oznaczony jako niezapisany
+    mb = _get_master_block(fdfs);
+    unsigned long inode_no;
+    inode * file_inode = _get_inode_by_path("/unwritten.txt", mb, fdfs, &inode_no);
+    unsigned long first_block = BLOCK_LINK_NUMBER(file_inode->first_data_block);
+    unsigned long first_link = _get_block_link(fdfs, mb, first_block);
+    CU_ASSERT(0 != (first_link & BLOCK_LINK_UNWRITTEN));
+    CU_ASSERT(0 == (_get_block_link(fdfs, mb, BLOCK_LINK_NUMBER(first_link)) & BLOCK_LINK_UNWRITTEN));
+    free(file_inode);
+    simplefs_lseek(fd, SEEK_SET, 100, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 10, fdfs));
+    CU_ASSERT(0 == (_get_block_link(fdfs, mb, first_block) & BLOCK_LINK_UNWRITTEN));
+    free(mb);
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(8000 == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(zeros, read, 100));
+    CU_ASSERT(0 == memcmp(message, read + 100, 10));
+    CU_ASSERT(0 == memcmp(zeros, read + 110, 4890));
+    CU_ASSERT(0 == memcmp(message, read + 5000, 10));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/unwritten.txt", fdfs));
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
+void test_sparse_files() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(OK == simplefs_creat("/sparse.txt", fdfs));
+    int fd = simplefs_open("/sparse.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(0 <= fd);
+    if (fd < 0) {
+        return;
+    }
+    char message[CHUNK_TEST_LEN], read[CHUNK_TEST_LEN], zeros[CHUNK_TEST_LEN];
+    int i;
+    for(i = 0; i < CHUNK_TEST_LEN; ++i) {
+        message[i] = 'a' + i % 19;
+    }
+    memset(zeros, 0, CHUNK_TEST_LEN);
+    unsigned long real_block_size = 4096 - sizeof(long);
+    master_block * mb = _get_master_block(fdfs);
+    unsigned long free_blocks = mb->number_of_free_blocks;
+    free(mb);
+
+    //zapis za końcem pliku przydziela tylko zapisany blok
+    CU_ASSERT(100000 == simplefs_lseek(fd, SEEK_SET, 100000, fdfs));
+    CU_ASSERT(OK == simplefs_write(fd, message, 10, fdfs));
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 1 == mb->number_of_free_blocks);
+    free(mb);
+    CU_ASSERT(100060 == simplefs_lseek(fd, SEEK_END, 50, fdfs));
+    CU_ASSERT(0 == simplefs_read(fd, read, 10, fdfs));
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(CHUNK_TEST_LEN == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(zeros, read, CHUNK_TEST_LEN));
+    simplefs_lseek(fd, SEEK_SET, 99990, fdfs);
+    CU_ASSERT(20 == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(zeros, read, 10));
+    CU_ASSERT(0 == memcmp(message, read + 10, 10));
+
+    //SEEK_DATA i SEEK_HOLE
+    CU_ASSERT(24 * real_block_size == simplefs_lseek(fd, SEEK_DATA, 0, fdfs));
+    CU_ASSERT(100005 == simplefs_lseek(fd, SEEK_DATA, 100005, fdfs));
+    CU_ASSERT(0 == simplefs_lseek(fd, SEEK_HOLE, 0, fdfs));
+    CU_ASSERT(100010 == simplefs_lseek(fd, SEEK_HOLE, 99000, fdfs));
+    CU_ASSERT(NO_DATA_AFTER_OFFSET == simplefs_lseek(fd, SEEK_DATA, 100010, fdfs));
+    //pozycje powyżej 2 GB
+    CU_ASSERT(3000000000L == simplefs_lseek(fd, SEEK_SET, 3000000000L, fdfs));
+    CU_ASSERT(3000000010L == simplefs_lseek(fd, SEEK_CUR, 10, fdfs));
+
+    //wypełnianie dziury w środku pliku
+    simplefs_lseek(fd, SEEK_SET, 2 * real_block_size + 5, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 10, fdfs));
+    simplefs_lseek(fd, SEEK_SET, real_block_size, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, real_block_size, fdfs));
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 3 == mb->number_of_free_blocks);
+    free(mb);
+    CU_ASSERT(real_block_size == simplefs_lseek(fd, SEEK_DATA, 0, fdfs));
+    CU_ASSERT(3 * real_block_size == simplefs_lseek(fd, SEEK_HOLE, real_block_size + 1, fdfs));
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(CHUNK_TEST_LEN == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(zeros, read, real_block_size));
+    CU_ASSERT(0 == memcmp(message, read + real_block_size, real_block_size));
+    CU_ASSERT(0 == memcmp(zeros, read + 2 * real_block_size, 5));
+    CU_ASSERT(0 == memcmp(message, read + 2 * real_block_size + 5, 10));
+    CU_ASSERT(0 == memcmp(zeros, read + 2 * real_block_size + 15, CHUNK_TEST_LEN - 2 * real_block_size - 15));
+    simplefs_lseek(fd, SEEK_SET, 100000, fdfs);
+    CU_ASSERT(10 == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 10));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/sparse.txt", fdfs));
+    simplefs_reclaim_orphans(fdfs);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks == mb->number_of_free_blocks);
+    free(mb);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
+void test_ftruncate() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(FD_NOT_FOUND == simplefs_ftruncate(-1, 0, fdfs));
+    CU_ASSERT(OK == simplefs_creat("/truncate.txt", fdfs));
+    int fd = simplefs_open("/truncate.txt", READ_MODE, fdfs);
+    CU_ASSERT(WRONG_MODE == simplefs_ftruncate(fd, 0, fdfs));
+    simplefs_close(fd);
+    fd = simplefs_open("/truncate.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(0 <= fd);
+    if (fd < 0) {
+        return;
+    }
+    char message[CHUNK_TEST_LEN], read[CHUNK_TEST_LEN], zeros[CHUNK_TEST_LEN];
+    int i;
+    for(i = 0; i < CHUNK_TEST_LEN; ++i) {
+        message[i] = 'a' + i % 23;
+    }
+    memset(zeros, 0, CHUNK_TEST_LEN);
+    master_block * mb = _get_master_block(fdfs);
+    unsigned long free_blocks = mb->number_of_free_blocks;
+    free(mb);
+    CU_ASSERT(OK == simplefs_write(fd, message, CHUNK_TEST_LEN, fdfs));
+
+    //skrócenie zwalnia bloki za nowym końcem pliku
+    CU_ASSERT(OK == simplefs_ftruncate(fd, 5000, fdfs));
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 2 == mb->number_of_free_blocks);
+    free(mb);
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(5000 == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 5000));
+
+    //powiększenie nie przydziela bloków, a odcięte dane czytane są jako zera
+    CU_ASSERT(OK == simplefs_ftruncate(fd, 9000, fdfs));
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 2 == mb->number_of_free_blocks);
+    free(mb);
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(9000 == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 5000));
+    CU_ASSERT(0 == memcmp(zeros, read + 5000, 4000));
+
+    //bloki przydzielone z góry za końcem pliku też są zwalniane
+    CU_ASSERT(OK == simplefs_fallocate(fd, FALLOCATE_KEEP_SIZE, 0, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(OK == simplefs_ftruncate(fd, 5000, fdfs));
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 2 == mb->number_of_free_blocks);
+    free(mb);
+    CU_ASSERT(OK == simplefs_ftruncate(fd, 0, fdfs));
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks == mb->number_of_free_blocks);
+    free(mb);
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(0 == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(OK == simplefs_write(fd, message, 100, fdfs));
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(100 == simplefs_read(fd, read, CHUNK_TEST_LEN, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 100));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/truncate.txt", fdfs));
+    simplefs_reclaim_orphans(fdfs);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks == mb->number_of_free_blocks);
+    free(mb);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
+void test_orphan_reclaim() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    unsigned long real_block_size = 4096 - sizeof(long);
+    master_block * mb = _get_master_block(fdfs);
+    unsigned long free_blocks = mb->number_of_free_blocks;
+    free(mb);
+    unsigned long length = (free_blocks - 2) * real_block_size;
+    char * message = malloc(length);
+    char * read = malloc(length);
+    unsigned long i;
+    for(i = 0; i < length; ++i) {
+        message[i] = 'a' + i % 29;
+    }
+
+    //usunięcie pliku nie zwalnia bloków - robi to simplefs_reclaim_orphans
+    CU_ASSERT(OK == simplefs_creat("/orphan.txt", fdfs));
+    int fd = simplefs_open("/orphan.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 3 * real_block_size, fdfs));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/orphan.txt", fdfs));
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 3 == mb->number_of_free_blocks);
+    CU_ASSERT(0 != mb->first_orphan_inode);
+    free(mb);
+    CU_ASSERT(3 == simplefs_reclaim_orphans(fdfs));
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks == mb->number_of_free_blocks);
+    CU_ASSERT(0 == mb->first_orphan_inode);
+    free(mb);
+
+    //przydział, któremu brakuje miejsca, zwalnia bloki usuniętych plików
+    CU_ASSERT(OK == simplefs_creat("/orphan.txt", fdfs));
+    fd = simplefs_open("/orphan.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 3 * real_block_size, fdfs));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/orphan.txt", fdfs));
+    CU_ASSERT(OK == simplefs_creat("/big.txt", fdfs));
+    fd = simplefs_open("/big.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, length, fdfs));
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(length == simplefs_read(fd, read, length, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, length));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/big.txt", fdfs));
+
+    //pozostałe bloki zwalniane są przy następnym montowaniu
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    fdfs = simplefs_openfs("testfs3");
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks == mb->number_of_free_blocks);
+    CU_ASSERT(0 == mb->first_orphan_inode);
+    free(mb);
+    free(message);
+    free(read);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
+void test_journal() {
+    unlink("testfs_journal");
+    CU_ASSERT(0 == simplefs_init_flags("testfs_journal", 4096, 8, INIT_JOURNAL));
+    int fdfs = simplefs_openfs("testfs_journal");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(UNKNOWN_DESCRIPTOR == simplefs_journal_configure(-1, JOURNAL_GROUP_COMMIT));
+    CU_ASSERT(OK == simplefs_journal_configure(fdfs, JOURNAL_GROUP_COMMIT));
+    master_block * mb = _get_master_block(fdfs);
+    unsigned long block_size = mb->block_size;
+    unsigned long header_offset = mb->journal_start_block * block_size;
+    free(mb);
+    journal_header header;
+
+    //każda operacja kończy się po zapisie transakcji z jej zmianami
+    pread(fdfs, &header, sizeof(journal_header), header_offset);
+    CU_ASSERT(JOURNAL_HEADER_MAGIC == header.magic);
+    unsigned long sequence = header.committed_sequence;
+    CU_ASSERT(OK == simplefs_creat("/journal_a.txt", fdfs));
+    pread(fdfs, &header, sizeof(journal_header), header_offset);
+    CU_ASSERT(sequence < header.committed_sequence);
+    CU_ASSERT(0 == header.number_of_pending_blocks);
+
+    //w trybie odroczonym zmiany czekają w otwartej transakcji
+    CU_ASSERT(OK == simplefs_journal_configure(fdfs, JOURNAL_DEFERRED));
+    sequence = header.committed_sequence;
+    CU_ASSERT(OK == simplefs_creat("/journal_b.txt", fdfs));
+    pread(fdfs, &header, sizeof(journal_header), header_offset);
+    CU_ASSERT(sequence == header.committed_sequence);
+    CU_ASSERT(0 < header.number_of_pending_blocks);
+    journal_header before_commit = header;
+    CU_ASSERT(OK == simplefs_journal_commit(fdfs));
+    pread(fdfs, &header, sizeof(journal_header), header_offset);
+    CU_ASSERT(before_commit.next_sequence == header.committed_sequence);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+
+    //otwarta transakcja procesu zakończonego w trakcie pracy opróżniana jest przez jedynego montującego
+    int host_fd = open("testfs_journal", O_RDWR);
+    pread(host_fd, &header, sizeof(journal_header), header_offset);
+    header.number_of_pending_blocks = 3;
+    header.ordered_data_writes = 2;
+    pwrite(host_fd, &header, sizeof(journal_header), header_offset);
+    close(host_fd);
+    fdfs = simplefs_openfs("testfs_journal");
+    CU_ASSERT(fdfs > 0);
+    pread(fdfs, &header, sizeof(journal_header), header_offset);
+    CU_ASSERT(before_commit.next_sequence <= header.committed_sequence);
+    CU_ASSERT(0 == header.number_of_pending_blocks);
+    CU_ASSERT(0 == header.ordered_data_writes);
+
+    //kolejny montujący nie zmienia otwartej transakcji zamontowanych
+    CU_ASSERT(OK == simplefs_journal_configure(fdfs, JOURNAL_DEFERRED));
+    CU_ASSERT(OK == simplefs_creat("/journal_c.txt", fdfs));
+    pread(fdfs, &header, sizeof(journal_header), header_offset);
+    unsigned long pending_blocks = header.number_of_pending_blocks;
+    CU_ASSERT(0 < pending_blocks);
+    int second_fdfs = simplefs_openfs("testfs_journal");
+    CU_ASSERT(second_fdfs > 0);
+    pread(fdfs, &header, sizeof(journal_header), header_offset);
+    CU_ASSERT(pending_blocks == header.number_of_pending_blocks);
+    CU_ASSERT(OK == simplefs_closefs(second_fdfs));
+    CU_ASSERT(OK == simplefs_unlink("/journal_c.txt", fdfs));
+    int fd = simplefs_open("/journal_a.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(0 <= fd);
+    simplefs_close(fd);
+    fd = simplefs_open("/journal_b.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(0 <= fd);
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/journal_a.txt", fdfs));
+    CU_ASSERT(OK == simplefs_unlink("/journal_b.txt", fdfs));
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    unlink("testfs_journal");
+
+    //obraz bez INIT_JOURNAL nie ma dziennika
+    unlink("testfs_nojournal");
+    CU_ASSERT(0 == simplefs_init("testfs_nojournal", 4096, 8));
+    fdfs = simplefs_openfs("testfs_nojournal");
+    CU_ASSERT(fdfs > 0);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(0 == mb->number_of_journal_blocks);
+    free(mb);
+    CU_ASSERT(JOURNAL_NOT_AVAILABLE == simplefs_journal_configure(fdfs, JOURNAL_GROUP_COMMIT));
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    unlink("testfs_nojournal");
+
+    //obszar dziennika to sam nagłówek
+    unlink("testfs_bigjournal");
+    CU_ASSERT(0 == simplefs_init_flags("testfs_bigjournal", MAX_BLOCK_SIZE, 4, INIT_JOURNAL));
+    fdfs = simplefs_openfs("testfs_bigjournal");
+    CU_ASSERT(fdfs > 0);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(1 == mb->number_of_journal_blocks);
+    free(mb);
+    CU_ASSERT(OK == simplefs_journal_configure(fdfs, JOURNAL_GROUP_COMMIT));
+    CU_ASSERT(OK == simplefs_creat("/big_journal.txt", fdfs));
+    CU_ASSERT(OK == simplefs_unlink("/big_journal.txt", fdfs));
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    unlink("testfs_bigjournal");
+}
+
+typedef struct sync_job_t {
+    int fd;
+    int fdfs;
+    int failures;
+} sync_job;
+
+void * sync_file_repeatedly(void * argument) {
+    sync_job * job = (sync_job *) argument;
+    int i;
+    for (i = 0; i < 20; i++) {
+        if (OK != simplefs_fdatasync(job->fd, job->fdfs) || OK != simplefs_syncfs(job->fdfs)) {
+            job->failures++;
+        }
+    }
+    return NULL;
+}
+
+int count_dirty_cache_entries(block_cache * cache) {
+    int dirty = 0;
+    unsigned long i;
+    for (i = 0; i < cache->capacity; i++) {
+        if (cache->entries[i].block_no != 0 && cache->entries[i].dirty) {
+            dirty++;
+        }
+    }
+    return dirty;
+}
+
+void test_sync() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    unsigned long real_block_size = 4096 - sizeof(long);
+    unsigned long length = 2 * real_block_size + 100;
+    char * message = malloc(length);
+    char * read = malloc(length);
+    unsigned long i;
+    for(i = 0; i < length; ++i) {
+        message[i] = 'a' + i % 23;
+    }
+    CU_ASSERT(FD_NOT_FOUND == simplefs_fsync(-1, fdfs));
+    CU_ASSERT(FD_NOT_FOUND == simplefs_fdatasync(-1, fdfs));
+    CU_ASSERT(UNKNOWN_DESCRIPTOR == simplefs_syncfs(-1));
+
+    //fsync zapisuje bufor zapisów deskryptora - dane widzi inny deskryptor
+    CU_ASSERT(OK == simplefs_creat("/sync.txt", fdfs));
+    int fd = simplefs_open("/sync.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_set_write_buffer(fd, 2 * length, fdfs));
+    CU_ASSERT(OK == simplefs_write(fd, message, length, fdfs));
+    CU_ASSERT(OK == simplefs_fsync(fd, fdfs));
+    int reader = simplefs_open("/sync.txt", READ_MODE, fdfs);
+    CU_ASSERT(length == simplefs_read(reader, read, length, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, length));
+    simplefs_close(reader);
+
+    //zmienione bloki pamięci podręcznej write-back
+    CU_ASSERT(OK == simplefs_cache_configure(fdfs, 16 * 4096, CACHE_WRITE_BACK));
+    CU_ASSERT(OK == simplefs_set_write_buffer(fd, 0, fdfs));
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message + 1, length - 1, fdfs));
+    block_cache * cache = &_get_mounted_fs(fdfs)->cache;
+    CU_ASSERT(0 < count_dirty_cache_entries(cache));
+    CU_ASSERT(OK == simplefs_fdatasync(fd, fdfs));
+    CU_ASSERT(0 == count_dirty_cache_entries(cache));
+
+    //wywołania równoczesne
+    pthread_t threads[4];
+    sync_job jobs[4];
+    for (i = 0; i < 4; i++) {
+        jobs[i].fd = fd;
+        jobs[i].fdfs = fdfs;
+        jobs[i].failures = 0;
+        pthread_create(threads + i, NULL, sync_file_repeatedly, jobs + i);
+    }
+    for (i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        CU_ASSERT(0 == jobs[i].failures);
+    }
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_cache_configure(fdfs, 0, CACHE_WRITE_THROUGH));
+
+    CU_ASSERT(OK == simplefs_unlink("/sync.txt", fdfs));
+    CU_ASSERT(OK == simplefs_syncfs(fdfs));
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+
+    //z dziennikiem fsync zapisuje otwartą transakcję
+    unlink("testfs_journal");
+    CU_ASSERT(0 == simplefs_init_flags("testfs_journal", 4096, 8, INIT_JOURNAL));
+    fdfs = simplefs_openfs("testfs_journal");
+    CU_ASSERT(OK == simplefs_journal_configure(fdfs, JOURNAL_DEFERRED));
+    CU_ASSERT(OK == simplefs_creat("/sync_journal.txt", fdfs));
+    fd = simplefs_open("/sync_journal.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 100, fdfs));
+    CU_ASSERT(OK == simplefs_fsync(fd, fdfs));
+    master_block * mb = _get_master_block(fdfs);
+    journal_header header;
+    pread(fdfs, &header, sizeof(journal_header), mb->journal_start_block * mb->block_size);
+    free(mb);
+    CU_ASSERT(0 == header.number_of_pending_blocks);
+    CU_ASSERT(header.committed_sequence + 1 == header.next_sequence);
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    unlink("testfs_journal");
+    free(message);
+    free(read);
+}
+
+void test_journal_ordered() {
+    unlink("testfs_journal");
+    CU_ASSERT(0 == simplefs_init_flags("testfs_journal", 4096, 8, INIT_JOURNAL));
+    int fdfs = simplefs_openfs("testfs_journal");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(JOURNAL_MODE_NOT_SUPPORTED == simplefs_journal_configure(fdfs, JOURNAL_ORDERED));
+    master_block * mb = _get_master_block(fdfs);
+    unsigned long header_offset = mb->journal_start_block * mb->block_size;
+    free(mb);
+    unsigned long real_block_size = 4096 - sizeof(long);
+    unsigned long length = 3 * real_block_size;
+    char * message = malloc(length);
+    char * read = malloc(length);
+    unsigned long i;
+    for(i = 0; i < length; ++i) {
+        message[i] = 'a' + i % 19;
+    }
+    journal_header header;
+
+    //zapisy gromadzą się w otwartej transakcji i są utrwalane razem z nią
+    CU_ASSERT(OK == simplefs_journal_configure(fdfs, JOURNAL_DEFERRED | JOURNAL_ORDERED));
+    CU_ASSERT(OK == simplefs_creat("/ordered.txt", fdfs));
+    int fd = simplefs_open("/ordered.txt", READ_AND_WRITE, fdfs);
+    for (i = 0; i < 3; i++) {
+        CU_ASSERT(OK == simplefs_write(fd, message + i * real_block_size, real_block_size, fdfs));
+    }
+    pread(fdfs, &header, sizeof(journal_header), header_offset);
+    CU_ASSERT(3 <= header.ordered_data_writes);
+    CU_ASSERT(0 < header.number_of_pending_blocks);
+    CU_ASSERT(OK == simplefs_journal_commit(fdfs));
+    pread(fdfs, &header, sizeof(journal_header), header_offset);
+    CU_ASSERT(0 == header.ordered_data_writes);
+    CU_ASSERT(0 == header.number_of_pending_blocks);
+
+    //zapis wewnątrz pliku i zapis wydłużający w trybie zapisu transakcji po każdej operacji
+    CU_ASSERT(OK == simplefs_journal_configure(fdfs, JOURNAL_GROUP_COMMIT | JOURNAL_ORDERED));
+    simplefs_lseek(fd, SEEK_SET, 10, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 100, fdfs));
+    simplefs_lseek(fd, SEEK_END, 0, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 100, fdfs));
+    pread(fdfs, &header, sizeof(journal_header), header_offset);
+    CU_ASSERT(0 == header.ordered_data_writes);
+    CU_ASSERT(header.committed_sequence + 1 == header.next_sequence);
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(length == simplefs_read(fd, read, length, fdfs));
+    CU_ASSERT(0 == memcmp(read, message, 10));
+    CU_ASSERT(0 == memcmp(read + 10, message, 100));
+    CU_ASSERT(0 == memcmp(read + 110, message + 110, length - 110));
+    CU_ASSERT(100 == simplefs_read(fd, read, 100, fdfs));
+    CU_ASSERT(0 == memcmp(read, message, 100));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/ordered.txt", fdfs));
+    CU_ASSERT(OK == simplefs_journal_configure(fdfs, JOURNAL_NONE));
+    free(message);
+    free(read);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    unlink("testfs_journal");
+}
+
+void test_file_tail() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    unsigned long real_block_size = 4096 - sizeof(long);
+    unsigned long length = 2 * real_block_size + 100;
+    char * message = malloc(length);
+    char * read = malloc(length);
+    unsigned long i;
+    for(i = 0; i < length; ++i) {
+        message[i] = 'a' + i % 17;
+    }
+    master_block * mb = _get_master_block(fdfs);
+    unsigned long inode_no;
+
+    //dopisywanie przez nowe deskryptory (bez kursora) trafia na koniec łańcucha
+    CU_ASSERT(OK == simplefs_creat("/tail.txt", fdfs));
+    for (i = 0; i < 3; i++) {
+        int fd = simplefs_open("/tail.txt", READ_AND_WRITE, fdfs);
+        simplefs_lseek(fd, SEEK_END, 0, fdfs);
+        CU_ASSERT(OK == simplefs_write(fd, message + i * real_block_size, i < 2 ? real_block_size : 100, fdfs));
+        simplefs_close(fd);
+    }
+    inode * file_inode = _get_inode_by_path("/tail.txt", mb, fdfs, &inode_no);
+    CU_ASSERT(length == file_inode->size);
+    CU_ASSERT(2 == file_inode->last_block_index);
+    CU_ASSERT(0 != file_inode->last_data_block);
+    unsigned long block_no = file_inode->first_data_block;
+    block_no = _find_next_block(fdfs, block_no, mb->data_start_block, mb->block_size);
+    block_no = _find_next_block(fdfs, block_no, mb->data_start_block, mb->block_size);
+    CU_ASSERT(block_no == file_inode->last_data_block);
+    free(file_inode);
+    int fd = simplefs_open("/tail.txt", READ_MODE, fdfs);
+    CU_ASSERT(length == simplefs_read(fd, read, length, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, length));
+    simplefs_close(fd);
+
+    //skrócenie pliku przenosi koniec łańcucha
+    fd = simplefs_open("/tail.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_ftruncate(fd, 100, fdfs));
+    file_inode = _get_inode_by_path("/tail.txt", mb, fdfs, &inode_no);
+    CU_ASSERT(0 == file_inode->last_block_index);
+    CU_ASSERT(file_inode->first_data_block == file_inode->last_data_block);
+    free(file_inode);
+    simplefs_close(fd);
+
+    //zapis za dziurą
+    fd = simplefs_open("/tail.txt", READ_AND_WRITE, fdfs);
+    simplefs_lseek(fd, SEEK_SET, 3 * real_block_size, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 100, fdfs));
+    simplefs_close(fd);
+    file_inode = _get_inode_by_path("/tail.txt", mb, fdfs, &inode_no);
+    CU_ASSERT(3 == file_inode->last_block_index);
+    free(file_inode);
+    fd = simplefs_open("/tail.txt", READ_MODE, fdfs);
+    simplefs_lseek(fd, SEEK_SET, 3 * real_block_size, fdfs);
+    CU_ASSERT(100 == simplefs_read(fd, read, length, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 100));
+    simplefs_close(fd);
+
+    //katalogi - wpisy dopisywane na końcu łańcucha
+    CU_ASSERT(OK == simplefs_mkdir("/tail_dir", fdfs));
+    CU_ASSERT(OK == simplefs_creat("/tail_dir/a", fdfs));
+    CU_ASSERT(OK == simplefs_creat("/tail_dir/b", fdfs));
+    file_inode = _get_inode_by_path("/tail_dir", mb, fdfs, &inode_no);
+    CU_ASSERT(0 == file_inode->last_block_index);
+    CU_ASSERT(file_inode->first_data_block == file_inode->last_data_block);
+    free(file_inode);
+    CU_ASSERT(OK == simplefs_unlink("/tail_dir/a", fdfs));
+    CU_ASSERT(OK == simplefs_unlink("/tail_dir/b", fdfs));
+    CU_ASSERT(OK == simplefs_unlink("/tail_dir", fdfs));
+    CU_ASSERT(OK == simplefs_unlink("/tail.txt", fdfs));
+
+    //nazwa dłuższa niż FILE_NAME_LENGTH (krótsza od czasu dodania końca łańcucha do inode)
+    char long_name[FILE_NAME_LENGTH + 4];
+    long_name[0] = '/';
+    memset(long_name + 1, 'n', FILE_NAME_LENGTH + 2);
+    long_name[FILE_NAME_LENGTH + 3] = '\0';
+    CU_ASSERT(NAME_TOO_LONG == simplefs_creat(long_name, fdfs));
+    free(mb);
+    free(message);
+    free(read);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+
+    //obraz w starszym formacie (poprzedni magic number) nie jest montowany
+    unlink("testfs_old");
+    CU_ASSERT(OK == simplefs_init("testfs_old", 4096, 8));
+    int image = open("testfs_old", O_RDWR);
+    unsigned int old_magic = 0x4A5B;
+    CU_ASSERT(sizeof(old_magic) == pwrite(image, &old_magic, sizeof(old_magic), offsetof(master_block, magic_number)));
+    close(image);
+    CU_ASSERT(-1 == simplefs_openfs("testfs_old"));
+}
+
+#define APPEND_RECORD_LENGTH 100
+#define APPEND_RECORDS 40
+#define APPEND_WRITERS 4
+
+void test_append_only() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    CU_ASSERT(OK == simplefs_creat("/audit.log", fdfs));
+    int fd = simplefs_open("/audit.log", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, "header", 6, fdfs));
+    CU_ASSERT(FD_NOT_FOUND == simplefs_set_append_only(-1, TRUE, fdfs));
+    CU_ASSERT(OK == simplefs_set_append_only(fd, TRUE, fdfs));
+    CU_ASSERT(WRONG_MODE == simplefs_ftruncate(fd, 0, fdfs));
+    CU_ASSERT(WRONG_MODE == simplefs_fallocate(fd, 0, 0, 4096, fdfs));
+
+    //zapis trafia na koniec pliku niezależnie od pozycji
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, "!", 1, fdfs));
+    simplefs_close(fd);
+
+    //procesy dopisują rekordy równocześnie
+    pid_t children[APPEND_WRITERS];
+    int i, j;
+    for (i = 0; i < APPEND_WRITERS; i++) {
+        children[i] = fork();
+        if (children[i] == 0) {
+            int child_fdfs = simplefs_openfs("testfs3");
+            int child_fd = simplefs_open("/audit.log", WRITE_MODE, child_fdfs);
+            char record[APPEND_RECORD_LENGTH];
+            int failures = 0;
+            for (j = 0; j < APPEND_RECORDS; j++) {
+                memset(record, 'a' + i, APPEND_RECORD_LENGTH);
+                record[0] = '0' + j % 10;
+                record[APPEND_RECORD_LENGTH - 1] = '\n';
+                if (OK != simplefs_write(child_fd, record, APPEND_RECORD_LENGTH, child_fdfs)) {
+                    failures++;
+                }
+            }
+            simplefs_close(child_fd);
+            simplefs_closefs(child_fdfs);
+            _exit(failures == 0 ? 0 : 1);
+        }
+    }
+    for (i = 0; i < APPEND_WRITERS; i++) {
+        int status;
+        waitpid(children[i], &status, 0);
+        CU_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    //każdy rekord jest kompletny, a kolejne rekordy jednego procesu występują w kolejności zapisu
+    unsigned long length = 7 + APPEND_WRITERS * APPEND_RECORDS * APPEND_RECORD_LENGTH;
+    char * read = malloc(length + 1);
+    fd = simplefs_open("/audit.log", READ_MODE, fdfs);
+    CU_ASSERT(length == simplefs_read(fd, read, length + 1, fdfs));
+    CU_ASSERT(0 == memcmp("header!", read, 7));
+    int next_record[APPEND_WRITERS] = { 0 };
+    for (i = 0; i < APPEND_WRITERS * APPEND_RECORDS; i++) {
+        char * record = read + 7 + i * APPEND_RECORD_LENGTH;
+        int writer = record[1] - 'a';
+        CU_ASSERT(writer >= 0 && writer < APPEND_WRITERS);
+        if (writer < 0 || writer >= APPEND_WRITERS) {
+            break;
+        }
+        CU_ASSERT(record[0] == '0' + next_record[writer]++ % 10);
+        CU_ASSERT(record[APPEND_RECORD_LENGTH - 1] == '\n');
+        for (j = 1; j < APPEND_RECORD_LENGTH - 1 && record[j] == 'a' + writer; j++) {
+        }
+        CU_ASSERT(APPEND_RECORD_LENGTH - 1 == j);
+    }
+    simplefs_close(fd);
+
+    fd = simplefs_open("/audit.log", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_set_append_only(fd, FALSE, fdfs));
+    CU_ASSERT(OK == simplefs_ftruncate(fd, 0, fdfs));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/audit.log", fdfs));
+    free(read);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+
+    //zakres zarezerwowany przez proces zakończony przed zapisem przepada przy montowaniu przez jedynego montującego
+    unlink("testfs_append");
+    CU_ASSERT(OK == simplefs_init("testfs_append", 4096, 16));
+    fdfs = simplefs_openfs("testfs_append");
+    CU_ASSERT(OK == simplefs_creat("/dead.log", fdfs));
+    fd = simplefs_open("/dead.log", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_set_append_only(fd, TRUE, fdfs));
+    CU_ASSERT(OK == simplefs_write(fd, "abc", 3, fdfs));
+    simplefs_close(fd);
+    master_block * mb = _get_master_block(fdfs);
+    unsigned long inode_no;
+    free(_get_inode_by_path("/dead.log", mb, fdfs, &inode_no));
+    unsigned long append_cursor = 3 + APPEND_RECORD_LENGTH;
+    CU_ASSERT(sizeof(append_cursor) == pwrite(fdfs, &append_cursor, sizeof(append_cursor),
+                                              mb->first_inode_table_block * mb->block_size + inode_no * sizeof(inode)
+                                              + offsetof(inode, append_cursor)));
+    free(mb);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    fdfs = simplefs_openfs("testfs_append");
+    fd = simplefs_open("/dead.log", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, "def", 3, fdfs));
+    simplefs_lseek(fd, SEEK_SET, 0, fdfs);
+    char contents[8];
+    CU_ASSERT(6 == simplefs_read(fd, contents, sizeof(contents), fdfs));
+    CU_ASSERT(0 == memcmp("abcdef", contents, 6));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
+void test_block_map() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    unsigned long real_block_size = 4096 - sizeof(long);
+    unsigned long entries_in_block = 4096 / sizeof(long);
+    char message[100], read[100], zeros[100];
+    int i;
+    for(i = 0; i < 100; ++i) {
+        message[i] = 'a' + i % 17;
+    }
+    memset(zeros, 0, 100);
+    unsigned long inode_no;
+    CU_ASSERT(WRONG_MODE == simplefs_creat_layout("/mapped.bin", 7, fdfs));
+    CU_ASSERT(OK == simplefs_creat_layout("/mapped.bin", FILE_LAYOUT_MAPPED, fdfs));
+    master_block * mb = _get_master_block(fdfs);
+    unsigned long free_blocks = mb->number_of_free_blocks;
+    free(mb);
+
+    //blok za dziurą dłuższą niż zasięg jednego węzła - mapa o dwóch poziomach (korzeń, dwa węzły, blok danych)
+    int fd = simplefs_open("/mapped.bin", READ_AND_WRITE, fdfs);
+    simplefs_lseek(fd, SEEK_SET, entries_in_block * real_block_size, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 100, fdfs));
+    simplefs_close(fd);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 4 == mb->number_of_free_blocks);
+    inode * file_inode = _get_inode_by_path("/mapped.bin", mb, fdfs, &inode_no);
+    CU_ASSERT(FILE_LAYOUT_MAPPED == file_inode->layout);
+    CU_ASSERT(2 == file_inode->block_map_levels);
+    CU_ASSERT(0 != file_inode->block_map);
+    free(file_inode);
+    free(mb);
+    fd = simplefs_open("/mapped.bin", READ_MODE, fdfs);
+    simplefs_lseek(fd, SEEK_SET, entries_in_block * real_block_size, fdfs);
+    CU_ASSERT(100 == simplefs_read(fd, read, 100, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 100));
+    simplefs_lseek(fd, SEEK_SET, 3 * real_block_size, fdfs);
+    CU_ASSERT(100 == simplefs_read(fd, read, 100, fdfs));
+    CU_ASSERT(0 == memcmp(zeros, read, 100));
+    CU_ASSERT(entries_in_block * real_block_size == simplefs_lseek(fd, SEEK_DATA, 0, fdfs));
+    simplefs_close(fd);
+
+    //skrócenie zwalnia blok danych i węzeł mapy, który go obejmował
+    fd = simplefs_open("/mapped.bin", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_ftruncate(fd, 100, fdfs));
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 2 == mb->number_of_free_blocks);
+    free(mb);
+
+    //zapis w dziurze na początku pliku - węzeł pierwszego poddrzewa już istnieje
+    CU_ASSERT(OK == simplefs_write(fd, message, 100, fdfs));
+    CU_ASSERT(OK == simplefs_fsync(fd, fdfs));
+    simplefs_close(fd);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 3 == mb->number_of_free_blocks);
+    free(mb);
+    fd = simplefs_open("/mapped.bin", READ_MODE, fdfs);
+    CU_ASSERT(100 == simplefs_read(fd, read, 100, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 100));
+    simplefs_close(fd);
+
+    //wskazówka pierwszego wolnego bloku na zajętym bloku (korzeniu mapy) - przydział szuka wolnego bloku w bitmapie
+    master_block hint;
+    pread(fdfs, &hint, sizeof(master_block), 0);
+    mb = _get_master_block(fdfs);
+    file_inode = _get_inode_by_path("/mapped.bin", mb, fdfs, &inode_no);
+    hint.first_free_block_number = file_inode->block_map;
+    free(file_inode);
+    free(mb);
+    pwrite(fdfs, &hint, sizeof(master_block), 0);
+    CU_ASSERT(OK == simplefs_creat("/mapped_hint.txt", fdfs));
+    fd = simplefs_open("/mapped_hint.txt", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, zeros, 100, fdfs));
+    simplefs_close(fd);
+    fd = simplefs_open("/mapped.bin", READ_MODE, fdfs);
+    CU_ASSERT(100 == simplefs_read(fd, read, 100, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 100));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/mapped_hint.txt", fdfs));
+
+    //usunięcie pliku zwalnia całą mapę
+    CU_ASSERT(OK == simplefs_unlink("/mapped.bin", fdfs));
+    simplefs_reclaim_orphans(fdfs);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks == mb->number_of_free_blocks);
+    free(mb);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
+void test_extent_tree() {
+    int fdfs = simplefs_openfs("testfs3");
+    CU_ASSERT(fdfs > 0);
+    unsigned long real_block_size = 4096 - sizeof(long);
+    unsigned long length = 3 * real_block_size;
+    char * message = malloc(length);
+    char * read = malloc(length);
+    unsigned long i;
+    for(i = 0; i < length; ++i) {
+        message[i] = 'a' + i % 17;
+    }
+    unsigned long inode_no;
+    char node[4096];
+    extent_node * header = (extent_node *) node;
+    extent * entries = (extent *) (header + 1);
+    CU_ASSERT(OK == simplefs_creat_layout("/extents.bin", FILE_LAYOUT_EXTENTS, fdfs));
+    master_block * mb = _get_master_block(fdfs);
+    unsigned long free_blocks = mb->number_of_free_blocks;
+    free(mb);
+
+    //bloki przydzielone jednym zapisem tworzą jeden ekstent, blok dopisany za węzłem drzewa - drugi
+    int fd = simplefs_open("/extents.bin", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 2 * real_block_size, fdfs));
+    CU_ASSERT(OK == simplefs_write(fd, message + 2 * real_block_size, real_block_size, fdfs));
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 4 == mb->number_of_free_blocks);
+    inode * file_inode = _get_inode_by_path("/extents.bin", mb, fdfs, &inode_no);
+    CU_ASSERT(1 == file_inode->block_map_levels);
+    pread(fdfs, node, 4096, (mb->data_start_block + file_inode->block_map) * 4096);
+    CU_ASSERT(0 == header->level);
+    CU_ASSERT(2 == header->number_of_entries);
+    CU_ASSERT(0 == entries[0].logical_block && 2 == entries[0].length);
+    CU_ASSERT(2 == entries[1].logical_block && 1 == entries[1].length);
+    free(file_inode);
+    free(mb);
+    simplefs_close(fd);
+    fd = simplefs_open("/extents.bin", READ_MODE, fdfs);
+    simplefs_lseek(fd, SEEK_SET, real_block_size + 10, fdfs);
+    CU_ASSERT(length - real_block_size - 10 == simplefs_read(fd, read, length, fdfs));
+    CU_ASSERT(0 == memcmp(message + real_block_size + 10, read, length - real_block_size - 10));
+    simplefs_close(fd);
+
+    //skrócenie usuwa drugi ekstent i przycina pierwszy
+    fd = simplefs_open("/extents.bin", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_ftruncate(fd, 100, fdfs));
+    simplefs_close(fd);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 2 == mb->number_of_free_blocks);
+    file_inode = _get_inode_by_path("/extents.bin", mb, fdfs, &inode_no);
+    pread(fdfs, node, 4096, (mb->data_start_block + file_inode->block_map) * 4096);
+    CU_ASSERT(1 == header->number_of_entries);
+    CU_ASSERT(0 == entries[0].logical_block && 1 == entries[0].length);
+    free(file_inode);
+    free(mb);
+    fd = simplefs_open("/extents.bin", READ_MODE, fdfs);
+    CU_ASSERT(100 == simplefs_read(fd, read, length, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 100));
+    simplefs_close(fd);
+
+    CU_ASSERT(OK == simplefs_unlink("/extents.bin", fdfs));
+    simplefs_reclaim_orphans(fdfs);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks == mb->number_of_free_blocks);
+    free(mb);
+    free(message);
+    free(read);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+}
+
 void test_create_100_files() {
     /*simplefs_init("testfs3", 4096, 1024);
     int fsfd;
@@ -397,6 +1948,236 @@ void test_create_100_files() {
     }*/
 }
 
+void test_block_geometry() {
+    // dzielenie przez odwrotność (łańcuch w blokach) i przesunięcie (tablica wskaźników, potęga dwójki)
+    unsigned int block_sizes[] = {1024, 1536, 1024};
+    int flags[] = {0, 0, INIT_LINK_TABLE};
+    char * images[] = {"testfs_geometry1", "testfs_geometry2", "testfs_geometry3"};
+    int k;
+    for (k = 0; k < 3; ++k) {
+        unlink(images[k]);
+        CU_ASSERT(0 == simplefs_init_flags(images[k], block_sizes[k], 16, flags[k]));
+        int fdfs = simplefs_openfs(images[k]);
+        CU_ASSERT(fdfs > 0);
+        unsigned long real_block_size = flags[k] == INIT_LINK_TABLE ? block_sizes[k] : block_sizes[k] - sizeof(long);
+        unsigned long length = 4 * real_block_size + 100;
+        char * message = malloc(length);
+        char * read = malloc(length);
+        unsigned long i;
+        for (i = 0; i < length; ++i) {
+            message[i] = 'a' + i % 23;
+        }
+        CU_ASSERT(OK == simplefs_creat("/geometry.txt", fdfs));
+        int fd = simplefs_open("/geometry.txt", READ_AND_WRITE, fdfs);
+        CU_ASSERT(fd >= 0);
+        // zapis zaczynający się w środku bloku i kończący na granicy kolejnego
+        CU_ASSERT(50 == simplefs_lseek(fd, SEEK_SET, 50, fdfs));
+        CU_ASSERT(OK == simplefs_write(fd, message + 50, 2 * real_block_size - 50, fdfs));
+        CU_ASSERT(OK == simplefs_write(fd, message + 2 * real_block_size, length - 2 * real_block_size, fdfs));
+        CU_ASSERT(0 == simplefs_lseek(fd, SEEK_SET, 0, fdfs));
+        CU_ASSERT(OK == simplefs_write(fd, message, 50, fdfs));
+        // odczyty w poprzek granic bloków
+        unsigned long starts[] = {0, real_block_size - 1, real_block_size, 3 * real_block_size + 7};
+        int j;
+        for (j = 0; j < 4; ++j) {
+            CU_ASSERT(starts[j] == simplefs_lseek(fd, SEEK_SET, starts[j], fdfs));
+            CU_ASSERT(length - starts[j] == simplefs_read(fd, read, length, fdfs));
+            CU_ASSERT(0 == memcmp(message + starts[j], read, length - starts[j]));
+        }
+        CU_ASSERT(OK == simplefs_close(fd));
+        CU_ASSERT(OK == simplefs_unlink("/geometry.txt", fdfs));
+        simplefs_closefs(fdfs);
+        unlink(images[k]);
+        free(message);
+        free(read);
+    }
+}
+
+void test_link_table() {
+    unlink("testfs_links");
+    CU_ASSERT(0 == simplefs_init_flags("testfs_links", 4096, 32, INIT_LINK_TABLE));
+    int fdfs = simplefs_openfs("testfs_links");
+    CU_ASSERT(fdfs > 0);
+    //bloki danych zawierają pełne 4096 B danych
+    unsigned long length = 3 * 4096;
+    char * message = malloc(length);
+    char * read = malloc(length);
+    unsigned long i;
+    for(i = 0; i < length; ++i) {
+        message[i] = 'a' + i % 19;
+    }
+    master_block * mb = _get_master_block(fdfs);
+    CU_ASSERT(1 == mb->number_of_link_table_blocks);
+    CU_ASSERT(mb->first_link_table_block + 1 == mb->data_start_block);
+    free(mb);
+    CU_ASSERT(OK == simplefs_creat("/links.bin", fdfs));
+    mb = _get_master_block(fdfs);
+    unsigned long free_blocks = mb->number_of_free_blocks;
+    free(mb);
+    int fd = simplefs_open("/links.bin", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, length, fdfs));
+    simplefs_close(fd);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 3 == mb->number_of_free_blocks);
+    unsigned long inode_no;
+    inode * file_inode = _get_inode_by_path("/links.bin", mb, fdfs, &inode_no);
+    unsigned long first_block = BLOCK_LINK_NUMBER(file_inode->first_data_block);
+    pread(fdfs, read, 4096, (mb->data_start_block + first_block) * 4096);
+    CU_ASSERT(0 == memcmp(message, read, 4096));
+    unsigned long second_block = _get_block_link(fdfs, mb, first_block);
+    CU_ASSERT(0 != second_block);
+    pread(fdfs, read, 4096, (mb->data_start_block + second_block) * 4096);
+    CU_ASSERT(0 == memcmp(message + 4096, read, 4096));
+    free(file_inode);
+    free(mb);
+    fd = simplefs_open("/links.bin", READ_MODE, fdfs);
+    CU_ASSERT(4090 == simplefs_lseek(fd, SEEK_SET, 4090, fdfs));
+    CU_ASSERT(length - 4090 == simplefs_read(fd, read, length, fdfs));
+    CU_ASSERT(0 == memcmp(message + 4090, read, length - 4090));
+    simplefs_close(fd);
+
+    //katalog dłuższy niż blok - 16 sygnatur w bloku
+    char name[32];
+    CU_ASSERT(OK == simplefs_mkdir("/dir", fdfs));
+    for(i = 0; i < 20; ++i) {
+        sprintf(name, "/dir/%lu", i);
+        CU_ASSERT(OK == simplefs_creat(name, fdfs));
+    }
+    fd = simplefs_open("/dir/19", READ_MODE, fdfs);
+    CU_ASSERT(fd >= 0);
+    simplefs_close(fd);
+    for(i = 0; i < 20; ++i) {
+        sprintf(name, "/dir/%lu", i);
+        CU_ASSERT(OK == simplefs_unlink(name, fdfs));
+    }
+    CU_ASSERT(OK == simplefs_unlink("/dir", fdfs));
+
+    //skrócenie odcina łańcuch w tablicy wskaźników
+    fd = simplefs_open("/links.bin", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_ftruncate(fd, 4096 + 10, fdfs));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    fdfs = simplefs_openfs("testfs_links");
+    fd = simplefs_open("/links.bin", READ_MODE, fdfs);
+    CU_ASSERT(4096 + 10 == simplefs_read(fd, read, length, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 4096 + 10));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_unlink("/links.bin", fdfs));
+    simplefs_reclaim_orphans(fdfs);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks == mb->number_of_free_blocks);
+    free(mb);
+    free(message);
+    free(read);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    unlink("testfs_links");
+}
+
+void test_fragments() {
+    unlink("testfs_fragments");
+    CU_ASSERT(BLOCK_SIZE_TOO_LARGE == simplefs_init_flags("testfs_fragments", 2 * MAX_BLOCK_SIZE, 16, INIT_FRAGMENTS));
+    CU_ASSERT(0 == simplefs_init_flags("testfs_fragments", 65536, 16, INIT_FRAGMENTS));
+    int fdfs = simplefs_openfs("testfs_fragments");
+    CU_ASSERT(fdfs > 0);
+    unsigned long length = 40000;
+    char * message = malloc(length);
+    char * read = malloc(2 * length);
+    unsigned long i;
+    for(i = 0; i < length; ++i) {
+        message[i] = 'a' + i % 23;
+    }
+    CU_ASSERT(OK == simplefs_creat("/a", fdfs));
+    CU_ASSERT(OK == simplefs_creat("/b", fdfs));
+    CU_ASSERT(OK == simplefs_creat("/c", fdfs));
+    master_block * mb = _get_master_block(fdfs);
+    CU_ASSERT(1024 == mb->fragment_size);
+    unsigned long free_blocks = mb->number_of_free_blocks;
+    free(mb);
+
+    //małe pliki współdzielą jeden blok fragmentów
+    int fd = simplefs_open("/a", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 100, fdfs));
+    simplefs_close(fd);
+    fd = simplefs_open("/b", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 3000, fdfs));
+    simplefs_close(fd);
+    fd = simplefs_open("/c", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_write(fd, message, 1024, fdfs));
+    simplefs_close(fd);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 1 == mb->number_of_free_blocks);
+    unsigned long inode_no;
+    inode * inode_a = _get_inode_by_path("/a", mb, fdfs, &inode_no);
+    inode * inode_b = _get_inode_by_path("/b", mb, fdfs, &inode_no);
+    CU_ASSERT(0 == inode_a->first_data_block);
+    CU_ASSERT(0 != inode_a->fragment);
+    CU_ASSERT(FRAGMENT_BLOCK(inode_a->fragment) == FRAGMENT_BLOCK(inode_b->fragment));
+    CU_ASSERT(4 == FRAGMENT_UNITS(inode_b->fragment));
+    free(inode_a);
+    free(inode_b);
+    free(mb);
+
+    //zapis w miejscu, za końcem pliku i przeniesienie do większego ciągu fragmentów
+    fd = simplefs_open("/a", READ_AND_WRITE, fdfs);
+    CU_ASSERT(10 == simplefs_lseek(fd, SEEK_SET, 10, fdfs));
+    CU_ASSERT(OK == simplefs_write(fd, "XYZ", 3, fdfs));
+    CU_ASSERT(200 == simplefs_lseek(fd, SEEK_SET, 200, fdfs));
+    CU_ASSERT(OK == simplefs_write(fd, message, 2000, fdfs));
+    CU_ASSERT(2200 == simplefs_lseek(fd, SEEK_HOLE, 0, fdfs));
+    CU_ASSERT(0 == simplefs_lseek(fd, SEEK_SET, 0, fdfs));
+    CU_ASSERT(2200 == simplefs_read(fd, read, length, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 10));
+    CU_ASSERT(0 == memcmp("XYZ", read + 10, 3));
+    CU_ASSERT(0 == memcmp(message + 13, read + 13, 87));
+    for(i = 100; i < 200 && read[i] == 0; ++i);
+    CU_ASSERT(200 == i);
+    CU_ASSERT(0 == memcmp(message, read + 200, 2000));
+    simplefs_close(fd);
+
+    //plik większy niż FRAGMENT_MAX_UNITS fragmentów przenoszony jest do bloku
+    fd = simplefs_open("/b", READ_AND_WRITE, fdfs);
+    CU_ASSERT(3000 == simplefs_lseek(fd, SEEK_SET, 3000, fdfs));
+    CU_ASSERT(OK == simplefs_write(fd, message, length, fdfs));
+    simplefs_close(fd);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks - 2 == mb->number_of_free_blocks);
+    inode_b = _get_inode_by_path("/b", mb, fdfs, &inode_no);
+    CU_ASSERT(0 == inode_b->fragment);
+    CU_ASSERT(0 != inode_b->first_data_block);
+    free(inode_b);
+    free(mb);
+
+    //skrócenie do zera zwalnia fragmenty, zawartość przetrwa ponowne zamontowanie
+    fd = simplefs_open("/c", READ_AND_WRITE, fdfs);
+    CU_ASSERT(OK == simplefs_ftruncate(fd, 0, fdfs));
+    simplefs_close(fd);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    fdfs = simplefs_openfs("testfs_fragments");
+    fd = simplefs_open("/b", READ_MODE, fdfs);
+    CU_ASSERT(3000 + length == simplefs_read(fd, read, 3000, fdfs) + simplefs_read(fd, read + 3000, length, fdfs));
+    CU_ASSERT(0 == memcmp(message, read, 3000));
+    CU_ASSERT(0 == memcmp(message, read + 3000, length));
+    simplefs_close(fd);
+    fd = simplefs_open("/a", READ_MODE, fdfs);
+    CU_ASSERT(2200 == simplefs_read(fd, read, length, fdfs));
+    CU_ASSERT(0 == memcmp(message, read + 200, 2000));
+    simplefs_close(fd);
+
+    //usunięcie plików zwalnia blok fragmentów
+    CU_ASSERT(OK == simplefs_unlink("/a", fdfs));
+    CU_ASSERT(OK == simplefs_unlink("/b", fdfs));
+    CU_ASSERT(OK == simplefs_unlink("/c", fdfs));
+    simplefs_reclaim_orphans(fdfs);
+    mb = _get_master_block(fdfs);
+    CU_ASSERT(free_blocks == mb->number_of_free_blocks);
+    CU_ASSERT(0 == mb->first_fragment_block);
+    free(mb);
+    free(message);
+    free(read);
+    CU_ASSERT(OK == simplefs_closefs(fdfs));
+    unlink("testfs_fragments");
+}
+
 int main()
 {
    CU_pSuite pSuite = NULL;
@@ -446,12 +2227,42 @@ int main()
     }
 
     /* Test reada */
+    CU_pTest io_uring_test, direct_io_test;
     pSuite = CU_add_suite("Suite_3", init_suite3, clean_suite3);
-    if ((NULL == CU_add_test(pSuite, "test of simplefs_read operation", test_read)))
+    if ((NULL == CU_add_test(pSuite, "test of simplefs_read operation", test_read)) ||
+        (NULL == CU_add_test(pSuite, "test of chunked read and write", test_chunked_read_write)) ||
+        (NULL == CU_add_test(pSuite, "test of chain-following readahead", test_readahead)) ||
+        (NULL == CU_add_test(pSuite, "test of write-back block cache", test_cache_write_back)) ||
+        (NULL == CU_add_test(pSuite, "test of shared block cache", test_cache_shared)) ||
+        (NULL == CU_add_test(pSuite, "test of buffered writes", test_write_buffer)) ||
+        (NULL == (io_uring_test = CU_add_test(pSuite, "test of io_uring backend", test_io_uring_backend))) ||
+        (NULL == CU_add_test(pSuite, "test of asynchronous operations", test_async_operations)) ||
+        (NULL == CU_add_test(pSuite, "test of parallel reads and writes", test_parallel_read_write)) ||
+        (NULL == (direct_io_test = CU_add_test(pSuite, "test of O_DIRECT mode", test_direct_io))) ||
+        (NULL == CU_add_test(pSuite, "test of buffer pool", test_buffer_pool)) ||
+        (NULL == CU_add_test(pSuite, "test of delayed allocation", test_delayed_allocation)) ||
+        (NULL == CU_add_test(pSuite, "test of fallocate", test_fallocate)) ||
+        (NULL == CU_add_test(pSuite, "test of sparse files", test_sparse_files)) ||
+        (NULL == CU_add_test(pSuite, "test of ftruncate", test_ftruncate)) ||
+        (NULL == CU_add_test(pSuite, "test of orphan reclaim", test_orphan_reclaim)) ||
+        (NULL == CU_add_test(pSuite, "test of metadata journal", test_journal)) ||
+        (NULL == CU_add_test(pSuite, "test of fsync, fdatasync and syncfs", test_sync)) ||
+        (NULL == CU_add_test(pSuite, "test of ordered journal mode", test_journal_ordered)) ||
+        (NULL == CU_add_test(pSuite, "test of inode tail pointer", test_file_tail)) ||
+        (NULL == CU_add_test(pSuite, "test of lock-free appends", test_append_only)) ||
+        (NULL == CU_add_test(pSuite, "test of indirect block map", test_block_map)) ||
+        (NULL == CU_add_test(pSuite, "test of extent B+tree", test_extent_tree)) ||
+        (NULL == CU_add_test(pSuite, "test of block-size specialized arithmetic", test_block_geometry)) ||
+        (NULL == CU_add_test(pSuite, "test of out-of-band block link table", test_link_table)) ||
+        (NULL == CU_add_test(pSuite, "test of sub-block fragments", test_fragments)))
     {
         CU_cleanup_registry();
         return CU_get_error();
     }
+    //testy backendów, których host nie obsługuje, są pomijane
+    CU_set_fail_on_inactive(CU_FALSE);
+    CU_set_test_active(io_uring_test, backend_available(FALSE) ? CU_TRUE : CU_FALSE);
+    CU_set_test_active(direct_io_test, backend_available(TRUE) ? CU_TRUE : CU_FALSE);
 
 
 